@@ -8,6 +8,8 @@
 #define BANNER_BSIZE_V2 0x0940
 #define BANNER_BSIZE_V3 0x1240
 #define ROM_ALIGN       0x200
+#define ROM_MINALIGN    0x0004
+#define ROM_MAXALIGN    0x8000
 
 #define TRY_CAPSHIFT_BASE 0x00020000
 #define MAX_CAPSHIFT_MROM 10
@@ -46,6 +48,42 @@
 #define OFS_HEADER_STATICFOOTER     0x088
 #define OFS_HEADER_HEADERCRC        0x15E
 
+// The extended header of DSi-enhanced (TWL) ROMs. Digests cover the NTR region, which runs from the
+// ARM9 to the digest tables; this packer builds no TWL region.
+#define OFS_HEADER_DIGEST_NTROFFSET    0x1E0
+#define OFS_HEADER_DIGEST_NTRBSIZE     0x1E4
+#define OFS_HEADER_DIGEST_TWLOFFSET    0x1E8
+#define OFS_HEADER_DIGEST_TWLBSIZE     0x1EC
+#define OFS_HEADER_DIGEST_SECTOFFSET   0x1F0
+#define OFS_HEADER_DIGEST_SECTBSIZE    0x1F4
+#define OFS_HEADER_DIGEST_BLOCKOFFSET  0x1F8
+#define OFS_HEADER_DIGEST_BLOCKBSIZE   0x1FC
+#define OFS_HEADER_DIGEST_SECTORSIZE   0x200
+#define OFS_HEADER_DIGEST_BLOCKSECTORS 0x204
+#define OFS_HEADER_TWL_ROMSIZE         0x210
+#define OFS_HEADER_HMAC_ARM9           0x300
+#define OFS_HEADER_HMAC_ARM7           0x314
+#define OFS_HEADER_HMAC_DIGESTS        0x328
+#define OFS_HEADER_HMAC_BANNER         0x33C
+
+#define DIGEST_SECTORSIZE   0x400
+#define DIGEST_BLOCKSECTORS 0x20
+
+#define OVT_ENTRY_BSIZE     0x20
+#define OFS_OVT_FILEID      0x18
+#define OFS_OVT_COMPRESSED  0x1C // bits 0-23: compressed size; bits 24-31: flags
+#define OVT_FLAG_COMPRESSED 0x01000000
+#define OVT_MASK_COMPRESSED 0x00FFFFFF
+
+#define NITROCODE_LE       0xDEC00621
+#define NITROCODE_BE       0x2106C0DE
+#define STATICFOOTER_BSIZE 0x0C
+#define ARM9_BLZ_RAWPREFIX 0x4000 // secure area and crt0, which must not be compressed
+
+#define OFS_MODPARAMS_COMPSTATICEND 0x14
+#define OFS_MODPARAMS_NITROCODE     0x1C
+#define MODPARAMS_BSIZE             0x24
+
 #define LEN_HEADER_TITLE  12
 #define LEN_HEADER_SERIAL 4
 #define LEN_HEADER_MAKER  2
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * blz - Backward-LZ compression, as used by the ARM9 static binary and its overlays.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * Backward-LZ is designed to be decompressed in-place, from the end of a buffer towards its start.
+ * A compressed buffer consists of the following, in order:
+ *
+ *   - an uncompressed prefix;
+ *   - the compressed stream, stored back-to-front. Read from its end, the stream is a sequence of
+ *     groups, each led by a flag-byte whose bits (most-significant first) mark the following tokens
+ *     as either a literal byte or a 2-byte back-reference of 3 to 18 bytes at a distance of 3 to
+ *     4098 bytes;
+ *   - padding of 0xFF to a 4-byte boundary;
+ *   - an 8-byte footer: a 24-bit length of the compressed stream plus its padding and footer, the
+ *     8-bit length of the padding and footer, and a 32-bit count of the bytes by which the buffer
+ *     grows when decompressed, less the length of the padding and footer.
+ *
+ * The encoder only emits back-references which never overlap the bytes that they produce, and it
+ * chooses the uncompressed prefix such that an in-place decompression never overwrites compressed
+ * bytes which it has yet to read.
+ */
+
+#ifndef BLZ_H
+#define BLZ_H
+
+#define BLZ_FOOTER_BSIZE 8
+
+// An upper-bound for the size of the output of `blzencode` for an input of `__len` bytes.
+#define blzbound(__len) ((__len) + 4)
+
+/*
+ * Compress `len` bytes of `src` into `dst`, which must hold at least `blzbound(len)` bytes. The
+ * first `rawprefix` bytes of `src` are always left uncompressed. Returns the size of the compressed
+ * output, or 0 if compression would not make the input any smaller; in the latter case, the
+ * contents of `dst` are unspecified.
+ */
+long blzencode(const unsigned char *src, long len, long rawprefix, unsigned char *dst);
+
+/*
+ * Get the decompressed size of a compressed buffer, or -1 if its footer is malformed.
+ */
+long blzdecsize(const unsigned char *src, long len);
+
+/*
+ * Decompress `len` bytes of `src` into `dst`, which must hold at least `blzdecsize(src, len)`
+ * bytes. Returns the size of the decompressed output, or -1 if `src` is malformed.
+ */
+long blzdecode(const unsigned char *src, long len, unsigned char *dst);
+
+#endif // BLZ_H
@@ -0,0 +1,21 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * crc16 - CRC-16/MODBUS checksums, as used by the ROM header and the banner.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ */
+
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+
+#include "libs/strings.h"
+
+/*
+ * Continue the checksum `crc` over `data`, which is consumed 16 bits at a time and so should have
+ * an even length. A fresh checksum starts from 0xFFFF.
+ */
+uint16_t crc16(string data, uint16_t crc);
+
+#endif // CRC16_H
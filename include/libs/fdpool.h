@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * fdpool - Share a bounded set of open file-descriptors between the readers of many files.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A pool opens files relative to the working directory at the time of its creation, and keeps each
+ * descriptor open after it is released so that later readers of the same file may reuse it. Once
+ * the pool is full, the descriptor which was least-recently released is closed to make room;
+ * descriptors which are still leased are never closed. If every descriptor is leased, then a file
+ * is opened outside of the pool and closed again when it is released.
+ *
+ * fdpool *pool  = fdpoolnew(0);
+ * fdlease lease = fdacquire(pool, string("build/UTF16.dat"));
+ * if (lease.fd >= 0) fdread(lease.fd, buf, lease.size, 0);
+ * fdrelease(pool, lease);
+ * fdpooldel(pool);
+ *
+ * Leases may be acquired and released from multiple threads at once; descriptors should be read by
+ * `fdread`, which does not depend on (or move) a shared file-offset.
+ */
+
+#ifndef FDPOOL_H
+#define FDPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libs/strings.h"
+
+#define FDPOOL_MAXCAP 256
+
+typedef struct fdpool fdpool;
+
+typedef struct fdlease {
+    int       fd;   // -1 if the file could not be opened
+    int       slot; // -1 if the descriptor is not pooled
+    long long size; // size of the file when it was opened
+} fdlease;
+
+/*
+ * Create a pool of at most `capacity` descriptors. If `capacity` is 0, then it is chosen from the
+ * process' limit on open files, up to FDPOOL_MAXCAP. Returns NULL if the working directory cannot
+ * be opened.
+ */
+fdpool *fdpoolnew(int capacity);
+
+/*
+ * Close every descriptor held by a pool and release it. Every lease must already be released.
+ */
+void fdpooldel(fdpool *pool);
+
+/*
+ * Lease a read-only descriptor for the file at `path`, opening it if the pool does not yet hold it.
+ */
+fdlease fdacquire(fdpool *pool, string path);
+
+/*
+ * Return a lease to its pool.
+ */
+void fdrelease(fdpool *pool, fdlease lease);
+
+/*
+ * Close the pool's descriptor for the file at `path`, if it holds one which is not leased, so that
+ * the next lease observes the file's current content (e.g., after it was replaced by a rename).
+ */
+void fdevict(fdpool *pool, string path);
+
+/*
+ * Read exactly `size` bytes from a descriptor, starting from `offset`. Returns 0 on success, or -1
+ * if the file ended early or could not be read.
+ */
+int fdread(int fd, void *buf, size_t size, uint64_t offset);
+
+/*
+ * Get the number of files which a pool has opened, and the number of leases which it satisfied
+ * without opening a file.
+ */
+long long fdpoolopens(const fdpool *pool);
+long long fdpoolhits(const fdpool *pool);
+
+#endif // FDPOOL_H
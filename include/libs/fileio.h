@@ -17,6 +17,18 @@ typedef struct file {
     long  size;
 } file;
 
+typedef struct stamp {
+    long long size;    // -1 if the file could not be inspected
+    long long mtime;   // seconds since the epoch
+    long      mtimens; // nanoseconds within `mtime`
+    int       dir;     // 1 if the file is a directory
+} stamp;
+
+typedef struct fview {
+    string data;   // read-only file contents; `data.len` is -1 if the file could not be loaded
+    int    mapped; // 1 if `data` is backed by a memory-mapping, 0 if it was read onto the heap
+} fview;
+
 /*
  * Load the contents of a file into memory.
  */
@@ -27,6 +39,29 @@ string fload(const char *filename);
  */
 string floads(const string filename);
 
+/*
+ * Map the contents of a file into memory as read-only. If the file cannot be mapped, then its
+ * contents are instead read into an uninitialized heap buffer; files which are not regular (e.g.,
+ * pipes) are read until their end, as by `fmapstream`. Views must be released by `funmap`.
+ */
+fview fmap(const char *filename);
+
+/*
+ * Map the contents of a file into memory as read-only. `fmap`-wrapper for `string` filenames.
+ */
+fview fmaps(const string filename);
+
+/*
+ * Read the remaining contents of a stream (e.g., standard input) onto the heap. Streams cannot be
+ * mapped, as their size is not known up front. Views must be released by `funmap`.
+ */
+fview fmapstream(FILE *stream);
+
+/*
+ * Release a view previously returned by `fmap` or `fmapstream`.
+ */
+void funmap(fview view);
+
 /*
  * Get the size of a file from disk.
  */
@@ -37,6 +72,16 @@ long fsize(const char *filename);
  */
 long fsizes(const string filename);
 
+/*
+ * Get the size and modification time of a file from disk.
+ */
+stamp fstamp(const char *filename);
+
+/*
+ * Get the size and modification time of a file from disk. `fstamp`-wrapper for `string` filenames.
+ */
+stamp fstamps(const string filename);
+
 /*
  * Prepare a file-handle for consumption by other processes.
  */
@@ -47,9 +92,55 @@ file fprep(const char *filename);
  */
 file fpreps(const string filename);
 
+/*
+ * Open a file read-only, relative to the directory `dirfd`. Returns a descriptor, or -1 if the file
+ * could not be opened.
+ */
+int fopenat(int dirfd, const char *filename);
+
+/*
+ * Copy `size` bytes from the descriptor `infd`, starting from `offset`, to the current position of
+ * the descriptor `outfd`. Where the platform permits, the bytes are copied by the kernel without
+ * passing through the process, and filesystems which support reflinks may share their blocks
+ * instead. Returns 0 on success, or -1 if `infd` ended early or either descriptor failed.
+ */
+int fclone(int infd, long long offset, int outfd, long long size);
+
 /*
  * Dump file contents to a file on-disk.
  */
 void fdump(const char *filename, const void *buf, const long bufsize);
 
+/*
+ * Dump file contents to a file on-disk via a sibling temporary file, such that concurrent readers
+ * only ever observe either the complete previous contents or the complete new contents. Returns 0
+ * on success.
+ */
+int fstore(const char *filename, const void *buf, const long bufsize);
+
+/*
+ * Open a sibling temporary file of `filename` for writing, to be moved over `filename` by `fcommit`
+ * once it is complete; until then, `filename` is left as it was. The name of the temporary file is
+ * stored in `stagename`, or NULL where the platform can only write `filename` in-place. Returns
+ * NULL if the file could not be created.
+ */
+FILE *fstage(const char *filename, char **stagename);
+
+/*
+ * Move a file opened by `fstage` over `filename`, releasing `stagename`. If `filename` is NULL,
+ * then the staged file is instead discarded. The stream must already be flushed. Returns 0 on
+ * success.
+ */
+int fcommit(char *stagename, const char *filename);
+
+/*
+ * Create a directory if it does not already exist. Returns 0 if the directory exists afterward.
+ */
+int fmkdir(const char *dirname);
+
+/*
+ * Get the number of files which the functions above have opened since the program started.
+ */
+long long fopened(void);
+
 #endif // FILEIO_H
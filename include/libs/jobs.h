@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * jobs - Minimal fork-join parallelism over an index range.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * Jobs are identified by their index in the range [0, njobs). Workers claim indices in ascending
+ * order until the range is exhausted; no ordering is guaranteed between jobs which run on different
+ * workers. The calling thread participates as one of the workers, and `jobsrun` returns only once
+ * every job has finished.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+typedef void (*jobfn)(void *user, long job);
+
+/*
+ * Get the number of workers to use by default: the number of online processors, or 1 if that
+ * number cannot be determined.
+ */
+int jobsdefault(void);
+
+/*
+ * Run `fn` for each job in [0, njobs) across at most `nworkers` workers. If `nworkers` is less than
+ * 1, then `jobsdefault` workers are used. If worker threads cannot be created, then the remaining
+ * jobs run on the calling thread.
+ */
+void jobsrun(int nworkers, long njobs, jobfn fn, void *user);
+
+#endif // JOBS_H
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * log - Emit leveled diagnostics through a buffered stream, as text or as JSON lines.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * Messages are written to a private, fully-buffered duplicate of the given stream, so that a burst
+ * of messages costs one write for every LOG_BUFSIZE bytes rather than one or more writes for each
+ * message. Buffered messages are written when the logger is closed, when the program exits, or when
+ * any caller flushes every stream with `fflush(NULL)`.
+ *
+ * logger *logger = logopen(stderr, L_info, L_text);
+ * loginfo(logger, "rompacker:configuration:header", "set title to “%s”", title);
+ * logclose(logger);
+ *
+ * In the text format, each message is written as "<scope>: <message>"; in the JSON format, each
+ * message is written as one object with the keys "level", "scope", and "message". A NULL logger
+ * discards every message, as does a logger whose level is less verbose than the message's; in
+ * either case, the message's arguments are not evaluated.
+ */
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+#define LOG_BUFSIZE (1 << 16)
+
+enum loglevel {
+    L_error = 0,
+    L_warn,
+    L_info,
+    L_debug,
+};
+
+enum logformat {
+    L_text = 0,
+    L_json,
+};
+
+typedef struct logger {
+    FILE          *out;
+    enum loglevel  level;
+    enum logformat format;
+} logger;
+
+/*
+ * Begin logging messages at least as severe as `level` to `stream`. Returns NULL if the stream
+ * cannot be duplicated.
+ */
+logger *logopen(FILE *stream, enum loglevel level, enum logformat format);
+
+/*
+ * Write any buffered messages and release the logger. Returns 0 if every message was written.
+ */
+int logclose(logger *logger);
+
+/*
+ * Write a message from the subsystem named by `scope`, formatted by the format-string `fmt`.
+ * Messages from concurrent threads are not interleaved.
+ */
+void logput(logger *logger, enum loglevel level, const char *scope, const char *fmt, ...);
+
+/*
+ * Parse the name of a level: "error", "warn", "info", or "debug". Returns -1 if the name is not
+ * recognized.
+ */
+int loglevelof(const char *name);
+
+#define logat(__logger, __level, __scope, ...)                     \
+    do {                                                           \
+        if ((__logger) && (__level) <= (__logger)->level) {        \
+            logput((__logger), (__level), (__scope), __VA_ARGS__); \
+        }                                                          \
+    } while (0)
+
+#define logerror(__logger, __scope, ...) logat((__logger), L_error, (__scope), __VA_ARGS__)
+#define logwarn(__logger, __scope, ...)  logat((__logger), L_warn, (__scope), __VA_ARGS__)
+#define loginfo(__logger, __scope, ...)  logat((__logger), L_info, (__scope), __VA_ARGS__)
+#define logdebug(__logger, __scope, ...) logat((__logger), L_debug, (__scope), __VA_ARGS__)
+
+#endif // LOG_H
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * lz - Forward-LZ compression, as decompressed by the BIOS and by most asset loaders.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A compressed buffer begins with a 32-bit header: the format's type-byte in its low 8 bits, and
+ * the decompressed size in its high 24 bits. Larger sizes are only supported by LZ11, which stores
+ * a size of 0 in the header and follows it with the full 32-bit size. The header is followed by a
+ * sequence of groups, each led by a flag-byte whose bits (most-significant first) mark the
+ * following tokens as either a literal byte or a back-reference into the output; the stream is
+ * padded with zeros to a 4-byte boundary.
+ *
+ *   - LZ10 back-references are 2 bytes long: a 4-bit length of 3 to 18 bytes and a 12-bit
+ *     displacement of 1 to 4096 bytes.
+ *   - LZ11 back-references are 2, 3, or 4 bytes long, as selected by their first 4 bits, and
+ *     reach lengths of 3 to 16, 17 to 272, and 273 to 65808 bytes, respectively.
+ *
+ * The encoder never emits a displacement of 1, so that its output may also be decompressed by
+ * routines which write 16 bits at a time (e.g., into VRAM).
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+enum lzformat {
+    LZ_FORMAT_LZ10 = 0x10,
+    LZ_FORMAT_LZ11 = 0x11,
+};
+
+#define LZ_MAXSIZE_LZ10 0x00FFFFFF
+
+// An upper-bound for the size of the output of `lzencode` for an input of `__len` bytes.
+#define lzbound(__len) ((__len) + ((__len) + 7) / 8 + 12)
+
+/*
+ * Compress `len` bytes of `src` into `dst`, which must hold at least `lzbound(len)` bytes. Returns
+ * the size of the compressed output, or -1 if `len` cannot be represented by `format`. The output
+ * may be larger than the input.
+ */
+long lzencode(const unsigned char *src, long len, enum lzformat format, unsigned char *dst);
+
+/*
+ * Get the decompressed size of a compressed buffer, or -1 if its header is malformed.
+ */
+long lzdecsize(const unsigned char *src, long len);
+
+/*
+ * Decompress `len` bytes of `src` into `dst`, which must hold at least `lzdecsize(src, len)`
+ * bytes. Returns the size of the decompressed output, or -1 if `src` is malformed.
+ */
+long lzdecode(const unsigned char *src, long len, unsigned char *dst);
+
+#endif // LZ_H
@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * meter - Measure the time and resources spent by intervals of a program's execution.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A meter is either a sample of the process' counters at one instant, as returned by `meterread`,
+ * or the sum of the differences between pairs of samples, as accumulated by `meteradd`:
+ *
+ * meter total = { 0 };
+ * meter start = meterread(M_full);
+ * ...
+ * meteradd(&total, start, meterread(M_full));
+ *
+ * Counters which are unavailable on the host, or which were not requested, are -1. I/O counters
+ * are read from the kernel, and so they include the I/O of every thread, but they exclude any reads
+ * which are satisfied through a memory-mapping.
+ */
+
+#ifndef METER_H
+#define METER_H
+
+enum meterscope {
+    M_clock = 0, // only the clocks and the count of opened files; cheap enough for tight loops
+    M_full,      // every counter, at the cost of a few syscalls
+};
+
+typedef struct meter {
+    double    wall;      // seconds elapsed on a monotonic clock
+    double    cpu;       // seconds of user and system time, summed over every thread
+    long long nread;     // bytes read through read-like syscalls
+    long long nwritten;  // bytes written through write-like syscalls
+    long long nsyscalls; // read-like and write-like syscalls issued
+    long long nopened;   // files opened through libs/fileio
+    long      maxrss;    // peak resident set size of the process, in KiB
+    long      count;     // for accumulated meters, the number of intervals
+} meter;
+
+/*
+ * Sample the counters of the calling process.
+ */
+meter meterread(enum meterscope scope);
+
+/*
+ * Add the interval from `start` to `end` into `total`. The peak resident set size of `total` is the
+ * greatest of those seen so far, rather than a sum.
+ */
+void meteradd(meter *total, meter start, meter end);
+
+#endif // METER_H
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * romreader - Random access to the members of a Nintendo DS ROM.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A reader maps a ROM into memory and checks that every table located by its header lies within
+ * it. Nothing is copied; every lookup answers with a range of the ROM, or with a view of its bytes
+ * which lives as long as the reader. Lookups run in constant time:
+ *
+ *   - file IDs index the FATB directly, which is checked once, when the reader is opened;
+ *   - paths are decoded from the FNTB into an open-addressed table of file IDs on the first lookup
+ *     by path (or of a path), and are named relative to the root, without a leading slash;
+ *   - overlay IDs are indexed from each overlay table on the first lookup of an overlay.
+ *
+ * romreader  *rom = romopen("rom.nds", &err);
+ * uint32_t    fileid;
+ * if (rom && romfind(rom, string("data/text.bin"), &fileid) == E_romreader_none) {
+ *     string bytes = rombytes(rom, romfatb(rom, fileid));
+ * }
+ * romclose(rom);
+ *
+ * Readers are not thread-safe until each index which will be used has been built.
+ */
+
+#ifndef ROMREADER_H
+#define ROMREADER_H
+
+#include <stdint.h>
+
+#include "libs/strings.h"
+
+typedef enum romreaderr {
+    E_romreader_none = 0,
+    E_romreader_missing,   // The ROM could not be opened.
+    E_romreader_truncated, // The ROM ends before its header, or before a table which it locates.
+    E_romreader_badfatb,   // An allocation ends before it starts, or beyond the end of the ROM.
+    E_romreader_badfntb,   // The FNTB is malformed, or names a file ID outside of the FATB.
+    E_romreader_badovt,    // An overlay table names a file ID outside of the FATB.
+    E_romreader_notfound,  // No member has the requested path, file ID, or overlay ID.
+} romreaderr;
+
+// Components which the header locates. The ARM9's range includes the footer which may follow its
+// load size. The banner's size follows from its version; banners of an unknown version are reported
+// as empty.
+enum romsection {
+    K_romsection_header = 0,
+    K_romsection_arm9,
+    K_romsection_ovt9,
+    K_romsection_arm7,
+    K_romsection_ovt7,
+    K_romsection_fntb,
+    K_romsection_fatb,
+    K_romsection_banner,
+
+    NUM_ROMSECTIONS,
+};
+
+typedef struct romrange {
+    uint32_t start;
+    uint32_t end;
+} romrange;
+
+typedef struct romreader romreader;
+
+/*
+ * Map a ROM from disk. Returns NULL on failure, and sets `err` if it is non-NULL.
+ */
+romreader *romopen(const char *filename, romreaderr *err);
+
+/*
+ * Read a ROM which is already in memory. `rom` must outlive the reader.
+ */
+romreader *romopenbuf(string rom, romreaderr *err);
+
+void romclose(romreader *reader);
+
+/*
+ * Get the range of a component which the header locates.
+ */
+romrange romsection(const romreader *reader, enum romsection section);
+
+/*
+ * Get the number of entries in the FATB, which includes every overlay.
+ */
+uint32_t romnfiles(const romreader *reader);
+
+/*
+ * Get the range of the member with a file ID. Returns an empty range at 0 if there is no such file.
+ */
+romrange romfatb(const romreader *reader, uint32_t fileid);
+
+/*
+ * Get a view of the bytes within a range of the ROM.
+ */
+string rombytes(const romreader *reader, romrange range);
+
+/*
+ * Find the file ID of the member at `path`, which may be given with or without a leading slash.
+ */
+romreaderr romfind(romreader *reader, string path, uint32_t *fileid);
+
+/*
+ * Get the path of the member with a file ID. Overlays and members which the FNTB does not name
+ * have no path.
+ */
+romreaderr rompath(romreader *reader, uint32_t fileid, string *path);
+
+/*
+ * Find the file ID of an overlay by its ID within the overlay table `ovt`, which must be either
+ * `K_romsection_ovt9` or `K_romsection_ovt7`.
+ */
+romreaderr romoverlay(romreader *reader, enum romsection ovt, uint32_t ovyid, uint32_t *fileid);
+
+#endif // ROMREADER_H
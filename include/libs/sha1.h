@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * sha1 - Streaming SHA-1 digests.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * SHA-1 is no longer suitable for security purposes; this library exists for content-addressing
+ * and for formats which mandate it.
+ */
+
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <stdint.h>
+
+#define SHA1_DIGEST_BSIZE 20
+#define SHA1_BLOCK_BSIZE  64
+
+typedef struct sha1 {
+    uint32_t      state[5];
+    uint64_t      len; // total bytes consumed
+    unsigned char block[SHA1_BLOCK_BSIZE];
+} sha1;
+
+void sha1init(sha1 *ctx);
+void sha1update(sha1 *ctx, const void *data, long len);
+void sha1final(sha1 *ctx, unsigned char digest[SHA1_DIGEST_BSIZE]);
+
+/*
+ * Compute the digest of a single buffer.
+ */
+void sha1digest(const void *data, long len, unsigned char digest[SHA1_DIGEST_BSIZE]);
+
+/*
+ * Write the digest in lowercase hexadecimal to `hex`, followed by a null-terminator.
+ */
+void sha1hex(const unsigned char digest[SHA1_DIGEST_BSIZE], char hex[2 * SHA1_DIGEST_BSIZE + 1]);
+
+/*
+ * HMAC-SHA1 (RFC 2104). `sha1hmacinit` absorbs the key into both the inner and the outer hash, so
+ * that a keyed context may be copied to authenticate any number of messages without re-hashing the
+ * key; `sha1hmacdigest` does exactly that for a single buffer, and leaves `key` untouched so that
+ * it may be shared between threads.
+ */
+typedef struct sha1hmac {
+    sha1 inner;
+    sha1 outer;
+} sha1hmac;
+
+void sha1hmacinit(sha1hmac *ctx, const void *key, long keylen);
+void sha1hmacupdate(sha1hmac *ctx, const void *data, long len);
+void sha1hmacfinal(sha1hmac *ctx, unsigned char digest[SHA1_DIGEST_BSIZE]);
+void sha1hmacdigest(
+    const sha1hmac *key,
+    const void     *data,
+    long            len,
+    unsigned char   digest[SHA1_DIGEST_BSIZE]
+);
+
+#endif // SHA1_H
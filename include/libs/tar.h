@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * tar - SAX-style reader for tape archives.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * This library walks an in-memory tape archive and emits one parse-event per regular file. Nothing
+ * is copied or extracted; each event reports where the file's content lives within the archive,
+ * leaving the caller in full control of how (and whether) that content is consumed. In particular,
+ * this library implements the following rules:
+ *
+ *   - Archives are sequences of 512-byte blocks, terminated either by two zero-filled blocks or by
+ *     the end of the input.
+ *   - Header checksums are always verified.
+ *   - Entry names are assembled from the ustar "prefix" and "name" fields. A POSIX.1-2001 (pax)
+ *     extended header may override the name with its "path" record and the size with its "size"
+ *     record; GNU long-name ("L") headers are also accepted. Global pax headers are ignored.
+ *   - Sizes may be stored either in octal or in GNU base-256 notation.
+ *   - Only regular files are emitted. Directories, links, devices, and FIFOs are skipped.
+ */
+
+#ifndef TAR_H
+#define TAR_H
+
+#include "libs/strings.h"
+
+#define TAR_BLOCK_SIZE 512
+
+typedef enum tarerr {
+    E_tar_none = 0,
+    E_tar_truncated, // A header or its content extends beyond the end of the archive.
+    E_tar_checksum,  // A header's checksum does not match its contents.
+    E_tar_badfield,  // A header contains a malformed numeric field.
+    E_tar_badpax,    // A pax extended header contains a malformed record.
+
+    E_tar_user = 128, // User-defined errors should start here.
+} tarerr;
+
+typedef struct tarentry {
+    string name;   // Not null-terminated; only valid for the duration of the parse-event.
+    long   offset; // Offset of the file's content from the start of the archive.
+    long   size;   // Size of the file's content.
+} tarentry;
+
+typedef struct tarresult {
+    int    code;
+    char   msg[128];
+    string pos; // The header block at which the error was detected.
+} tarresult;
+
+/*
+ * Basic interface for consuming parse-events. This handler should return a non-zero error code if
+ * the calling client cannot accept the parse-event.
+ */
+typedef tarresult (*tarhandler)(tarentry *entry, void *user, int index);
+
+/*
+ * Check if a string begins with a ustar header.
+ */
+int tarprobe(string archive);
+
+/*
+ * Parse a string as a tape archive, invoking `handler` for each regular file in the archive.
+ *
+ * Optionally, a caller may provide `user` as additional context to the handler function.
+ */
+tarresult tarparse(string archive, tarhandler handler, void *user);
+
+#endif // TAR_H
@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * trace - Record nested spans of a program's execution as Chrome trace-event JSON.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A trace file may be opened in Perfetto (https://ui.perfetto.dev) or in chrome://tracing. Spans
+ * must be ended on the thread which began them, in the reverse order of their beginning; spans on
+ * different threads are recorded on separate tracks. The first thread to record a span is named
+ * "main", and every later thread is named as a worker.
+ *
+ * tracer *tracer = traceopen("trace.json");
+ * tracebegin(tracer, "seal", "fntb (%d members)", nmembers);
+ * ...
+ * traceend(tracer);
+ * traceclose(tracer);
+ *
+ * Tracing is disabled by passing a NULL tracer; `tracebegin` and `traceend` then cost one branch,
+ * and their arguments are not evaluated.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+typedef struct tracer tracer;
+
+/*
+ * Begin recording a trace to `filename`. Returns NULL if the file cannot be opened.
+ */
+tracer *traceopen(const char *filename);
+
+/*
+ * Finish a trace and release it. Returns 0 if the whole trace was written.
+ */
+int traceclose(tracer *tracer);
+
+/*
+ * Begin a span in the category `cat`, named by the format-string `fmt`.
+ */
+void tracerbegin(tracer *tracer, const char *cat, const char *fmt, ...);
+
+/*
+ * End the most recent span which was begun by the calling thread.
+ */
+void tracerend(tracer *tracer);
+
+#define tracebegin(__tracer, __cat, ...)                             \
+    do {                                                             \
+        if (__tracer) tracerbegin((__tracer), (__cat), __VA_ARGS__); \
+    } while (0)
+
+#define traceend(__tracer)                 \
+    do {                                   \
+        if (__tracer) tracerend(__tracer); \
+    } while (0)
+
+#endif // TRACE_H
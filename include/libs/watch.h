@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * watch - Wait for changes to a set of files.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * Files are watched through their parent directories, so that a file which is replaced by a rename
+ * (as many editors and build tools do) is still seen to change, and so that each directory costs
+ * one watch no matter how many of its files are watched. A directory which is itself added to the
+ * watcher is reported whenever any of its entries is created, written, moved, or removed.
+ *
+ * watcher *watcher = watchnew();
+ * watchadd(watcher, string("build/UTF16.dat"));
+ * vector changed = newvec(string, 16);
+ * while (watchwait(watcher, &changed, 100) >= 0) {
+ *     for (int i = 0; i < changed.len; i++) rebuild(*get(&changed, string, i));
+ * }
+ * watchdel(watcher);
+ *
+ * Watchers are only supported on Linux, where they are backed by inotify.
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+typedef struct watcher watcher;
+
+/*
+ * Create an empty watcher. Returns NULL if the platform does not support watching files, or if the
+ * process' limit on watchers is exhausted.
+ */
+watcher *watchnew(void);
+void     watchdel(watcher *watcher);
+
+/*
+ * Watch the file or directory at `path`, which is copied. Returns 0 on success, or -1 if the
+ * directory which holds `path` cannot be watched.
+ */
+int watchadd(watcher *watcher, string path);
+
+/*
+ * Block until at least one watched path changes, then continue to collect changes until none has
+ * arrived for `settle` milliseconds. Each changed path is pushed once to `changed` (T = string),
+ * exactly as it was given to `watchadd`; the strings remain owned by the watcher. If the system
+ * dropped any changes, then every watched path is reported. Returns the number of paths pushed, or
+ * -1 if the watcher could not be read (e.g., because a signal interrupted the wait).
+ */
+int watchwait(watcher *watcher, vector *changed, int settle);
+
+#endif // WATCH_H
@@ -0,0 +1,117 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * narc - Build and inspect Nitro archives (NARC).
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * A NARC is a container of the following sections, in order:
+ *
+ *   - a 16-byte header: magic "NARC", byte-order mark, version, total size, header size, and the
+ *     number of sections which follow (always 3);
+ *   - BTAF, the allocation table: one pair of start and end offsets per member, relative to the
+ *     start of GMIF's contents;
+ *   - BTNF, the name table: identical in format to a ROM's FNTB. Archives without member names
+ *     carry only a root directory entry;
+ *   - GMIF, the image: the contents of each member, padded to a 4-byte boundary.
+ *
+ * Archives built by this module are unnamed; members are addressed by their index. The contents of
+ * members are never held in memory. Resolving an archive only determines its members and their
+ * sizes; the archive itself is produced piece-by-piece by `narc_read`.
+ */
+
+#ifndef NARC_H
+#define NARC_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+#define NARC_HEADER_BSIZE 0x10
+#define NARC_ALIGN        4
+#define NARC_PADDING      0xFF
+
+typedef struct narcmember {
+    string   source; // owned by the archive
+    uint32_t size;
+    uint32_t offset; // offset of the member within the archive
+} narcmember;
+
+typedef struct narc {
+    string   source;  // a directory, or a member list with one source path per line
+    vector   members; // T = narcmember
+    uint32_t size;
+
+    unsigned char *prelude; // header, BTAF, BTNF, and GMIF's section header
+    uint32_t       prelen;
+
+    // streaming state for `narc_read`
+    FILE *hdl;
+    int   curr;
+
+    char err[128];
+} narc;
+
+typedef struct narcview {
+    unsigned char *fatb;
+    unsigned char *fntb;
+    unsigned char *image;
+    uint32_t       nmembers;
+    uint32_t       fntbsize;
+    uint32_t       imagesize;
+} narcview;
+
+// Called once for each named member of an archive, with its path relative to the archive's root.
+typedef void (*narcnamefn)(void *user, uint32_t member, string path);
+
+/*
+ * Check if a filesystem member's source names a member list, which holds one source path per line.
+ * Directories are also packed as NARCs; their regular files become members in lexicographic order.
+ */
+#define NARC_LIST_SUFFIX ".narclist"
+int narc_islist(string source);
+
+/*
+ * Create an unresolved archive for `source`, which must remain valid until the archive is freed.
+ */
+narc *narc_new(string source);
+void  narc_free(narc *narc);
+
+/*
+ * Find the members of an archive and compute its layout. Returns 0 on success; otherwise, a
+ * message is written to `narc->err`. Distinct archives may be resolved concurrently.
+ */
+int narc_resolve(narc *narc);
+
+/*
+ * Check if resolving an archive again would change its layout: i.e., if its members, their order,
+ * or their sizes have changed on disk. Returns 1 if so, or if the archive can no longer be
+ * resolved.
+ */
+int narc_changed(const narc *narc);
+
+/*
+ * Produce `size` bytes of a resolved archive, starting from `offset`. Returns 0 on success. This
+ * routine matches the signature of `romgenerator` and is fastest when called sequentially.
+ */
+int narc_read(void *narc, unsigned char *buf, uint32_t offset, uint32_t size);
+
+/*
+ * Close the member which `narc_read` holds open, so that the next read observes the current
+ * content of its source file.
+ */
+void narc_rewind(narc *narc);
+
+/*
+ * Inspect an archive held in memory. Returns 0 if `data` is a well-formed NARC.
+ */
+int narc_parse(string data, narcview *view);
+
+/*
+ * Walk the name table of a parsed archive. Returns the number of named members, or -1 if the name
+ * table is malformed.
+ */
+long narc_names(const narcview *view, narcnamefn fn, void *user);
+
+#endif // NARC_H
@@ -3,30 +3,59 @@
 #ifndef NITROROM_H
 #define NITROROM_H
 
-#define die(__msg, ...)                        \
+#define complain(__msg, ...)                   \
     {                                          \
+        fflush(NULL);                          \
         fputs(PROGRAM_NAME ": ", stderr);      \
         fprintf(stderr, __msg, ##__VA_ARGS__); \
         fputc('\n', stderr);                   \
-        exit(EXIT_FAILURE);                    \
     }
 
-#define dieusage(__msg, ...)                 \
+#define die(__msg, ...)                 \
+    {                                   \
+        complain(__msg, ##__VA_ARGS__); \
+        exit(EXIT_FAILURE);             \
+    }
+
+#define complainusage(__msg, ...)            \
     {                                        \
         fputs(PROGRAM_NAME ": ", stderr);    \
         fprintf(stderr, __msg, __VA_ARGS__); \
         fputs("\n\n", stderr);               \
         showusage(stderr);                   \
-        exit(EXIT_FAILURE);                  \
+    }
+
+#define dieusage(__msg, ...)               \
+    {                                      \
+        complainusage(__msg, __VA_ARGS__); \
+        exit(EXIT_FAILURE);                \
     }
 
 #define dieiferr(__cond, __resT)                \
     {                                           \
         __resT __res = __cond;                  \
         if (__res.code != 0) {                  \
+            fflush(NULL);                       \
             fprintf(stderr, "%s\n", __res.msg); \
             exit(EXIT_FAILURE);                 \
         }                                       \
     }
 
+// Packers which `nitrorom serve` keeps resident between requests.
+typedef struct packcache packcache;
+
+// The definitions for these functions are contained within `source/nitrorom_pack.c`. Each request
+// is packed exactly as by `nitrorom pack`, but failures are returned rather than exiting; `warm` is
+// set if the request was served by a resident packer.
+packcache *packcachenew(int capacity);
+void       packcachedel(packcache *cache);
+int        packserved(int argc, const char **argv, packcache *cache, int *warm);
+
+// The definition for this function is contained within `source/nitrorom_serve.c`. The arguments of
+// `nitrorom pack` are sent to the server listening on `socket`, whose diagnostics are replayed to
+// standard-error. The server's exit status is returned, and its time spent on the request is stored
+// in `wall`; -1 is returned (and `errno` set) if the server could not be reached, or if it did not
+// finish its reply.
+int packremote(const char *socket, int argc, const char **argv, double *wall, int *warm);
+
 #endif // NITROROM_H
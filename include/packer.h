@@ -1,5 +1,30 @@
 // SPDX-License-Identifier: MIT
 
+/*
+ * rompacker - Build Nintendo DS ROM images in-process.
+ * Copyright (C) 2025  <lhearachel@proton.me>
+ *
+ * This is the interface exposed by libnitrorom. A packer moves through three phases:
+ *
+ *   1. Input: members are declared either by parsing specification files (`cfgparse` with
+ *      `rompacker_cfgsections` and `csvparse` with `csv_addfile`) or programmatically through
+ *      `rompacker_define`, `rompacker_configure`, and `rompacker_addfile`. Programmatic calls
+ *      accept the same sections, keys, and values as CONFIG.INI and copy everything they are given.
+ *   2. Sealing: `rompacker_seal` computes the filesystem tables and the final ROM layout.
+ *   3. Output: `rompacker_dump`, `rompacker_dumpfd`, or `rompacker_dumpbuf` write the ROM. A sealed
+ *      packer may be dumped any number of times.
+ *
+ * No routine in this interface terminates the calling process; every failure is reported by a
+ * result code, and parse-level failures additionally carry a human-readable message.
+ *
+ * rompacker *packer = rompacker_new(0, NULL);
+ * rompacker_configure(packer, string("arm9"), string("static-binary"), string("main.sbin"));
+ * ...
+ * rompacker_addfile(packer, string("build/UTF16.dat"), string("/data/UTF16.dat"));
+ * if (rompacker_seal(packer) == E_seal_ok) rompacker_dumpfd(packer, fd);
+ * rompacker_del(packer);
+ */
+
 #ifndef PACKER_H
 #define PACKER_H
 
@@ -7,17 +32,21 @@
 #include <stdio.h>
 
 #include "libs/config.h"
+#include "libs/fdpool.h"
+#include "libs/fileio.h"
+#include "libs/log.h"
+#include "libs/meter.h"
 #include "libs/sheets.h"
 #include "libs/strings.h"
+#include "libs/tar.h"
+#include "libs/trace.h"
 #include "libs/vector.h"
 
+// Members on disk are named by `filename` and read through the packer's descriptor pool; members
+// computed in memory are held in `buf`.
 typedef struct source {
     string filename;
-
-    union {
-        FILE *hdl;
-        void *buf;
-    };
+    void  *buf;
 } source;
 
 typedef struct rommember {
@@ -27,21 +56,117 @@ typedef struct rommember {
     uint16_t pad;
 } rommember;
 
+// Generators produce the content of a filesystem member on demand while the ROM is dumped. Each
+// call must fill `buf` with `size` bytes of the member's content, starting from `offset`, and
+// return 0; any other return value aborts the dump with `E_dump_read`.
+typedef int (*romgenerator)(void *user, unsigned char *buf, uint32_t offset, uint32_t size);
+
+enum romfilekind {
+    K_romfile_path = 0, // the whole of the file at `source`
+    K_romfile_range,    // `size` bytes of the file at `source`, starting from `rangeofs`
+    K_romfile_buffer,   // `size` bytes of `buf`, owned by the packer
+    K_romfile_generator,
+    K_romfile_narc, // a NARC built from the directory or member list at `source`; see narc.h
+};
+
+// Each class of member starts at a multiple of its own alignment, which is ROM_ALIGN unless it is
+// configured; see `rompacker_minalign`.
+enum romclass {
+    K_romclass_arm = 0, // the ARM9 and ARM7 static binaries
+    K_romclass_overlay,
+    K_romclass_table, // the FNTB, the FATB, and the overlay tables
+    K_romclass_file,  // filesystem members, unless their own alignment is set
+    NUM_ROMCLASSES,
+};
+
+// Filesystem members read from a path may be compressed before they are packed. `rompacker_seal`
+// compresses every such member and redirects it to its entry in the packer's cache directory.
+enum romtransform {
+    K_transform_none = 0,
+    K_transform_lz10, // LZ10-compress the member; see libs/lz.h
+    K_transform_lz11, // LZ11-compress the member
+    K_transform_auto, // keep whichever of LZ10, LZ11, or the raw member is the smallest
+};
+
+// Phases of packing which are metered when a packer's `timings` is set. Phases are nested as shown
+// below; the outer phases are metered by the caller, as they span calls into the packer.
+enum romphase {
+    P_config = 0,   // parsing CONFIG.INI (caller)
+    P_filesys,      // parsing FILESYS (caller)
+    P_statscan,     //   inspecting the source file of each filesystem member
+    P_seal,         // rompacker_seal
+    P_narcs,        //   resolving NARC members
+    P_compress,     //   compressing filesystem members and the ARM9
+    P_fntb,         //   sorting filesystem members and building the FNTB
+    P_dump,         // rompacker_dump, rompacker_dumpfd, or rompacker_dumpbuf
+    P_dump_header,  //   the header
+    P_dump_arm9,    //   the ARM9 static binary, its overlay table, and its overlays
+    P_dump_arm7,    //   the ARM7 static binary, its overlay table, and its overlays
+    P_dump_tables,  //   the FNTB and the FATB
+    P_dump_banner,  //   the banner
+    P_dump_filesys, //   filesystem members
+    P_dump_digests, //   the digest tables of a DSi-enhanced ROM
+    P_dump_tail,    //   filling the tail of the ROM
+
+    NUM_ROMPHASES,
+};
+
+// Names of each phase, e.g., "seal.fntb"; inner phases are prefixed by the name of their outer one.
+extern const char *rompacker_phasenames[NUM_ROMPHASES];
+
 // We don't maintain file-handles for filesystem members as the upper-bound of filesystem members
 // supported by the DS is quite large (61440).
 typedef struct romfile {
-    string   source;
+    string   source; // for buffers and generators, a placeholder name for logs
     string   target;
     uint32_t size;
     uint32_t offset; // final offset of the file
     uint16_t pad;
     uint16_t filesysid;
     uint16_t packingid;
+    uint16_t kind;
+    uint16_t transform;
+    uint16_t align; // if 0, then the alignment of filesystem members applies
+
+    union {
+        uint64_t rangeofs;
+        void    *buf;
+
+        struct {
+            romgenerator func;
+            void        *user;
+        } gen;
+    };
 } romfile;
 
+// The place of a filesystem member within a previous ROM: its offset, and the start of whatever
+// followed it there.
+typedef struct romslot {
+    string   target;
+    uint32_t offset;
+    uint32_t end; // UINT32_MAX if nothing followed the member
+} romslot;
+
+// DSi-enhanced (TWL) ROMs carry an HMAC-SHA1 digest of each sector of the ROM from the ARM9 onward,
+// and a digest of each block of those digests, which the console checks as it reads the ROM. The
+// tables are laid out after every other member when the packer is sealed, and filled as the ROM is
+// dumped, along with the header's digests of the ARM binaries, the banner, and the block table.
+typedef struct romdigests {
+    string    key;          // HMAC key; empty if the ROM carries no digests
+    uint32_t  sectorsize;   // bytes covered by each sector digest
+    uint32_t  blocksectors; // sector digests covered by each block digest
+    rommember sectors;      // intermediate; placed by rompacker_seal, filled by rompacker_dump
+    rommember blocks;       // intermediate; placed by rompacker_seal, filled by rompacker_dump
+} romdigests;
+
+// An entry of a run-time access trace, which names a filesystem member by its target or its ID.
+typedef struct romaccess {
+    string target;
+    int    fileid; // -1 if the member is named by its target
+} romaccess;
+
 typedef struct rompacker {
     unsigned int packing : 1; // if 0, do not accept further input
-    unsigned int verbose : 1; // if 1, emit verbose logs during packing
 
     // basic sanity-checks for setting banner components
     unsigned int bannerver      : 2;
@@ -54,10 +179,16 @@ typedef struct rompacker {
     unsigned int filltail : 1;
     unsigned int fillwith : 8;
     unsigned int prom     : 1;
+    unsigned int compress : 1; // if 1, BLZ-compress the ARM9 and its overlays when sealing
+    unsigned int bestfit  : 1; // if 1, fit small filesystem members into the padding of others
 
     unsigned int tailsize;
+    unsigned int headroom; // bytes reserved after each filesystem member when it is first placed
+    uint32_t     align[NUM_ROMCLASSES];
 
     vector *vardefs;
+    vector  ownvars; // T = strpair; backs `vardefs` when the caller does not provide its own
+    vector  owned;   // T = void *; copies of caller-provided values, released by rompacker_del
 
     rommember header;  // intermediate (optional template)
     rommember arm9;    // from disk (required)
@@ -70,17 +201,222 @@ typedef struct rompacker {
     rommember fatb;    // intermediate; computed by rompacker_seal
     rommember banner;  // intermediate
     vector    filesys; // T = romfile
+
+    romdigests twl; // digests of a DSi-enhanced ROM, if its [twl] section sets a key
+
+    // If non-empty, then sealing keeps filesystem members at their offsets within a previous ROM;
+    // see `rompacker_keeplayout`. T = romslot, sorted by target.
+    vector layout;
+
+    // If non-empty, then sealing places the filesystem members named here ahead of all others; see
+    // `rompacker_accessorder`. T = romaccess, in order of access.
+    vector access;
+
+    vector deps; // T = string (owned); non-member input files which were read during configuration
+    fview  plan; // backing storage for member paths of a packer loaded by `rompacker_loadplan`
+
+    // Source files are opened through this pool, relative to the working directory at the time the
+    // packer was created, and share a bounded number of descriptors between configuration, sealing,
+    // and dumping.
+    fdpool *fds;
+
+    // Compressed members are stored here, named by the digest of their input, and are read back
+    // from here when dumping. Must be set if `compress` is 1 or if any filesystem member requests a
+    // transform; created by `rompacker_seal` if needed.
+    string cachedir;
+
+    // If non-NULL, then each phase of packing adds its cost to the element for its `romphase`. The
+    // stat scan is metered once per member with `M_clock`; all other phases, with `M_full`.
+    meter *timings;
+
+    // If non-NULL, then sealing and dumping record spans for each phase, each parallel job, and
+    // each member written.
+    tracer *trace;
+
+    // If non-NULL, then configuration, sealing, and dumping log their decisions here: each setting
+    // and summary at `L_info`, and each member at `L_debug`.
+    logger *log;
+    logger *ownlog; // opened by `rompacker_new` for a verbose packer, and closed with it
+
+    char errmsg[128]; // details of the most recent failure to seal or to read a trace, if any
 } rompacker;
 
+enum sealerr {
+    E_seal_ok = 0,
+    E_seal_toolarge, // The computed ROM size exceeds the capacity of the storage type.
+    E_seal_sealed,   // The packer has already been sealed.
+    E_seal_narc,     // A NARC could not be built; details are written to `errmsg`.
+    E_seal_compress, // A member could not be compressed; details are written to `errmsg`.
+};
+
 enum dumperr {
     E_dump_ok = 0,
-    E_dump_packing,
+    E_dump_packing, // The packer has not yet been sealed.
+    E_dump_nofile,  // A member's source file could not be opened.
+    E_dump_read,    // A member's source file ended before its sealed size was read.
+    E_dump_write,   // The output could not be written, or the output buffer is too small.
+};
+
+// Failures to refresh share their codes with failures to dump.
+enum refresherr {
+    E_refresh_ok      = E_dump_ok,
+    E_refresh_packing = E_dump_packing,
+    E_refresh_nofile  = E_dump_nofile,
+    E_refresh_read    = E_dump_read,
+    E_refresh_write   = E_dump_write,
+    E_refresh_unused, // No member of the ROM is read from the file.
+    E_refresh_layout, // The file no longer fits the sealed layout; the packer must be rebuilt.
 };
 
+enum planerr {
+    E_plan_ok = 0,
+    E_plan_missing, // The plan file does not exist or could not be opened.
+    E_plan_corrupt, // The plan file is truncated or otherwise malformed.
+    E_plan_version, // The plan file was written by an incompatible format version.
+    E_plan_stale,   // The plan's key or the fingerprint of one of its inputs no longer matches.
+    E_plan_packing, // The packer has not yet been sealed.
+    E_plan_memory,  // The packer contains buffer or generator members, which cannot be persisted.
+};
+
+enum layouterr {
+    E_layout_ok = 0,
+    E_layout_corrupt, // The previous ROM is truncated, or its filesystem tables are malformed.
+    E_layout_sealed,  // The packer is already sealed.
+};
+
+enum mapformat {
+    K_map_text = 0, // one line per member, for people and for line-oriented tools
+    K_map_json,     // one JSON object
+};
+
+enum accesserr {
+    E_access_ok = 0,
+    E_access_corrupt, // A line of the trace is malformed; details are written to `errmsg`.
+    E_access_sealed,  // The packer is already sealed.
+};
+
+// If `verbose` is 1, then the packer logs every decision to standard error; otherwise, it is silent
+// until given a logger by `rompacker_setlog`. If `vardefs` is NULL, then the packer maintains its
+// own variable-store for `rompacker_define`.
+// `rompacker_setlog` replaces the packer's logger, which the caller continues to own; if `log` is
+// NULL, then the packer is silent.
+// `rompacker_own` copies `s` into storage released by `rompacker_del`; if `s.s` is NULL, then the
+// copy is left uninitialized for the caller to fill.
 rompacker   *rompacker_new(unsigned int verbose, vector *vardefs);
+void         rompacker_setlog(rompacker *packer, logger *log);
 void         rompacker_del(rompacker *packer);
-int          rompacker_seal(rompacker *packer);
+void         rompacker_depend(rompacker *packer, string filename);
+string       rompacker_own(rompacker *packer, string s);
+enum sealerr rompacker_seal(rompacker *packer);
+uint64_t     rompacker_romsize(rompacker *packer);
 enum dumperr rompacker_dump(rompacker *packer, FILE *stream);
+enum dumperr rompacker_dumpfd(rompacker *packer, int fd);
+enum dumperr rompacker_dumpbuf(rompacker *packer, unsigned char *buf, uint64_t bufsize);
+
+// As `rompacker_dumpfd`, but copy each member whose content is also a member of `donor` out of the
+// ROM which `donor` dumped to `donorfd` (see `fclone`), rather than reading it from its source.
+// Members match if they read the same range of the same source file, or if they are NARCs of the
+// same size built from the same source. Both packers must be sealed, and the donor's sources must
+// not have changed since its ROM was dumped.
+enum dumperr rompacker_dumpshared(rompacker *packer, int fd, const rompacker *donor, int donorfd);
+
+// Rewrite each member which is read from `filename` within a ROM which this packer dumped to `fd`,
+// after that file changed on disk. Members must still fit the space which sealing gave them: ARM
+// binaries, overlays, overlay tables, and members of NARCs must keep their size, while filesystem
+// members may grow into their padding (except for the last one) and have their FATB entries
+// rewritten. If any member does not fit, or if the file is an input to a member which was computed
+// while configuring or sealing (e.g., a compressed member or a NARC's member list), then nothing
+// is written and `E_refresh_layout` is returned. The same holds for any change to a ROM which
+// carries TWL digests, as every change to its content changes its digest tables.
+enum refresherr rompacker_refresh(rompacker *packer, string filename, int fd);
+
+// Keep the layout of `rom`, a ROM packed earlier from similar inputs, when the packer is sealed.
+// Each filesystem member whose target was a member of `rom` keeps its offset there if it still fits
+// the space which it was given: up to the next allocation of `rom`, or without limit for the last.
+// Other members are placed in the smallest free space which fits them (e.g., the slack behind
+// members which shrank or moved), or else after every kept member. The FNTB and file IDs do not
+// depend on the layout. Everything needed from `rom` is copied.
+enum layouterr rompacker_keeplayout(rompacker *packer, string rom);
+
+// Returns the least alignment which the hardware permits for members of `class`: the boot firmware
+// reads the ARM binaries in pages of ROM_ALIGN bytes, while every other member is read through the
+// SDK's filesystem, which needs only ROM_MINALIGN. `rompacker_alignok` also requires a power of two
+// of at most ROM_MAXALIGN.
+uint32_t rompacker_minalign(enum romclass class);
+int      rompacker_alignok(enum romclass class, uint32_t align);
+
+// Place the filesystem members named by `trace`, which lists them in the order that they are read
+// at run-time (e.g., as exported from an emulator), ahead of all others and in order of their first
+// access, so that members which are read together are contiguous within the ROM. Each line names
+// one member by its rooted target path or by its file ID, in decimal or with a “0x” prefix; blank
+// lines, lines which begin with “#”, and entries which name no filesystem member (e.g., overlays)
+// are ignored. Members which keep their place in a previous ROM (see `rompacker_keeplayout`) are
+// not moved. The FNTB and file IDs do not depend on the placement. Everything needed from `trace`
+// is copied.
+enum accesserr rompacker_accessorder(rompacker *packer, string trace);
+
+// Write a map of the sealed packer's layout to `stream`: the ROM's size, its header and banner
+// CRCs, and the class, source, target, file ID, overlay ID, offset, size, and padding of every
+// member, in order of offset. Only `E_dump_packing` and `E_dump_write` are returned on failure.
+// The definition for this function and a description of its formats are contained within
+// `source/map.c`.
+enum dumperr rompacker_writemap(rompacker *packer, FILE *stream, enum mapformat format);
+
+// Programmatic equivalents of `-D` definitions, CONFIG.INI key-value pairs, and FILESYS.CSV
+// records. The definitions for these functions are contained within `source/parse/`.
+extern const cfgsection rompacker_cfgsections[];
+
+cfgresult    rompacker_define(rompacker *packer, string key, string val);
+cfgresult    rompacker_configure(rompacker *packer, string sec, string key, string val);
+sheetsresult rompacker_addfile(rompacker *packer, string source, string target);
+
+// As `rompacker_addfile`, but compress the member according to `transform`, which accepts the same
+// values as the optional third column of FILESYS.CSV: "lz10", "lz11", "auto", or "" for none.
+sheetsresult rompacker_addtransformed(
+    rompacker *packer,
+    string     source,
+    string     target,
+    string     transform
+);
+
+// Filesystem members which do not come from a whole file on disk. The size of each member must be
+// known up front. `rompacker_addbuffer` copies `buf`; a generator and its `user` context must
+// remain valid until the packer is deleted.
+sheetsresult rompacker_addrange(
+    rompacker *packer,
+    string     source,
+    uint64_t   offset,
+    uint32_t   size,
+    string     target
+);
+sheetsresult rompacker_addbuffer(rompacker *packer, const void *buf, uint32_t size, string target);
+sheetsresult rompacker_addgenerator(
+    rompacker   *packer,
+    romgenerator func,
+    void        *user,
+    uint32_t     size,
+    string       target
+);
+
+// Add every regular file within a tar archive as a filesystem member, targeted at "/" followed by
+// its entry name. If `filename` is non-empty, then it must name the file which holds `archive`, and
+// members are copied from that file when the ROM is dumped. Otherwise, members refer directly into
+// `archive`, which must remain valid until the packer is deleted.
+tarresult rompacker_addtar(rompacker *packer, string archive, string filename);
+
+// Add every filesystem member of `donor` to `packer`, in the donor's order, except that a member of
+// `packer` with the same target takes the place of the donor's. Members of `packer` which replace
+// none of the donor's follow, in the order that they were added. Sources, targets, and buffers are
+// copied; generators are shared with the donor, which must outlive `packer`. Neither packer may be
+// sealed, and `donor` is not modified (e.g., so that it can be inherited by several variants).
+sheetsresult rompacker_inherit(rompacker *packer, const rompacker *donor);
+
+// Persist and restore a sealed packer. `key` should uniquely describe the invocation which built
+// the packer (e.g., program version, working directory, variable definitions); a plan is only
+// restored if its key matches and every recorded input still has its recorded size and mtime.
+// The definitions for these functions are contained within `source/plan.c`.
+enum planerr rompacker_saveplan(rompacker *packer, const char *filename, string key);
+enum planerr rompacker_loadplan(rompacker **packer, const char *filename, string key);
 
 // Handlers for packer configuration and filesystem entries. The definitions for these functions
 // are contained within their own files in `source/parse/`.
@@ -89,6 +425,7 @@ cfgresult    cfg_rom(string sec, string key, string val, void *packer, long line
 cfgresult    cfg_banner(string sec, string key, string val, void *packer, long line);
 cfgresult    cfg_arm9(string sec, string key, string val, void *packer, long line);
 cfgresult    cfg_arm7(string sec, string key, string val, void *packer, long line);
+cfgresult    cfg_twl(string sec, string key, string val, void *packer, long line);
 sheetsresult csv_addfile(sheetsrecord *record, void *packer, int line);
 
 #endif // PACKER_H
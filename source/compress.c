@@ -0,0 +1,487 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * Retail ROMs store the ARM9 static binary and most of its overlays backward-LZ compressed. Every
+ * member is compressed by its own job. Results are stored in the packer's cache directory, named by
+ * the SHA-1 digest of everything which determines them, so that an unchanged member is never
+ * compressed twice; an empty entry records that a member does not benefit from compression.
+ *
+ * Once every job has finished, each compressed member is redirected to its entry in the cache, and
+ * the ROM header, the static binary's module parameters, and the overlay table are patched to
+ * match. The patched overlay table is itself stored in the cache, so that a packing plan may refer
+ * to it like any other member.
+ *
+ * Filesystem members which request a transform are forward-LZ compressed in the same manner, and
+ * before the filesystem is laid out, so that their sealed sizes are known to the layout.
+ */
+
+#include "compress.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "packer.h"
+
+#include "libs/blz.h"
+#include "libs/fdpool.h"
+#include "libs/fileio.h"
+#include "libs/jobs.h"
+#include "libs/litend.h"
+#include "libs/log.h"
+#include "libs/lz.h"
+#include "libs/sha1.h"
+#include "libs/strings.h"
+
+// Salts every digest; change these whenever the encoder's output changes.
+#define CACHE_TAG    "nitrorom-blz-1"
+#define CACHE_TAG_LZ "nitrorom-lz-1"
+#define CACHE_LOG "rompacker:compress: "
+
+typedef struct blzjob {
+    rommember  *memb;
+    const char *cachedir;
+    fdpool     *fds;
+    tracer     *trace;
+    int         arm9;
+    uint32_t    loadaddr; // for the static binary, which embeds its compressed end-address
+    uint32_t    loadsize; // for the static binary, which may be followed by a footer
+    long        ovtentry; // for overlays, the offset of their entry in the overlay table
+
+    char     path[4096]; // location of the member's cache entry
+    uint32_t modsize;    // compressed size, excluding any footer
+    int      compressed;
+    int      cached;
+    char     err[128];
+} blzjob;
+
+#define joberr(__job, __msg, ...)                                                   \
+    {                                                                               \
+        snprintf((__job)->err, sizeof((__job)->err), CACHE_LOG __msg, __VA_ARGS__); \
+        goto cleanup;                                                               \
+    }
+
+// Module parameters are located by the static footer, if there is one, and otherwise by the pair of
+// "nitro codes" which end them.
+static long findparams(unsigned char *raw, uint32_t size, uint32_t modsize)
+{
+    if (size >= modsize + STATICFOOTER_BSIZE && leword(raw + modsize) == NITROCODE_LE) {
+        uint32_t ofs = leword(raw + modsize + 4);
+        if (ofs + MODPARAMS_BSIZE <= modsize) return ofs;
+    }
+
+    for (uint32_t ofs = 0; ofs + MODPARAMS_BSIZE <= modsize; ofs += 4) {
+        if (leword(raw + ofs + OFS_MODPARAMS_NITROCODE) == NITROCODE_BE
+            && leword(raw + ofs + OFS_MODPARAMS_NITROCODE + 4) == NITROCODE_LE) {
+            return ofs;
+        }
+    }
+
+    return -1;
+}
+
+static void compressmemb(void *user, long jobid)
+{
+    blzjob        *job  = &((blzjob *)user)[jobid];
+    rommember     *memb = job->memb;
+    uint32_t       size = memb->size;
+    unsigned char *raw  = malloc(size + 1);
+    unsigned char *comp = NULL;
+    tracebegin(job->trace, "blz", "%.*s", fmtstring(memb->source.filename));
+
+    fdlease lease = fdacquire(job->fds, memb->source.filename);
+    int     err   = lease.fd < 0 || fdread(lease.fd, raw, size, 0) != 0;
+    fdrelease(job->fds, lease);
+    if (err) joberr(job, "could not read “%.*s”", fmtstring(memb->source.filename));
+
+    uint32_t      modsize = job->arm9 && job->loadsize < size ? job->loadsize : size;
+    unsigned char params[8];
+    putleword(params, job->loadaddr);
+    putleword(params + 4, modsize);
+
+    sha1          ctx;
+    unsigned char digest[SHA1_DIGEST_BSIZE];
+    char          hex[(2 * SHA1_DIGEST_BSIZE) + 1];
+    sha1init(&ctx);
+    sha1update(&ctx, CACHE_TAG, lengthof(CACHE_TAG));
+    if (job->arm9) sha1update(&ctx, params, sizeof(params));
+    sha1update(&ctx, raw, size);
+    sha1final(&ctx, digest);
+    sha1hex(digest, hex);
+    snprintf(job->path, sizeof(job->path), "%s/%s.blz", job->cachedir, hex);
+
+    file cached = fprep(job->path);
+    if (cached.size >= 0) {
+        fclose(cached.hdl);
+        job->cached     = 1;
+        job->compressed = cached.size > 0;
+        job->modsize    = cached.size > 0 ? cached.size - (size - modsize) : size;
+        goto cleanup;
+    }
+
+    long rawprefix = 0;
+    long paramsofs = -1;
+    if (job->arm9) {
+        paramsofs = findparams(raw, size, modsize);
+        if (paramsofs < 0) {
+            joberr(
+                job,
+                "could not find module parameters in “%.*s”",
+                fmtstring(memb->source.filename)
+            );
+        }
+        if (paramsofs + MODPARAMS_BSIZE > ARM9_BLZ_RAWPREFIX) {
+            joberr(
+                job,
+                "module parameters of “%.*s” lie beyond its first 0x%X bytes",
+                fmtstring(memb->source.filename),
+                ARM9_BLZ_RAWPREFIX
+            );
+        }
+
+        rawprefix = ARM9_BLZ_RAWPREFIX;
+    }
+
+    // A static binary whose module parameters already record a compressed end is left as-is.
+    long complen = 0;
+    comp         = malloc(blzbound(modsize) + (size - modsize));
+    if (paramsofs < 0 || leword(raw + paramsofs + OFS_MODPARAMS_COMPSTATICEND) == 0) {
+        complen = blzencode(raw, modsize, rawprefix, comp);
+    }
+
+    if (complen > 0) {
+        if (job->arm9) {
+            putleword(comp + paramsofs + OFS_MODPARAMS_COMPSTATICEND, job->loadaddr + complen);
+        }
+
+        memcpy(comp + complen, raw + modsize, size - modsize);
+        job->compressed = 1;
+        job->modsize    = complen;
+    }
+
+    long entrysize = complen > 0 ? complen + (size - modsize) : 0;
+    if (fstore(job->path, comp, entrysize) != 0) {
+        joberr(job, "could not write to cache directory “%s”", job->cachedir);
+    }
+
+cleanup:
+    free(raw);
+    free(comp);
+    traceend(job->trace);
+}
+
+static int redirect(rompacker *packer, rommember *memb, const char *path)
+{
+    stamp cached = fstamp(path);
+    if (cached.size < 0) return -1;
+
+    rompacker_depend(packer, memb->source.filename);
+    memb->source.filename = rompacker_own(packer, string(path, strlen(path)));
+    memb->size            = cached.size;
+    return 0;
+}
+
+#define compresserr(__msg, ...)                                                         \
+    {                                                                                   \
+        snprintf(packer->errmsg, sizeof(packer->errmsg), CACHE_LOG __msg, __VA_ARGS__); \
+        goto cleanup;                                                                   \
+    }
+
+// Returns the path of the cache directory, which the caller must free, or NULL on failure.
+static char *opencache(rompacker *packer)
+{
+    char *cachedir = NULL;
+    if (packer->cachedir.len <= 0) compresserr("%s", "no cache directory was configured");
+
+    cachedir = malloc(packer->cachedir.len + 1);
+    memcpy(cachedir, packer->cachedir.s, packer->cachedir.len);
+    cachedir[packer->cachedir.len] = '\0';
+    if (fmkdir(cachedir) != 0) compresserr("could not create cache directory “%s”", cachedir);
+
+    return cachedir;
+
+cleanup:
+    free(cachedir);
+    return NULL;
+}
+
+int compressarm9(rompacker *packer)
+{
+    if (!packer->compress) return 0;
+
+    int            result   = -1;
+    unsigned char *ovt      = NULL;
+    blzjob        *jobs     = calloc(packer->ovy9.len + 1, sizeof(blzjob));
+    char          *cachedir = opencache(packer);
+    if (!cachedir) goto cleanup;
+
+    // Overlays can only be marked as compressed through an overlay table.
+    uint32_t novts = packer->ovt9.size / OVT_ENTRY_BSIZE;
+    if (novts > 0) {
+        ovt           = malloc(packer->ovt9.size);
+        fdlease lease = fdacquire(packer->fds, packer->ovt9.source.filename);
+        int     err   = lease.fd < 0 || fdread(lease.fd, ovt, packer->ovt9.size, 0) != 0;
+        fdrelease(packer->fds, lease);
+        if (err) compresserr("could not read “%.*s”", fmtstring(packer->ovt9.source.filename));
+    }
+
+    unsigned char *header = packer->header.source.buf;
+    long           njobs  = 0;
+    if (packer->arm9.size > 0) {
+        blzjob *job   = &jobs[njobs++];
+        job->memb     = &packer->arm9;
+        job->arm9     = 1;
+        job->loadaddr = leword(header + OFS_HEADER_ARM9_LOADADDR);
+        job->loadsize = leword(header + OFS_HEADER_ARM9_LOADSIZE);
+    }
+
+    for (uint32_t i = 0; i < novts; i++) {
+        uint32_t   fileid = leword(ovt + (i * OVT_ENTRY_BSIZE) + OFS_OVT_FILEID);
+        uint32_t   flags  = leword(ovt + (i * OVT_ENTRY_BSIZE) + OFS_OVT_COMPRESSED);
+        rommember *ovy    = fileid < (uint32_t)packer->ovy9.len
+                              ? get(&packer->ovy9, rommember, fileid)
+                              : NULL;
+        if (!ovy || (flags & OVT_FLAG_COMPRESSED)) continue;
+
+        // Each overlay should have exactly one entry; compress it only for the first.
+        int queued = 0;
+        for (long j = 0; j < njobs && !queued; j++) queued = jobs[j].memb == ovy;
+        if (queued) continue;
+
+        blzjob *job   = &jobs[njobs++];
+        job->memb     = ovy;
+        job->ovtentry = i * OVT_ENTRY_BSIZE;
+    }
+
+    for (long i = 0; i < njobs; i++) {
+        jobs[i].cachedir = cachedir;
+        jobs[i].fds      = packer->fds;
+        jobs[i].trace    = packer->trace;
+    }
+
+    jobsrun(0, njobs, compressmemb, jobs);
+
+    int ovtdirty = 0;
+    for (long i = 0; i < njobs; i++) {
+        blzjob *job = &jobs[i];
+        if (job->err[0] != '\0') {
+            snprintf(packer->errmsg, sizeof(packer->errmsg), "%s", job->err);
+            goto cleanup;
+        }
+
+        uint32_t rawsize = job->memb->size;
+        string   rawname = job->memb->source.filename;
+        if (job->compressed) {
+            if (redirect(packer, job->memb, job->path) != 0) {
+                compresserr("could not read from cache directory “%s”", cachedir);
+            }
+
+            if (job->arm9) {
+                putleword(header + OFS_HEADER_ARM9_LOADSIZE, job->modsize);
+            } else {
+                unsigned char *entry = ovt + job->ovtentry;
+                uint32_t       flags = leword(entry + OFS_OVT_COMPRESSED) & ~OVT_MASK_COMPRESSED;
+                flags                |= OVT_FLAG_COMPRESSED | (job->modsize & OVT_MASK_COMPRESSED);
+                putleword(entry + OFS_OVT_COMPRESSED, flags);
+                ovtdirty = 1;
+            }
+        }
+
+        logdebug(
+            packer->log,
+            "rompacker:compress",
+            "0x%08X -> 0x%08X,%.*s%s",
+            rawsize,
+            job->memb->size,
+            fmtstring(rawname),
+            job->cached ? " (cached)" : ""
+        );
+    }
+
+    if (ovtdirty) {
+        char          path[4096];
+        char          hex[(2 * SHA1_DIGEST_BSIZE) + 1];
+        unsigned char digest[SHA1_DIGEST_BSIZE];
+        sha1digest(ovt, packer->ovt9.size, digest);
+        sha1hex(digest, hex);
+        snprintf(path, sizeof(path), "%s/%s.ovt", cachedir, hex);
+
+        int err = fstore(path, ovt, packer->ovt9.size) != 0;
+        if (err || redirect(packer, &packer->ovt9, path) != 0) {
+            compresserr("could not write to cache directory “%s”", cachedir);
+        }
+    }
+
+    result = 0;
+
+cleanup:
+    free(jobs);
+    free(ovt);
+    free(cachedir);
+    return result;
+}
+
+typedef struct lzjob {
+    romfile    *file;
+    const char *cachedir;
+    tracer     *trace;
+
+    char     path[4096]; // location of the member's cache entry
+    uint32_t size;       // size of the entry, or 0 if the member is packed as-is
+    uint8_t  format;     // the chosen lzformat, or 0 if the member is packed as-is
+    int      cached;
+    char     err[128];
+} lzjob;
+
+static const char *lzmodes[] = {
+    [K_transform_lz10] = "lz10",
+    [K_transform_lz11] = "lz11",
+    [K_transform_auto] = "auto",
+};
+
+static void transformfile(void *user, long jobid)
+{
+    lzjob         *job   = &((lzjob *)user)[jobid];
+    romfile       *memb  = job->file;
+    const char    *mode  = lzmodes[memb->transform];
+    fview          raw   = fmaps(memb->source);
+    unsigned char *comp  = NULL;
+    unsigned char *alt   = NULL;
+    long           len   = raw.data.len;
+    long           clen  = -1;
+    long           altln = -1;
+    tracebegin(job->trace, "lz", "%.*s", fmtstring(memb->source));
+    if (len < 0) joberr(job, "could not read “%.*s”", fmtstring(memb->source));
+
+    sha1          ctx;
+    unsigned char digest[SHA1_DIGEST_BSIZE];
+    char          hex[(2 * SHA1_DIGEST_BSIZE) + 1];
+    sha1init(&ctx);
+    sha1update(&ctx, CACHE_TAG_LZ, lengthof(CACHE_TAG_LZ));
+    sha1update(&ctx, mode, strlen(mode) + 1);
+    sha1update(&ctx, raw.data.s, len);
+    sha1final(&ctx, digest);
+    sha1hex(digest, hex);
+    snprintf(job->path, sizeof(job->path), "%s/%s.%s", job->cachedir, hex, mode);
+
+    file cached = fprep(job->path);
+    if (cached.size >= 0) {
+        unsigned char type = 0;
+        if (cached.size > 0) fread(&type, 1, 1, cached.hdl);
+        fclose(cached.hdl);
+
+        job->cached = 1;
+        job->size   = cached.size;
+        job->format = type;
+        goto cleanup;
+    }
+
+    comp = malloc(lzbound(len));
+    if (memb->transform == K_transform_lz10 || memb->transform == K_transform_auto) {
+        clen        = lzencode(raw.data.s, len, LZ_FORMAT_LZ10, comp);
+        job->format = LZ_FORMAT_LZ10;
+    }
+
+    // Automatic transforms keep the smaller of both formats, and only if it is smaller than the raw
+    // member.
+    if (memb->transform == K_transform_lz11 || memb->transform == K_transform_auto) {
+        alt   = malloc(lzbound(len));
+        altln = lzencode(raw.data.s, len, LZ_FORMAT_LZ11, alt);
+        if (clen < 0 || (altln >= 0 && altln < clen)) {
+            unsigned char *swap = comp;
+            comp                = alt;
+            alt                 = swap;
+            clen                = altln;
+            job->format         = LZ_FORMAT_LZ11;
+        }
+    }
+
+    if (clen < 0) {
+        joberr(job, "“%.*s” is too large to compress as %s", fmtstring(memb->source), mode);
+    }
+
+    if (memb->transform == K_transform_auto && clen >= len) {
+        clen        = 0;
+        job->format = 0;
+    }
+
+    job->size = clen;
+    if (fstore(job->path, comp, clen) != 0) {
+        joberr(job, "could not write to cache directory “%s”", job->cachedir);
+    }
+
+cleanup:
+    if (len >= 0) funmap(raw);
+    free(comp);
+    free(alt);
+    traceend(job->trace);
+}
+
+int compressfiles(rompacker *packer)
+{
+    int    result   = -1;
+    long   njobs    = 0;
+    lzjob *jobs     = NULL;
+    char  *cachedir = NULL;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        njobs += get(&packer->filesys, romfile, i)->transform != K_transform_none;
+    }
+
+    if (njobs == 0) return 0;
+    if (!(cachedir = opencache(packer))) return -1;
+
+    jobs  = calloc(njobs, sizeof(lzjob));
+    njobs = 0;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->transform == K_transform_none) continue;
+
+        jobs[njobs].file       = file;
+        jobs[njobs].trace      = packer->trace;
+        jobs[njobs++].cachedir = cachedir;
+    }
+
+    jobsrun(0, njobs, transformfile, jobs);
+
+    for (long i = 0; i < njobs; i++) {
+        lzjob   *job  = &jobs[i];
+        romfile *file = job->file;
+        if (job->err[0] != '\0') {
+            snprintf(packer->errmsg, sizeof(packer->errmsg), "%s", job->err);
+            goto cleanup;
+        }
+
+        uint32_t rawsize = file->size;
+        string   rawname = file->source;
+        if (job->size > 0) {
+            rompacker_depend(packer, file->source);
+            file->source = rompacker_own(packer, string(job->path, strlen(job->path)));
+            file->size   = job->size;
+        }
+
+        if (packer->log) {
+            const char *chosen = job->format == LZ_FORMAT_LZ10   ? "lz10"
+                               : job->format == LZ_FORMAT_LZ11 ? "lz11"
+                                                               : "raw";
+            logdebug(
+                packer->log,
+                "rompacker:compress",
+                "0x%08X -> 0x%08X,%.*s (%s)%s",
+                rawsize,
+                file->size,
+                fmtstring(rawname),
+                chosen,
+                job->cached ? " (cached)" : ""
+            );
+        }
+    }
+
+    result = 0;
+
+cleanup:
+    free(jobs);
+    free(cachedir);
+    return result;
+}
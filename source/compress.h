@@ -0,0 +1,18 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "packer.h"
+
+// Compress the ARM9 static binary and each of its overlays which is not already compressed, then
+// patch the ROM header, the module parameters, and the overlay table to match. Does nothing unless
+// `packer->compress` is set. Returns 0 on success; otherwise, a message is written to
+// `packer->errmsg`.
+int compressarm9(rompacker *packer);
+
+// Compress each filesystem member which requests a transform, redirecting it to its entry in the
+// cache directory. Returns 0 on success; otherwise, a message is written to `packer->errmsg`.
+int compressfiles(rompacker *packer);
+
+#endif // COMPRESS_H
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * DSi-enhanced (TWL) ROMs authenticate the region which a DS would read — from the ARM9 to the end
+ * of the filesystem, rounded up to a whole block — with an HMAC-SHA1 digest of each sector, and a
+ * digest of each block of consecutive sector digests. The header carries a digest of the block
+ * table, and one of each of the ARM binaries and the banner.
+ *
+ * Digests are computed from the bytes of the ROM as they are dumped, so that no member is read
+ * twice. Sectors are gathered into batches, and each batch is digested across the packer's job
+ * pool before the next one is gathered; the header's digests stream alongside them. Since the
+ * header precedes everything it authenticates, its digests are patched once the dump reaches the
+ * tables.
+ */
+
+#include "digest.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "packer.h"
+
+#include "libs/jobs.h"
+#include "libs/litend.h"
+#include "libs/log.h"
+#include "libs/sha1.h"
+
+#define BATCH_BSIZE 0x400000 // a multiple of every sector size
+#define JOB_BSIZE   0x10000  // sectors are digested in runs of at least this many bytes per job
+
+#define padto(__size, __align)  (-(__size) & ((__align) - 1))
+#define alignup(__ofs, __align) (((__ofs) + (__align) - 1) & ~(uint64_t)((__align) - 1))
+
+enum hashedmemb {
+    K_hashed_arm9 = 0,
+    K_hashed_arm7,
+    K_hashed_banner,
+
+    NUM_HASHEDMEMBS,
+};
+
+// clang-format off
+static const uint32_t hmacoffsets[NUM_HASHEDMEMBS] = {
+    [K_hashed_arm9]   = OFS_HEADER_HMAC_ARM9,
+    [K_hashed_arm7]   = OFS_HEADER_HMAC_ARM7,
+    [K_hashed_banner] = OFS_HEADER_HMAC_BANNER,
+};
+// clang-format on
+
+struct romhasher {
+    rompacker *packer;
+    sha1hmac   keyed; // copied by each digest, so that the key is only absorbed once
+
+    sha1hmac memb[NUM_HASHEDMEMBS];
+    uint64_t membofs[NUM_HASHEDMEMBS];
+    uint64_t membend[NUM_HASHEDMEMBS];
+
+    uint64_t       ntrofs;
+    uint64_t       ntrend;
+    unsigned char *batch;
+    uint64_t       batchofs; // of the first byte of the batch, relative to `ntrofs`
+    uint32_t       batchlen;
+    uint32_t       jobsectors;
+};
+
+void sealdigests(rompacker *packer, uint64_t extent)
+{
+    romdigests *twl = &packer->twl;
+    if (twl->key.len == 0) return;
+
+    uint64_t ntrofs    = packer->arm9.offset;
+    uint64_t blocksize = (uint64_t)twl->sectorsize * twl->blocksectors;
+    uint64_t ntrsize   = alignup(extent - ntrofs, blocksize);
+    uint64_t nsectors  = ntrsize / twl->sectorsize;
+    uint64_t nblocks   = nsectors / twl->blocksectors;
+
+    free(twl->sectors.source.buf);
+    twl->sectors.source.filename = string("%SECTORDIGESTS%");
+    twl->sectors.offset          = ntrofs + ntrsize;
+    twl->sectors.size            = nsectors * SHA1_DIGEST_BSIZE;
+    twl->sectors.pad             = padto(twl->sectors.size, ROM_ALIGN);
+    twl->sectors.source.buf      = calloc(twl->sectors.size, 1);
+
+    free(twl->blocks.source.buf);
+    twl->blocks.source.filename = string("%BLOCKDIGESTS%");
+    twl->blocks.offset          = twl->sectors.offset + twl->sectors.size + twl->sectors.pad;
+    twl->blocks.size            = nblocks * SHA1_DIGEST_BSIZE;
+    twl->blocks.pad             = padto(twl->blocks.size, ROM_ALIGN);
+    twl->blocks.source.buf      = calloc(twl->blocks.size, 1);
+
+    unsigned char *header = packer->header.source.buf;
+    putleword(header + OFS_HEADER_DIGEST_NTROFFSET, ntrofs);
+    putleword(header + OFS_HEADER_DIGEST_NTRBSIZE, ntrsize);
+    putleword(header + OFS_HEADER_DIGEST_TWLOFFSET, 0);
+    putleword(header + OFS_HEADER_DIGEST_TWLBSIZE, 0);
+    putleword(header + OFS_HEADER_DIGEST_SECTOFFSET, twl->sectors.offset);
+    putleword(header + OFS_HEADER_DIGEST_SECTBSIZE, twl->sectors.size);
+    putleword(header + OFS_HEADER_DIGEST_BLOCKOFFSET, twl->blocks.offset);
+    putleword(header + OFS_HEADER_DIGEST_BLOCKBSIZE, twl->blocks.size);
+    putleword(header + OFS_HEADER_DIGEST_SECTORSIZE, twl->sectorsize);
+    putleword(header + OFS_HEADER_DIGEST_BLOCKSECTORS, twl->blocksectors);
+    putleword(header + OFS_HEADER_TWL_ROMSIZE, twl->blocks.offset + twl->blocks.size);
+
+    loginfo(
+        packer->log,
+        "rompacker:twl",
+        "digesting 0x%08" PRIX64 " bytes from 0x%08" PRIX64 " in %" PRIu64 " sectors, %" PRIu64
+        " blocks",
+        ntrsize,
+        ntrofs,
+        nsectors,
+        nblocks
+    );
+}
+
+romhasher *hashernew(rompacker *packer)
+{
+    romdigests *twl = &packer->twl;
+    if (twl->key.len == 0) return NULL;
+
+    romhasher *hasher  = calloc(1, sizeof(*hasher));
+    hasher->packer     = packer;
+    hasher->ntrofs     = packer->arm9.offset;
+    hasher->ntrend     = twl->sectors.offset;
+    hasher->batch      = malloc(BATCH_BSIZE);
+    hasher->jobsectors = twl->sectorsize < JOB_BSIZE ? JOB_BSIZE / twl->sectorsize : 1;
+    sha1hmacinit(&hasher->keyed, twl->key.s, twl->key.len);
+
+    const rommember *membs[NUM_HASHEDMEMBS] = {
+        [K_hashed_arm9]   = &packer->arm9,
+        [K_hashed_arm7]   = &packer->arm7,
+        [K_hashed_banner] = &packer->banner,
+    };
+
+    for (int i = 0; i < NUM_HASHEDMEMBS; i++) {
+        hasher->memb[i]    = hasher->keyed;
+        hasher->membofs[i] = membs[i]->offset;
+        hasher->membend[i] = (uint64_t)membs[i]->offset + membs[i]->size;
+    }
+
+    return hasher;
+}
+
+static void digestsectors(void *user, long job)
+{
+    romhasher  *hasher = user;
+    romdigests *twl    = &hasher->packer->twl;
+    uint32_t    nbatch = hasher->batchlen / twl->sectorsize;
+    uint32_t    first  = job * hasher->jobsectors;
+    uint32_t    last   = first + hasher->jobsectors < nbatch ? first + hasher->jobsectors : nbatch;
+
+    uint64_t       base    = hasher->batchofs / twl->sectorsize;
+    unsigned char *digests = twl->sectors.source.buf;
+    for (uint32_t i = first; i < last; i++) {
+        const unsigned char *sector = hasher->batch + (uint64_t)i * twl->sectorsize;
+        sha1hmacdigest(
+            &hasher->keyed,
+            sector,
+            twl->sectorsize,
+            digests + (base + i) * SHA1_DIGEST_BSIZE
+        );
+    }
+}
+
+static void flushbatch(romhasher *hasher)
+{
+    uint32_t nsectors = hasher->batchlen / hasher->packer->twl.sectorsize;
+    long     njobs    = (nsectors + hasher->jobsectors - 1) / hasher->jobsectors;
+    jobsrun(0, njobs, digestsectors, hasher);
+
+    hasher->batchofs += hasher->batchlen;
+    hasher->batchlen  = 0;
+}
+
+void hasherfeed(romhasher *hasher, uint64_t offset, const unsigned char *buf, size_t size)
+{
+    uint64_t end = offset + size;
+    for (int i = 0; i < NUM_HASHEDMEMBS; i++) {
+        uint64_t from = offset > hasher->membofs[i] ? offset : hasher->membofs[i];
+        uint64_t to   = end < hasher->membend[i] ? end : hasher->membend[i];
+        if (from < to) sha1hmacupdate(&hasher->memb[i], buf + (from - offset), to - from);
+    }
+
+    uint64_t from = offset > hasher->ntrofs ? offset : hasher->ntrofs;
+    uint64_t to   = end < hasher->ntrend ? end : hasher->ntrend;
+    while (from < to) {
+        uint64_t chunk = BATCH_BSIZE - hasher->batchlen;
+        if (chunk > to - from) chunk = to - from;
+
+        memcpy(hasher->batch + hasher->batchlen, buf + (from - offset), chunk);
+        hasher->batchlen += chunk;
+        from             += chunk;
+        if (hasher->batchlen == BATCH_BSIZE) flushbatch(hasher);
+    }
+}
+
+void hasherfinish(romhasher *hasher)
+{
+    rompacker  *packer = hasher->packer;
+    romdigests *twl    = &packer->twl;
+    if (hasher->batchlen > 0) flushbatch(hasher);
+
+    // Each block covers a fixed count of sector digests; there are few enough blocks that they are
+    // digested in turn.
+    uint32_t       blockbsize = twl->blocksectors * SHA1_DIGEST_BSIZE;
+    uint32_t       nblocks    = twl->blocks.size / SHA1_DIGEST_BSIZE;
+    unsigned char *sectors    = twl->sectors.source.buf;
+    unsigned char *blocks     = twl->blocks.source.buf;
+    for (uint32_t i = 0; i < nblocks; i++) {
+        unsigned char *digest = blocks + (uint64_t)i * SHA1_DIGEST_BSIZE;
+        sha1hmacdigest(&hasher->keyed, sectors + (uint64_t)i * blockbsize, blockbsize, digest);
+    }
+
+    unsigned char *header = packer->header.source.buf;
+    sha1hmacdigest(&hasher->keyed, blocks, twl->blocks.size, header + OFS_HEADER_HMAC_DIGESTS);
+    for (int i = 0; i < NUM_HASHEDMEMBS; i++) {
+        sha1hmacfinal(&hasher->memb[i], header + hmacoffsets[i]);
+    }
+}
+
+void hasherdel(romhasher *hasher)
+{
+    if (!hasher) return;
+
+    free(hasher->batch);
+    free(hasher);
+}
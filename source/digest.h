@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packer.h"
+
+// Lay out the digest tables of a DSi-enhanced ROM after `extent`, the end of every other member
+// including its padding, and record them in the header. Does nothing unless the packer has a
+// digest key.
+void sealdigests(rompacker *packer, uint64_t extent);
+
+typedef struct romhasher romhasher;
+
+// Begin to digest a dump of a sealed packer. Returns NULL if the packer has no digest key.
+romhasher *hashernew(rompacker *packer);
+
+// Digest `size` bytes which were written at `offset` within the ROM. Bytes must be fed in order of
+// their offsets, and without gaps, up to the start of the sector table.
+void hasherfeed(romhasher *hasher, uint64_t offset, const unsigned char *buf, size_t size);
+
+// Fill the packer's digest tables and the header's digests of the ARM binaries, the banner, and the
+// block table from every byte fed so far.
+void hasherfinish(romhasher *hasher);
+
+void hasherdel(romhasher *hasher);
+
+#endif // DIGEST_H
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/blz.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/litend.h"
+
+#define BLZ_THRESHOLD 2      // back-references must be longer than this
+#define BLZ_MAXLEN    0x12   // 4-bit length field, offset by 3
+#define BLZ_MINDIST   3      // distances are offset by 3 ...
+#define BLZ_MAXDIST   0x1002 // ... within a 12-bit field
+
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+
+static inline uint32_t hash3(const unsigned char *p)
+{
+    uint32_t key = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// The encoder works on a reversed copy of its input, which turns the format into an ordinary
+// forward LZ77 stream. Previous occurrences of each 3-byte sequence are chained together, nearest
+// first, so that the longest match at the smallest distance is found without a full window scan.
+long blzencode(const unsigned char *src, long len, long rawprefix, unsigned char *dst)
+{
+    if (rawprefix > len) rawprefix = len;
+
+    long           end  = len - rawprefix;
+    unsigned char *inv  = malloc(len + 1);
+    unsigned char *pak  = malloc(end + ((end + 7) / 8) + 1);
+    int32_t       *head = malloc(sizeof(int32_t) * HASH_SIZE);
+    int32_t       *prev = malloc(sizeof(int32_t) * (end + 1));
+    for (long i = 0; i < len; i++) inv[i] = src[len - 1 - i];
+    for (long i = 0; i < HASH_SIZE; i++) head[i] = -1;
+
+    long     paklen  = 0;
+    long     flagpos = 0;
+    unsigned mask    = 0;
+    long     bestpak = 0;   // length of the compressed stream at the best split found so far ...
+    long     bestraw = len; // ... and the number of input bytes left uncompressed at that split
+
+    for (long r = 0, indexed = 0; r < end;) {
+        if ((mask >>= 1) == 0) {
+            flagpos       = paklen;
+            pak[paklen++] = 0;
+            mask          = 0x80;
+        }
+
+        for (; indexed < r && indexed + BLZ_THRESHOLD < end; indexed++) {
+            uint32_t h    = hash3(inv + indexed);
+            prev[indexed] = head[h];
+            head[h]       = (int32_t)indexed;
+        }
+
+        long maxlen  = end - r < BLZ_MAXLEN ? end - r : BLZ_MAXLEN;
+        long bestlen = BLZ_THRESHOLD;
+        long bestdst = 0;
+        if (maxlen > BLZ_THRESHOLD) {
+            for (int32_t q = head[hash3(inv + r)]; q >= 0; q = prev[q]) {
+                long dist = r - q;
+                if (dist < BLZ_MINDIST) continue;
+                if (dist > BLZ_MAXDIST) break;
+
+                long limit = maxlen < dist ? maxlen : dist;
+                long n     = 0;
+                while (n < limit && inv[r + n] == inv[q + n]) n++;
+                if (n > bestlen) {
+                    bestlen = n;
+                    bestdst = dist;
+                    if (n == maxlen) break;
+                }
+            }
+        }
+
+        if (bestlen > BLZ_THRESHOLD) {
+            long disp      = bestdst - BLZ_MINDIST;
+            pak[flagpos]  |= mask;
+            pak[paklen++]  = ((bestlen - (BLZ_THRESHOLD + 1)) << 4) | (disp >> 8);
+            pak[paklen++]  = disp & 0xFF;
+            r             += bestlen;
+        } else {
+            pak[paklen++] = inv[r++];
+        }
+
+        // Stopping the compressed stream here would leave the rest of the input as the prefix.
+        if (paklen + (len - r) < bestpak + bestraw) {
+            bestpak = paklen;
+            bestraw = len - r;
+        }
+    }
+
+    long padded = (bestraw + bestpak + 3) & ~3L;
+    long outlen = 0;
+    if (bestpak > 0 && padded + BLZ_FOOTER_BSIZE < len) {
+        memcpy(dst, src, bestraw);
+        for (long i = 0; i < bestpak; i++) dst[bestraw + i] = pak[bestpak - 1 - i];
+
+        outlen          = bestraw + bestpak;
+        uint32_t hdrlen = BLZ_FOOTER_BSIZE;
+        for (; outlen < padded; outlen++, hdrlen++) dst[outlen] = 0xFF;
+
+        uint32_t enclen = ((bestpak + hdrlen) & 0x00FFFFFF) | (hdrlen << 24);
+        uint32_t inclen = len - bestpak - bestraw - hdrlen;
+        putleword(dst + outlen, enclen);
+        putleword(dst + outlen + 4, inclen);
+        outlen += BLZ_FOOTER_BSIZE;
+    }
+
+    free(inv);
+    free(pak);
+    free(head);
+    free(prev);
+    return outlen;
+}
+
+long blzdecsize(const unsigned char *src, long len)
+{
+    if (len < BLZ_FOOTER_BSIZE) return -1;
+
+    long enclen = leword((unsigned char *)src + len - 8) & 0x00FFFFFF;
+    long hdrlen = src[len - 5];
+    long inclen = leword((unsigned char *)src + len - 4);
+    if (hdrlen < BLZ_FOOTER_BSIZE || hdrlen > BLZ_FOOTER_BSIZE + 3) return -1;
+    if (enclen < hdrlen || enclen > len || inclen == 0) return -1;
+
+    return len + inclen;
+}
+
+long blzdecode(const unsigned char *src, long len, unsigned char *dst)
+{
+    long declen = blzdecsize(src, len);
+    if (declen < 0) return -1;
+
+    long                 enclen = leword((unsigned char *)src + len - 8) & 0x00FFFFFF;
+    long                 prefix = len - enclen;
+    const unsigned char *stream = src + prefix;
+    const unsigned char *curs   = stream + enclen - src[len - 5];
+    memcpy(dst, src, prefix);
+
+    long     out   = declen;
+    unsigned flags = 0;
+    unsigned mask  = 0;
+    while (out > prefix) {
+        if ((mask >>= 1) == 0) {
+            if (curs == stream) return -1;
+            flags = *--curs;
+            mask  = 0x80;
+        }
+
+        if (flags & mask) {
+            if (curs - stream < 2) return -1;
+
+            unsigned hi   = *--curs;
+            unsigned lo   = *--curs;
+            long     n    = (hi >> 4) + BLZ_THRESHOLD + 1;
+            long     dist = (((hi & 0x0F) << 8) | lo) + BLZ_MINDIST;
+            if (n > out - prefix) n = out - prefix;
+            if (out + dist > declen) return -1;
+
+            for (; n > 0; n--, out--) dst[out - 1] = dst[out - 1 + dist];
+        } else {
+            if (curs == stream) return -1;
+            dst[--out] = *--curs;
+        }
+    }
+
+    return declen;
+}
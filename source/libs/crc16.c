@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/crc16.h"
+
+#include <stdint.h>
+
+#include "libs/litend.h"
+#include "libs/strings.h"
+
+static uint16_t crctable[16] = {
+    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
+    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400,
+};
+
+uint16_t crc16(string data, uint16_t crc)
+{
+    const unsigned char *end = data.s + data.len;
+
+    uint16_t x = 0;
+    uint16_t y;
+    uint16_t bit = 0;
+    while (data.s < end) {
+        if (bit == 0) x = lehalf(data.s);
+
+        y     = crctable[crc & 15];
+        crc >>= 4;
+        crc  ^= y;
+        crc  ^= crctable[(x >> bit) & 15];
+        bit  += 4;
+
+        if (bit == 16) {
+            data.s += 2;
+            bit     = 0;
+        }
+    }
+
+    return crc;
+}
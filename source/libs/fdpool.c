@@ -0,0 +1,315 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/fdpool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libs/fileio.h"
+#include "libs/strings.h"
+
+#define MIN_CAPACITY 4
+
+typedef struct fdslot {
+    char     *path; // NUL-terminated copy of the leased path
+    long      len;
+    uint32_t  hash;
+    int       fd;
+    int       pins;
+    long long size;
+    int       prev; // neighbours in order of use, from most- to least-recent
+    int       next;
+} fdslot;
+
+struct fdpool {
+    int dirfd;
+    int capacity;
+    int nslots;
+    int head;   // most-recently used
+    int tail;   // least-recently used
+    int vacant; // slots emptied by `fdevict`, linked by `next`
+
+    fdslot *slots;
+    int    *index; // open-addressed table of slot numbers, keyed by path; -1 if empty
+    int     nbuckets;
+
+    long long nopens;
+    long long nhits;
+
+    pthread_mutex_t lock;
+};
+
+#define lockpool(__pool)   pthread_mutex_lock(&(__pool)->lock)
+#define unlockpool(__pool) pthread_mutex_unlock(&(__pool)->lock)
+
+static uint32_t hashpath(string path)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (long i = 0; i < path.len; i++) hash = (hash ^ path.s[i]) * 16777619u;
+    return hash;
+}
+
+static int defaultcap(void)
+{
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) != 0 || lim.rlim_cur == RLIM_INFINITY) return FDPOOL_MAXCAP;
+
+    // Leave most descriptors to the rest of the program (e.g., the output ROM and the cache).
+    rlim_t cap = lim.rlim_cur / 4;
+    return cap < MIN_CAPACITY ? MIN_CAPACITY : cap > FDPOOL_MAXCAP ? FDPOOL_MAXCAP : (int)cap;
+}
+
+fdpool *fdpoolnew(int capacity)
+{
+    int dirfd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return NULL;
+
+    fdpool *pool   = calloc(1, sizeof(*pool));
+    pool->dirfd    = dirfd;
+    pool->capacity = capacity > 0 ? capacity : defaultcap();
+    pool->head     = -1;
+    pool->tail     = -1;
+    pool->vacant   = -1;
+    pool->slots    = calloc(pool->capacity, sizeof(fdslot));
+
+    // Keep the table at most half-full, so that probes stay short.
+    for (pool->nbuckets = 1; pool->nbuckets < pool->capacity * 2; pool->nbuckets <<= 1);
+    pool->index = malloc(sizeof(int) * pool->nbuckets);
+    for (int i = 0; i < pool->nbuckets; i++) pool->index[i] = -1;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+void fdpooldel(fdpool *pool)
+{
+    if (!pool) return;
+
+    for (int i = 0; i < pool->nslots; i++) {
+        if (pool->slots[i].fd >= 0) close(pool->slots[i].fd);
+        free(pool->slots[i].path);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    close(pool->dirfd);
+    free(pool->slots);
+    free(pool->index);
+    free(pool);
+}
+
+// Returns the bucket which holds `path`, or the empty bucket where it would be inserted.
+static int findbucket(const fdpool *pool, const char *path, long len, uint32_t hash)
+{
+    int mask   = pool->nbuckets - 1;
+    int bucket = (int)(hash & mask);
+    for (; pool->index[bucket] >= 0; bucket = (bucket + 1) & mask) {
+        const fdslot *slot = &pool->slots[pool->index[bucket]];
+        if (slot->hash == hash && slot->len == len && memcmp(slot->path, path, len) == 0) break;
+    }
+
+    return bucket;
+}
+
+// Linear probing permits no tombstones; later members of the removed bucket's cluster are shifted
+// back into any gap which their probe would cross.
+static void unindex(fdpool *pool, int slotno)
+{
+    fdslot *slot   = &pool->slots[slotno];
+    int     mask   = pool->nbuckets - 1;
+    int     bucket = findbucket(pool, slot->path, slot->len, slot->hash);
+
+    pool->index[bucket] = -1;
+    for (int next = (bucket + 1) & mask; pool->index[next] >= 0; next = (next + 1) & mask) {
+        int home = (int)(pool->slots[pool->index[next]].hash & mask);
+        if (((next - home) & mask) >= ((next - bucket) & mask)) {
+            pool->index[bucket] = pool->index[next];
+            pool->index[next]   = -1;
+            bucket              = next;
+        }
+    }
+}
+
+static void detach(fdpool *pool, int slotno)
+{
+    fdslot *slot = &pool->slots[slotno];
+    if (slot->prev >= 0) pool->slots[slot->prev].next = slot->next;
+    else pool->head = slot->next;
+    if (slot->next >= 0) pool->slots[slot->next].prev = slot->prev;
+    else pool->tail = slot->prev;
+}
+
+static void pushfront(fdpool *pool, int slotno)
+{
+    fdslot *slot = &pool->slots[slotno];
+    slot->prev   = -1;
+    slot->next   = pool->head;
+    if (pool->head >= 0) pool->slots[pool->head].prev = slotno;
+    else pool->tail = slotno;
+    pool->head = slotno;
+}
+
+// Returns a free slot, closing the least-recently used descriptor which is not leased if the pool
+// is full, or -1 if every descriptor is leased.
+static int claimslot(fdpool *pool)
+{
+    if (pool->vacant >= 0) {
+        int slotno   = pool->vacant;
+        pool->vacant = pool->slots[slotno].next;
+        return slotno;
+    }
+
+    if (pool->nslots < pool->capacity) return pool->nslots++;
+
+    int victim = pool->tail;
+    for (; victim >= 0 && pool->slots[victim].pins > 0; victim = pool->slots[victim].prev);
+    if (victim < 0) return -1;
+
+    fdslot *slot = &pool->slots[victim];
+    unindex(pool, victim);
+    detach(pool, victim);
+    close(slot->fd);
+    free(slot->path);
+    return victim;
+}
+
+fdlease fdacquire(fdpool *pool, string path)
+{
+    uint32_t hash = hashpath(path);
+
+    lockpool(pool);
+    int bucket = findbucket(pool, (const char *)path.s, path.len, hash);
+    int slotno = pool->index[bucket];
+    if (slotno >= 0) {
+        fdslot *slot = &pool->slots[slotno];
+        slot->pins++;
+        pool->nhits++;
+        detach(pool, slotno);
+        pushfront(pool, slotno);
+        unlockpool(pool);
+        return (fdlease){ .fd = slot->fd, .slot = slotno, .size = slot->size };
+    }
+    unlockpool(pool);
+
+    // Files are opened outside of the lock, so that concurrent misses do not serialize.
+    char *cpath = malloc(path.len + 1);
+    memcpy(cpath, path.s, path.len);
+    cpath[path.len] = '\0';
+
+    struct stat st;
+    int         fd = fopenat(pool->dirfd, cpath);
+    if (fd >= 0 && (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode))) {
+        close(fd);
+        fd = -1;
+    }
+
+    if (fd < 0) {
+        free(cpath);
+        return (fdlease){ .fd = -1, .slot = -1, .size = -1 };
+    }
+
+    lockpool(pool);
+    pool->nopens++;
+
+    // Another thread may have opened the same file in the meantime.
+    bucket = findbucket(pool, cpath, path.len, hash);
+    if (pool->index[bucket] >= 0) {
+        slotno       = pool->index[bucket];
+        fdslot *slot = &pool->slots[slotno];
+        slot->pins++;
+        unlockpool(pool);
+
+        close(fd);
+        free(cpath);
+        return (fdlease){ .fd = slot->fd, .slot = slotno, .size = slot->size };
+    }
+
+    slotno = claimslot(pool);
+    if (slotno < 0) {
+        unlockpool(pool);
+        free(cpath);
+        return (fdlease){ .fd = fd, .slot = -1, .size = st.st_size };
+    }
+
+    fdslot *slot = &pool->slots[slotno];
+    *slot        = (fdslot){
+        .path = cpath,
+        .len  = path.len,
+        .hash = hash,
+        .fd   = fd,
+        .pins = 1,
+        .size = st.st_size,
+    };
+
+    pushfront(pool, slotno);
+    pool->index[findbucket(pool, cpath, path.len, hash)] = slotno;
+    unlockpool(pool);
+    return (fdlease){ .fd = fd, .slot = slotno, .size = st.st_size };
+}
+
+void fdrelease(fdpool *pool, fdlease lease)
+{
+    if (lease.fd < 0) return;
+    if (lease.slot < 0) {
+        close(lease.fd);
+        return;
+    }
+
+    lockpool(pool);
+    pool->slots[lease.slot].pins--;
+    unlockpool(pool);
+}
+
+void fdevict(fdpool *pool, string path)
+{
+    uint32_t hash = hashpath(path);
+
+    lockpool(pool);
+    int slotno = pool->index[findbucket(pool, (const char *)path.s, path.len, hash)];
+    if (slotno >= 0 && pool->slots[slotno].pins == 0) {
+        fdslot *slot = &pool->slots[slotno];
+        unindex(pool, slotno);
+        detach(pool, slotno);
+        close(slot->fd);
+        free(slot->path);
+
+        // Leases name their slot by number, so the gap is left in place for the next claim.
+        *slot        = (fdslot){ .fd = -1, .next = pool->vacant };
+        pool->vacant = slotno;
+    }
+    unlockpool(pool);
+}
+
+int fdread(int fd, void *buf, size_t size, uint64_t offset)
+{
+    unsigned char *curs = buf;
+    while (size > 0) {
+        ssize_t nread = pread(fd, curs, size, (off_t)offset);
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread <= 0) return -1;
+
+        curs   += nread;
+        size   -= nread;
+        offset += nread;
+    }
+
+    return 0;
+}
+
+long long fdpoolopens(const fdpool *pool)
+{
+    return pool->nopens;
+}
+
+long long fdpoolhits(const fdpool *pool)
+{
+    return pool->nhits;
+}
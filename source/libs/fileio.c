@@ -1,12 +1,48 @@
+#if defined(__linux__)
+#define _GNU_SOURCE // for copy_file_range
+#endif
+#define _POSIX_C_SOURCE 200809L
+
 #include "libs/fileio.h"
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define FILEIO_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#define FILEIO_COPYRANGE 1
+#endif
+
 #include "libs/strings.h"
 
+// Files may be opened from multiple threads at once (e.g., by `jobsrun` workers).
+static long long nopened;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define countopen() ((void)__atomic_add_fetch(&nopened, 1, __ATOMIC_RELAXED))
+#else
+#define countopen() ((void)nopened++)
+#endif
+
+long long fopened(void)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __atomic_load_n(&nopened, __ATOMIC_RELAXED);
+#else
+    return nopened;
+#endif
+}
+
 static inline long priv_fsize(FILE *infp)
 {
     fseek(infp, 0, SEEK_END);
@@ -27,6 +63,7 @@ string fload(const char *filename)
 {
     FILE *infp = fopen(filename, "rb");
     if (!infp) return string(NULL, -1);
+    countopen();
 
     long fsize = priv_fsize(infp);
     if (fsize < 0) {
@@ -45,10 +82,132 @@ string floads(const string filename)
     wrapsfn(fload);
 }
 
+#ifdef FILEIO_MMAP
+fview fmap(const char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return (fview){ .data = string(NULL, -1), .mapped = 0 };
+    countopen();
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return (fview){ .data = string(NULL, -1), .mapped = 0 };
+    }
+
+    // Anything but a regular file (e.g., a pipe) has no size up front, so it is read until its end.
+    if (!S_ISREG(st.st_mode)) {
+        FILE *stream = fdopen(fd, "rb");
+        if (!stream) {
+            close(fd);
+            return (fview){ .data = string(NULL, -1), .mapped = 0 };
+        }
+
+        fview view = fmapstream(stream);
+        fclose(stream);
+        return view;
+    }
+
+    // Zero-length mappings are invalid; an empty view needs no backing memory at all.
+    long fsize = (long)st.st_size;
+    if (fsize == 0) {
+        close(fd);
+        return (fview){ .data = stringZ, .mapped = 0 };
+    }
+
+    void *addr = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+        close(fd);
+        posix_madvise(addr, fsize, POSIX_MADV_SEQUENTIAL);
+        return (fview){ .data = string(addr, fsize), .mapped = 1 };
+    }
+
+    // Not every regular file can be mapped; fall back to reading it onto the heap.
+    unsigned char *buf  = malloc(fsize);
+    long           nget = 0;
+    while (buf && nget < fsize) {
+        ssize_t nread = read(fd, buf + nget, fsize - nget);
+        if (nread <= 0) break;
+        nget += nread;
+    }
+
+    close(fd);
+    if (!buf || nget != fsize) {
+        free(buf);
+        return (fview){ .data = string(NULL, -1), .mapped = 0 };
+    }
+
+    return (fview){ .data = string(buf, fsize), .mapped = 0 };
+}
+
+void funmap(fview view)
+{
+    if (view.mapped) munmap(view.data.s, view.data.len);
+    else free(view.data.s);
+}
+#else
+fview fmap(const char *filename)
+{
+    FILE *infp = fopen(filename, "rb");
+    if (!infp) return (fview){ .data = string(NULL, -1), .mapped = 0 };
+    countopen();
+
+    // Streams which cannot seek (e.g., pipes) have no size up front; read them until their end.
+    long fsize = priv_fsize(infp);
+    if (fsize < 0) {
+        fview view = fmapstream(infp);
+        fclose(infp);
+        return view;
+    }
+
+    string fcont = string(malloc(fsize > 0 ? fsize : 1), fsize);
+    fcont.len    = (long)fread(fcont.s, 1, fsize, infp);
+    fclose(infp);
+    return (fview){ .data = fcont, .mapped = 0 };
+}
+
+void funmap(fview view)
+{
+    free(view.data.s);
+}
+#endif
+
+fview fmaps(const string filename)
+{
+    wrapsfn(fmap);
+}
+
+fview fmapstream(FILE *stream)
+{
+    long           cap  = 1 << 16;
+    long           len  = 0;
+    unsigned char *buf  = malloc(cap);
+    size_t         nget = 0;
+
+    while (buf && (nget = fread(buf + len, 1, cap - len, stream)) > 0) {
+        len += (long)nget;
+        if (len == cap) {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (!grown) free(buf);
+
+            buf  = grown;
+            cap *= 2;
+        }
+    }
+
+    if (!buf || ferror(stream)) {
+        free(buf);
+        return (fview){ .data = string(NULL, -1), .mapped = 0 };
+    }
+
+    return (fview){ .data = string(buf, len), .mapped = 0 };
+}
+
 long fsize(const char *filename)
 {
     FILE *infp = fopen(filename, "rb");
     if (!infp) return -1;
+    countopen();
 
     long fsize = priv_fsize(infp);
 
@@ -61,10 +220,40 @@ long fsizes(const string filename)
     wrapsfn(fsize);
 }
 
+#ifdef FILEIO_MMAP
+stamp fstamp(const char *filename)
+{
+    struct stat st;
+    if (stat(filename, &st) < 0) return (stamp){ .size = -1, .mtime = 0, .mtimens = 0 };
+
+    stamp result = { .size = st.st_size, .mtime = 0, .mtimens = 0, .dir = S_ISDIR(st.st_mode) };
+#ifdef __APPLE__
+    result.mtime   = st.st_mtimespec.tv_sec;
+    result.mtimens = st.st_mtimespec.tv_nsec;
+#else
+    result.mtime   = st.st_mtim.tv_sec;
+    result.mtimens = st.st_mtim.tv_nsec;
+#endif
+    return result;
+}
+#else
+stamp fstamp(const char *filename)
+{
+    // Without a portable modification-time, fall back to size alone.
+    return (stamp){ .size = fsize(filename), .mtime = 0, .mtimens = 0 };
+}
+#endif
+
+stamp fstamps(const string filename)
+{
+    wrapsfn(fstamp);
+}
+
 file fprep(const char *filename)
 {
     FILE *infp = fopen(filename, "rb");
     if (!infp) return (file){ .hdl = NULL, .size = -1 };
+    countopen();
 
     long fsize = priv_fsize(infp);
     if (fsize < 0) {
@@ -80,11 +269,180 @@ file fpreps(const string filename)
     wrapsfn(fprep);
 }
 
+#ifdef FILEIO_MMAP
+int fopenat(int dirfd, const char *filename)
+{
+    int fd = openat(dirfd, filename, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) countopen();
+    return fd;
+}
+#else
+int fopenat(int dirfd, const char *filename)
+{
+    (void)dirfd;
+    (void)filename;
+    return -1; // descriptors are not portable
+}
+#endif
+
+#ifdef FILEIO_MMAP
+int fclone(int infd, long long offset, int outfd, long long size)
+{
+#ifdef FILEIO_COPYRANGE
+    // Whatever the kernel declines to copy (e.g., across filesystems) is copied by hand below.
+    loff_t inofs = offset;
+    while (size > 0) {
+        ssize_t ncopied = copy_file_range(infd, &inofs, outfd, NULL, size, 0);
+        if (ncopied < 0 && errno == EINTR) continue;
+        if (ncopied <= 0) break;
+        size -= ncopied;
+    }
+    offset = inofs;
+#endif
+
+    char buf[4096];
+    while (size > 0) {
+        size_t  chunk = size > (long long)sizeof(buf) ? sizeof(buf) : (size_t)size;
+        ssize_t nread = pread(infd, buf, chunk, (off_t)offset);
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread <= 0) return -1;
+
+        for (ssize_t nwritten = 0; nwritten < nread;) {
+            ssize_t n = write(outfd, buf + nwritten, nread - nwritten);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return -1;
+            nwritten += n;
+        }
+
+        offset += nread;
+        size   -= nread;
+    }
+
+    return 0;
+}
+#else
+int fclone(int infd, long long offset, int outfd, long long size)
+{
+    (void)infd;
+    (void)offset;
+    (void)outfd;
+    (void)size;
+    return -1; // descriptors are not portable
+}
+#endif
+
 void fdump(const char *filename, const void *buf, const long bufsize)
 {
     FILE *outfp = fopen(filename, "wb");
     if (!outfp) return;
+    countopen();
 
     fwrite(buf, 1, bufsize, outfp);
     fclose(outfp);
 }
+
+#ifdef FILEIO_MMAP
+// The umask can only be read by replacing it, so it is read once, by whichever caller is first.
+static mode_t priv_umask(void)
+{
+    static mode_t mask;
+#if defined(__GNUC__) || defined(__clang__)
+    static int state; // 0: unread; 1: being read; 2: read
+    int        unread = 0;
+    if (__atomic_compare_exchange_n(&state, &unread, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        mask = umask(0);
+        umask(mask);
+        __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+    }
+
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2);
+#else
+    static int read;
+    if (!read) {
+        mask = umask(0);
+        umask(mask);
+        read = 1;
+    }
+#endif
+
+    return mask;
+}
+
+FILE *fstage(const char *filename, char **stagename)
+{
+    long  namelen = (long)strlen(filename);
+    char *tmpname = malloc(namelen + lengthof(".XXXXXX") + 1);
+    memcpy(tmpname, filename, namelen);
+    memcpy(tmpname + namelen, ".XXXXXX", lengthof(".XXXXXX") + 1);
+
+    int fd = mkstemp(tmpname);
+    if (fd < 0) {
+        free(tmpname);
+        return NULL;
+    }
+    countopen();
+
+    // `mkstemp` creates files which only their owner may read; staged files are instead created as
+    // any other would be, so that they may be shared (e.g., by a cache directory).
+    FILE *outfp = fchmod(fd, 0666 & ~priv_umask()) == 0 ? fdopen(fd, "wb") : NULL;
+    if (!outfp) {
+        close(fd);
+        unlink(tmpname);
+        free(tmpname);
+        return NULL;
+    }
+
+    *stagename = tmpname;
+    return outfp;
+}
+
+int fcommit(char *stagename, const char *filename)
+{
+    int err = filename == NULL || rename(stagename, filename) != 0;
+    if (err) unlink(stagename);
+    free(stagename);
+    return filename != NULL && err ? -1 : 0;
+}
+
+int fmkdir(const char *dirname)
+{
+    if (mkdir(dirname, 0777) == 0) return 0;
+    return errno == EEXIST && fstamp(dirname).dir ? 0 : -1;
+}
+#else
+FILE *fstage(const char *filename, char **stagename)
+{
+    // Without `mkstemp`, fall back to writing in-place.
+    FILE *outfp = fopen(filename, "wb");
+    if (outfp) countopen();
+
+    *stagename = NULL;
+    return outfp;
+}
+
+int fcommit(char *stagename, const char *filename)
+{
+    (void)stagename;
+    (void)filename;
+    return 0;
+}
+
+int fmkdir(const char *dirname)
+{
+    // Without a portable means of creating directories, the directory must already exist.
+    FILE *probe = fopen(dirname, "rb");
+    if (probe) fclose(probe);
+    return probe ? 0 : -1;
+}
+#endif
+
+int fstore(const char *filename, const void *buf, const long bufsize)
+{
+    char *stagename = NULL;
+    FILE *outfp     = fstage(filename, &stagename);
+    if (!outfp) return -1;
+
+    long written = (long)fwrite(buf, 1, bufsize, outfp);
+    int  err     = fclose(outfp) != 0 || written != bufsize;
+    return fcommit(stagename, err ? NULL : filename) != 0 || err ? -1 : 0;
+}
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/jobs.h"
+
+#include <stdlib.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define JOBS_PTHREAD 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAX_WORKERS 64
+
+typedef struct jobqueue {
+    jobfn fn;
+    void *user;
+    long  njobs;
+    long  next;
+
+#ifdef JOBS_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} jobqueue;
+
+static long claim(jobqueue *queue)
+{
+#ifdef JOBS_PTHREAD
+    pthread_mutex_lock(&queue->lock);
+    long job = queue->next < queue->njobs ? queue->next++ : -1;
+    pthread_mutex_unlock(&queue->lock);
+#else
+    long job = queue->next < queue->njobs ? queue->next++ : -1;
+#endif
+    return job;
+}
+
+static void *work(void *arg)
+{
+    jobqueue *queue = arg;
+    for (long job = claim(queue); job >= 0; job = claim(queue)) queue->fn(queue->user, job);
+    return NULL;
+}
+
+int jobsdefault(void)
+{
+#ifdef JOBS_PTHREAD
+    long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nprocs > MAX_WORKERS) return MAX_WORKERS;
+    if (nprocs > 0) return (int)nprocs;
+#endif
+    return 1;
+}
+
+void jobsrun(int nworkers, long njobs, jobfn fn, void *user)
+{
+    if (njobs <= 0) return;
+    if (nworkers < 1) nworkers = jobsdefault();
+    if (nworkers > MAX_WORKERS) nworkers = MAX_WORKERS;
+    if (nworkers > njobs) nworkers = (int)njobs;
+
+    jobqueue queue = { .fn = fn, .user = user, .njobs = njobs, .next = 0 };
+
+#ifdef JOBS_PTHREAD
+    pthread_t threads[MAX_WORKERS];
+    int       nthreads = 0;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    for (; nthreads < nworkers - 1; nthreads++) {
+        if (pthread_create(&threads[nthreads], NULL, work, &queue) != 0) break;
+    }
+
+    work(&queue);
+    for (int i = 0; i < nthreads; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+#else
+    (void)nworkers;
+    work(&queue);
+#endif
+}
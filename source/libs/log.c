@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LOG_POSIX 1
+#include <unistd.h>
+#endif
+
+#define MAX_MSGLEN 1024 // longer messages are formatted into a heap buffer
+
+static const char *levelnames[] = {
+    [L_error] = "error",
+    [L_warn]  = "warn",
+    [L_info]  = "info",
+    [L_debug] = "debug",
+};
+
+static void putstring(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04X", c);
+        else fputc(c, out);
+    }
+
+    fputc('"', out);
+}
+
+logger *logopen(FILE *stream, enum loglevel level, enum logformat format)
+{
+    logger *logger = calloc(1, sizeof(*logger));
+    if (!logger) return NULL;
+
+#ifdef LOG_POSIX
+    int fd = dup(fileno(stream));
+    logger->out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!logger->out) {
+        if (fd >= 0) close(fd);
+        free(logger);
+        return NULL;
+    }
+
+    setvbuf(logger->out, NULL, _IOFBF, LOG_BUFSIZE);
+#else
+    logger->out = stream; // no portable way to buffer a duplicate; write through the stream
+#endif
+
+    logger->level  = level;
+    logger->format = format;
+    return logger;
+}
+
+int logclose(logger *logger)
+{
+    int err = fflush(logger->out) != 0 || ferror(logger->out) != 0;
+
+#ifdef LOG_POSIX
+    err = fclose(logger->out) != 0 || err;
+#endif
+
+    free(logger);
+    return err ? -1 : 0;
+}
+
+void logput(logger *logger, enum loglevel level, const char *scope, const char *fmt, ...)
+{
+    char    buf[MAX_MSGLEN];
+    char   *msg = buf;
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(buf) && (msg = malloc((size_t)len + 1)) != NULL) {
+        va_start(args, fmt);
+        vsnprintf(msg, (size_t)len + 1, fmt, args);
+        va_end(args);
+    }
+
+    if (!msg) msg = buf; // truncated, but better than nothing
+
+#ifdef LOG_POSIX
+    flockfile(logger->out);
+#endif
+
+    if (logger->format == L_json) {
+        fprintf(logger->out, "{\"level\":\"%s\",\"scope\":", levelnames[level]);
+        putstring(logger->out, scope);
+        fputs(",\"message\":", logger->out);
+        putstring(logger->out, msg);
+        fputs("}\n", logger->out);
+    } else {
+        fprintf(logger->out, "%s: %s\n", scope, msg);
+    }
+
+#ifdef LOG_POSIX
+    funlockfile(logger->out);
+#endif
+
+    if (msg != buf) free(msg);
+}
+
+int loglevelof(const char *name)
+{
+    for (int i = L_error; i <= L_debug; i++) {
+        if (strcmp(name, levelnames[i]) == 0) return i;
+    }
+
+    return -1;
+}
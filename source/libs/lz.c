@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/lz.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libs/litend.h"
+
+#define LZ_THRESHOLD 2      // back-references must be longer than this
+#define LZ_MINDISP   2      // see lz.h
+#define LZ_MAXDISP   0x1000 // 12-bit field, offset by 1
+#define LZ10_MAXLEN  0x12   // 4-bit field, offset by 3
+
+#define LZ11_MAXLEN2 0x10    // 4-bit field, offset by 1; values of 0 and 1 select longer tokens
+#define LZ11_MAXLEN3 0x110   // 8-bit field, offset by 0x11
+#define LZ11_MAXLEN4 0x10110 // 16-bit field, offset by 0x111
+
+// The search for a longer match stops once it finds one of at least this length, which bounds the
+// cost of long runs for LZ11 without affecting LZ10 at all.
+#define LZ_NICELEN 0x400
+
+#define HASH_BITS 15
+#define HASH_SIZE (1 << HASH_BITS)
+
+static inline uint32_t hash3(const unsigned char *p)
+{
+    uint32_t key = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (key * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static long puttoken(unsigned char *dst, enum lzformat format, long len, long disp)
+{
+    disp -= 1;
+    if (format == LZ_FORMAT_LZ10) {
+        dst[0] = ((len - 3) << 4) | (disp >> 8);
+        dst[1] = disp & 0xFF;
+        return 2;
+    }
+
+    if (len <= LZ11_MAXLEN2) {
+        dst[0] = ((len - 1) << 4) | (disp >> 8);
+        dst[1] = disp & 0xFF;
+        return 2;
+    }
+
+    if (len <= LZ11_MAXLEN3) {
+        len    -= LZ11_MAXLEN2 + 1;
+        dst[0]  = len >> 4;
+        dst[1]  = ((len & 0x0F) << 4) | (disp >> 8);
+        dst[2]  = disp & 0xFF;
+        return 3;
+    }
+
+    len    -= LZ11_MAXLEN3 + 1;
+    dst[0]  = 0x10 | (len >> 12);
+    dst[1]  = (len >> 4) & 0xFF;
+    dst[2]  = ((len & 0x0F) << 4) | (disp >> 8);
+    dst[3]  = disp & 0xFF;
+    return 4;
+}
+
+// Previous occurrences of each 3-byte sequence are chained together, nearest first, so that the
+// longest match at the smallest displacement is found without a full window scan.
+long lzencode(const unsigned char *src, long len, enum lzformat format, unsigned char *dst)
+{
+    if (len < 0 || len > (long)UINT32_MAX) return -1;
+    if (format == LZ_FORMAT_LZ10 && len > LZ_MAXSIZE_LZ10) return -1;
+
+    long outlen = 4;
+    if (format == LZ_FORMAT_LZ11 && (len == 0 || len > LZ_MAXSIZE_LZ10)) {
+        putleword(dst, (uint32_t)format);
+        putleword(dst + 4, (uint32_t)len);
+        outlen = 8;
+    } else {
+        putleword(dst, (uint32_t)format | ((uint32_t)len << 8));
+    }
+
+    long     maxlen = format == LZ_FORMAT_LZ10 ? LZ10_MAXLEN : LZ11_MAXLEN4;
+    int32_t *head   = malloc(sizeof(int32_t) * HASH_SIZE);
+    int32_t *prev   = malloc(sizeof(int32_t) * (len + 1));
+    for (long i = 0; i < HASH_SIZE; i++) head[i] = -1;
+
+    long     flagpos = 0;
+    unsigned mask    = 0;
+    for (long r = 0, indexed = 0; r < len;) {
+        if ((mask >>= 1) == 0) {
+            flagpos       = outlen;
+            dst[outlen++] = 0;
+            mask          = 0x80;
+        }
+
+        for (; indexed < r && indexed + LZ_THRESHOLD < len; indexed++) {
+            uint32_t h    = hash3(src + indexed);
+            prev[indexed] = head[h];
+            head[h]       = (int32_t)indexed;
+        }
+
+        long limit    = len - r < maxlen ? len - r : maxlen;
+        long bestlen  = LZ_THRESHOLD;
+        long bestdisp = 0;
+        if (limit > LZ_THRESHOLD) {
+            for (int32_t q = head[hash3(src + r)]; q >= 0; q = prev[q]) {
+                long disp = r - q;
+                if (disp < LZ_MINDISP) continue;
+                if (disp > LZ_MAXDISP) break;
+
+                // Back-references may overlap the bytes that they produce.
+                long n = 0;
+                while (n < limit && src[r + n] == src[q + n]) n++;
+                if (n > bestlen) {
+                    bestlen  = n;
+                    bestdisp = disp;
+                    if (n == limit || n >= LZ_NICELEN) break;
+                }
+            }
+        }
+
+        if (bestlen > LZ_THRESHOLD) {
+            dst[flagpos] |= mask;
+            outlen       += puttoken(dst + outlen, format, bestlen, bestdisp);
+            r            += bestlen;
+        } else {
+            dst[outlen++] = src[r++];
+        }
+    }
+
+    while (outlen % 4 != 0) dst[outlen++] = 0;
+
+    free(head);
+    free(prev);
+    return outlen;
+}
+
+static long headersize(const unsigned char *src, long len)
+{
+    if (len < 4 || (src[0] != LZ_FORMAT_LZ10 && src[0] != LZ_FORMAT_LZ11)) return -1;
+    if (src[0] == LZ_FORMAT_LZ11 && (leword((unsigned char *)src) >> 8) == 0) {
+        return len < 8 ? -1 : 8;
+    }
+
+    return 4;
+}
+
+long lzdecsize(const unsigned char *src, long len)
+{
+    long hdrlen = headersize(src, len);
+    if (hdrlen < 0) return -1;
+
+    return hdrlen == 8 ? (long)leword((unsigned char *)src + 4)
+                       : (long)(leword((unsigned char *)src) >> 8);
+}
+
+long lzdecode(const unsigned char *src, long len, unsigned char *dst)
+{
+    long declen = lzdecsize(src, len);
+    if (declen < 0) return -1;
+
+    enum lzformat        format = src[0];
+    const unsigned char *curs   = src + headersize(src, len);
+    const unsigned char *end    = src + len;
+
+    long     out   = 0;
+    unsigned flags = 0;
+    unsigned mask  = 0;
+    while (out < declen) {
+        if ((mask >>= 1) == 0) {
+            if (curs == end) return -1;
+            flags = *curs++;
+            mask  = 0x80;
+        }
+
+        if (!(flags & mask)) {
+            if (curs == end) return -1;
+            dst[out++] = *curs++;
+            continue;
+        }
+
+        if (curs == end) return -1;
+
+        long n    = 0;
+        long disp = 0;
+        long size = format == LZ_FORMAT_LZ10 || (*curs >> 4) > 1 ? 2 : (*curs >> 4) + 3;
+        if (end - curs < size) return -1;
+
+        if (format == LZ_FORMAT_LZ10) {
+            n = (curs[0] >> 4) + LZ_THRESHOLD + 1;
+        } else if (size == 2) {
+            n = (curs[0] >> 4) + 1;
+        } else if (size == 3) {
+            n = (((curs[0] & 0x0F) << 4) | (curs[1] >> 4)) + LZ11_MAXLEN2 + 1;
+        } else {
+            n = (((curs[0] & 0x0F) << 12) | (curs[1] << 4) | (curs[2] >> 4)) + LZ11_MAXLEN3 + 1;
+        }
+
+        disp  = (((curs[size - 2] & 0x0F) << 8) | curs[size - 1]) + 1;
+        curs += size;
+        if (disp > out) return -1;
+        if (n > declen - out) n = declen - out;
+
+        for (; n > 0; n--, out++) dst[out] = dst[out - disp];
+    }
+
+    return declen;
+}
@@ -0,0 +1,123 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/meter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "libs/fileio.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define METER_POSIX 1
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifdef METER_POSIX
+static double seconds(clockid_t clock)
+{
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) != 0) return 0;
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+#endif
+
+#ifdef __linux__
+// Bytes and syscalls consumed by reading the counters themselves, which are excluded from samples.
+static long long selfread;
+static long long selfcalls;
+#endif
+
+// Only Linux exposes per-process I/O counters, as lines of "key: value" in /proc/self/io. They are
+// read with a single syscall, which the counters do not yet include.
+static void readio(meter *sample)
+{
+#ifdef __linux__
+    int fd = open("/proc/self/io", O_RDONLY);
+    if (fd < 0) return;
+
+    char    buf[512];
+    ssize_t len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) return;
+
+    long long rchar = -1;
+    long long wchar = -1;
+    long long syscr = -1;
+    long long syscw = -1;
+    buf[len]        = '\0';
+    for (char *line = buf; line; line = strchr(line, '\n')) {
+        line += *line == '\n';
+        sscanf(line, "rchar: %lld", &rchar);
+        sscanf(line, "wchar: %lld", &wchar);
+        sscanf(line, "syscr: %lld", &syscr);
+        sscanf(line, "syscw: %lld", &syscw);
+    }
+
+    if (rchar >= 0) sample->nread = rchar - __atomic_fetch_add(&selfread, len, __ATOMIC_RELAXED);
+    if (wchar >= 0) sample->nwritten = wchar;
+    if (syscr >= 0 && syscw >= 0) {
+        sample->nsyscalls = syscr + syscw - __atomic_fetch_add(&selfcalls, 1, __ATOMIC_RELAXED);
+    }
+#else
+    (void)sample;
+#endif
+}
+
+meter meterread(enum meterscope scope)
+{
+    meter sample = {
+        .nread     = -1,
+        .nwritten  = -1,
+        .nsyscalls = -1,
+        .nopened   = fopened(),
+        .maxrss    = -1,
+    };
+
+#ifdef METER_POSIX
+    sample.wall = seconds(CLOCK_MONOTONIC);
+    sample.cpu  = seconds(CLOCK_PROCESS_CPUTIME_ID);
+#else
+    sample.wall = (double)time(NULL);
+    sample.cpu  = (double)clock() / CLOCKS_PER_SEC;
+#endif
+
+    if (scope == M_clock) return sample;
+
+    readio(&sample);
+
+#ifdef METER_POSIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        sample.maxrss = usage.ru_maxrss / 1024; // reported in bytes, rather than KiB
+#else
+        sample.maxrss = usage.ru_maxrss;
+#endif
+    }
+#endif
+
+    return sample;
+}
+
+#define addcounter(__field)                                                       \
+    total->__field = (total->__field < 0 || start.__field < 0 || end.__field < 0) \
+                       ? -1                                                       \
+                       : total->__field + (end.__field - start.__field)
+
+void meteradd(meter *total, meter start, meter end)
+{
+    total->wall += end.wall - start.wall;
+    total->cpu  += end.cpu - start.cpu;
+    addcounter(nread);
+    addcounter(nwritten);
+    addcounter(nsyscalls);
+    addcounter(nopened);
+
+    if (total->count == 0 || end.maxrss > total->maxrss) total->maxrss = end.maxrss;
+    total->count++;
+}
@@ -0,0 +1,392 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/romreader.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/fileio.h"
+#include "libs/litend.h"
+#include "libs/strings.h"
+
+#define MIN_HEADER_BSIZE  0x200
+#define OVT_ENTRY_BSIZE   0x20
+#define MAX_OVERLAYID     0xFFFF
+#define MAX_PATH_BSIZE    4096
+#define MAX_DIR_DEPTH     128
+#define NO_FILE           UINT32_MAX
+#define ARM9_FOOTER       0xDEC00621
+#define ARM9_FOOTER_BSIZE 12
+
+#define OFS_ARM9_ROMOFFSET   0x020
+#define OFS_ARM9_LOADSIZE    0x02C
+#define OFS_ARM7_ROMOFFSET   0x030
+#define OFS_ARM7_LOADSIZE    0x03C
+#define OFS_FNTB_ROMOFFSET   0x040
+#define OFS_FNTB_BSIZE       0x044
+#define OFS_FATB_ROMOFFSET   0x048
+#define OFS_FATB_BSIZE       0x04C
+#define OFS_OVT9_ROMOFFSET   0x050
+#define OFS_OVT9_BSIZE       0x054
+#define OFS_OVT7_ROMOFFSET   0x058
+#define OFS_OVT7_BSIZE       0x05C
+#define OFS_BANNER_ROMOFFSET 0x068
+#define OFS_HEADERSIZE       0x084
+#define OFS_OVT_FILEID       0x018
+
+// clang-format off
+static const struct { int ofs; int sizeofs; } sectionfields[NUM_ROMSECTIONS] = {
+    [K_romsection_header] = { .ofs = -1,                   .sizeofs = OFS_HEADERSIZE    },
+    [K_romsection_arm9]   = { .ofs = OFS_ARM9_ROMOFFSET,   .sizeofs = OFS_ARM9_LOADSIZE },
+    [K_romsection_ovt9]   = { .ofs = OFS_OVT9_ROMOFFSET,   .sizeofs = OFS_OVT9_BSIZE    },
+    [K_romsection_arm7]   = { .ofs = OFS_ARM7_ROMOFFSET,   .sizeofs = OFS_ARM7_LOADSIZE },
+    [K_romsection_ovt7]   = { .ofs = OFS_OVT7_ROMOFFSET,   .sizeofs = OFS_OVT7_BSIZE    },
+    [K_romsection_fntb]   = { .ofs = OFS_FNTB_ROMOFFSET,   .sizeofs = OFS_FNTB_BSIZE    },
+    [K_romsection_fatb]   = { .ofs = OFS_FATB_ROMOFFSET,   .sizeofs = OFS_FATB_BSIZE    },
+    [K_romsection_banner] = { .ofs = OFS_BANNER_ROMOFFSET, .sizeofs = -1                },
+};
+
+static const struct { uint16_t version; uint32_t size; } bannersizes[] = {
+    { .version = 0x0001, .size = 0x0840 },
+    { .version = 0x0002, .size = 0x0940 },
+    { .version = 0x0003, .size = 0x1240 },
+    { .version = 0x0103, .size = 0x23C0 }, // DSi-enhanced, with an animated icon
+    { .version = 0,      .size = 0      },
+};
+// clang-format on
+
+typedef struct pathname {
+    uint32_t ofs; // within `romreader.names`
+    uint32_t len; // 0 for members which the FNTB does not name
+} pathname;
+
+typedef struct ovyindex {
+    uint32_t *fileids; // indexed by overlay ID; NO_FILE if the table has no such overlay
+    uint32_t  len;
+} ovyindex;
+
+struct romreader {
+    string   rom;
+    fview    view; // backs `rom` if the reader mapped it; otherwise, `view.data.len` is -1
+    romrange sections[NUM_ROMSECTIONS];
+    uint32_t nfiles;
+
+    // built by the first lookup which needs them; `builterr` records a malformed FNTB
+    pathname      *paths; // indexed by file ID
+    char          *names;
+    uint32_t       nameslen;
+    uint32_t       namescap;
+    uint32_t      *buckets; // open-addressed table of file IDs, keyed by path; NO_FILE if empty
+    uint32_t       nbuckets;
+    romreaderr     builterr;
+    ovyindex       ovys[2]; // for the overlay tables of the ARM9 and the ARM7
+    unsigned char *fatb;
+};
+
+static uint32_t hashpath(string path)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (long i = 0; i < path.len; i++) hash = (hash ^ path.s[i]) * 16777619u;
+    return hash;
+}
+
+static int inbounds(string rom, romrange range)
+{
+    return range.start <= range.end && (uint64_t)range.end <= (uint64_t)rom.len;
+}
+
+static uint32_t bannersize(string rom, uint32_t offset)
+{
+    if (offset == 0 || (uint64_t)offset + 2 > (uint64_t)rom.len) return 0;
+
+    uint16_t version = lehalf(rom.s + offset);
+    int      i       = 0;
+    for (; bannersizes[i].size != 0 && bannersizes[i].version != version; i++);
+    return bannersizes[i].size;
+}
+
+static romreaderr checkrom(romreader *reader)
+{
+    string rom = reader->rom;
+    if (rom.len < MIN_HEADER_BSIZE) return E_romreader_truncated;
+
+    // Sizes are added in 64 bits, so that a section cannot wrap around to lie within the ROM.
+    romrange *sects = reader->sections;
+    for (int i = 0; i < NUM_ROMSECTIONS; i++) {
+        uint64_t start = sectionfields[i].ofs >= 0 ? leword(rom.s + sectionfields[i].ofs) : 0;
+        uint64_t size  = sectionfields[i].sizeofs >= 0 ? leword(rom.s + sectionfields[i].sizeofs)
+                                                       : bannersize(rom, start);
+        if (start + size > (uint64_t)rom.len) return E_romreader_truncated;
+
+        sects[i] = (romrange){ .start = start, .end = start + size };
+    }
+
+    romrange *arm9 = &sects[K_romsection_arm9];
+    if ((uint64_t)arm9->end + ARM9_FOOTER_BSIZE <= (uint64_t)rom.len
+        && leword(rom.s + arm9->end) == ARM9_FOOTER) {
+        arm9->end += ARM9_FOOTER_BSIZE;
+    }
+
+    reader->fatb   = rom.s + sects[K_romsection_fatb].start;
+    reader->nfiles = (sects[K_romsection_fatb].end - sects[K_romsection_fatb].start) / 8;
+    for (uint32_t i = 0; i < reader->nfiles; i++) {
+        if (!inbounds(rom, romfatb(reader, i))) return E_romreader_badfatb;
+    }
+
+    return E_romreader_none;
+}
+
+romreader *romopenbuf(string rom, romreaderr *err)
+{
+    romreader *reader     = calloc(1, sizeof(*reader));
+    reader->rom           = rom;
+    reader->view.data.len = -1;
+
+    romreaderr result = checkrom(reader);
+    if (err) *err = result;
+    if (result == E_romreader_none) return reader;
+
+    free(reader);
+    return NULL;
+}
+
+romreader *romopen(const char *filename, romreaderr *err)
+{
+    fview view = fmap(filename);
+    if (view.data.len < 0) {
+        if (err) *err = E_romreader_missing;
+        return NULL;
+    }
+
+    romreader *reader = romopenbuf(view.data, err);
+    if (!reader) funmap(view);
+    else reader->view = view;
+
+    return reader;
+}
+
+void romclose(romreader *reader)
+{
+    if (!reader) return;
+    if (reader->view.data.len >= 0) funmap(reader->view);
+
+    free(reader->paths);
+    free(reader->names);
+    free(reader->buckets);
+    free(reader->ovys[0].fileids);
+    free(reader->ovys[1].fileids);
+    free(reader);
+}
+
+romrange romsection(const romreader *reader, enum romsection section)
+{
+    return reader->sections[section];
+}
+
+uint32_t romnfiles(const romreader *reader)
+{
+    return reader->nfiles;
+}
+
+romrange romfatb(const romreader *reader, uint32_t fileid)
+{
+    if (fileid >= reader->nfiles) return (romrange){ 0 };
+
+    unsigned char *entry = reader->fatb + (8 * (uint64_t)fileid);
+    return (romrange){ .start = leword(entry), .end = leword(entry + 4) };
+}
+
+string rombytes(const romreader *reader, romrange range)
+{
+    return string(reader->rom.s + range.start, range.end - range.start);
+}
+
+typedef struct walker {
+    romreader     *reader;
+    unsigned char *fntb;
+    uint32_t       fntbsize;
+    char           path[MAX_PATH_BSIZE];
+} walker;
+
+static void addname(romreader *reader, uint32_t fileid, const char *path, uint32_t len)
+{
+    if (reader->nameslen + len > reader->namescap) {
+        while (reader->nameslen + len > reader->namescap) reader->namescap *= 2;
+        reader->names = realloc(reader->names, reader->namescap);
+    }
+
+    memcpy(reader->names + reader->nameslen, path, len);
+
+    reader->paths[fileid].ofs  = reader->nameslen;
+    reader->paths[fileid].len  = len;
+    reader->nameslen          += len;
+}
+
+// Each directory lists its members in order of their file IDs, starting from the ID in its entry
+// of the FNTB's directory table.
+static romreaderr walkdir(walker *w, uint32_t dirid, uint32_t pathlen, int depth)
+{
+    if (depth > MAX_DIR_DEPTH || ((uint64_t)dirid + 1) * 8 > w->fntbsize) {
+        return E_romreader_badfntb;
+    }
+
+    unsigned char *entry  = w->fntb + (8 * dirid);
+    uint32_t       curs   = leword(entry);
+    uint32_t       fileid = lehalf(entry + 4);
+    while (curs < w->fntbsize && w->fntb[curs] != 0) {
+        unsigned char head    = w->fntb[curs++];
+        uint32_t      namelen = head & 0x7F;
+        if (curs + namelen > w->fntbsize || pathlen + namelen + 1 >= MAX_PATH_BSIZE) {
+            return E_romreader_badfntb;
+        }
+
+        memcpy(w->path + pathlen, w->fntb + curs, namelen);
+        curs += namelen;
+
+        if (head & 0x80) {
+            if (curs + 2 > w->fntbsize) return E_romreader_badfntb;
+
+            uint32_t subdir = lehalf(w->fntb + curs) & 0x0FFF;
+            curs           += 2;
+
+            w->path[pathlen + namelen] = '/';
+            romreaderr err             = walkdir(w, subdir, pathlen + namelen + 1, depth + 1);
+            if (err != E_romreader_none) return err;
+        } else {
+            if (fileid >= w->reader->nfiles) return E_romreader_badfntb;
+            if (w->reader->paths[fileid].len == 0) {
+                addname(w->reader, fileid, w->path, pathlen + namelen);
+            }
+
+            fileid++;
+        }
+    }
+
+    return curs < w->fntbsize ? E_romreader_none : E_romreader_badfntb;
+}
+
+static string nameof(const romreader *reader, uint32_t fileid)
+{
+    pathname name = reader->paths[fileid];
+    return string(reader->names + name.ofs, name.len);
+}
+
+// Each named member is inserted once; the table is at most half full, so that probes stay short.
+static void indexpaths(romreader *reader)
+{
+    uint32_t nbuckets = 16;
+    while (nbuckets < 2 * (uint64_t)reader->nfiles) nbuckets <<= 1;
+
+    reader->nbuckets = nbuckets;
+    reader->buckets  = malloc(sizeof(uint32_t) * nbuckets);
+    memset(reader->buckets, 0xFF, sizeof(uint32_t) * nbuckets);
+
+    for (uint32_t i = 0; i < reader->nfiles; i++) {
+        if (reader->paths[i].len == 0) continue;
+
+        uint32_t bucket = hashpath(nameof(reader, i)) & (nbuckets - 1);
+        while (reader->buckets[bucket] != NO_FILE) bucket = (bucket + 1) & (nbuckets - 1);
+        reader->buckets[bucket] = i;
+    }
+}
+
+static romreaderr buildpaths(romreader *reader)
+{
+    if (reader->paths || reader->builterr != E_romreader_none) return reader->builterr;
+
+    romrange fntb = reader->sections[K_romsection_fntb];
+    reader->paths    = calloc(reader->nfiles + 1, sizeof(pathname));
+    reader->namescap = 4096;
+    reader->names    = malloc(reader->namescap);
+
+    walker *w   = malloc(sizeof(*w));
+    w->reader   = reader;
+    w->fntb     = reader->rom.s + fntb.start;
+    w->fntbsize = fntb.end - fntb.start;
+
+    reader->builterr = walkdir(w, 0, 0, 0);
+    free(w);
+    if (reader->builterr == E_romreader_none) indexpaths(reader);
+
+    return reader->builterr;
+}
+
+romreaderr romfind(romreader *reader, string path, uint32_t *fileid)
+{
+    romreaderr err = buildpaths(reader);
+    if (err != E_romreader_none) return err;
+
+    if (path.len > 0 && path.s[0] == '/') {
+        path.s++;
+        path.len--;
+    }
+
+    uint32_t mask = reader->nbuckets - 1;
+    for (uint32_t bucket = hashpath(path) & mask; reader->buckets[bucket] != NO_FILE;
+         bucket = (bucket + 1) & mask) {
+        uint32_t candidate = reader->buckets[bucket];
+        if (strequ(nameof(reader, candidate), path)) {
+            *fileid = candidate;
+            return E_romreader_none;
+        }
+    }
+
+    return E_romreader_notfound;
+}
+
+romreaderr rompath(romreader *reader, uint32_t fileid, string *path)
+{
+    romreaderr err = buildpaths(reader);
+    if (err != E_romreader_none) return err;
+    if (fileid >= reader->nfiles || reader->paths[fileid].len == 0) return E_romreader_notfound;
+
+    *path = nameof(reader, fileid);
+    return E_romreader_none;
+}
+
+static romreaderr indexovys(romreader *reader, ovyindex *index, romrange ovt)
+{
+    uint32_t       novys   = (ovt.end - ovt.start) / OVT_ENTRY_BSIZE;
+    unsigned char *entries = reader->rom.s + ovt.start;
+
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < novys; i++) {
+        uint32_t ovyid = leword(entries + (i * OVT_ENTRY_BSIZE));
+        if (ovyid > MAX_OVERLAYID) return E_romreader_badovt;
+        if (ovyid + 1 > len) len = ovyid + 1;
+    }
+
+    uint32_t *fileids = malloc(sizeof(uint32_t) * (len + 1));
+    memset(fileids, 0xFF, sizeof(uint32_t) * (len + 1));
+    for (uint32_t i = 0; i < novys; i++) {
+        unsigned char *entry  = entries + (i * OVT_ENTRY_BSIZE);
+        uint32_t       fileid = leword(entry + OFS_OVT_FILEID);
+        if (fileid >= reader->nfiles) {
+            free(fileids);
+            return E_romreader_badovt;
+        }
+
+        fileids[leword(entry)] = fileid;
+    }
+
+    index->fileids = fileids;
+    index->len     = len;
+    return E_romreader_none;
+}
+
+romreaderr romoverlay(romreader *reader, enum romsection ovt, uint32_t ovyid, uint32_t *fileid)
+{
+    if (ovt != K_romsection_ovt9 && ovt != K_romsection_ovt7) return E_romreader_notfound;
+
+    ovyindex *index = &reader->ovys[ovt == K_romsection_ovt7];
+    if (!index->fileids) {
+        romreaderr err = indexovys(reader, index, reader->sections[ovt]);
+        if (err != E_romreader_none) return err;
+    }
+
+    if (ovyid >= index->len || index->fileids[ovyid] == NO_FILE) return E_romreader_notfound;
+
+    *fileid = index->fileids[ovyid];
+    return E_romreader_none;
+}
@@ -0,0 +1,170 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/sha1.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define rotl(__x, __n) (((__x) << (__n)) | ((__x) >> (32 - (__n))))
+
+static inline uint32_t bigword(const unsigned char *src)
+{
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+static void compress(uint32_t state[5], const unsigned char *block)
+{
+    uint32_t w[80];
+    for (int i = 0; i < 16; i++) w[i] = bigword(block + (4 * i));
+    for (int i = 16; i < 80; i++) w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+
+        uint32_t t = rotl(a, 5) + f + e + k + w[i];
+        e          = d;
+        d          = c;
+        c          = rotl(b, 30);
+        b          = a;
+        a          = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+void sha1init(sha1 *ctx)
+{
+    ctx->state[0] = 0x67452301;
+    ctx->state[1] = 0xEFCDAB89;
+    ctx->state[2] = 0x98BADCFE;
+    ctx->state[3] = 0x10325476;
+    ctx->state[4] = 0xC3D2E1F0;
+    ctx->len      = 0;
+}
+
+void sha1update(sha1 *ctx, const void *data, long len)
+{
+    if (len <= 0) return;
+
+    const unsigned char *p    = data;
+    long                 used = (long)(ctx->len % SHA1_BLOCK_BSIZE);
+    ctx->len                 += len;
+
+    if (used > 0) {
+        long take = SHA1_BLOCK_BSIZE - used < len ? SHA1_BLOCK_BSIZE - used : len;
+        memcpy(ctx->block + used, p, take);
+        p    += take;
+        len  -= take;
+        used += take;
+        if (used < SHA1_BLOCK_BSIZE) return;
+        compress(ctx->state, ctx->block);
+    }
+
+    for (; len >= SHA1_BLOCK_BSIZE; p += SHA1_BLOCK_BSIZE, len -= SHA1_BLOCK_BSIZE) {
+        compress(ctx->state, p);
+    }
+
+    if (len > 0) memcpy(ctx->block, p, len);
+}
+
+void sha1final(sha1 *ctx, unsigned char digest[SHA1_DIGEST_BSIZE])
+{
+    uint64_t      bits = ctx->len * 8;
+    unsigned char tail[SHA1_BLOCK_BSIZE + 8];
+    long          used = (long)(ctx->len % SHA1_BLOCK_BSIZE);
+    long          npad = (used < 56 ? 56 : 120) - used;
+
+    memset(tail, 0, sizeof(tail));
+    tail[0] = 0x80;
+    for (int i = 0; i < 8; i++) tail[npad + i] = (bits >> (56 - (8 * i))) & 0xFF;
+    sha1update(ctx, tail, npad + 8);
+
+    for (int i = 0; i < 5; i++) {
+        digest[(4 * i) + 0] = (ctx->state[i] >> 24) & 0xFF;
+        digest[(4 * i) + 1] = (ctx->state[i] >> 16) & 0xFF;
+        digest[(4 * i) + 2] = (ctx->state[i] >> 8) & 0xFF;
+        digest[(4 * i) + 3] = ctx->state[i] & 0xFF;
+    }
+}
+
+void sha1digest(const void *data, long len, unsigned char digest[SHA1_DIGEST_BSIZE])
+{
+    sha1 ctx;
+    sha1init(&ctx);
+    sha1update(&ctx, data, len);
+    sha1final(&ctx, digest);
+}
+
+void sha1hex(const unsigned char digest[SHA1_DIGEST_BSIZE], char hex[2 * SHA1_DIGEST_BSIZE + 1])
+{
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 0; i < SHA1_DIGEST_BSIZE; i++) {
+        hex[(2 * i) + 0] = digits[digest[i] >> 4];
+        hex[(2 * i) + 1] = digits[digest[i] & 0xF];
+    }
+
+    hex[2 * SHA1_DIGEST_BSIZE] = '\0';
+}
+
+void sha1hmacinit(sha1hmac *ctx, const void *key, long keylen)
+{
+    unsigned char pad[SHA1_BLOCK_BSIZE] = { 0 };
+    if (keylen > SHA1_BLOCK_BSIZE) sha1digest(key, keylen, pad);
+    else if (keylen > 0) memcpy(pad, key, keylen);
+
+    for (int i = 0; i < SHA1_BLOCK_BSIZE; i++) pad[i] ^= 0x36;
+    sha1init(&ctx->inner);
+    sha1update(&ctx->inner, pad, SHA1_BLOCK_BSIZE);
+
+    for (int i = 0; i < SHA1_BLOCK_BSIZE; i++) pad[i] ^= 0x36 ^ 0x5C;
+    sha1init(&ctx->outer);
+    sha1update(&ctx->outer, pad, SHA1_BLOCK_BSIZE);
+}
+
+void sha1hmacupdate(sha1hmac *ctx, const void *data, long len)
+{
+    sha1update(&ctx->inner, data, len);
+}
+
+void sha1hmacfinal(sha1hmac *ctx, unsigned char digest[SHA1_DIGEST_BSIZE])
+{
+    unsigned char inner[SHA1_DIGEST_BSIZE];
+    sha1final(&ctx->inner, inner);
+    sha1update(&ctx->outer, inner, SHA1_DIGEST_BSIZE);
+    sha1final(&ctx->outer, digest);
+}
+
+void sha1hmacdigest(
+    const sha1hmac *key,
+    const void     *data,
+    long            len,
+    unsigned char   digest[SHA1_DIGEST_BSIZE]
+)
+{
+    sha1hmac ctx = *key;
+    sha1hmacupdate(&ctx, data, len);
+    sha1hmacfinal(&ctx, digest);
+}
@@ -5,6 +5,11 @@
 #include "libs/strings.h"
 #include <stdio.h>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SHEETS_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
 #define NEWLINE string("\n")
 
 #define returniferr(__expr)                            \
@@ -36,6 +41,112 @@ static inline int endoffield(
         || field.s[field.len + offset] == fdelim;
 }
 
+// Scanners return the offset of the first byte in `s` which matches any of `a`, `b`, or `c`, or
+// `len` if no such byte exists. The vectorized variants test 16 or 32 bytes per iteration and fall
+// back to the scalar scanner for any remaining tail.
+typedef long (*scanner)(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a,
+    unsigned char        b,
+    unsigned char        c
+);
+
+static long scanscalar(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        b, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        c  // NOLINT bugprone-easily-swappable-parameters
+)
+{
+    long i = 0;
+    for (; i < len && s[i] != a && s[i] != b && s[i] != c; i++);
+    return i;
+}
+
+#ifdef SHEETS_SIMD_X86
+static long scansse2(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        b, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        c  // NOLINT bugprone-easily-swappable-parameters
+)
+{
+    const __m128i va = _mm_set1_epi8((char)a);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    const __m128i vc = _mm_set1_epi8((char)c);
+
+    long i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i hits  = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)),
+            _mm_cmpeq_epi8(chunk, vc)
+        );
+
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    return i + scanscalar(s + i, len - i, a, b, c);
+}
+
+__attribute__((target("avx2"))) static long scanavx2(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        b, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        c  // NOLINT bugprone-easily-swappable-parameters
+)
+{
+    const __m256i va = _mm256_set1_epi8((char)a);
+    const __m256i vb = _mm256_set1_epi8((char)b);
+    const __m256i vc = _mm256_set1_epi8((char)c);
+
+    long i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i hits  = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)),
+            _mm256_cmpeq_epi8(chunk, vc)
+        );
+
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    return i + scansse2(s + i, len - i, a, b, c);
+}
+
+static long scanresolve(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a,
+    unsigned char        b,
+    unsigned char        c
+);
+
+static scanner scanspecial = scanresolve;
+
+// Pick the widest scanner supported by the running CPU on first use.
+static long scanresolve(
+    const unsigned char *s,
+    long                 len,
+    unsigned char        a, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        b, // NOLINT bugprone-easily-swappable-parameters
+    unsigned char        c  // NOLINT bugprone-easily-swappable-parameters
+)
+{
+    __builtin_cpu_init();
+    scanspecial = __builtin_cpu_supports("avx2") ? scanavx2 : scansse2;
+    return scanspecial(s, len, a, b, c);
+}
+#else
+static const scanner scanspecial = scanscalar;
+#endif
+
 static sheetsresult takerecord(
     string       *table,
     unsigned char rdelim,   // NOLINT bugprone-easily-swappable-parameters
@@ -44,36 +155,45 @@ static sheetsresult takerecord(
     sheetsrecord *record
 )
 {
-    int finished = table->s && table->s[0] == rdelim;
+    int finished = table->s && table->len > 0 && table->s[0] == rdelim;
     while (table->len > 0 && !finished && record->nfields < SHEETS_MAX_FIELDS) {
         long   enclosed = table->s[0] == encloser;
         long   unpaired = enclosed;
         long   tablelen = table->len - enclosed;
         string field    = string(table->s + enclosed, 0);
 
-        while (!endoffield(field, 0, tablelen, rdelim, fdelim)) {
-            if (field.s[field.len] == encloser) {
-                // The encloser is not permitted unless the field is enclosed.
-                if (!enclosed) {
-                    return sheetsresult(
-                        E_sheets_unenclosed,
-                        field,
-                        "unexpected encloser in unenclosed field"
-                    );
-                }
-
-                // If the field is terminal, then we are done.
-                if (endoffield(field, 1, tablelen, rdelim, fdelim)) {
-                    unpaired  ^= 1;
-                    field.len += 1;
-                    continue;
-                }
-
-                // If the next character is also the encloser, iterate over both.
-                if (field.len + 1 < tablelen && field.s[field.len + 1] == encloser) {
-                    field.len += 2;
-                    continue;
-                }
+        while (field.len < tablelen) {
+            // Skip ahead to the next byte of interest; everything before it belongs to the field.
+            field.len += scanspecial(
+                field.s + field.len,
+                tablelen - field.len,
+                rdelim,
+                fdelim,
+                encloser
+            );
+
+            if (endoffield(field, 0, tablelen, rdelim, fdelim)) break;
+
+            // The encloser is not permitted unless the field is enclosed.
+            if (!enclosed) {
+                return sheetsresult(
+                    E_sheets_unenclosed,
+                    field,
+                    "unexpected encloser in unenclosed field"
+                );
+            }
+
+            // If the field is terminal, then we are done.
+            if (endoffield(field, 1, tablelen, rdelim, fdelim)) {
+                unpaired  ^= 1;
+                field.len += 1;
+                continue;
+            }
+
+            // If the next character is also the encloser, iterate over both.
+            if (field.len + 1 < tablelen && field.s[field.len + 1] == encloser) {
+                field.len += 2;
+                continue;
             }
 
             field.len++;
@@ -91,7 +211,7 @@ static sheetsresult takerecord(
         record->enclosed                |= (enclosed << record->nfields);
         record->nfields++;
 
-        finished    = table->s[field.len + enclosed] == '\n';
+        finished    = field.len + enclosed < table->len && table->s[field.len + enclosed] == '\n';
         table->s   += field.len + enclosed + 1;
         table->len  = tablelen - field.len - 1;
     }
@@ -118,7 +238,7 @@ sheetsresult dsvparse(
     sheetsrecord record = { 0 };
     int          line   = 1;
     returniferr(takerecord(&table, rdelim, fdelim, encloser, &record));
-    if (record.nfields >= SHEETS_MAX_FIELDS && table.s[0] != rdelim) {
+    if (record.nfields >= SHEETS_MAX_FIELDS && (table.len <= 0 || table.s[0] != rdelim)) {
         return sheetsresult(
             E_sheets_numfields,
             stringZ,
@@ -134,7 +254,7 @@ sheetsresult dsvparse(
         record.enclosed = 0;
 
         returniferr(takerecord(&table, rdelim, fdelim, encloser, &record));
-        if (record.nfields != mfields && table.s[0] != rdelim) {
+        if (record.nfields != mfields && (table.len <= 0 || table.s[0] != rdelim)) {
             sheetsresult res = sheetsresult(E_sheets_numfields, stringZ, "");
             snprintf(
                 res.msg,
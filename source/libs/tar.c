@@ -0,0 +1,244 @@
+// SPDX-License-Identifier: MIT
+
+#include "libs/tar.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libs/strings.h"
+
+#define OFS_NAME     0
+#define OFS_SIZE     124
+#define OFS_CHKSUM   148
+#define OFS_TYPEFLAG 156
+#define OFS_MAGIC    257
+#define OFS_PREFIX   345
+
+#define LEN_NAME   100
+#define LEN_SIZE   12
+#define LEN_CHKSUM 8
+#define LEN_PREFIX 155
+
+#define tarresult(__code, __pos, __msg)                  \
+    (tarresult)                                          \
+    {                                                    \
+        .code = (__code), .msg = (__msg), .pos = (__pos) \
+    }
+
+typedef struct overrides {
+    string path; // from a pax "path" record or a GNU long-name header
+    long   size; // from a pax "size" record; -1 if not overridden
+} overrides;
+
+static inline long roundblock(long size)
+{
+    return (size + TAR_BLOCK_SIZE - 1) & ~(long)(TAR_BLOCK_SIZE - 1);
+}
+
+static inline long fieldlen(const unsigned char *field, long maxlen)
+{
+    long len = 0;
+    for (; len < maxlen && field[len] != '\0'; len++);
+    return len;
+}
+
+static inline int iszeroblock(const unsigned char *block)
+{
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (block[i] != 0) return 0;
+    }
+
+    return 1;
+}
+
+// Numeric fields are octal, padded by leading spaces or zeroes and terminated by a space or NUL.
+// GNU tar stores sizes which exceed the octal range in base-256, flagged by the high bit.
+static long parsenum(const unsigned char *field, int len)
+{
+    if (field[0] & 0x80) {
+        if (field[0] & 0x40) return -1; // negative values are never valid here
+
+        unsigned long value = field[0] & 0x3F;
+        for (int i = 1; i < len; i++) {
+            if (value >> 55) return -1;
+            value = (value << 8) | field[i];
+        }
+
+        return (long)value;
+    }
+
+    int i = 0;
+    for (; i < len && field[i] == ' '; i++);
+    if (i == len) return -1;
+
+    long value = 0;
+    for (; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        if (value >> 58) return -1;
+        value = (value << 3) | (field[i] - '0');
+    }
+
+    if (i < len && field[i] != ' ' && field[i] != '\0') return -1;
+    return value;
+}
+
+static int checksummed(const unsigned char *block)
+{
+    long expect = parsenum(block + OFS_CHKSUM, LEN_CHKSUM);
+    if (expect < 0) return 0;
+
+    // The checksum is computed as if its own field were filled with spaces. Historic archivers
+    // summed signed chars, so both interpretations are accepted.
+    long usum = ' ' * LEN_CHKSUM;
+    long ssum = ' ' * LEN_CHKSUM;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++) {
+        if (i >= OFS_CHKSUM && i < OFS_CHKSUM + LEN_CHKSUM) continue;
+        usum += block[i];
+        ssum += (signed char)block[i];
+    }
+
+    return expect == usum || expect == ssum;
+}
+
+// Records are of the form "<len> <key>=<value>\n", where <len> counts the entire record.
+static int parsepax(string data, overrides *over)
+{
+    while (data.len > 0) {
+        long len = 0;
+        long i   = 0;
+        for (; i < data.len && data.s[i] >= '0' && data.s[i] <= '9'; i++) {
+            if (len > data.len) return -1;
+            len = (len * 10) + (data.s[i] - '0');
+        }
+
+        if (i == 0 || i >= data.len || data.s[i] != ' ') return -1;
+        if (len <= i + 1 || len > data.len || data.s[len - 1] != '\n') return -1;
+
+        string  record = string(data.s + i + 1, len - i - 2);
+        strpair keyval = strcut(record, '=');
+        if (keyval.head.len == record.len) return -1;
+
+        if (strequ(keyval.head, string("path"))) {
+            over->path = keyval.tail;
+        } else if (strequ(keyval.head, string("size"))) {
+            long size = 0;
+            for (long j = 0; j < keyval.tail.len; j++) {
+                unsigned char c = keyval.tail.s[j];
+                if (c < '0' || c > '9' || size > (0x7FFFFFFFFFFFFFFFL - 9) / 10) return -1;
+                size = (size * 10) + (c - '0');
+            }
+
+            if (keyval.tail.len == 0) return -1;
+            over->size = size;
+        }
+
+        data = string(data.s + len, data.len - len);
+    }
+
+    return 0;
+}
+
+int tarprobe(string archive)
+{
+    return archive.len >= TAR_BLOCK_SIZE && memcmp(archive.s + OFS_MAGIC, "ustar", 5) == 0;
+}
+
+tarresult tarparse(string archive, tarhandler handler, void *user)
+{
+    overrides      over  = { .path = stringZ, .size = -1 };
+    unsigned char  namebuf[LEN_PREFIX + 1 + LEN_NAME];
+    int            index = 0;
+    unsigned char *curs  = archive.s;
+    unsigned char *end   = archive.s + archive.len;
+
+    while (end - curs >= TAR_BLOCK_SIZE && !iszeroblock(curs)) {
+        string header = string(curs, TAR_BLOCK_SIZE);
+        if (!checksummed(curs)) {
+            tarresult res = tarresult(E_tar_checksum, header, "");
+            snprintf(
+                res.msg,
+                sizeof(res.msg),
+                "header checksum mismatch at offset 0x%08lX",
+                (long)(curs - archive.s)
+            );
+            return res;
+        }
+
+        long size = parsenum(curs + OFS_SIZE, LEN_SIZE);
+        if (over.size >= 0) size = over.size;
+        if (size < 0) return tarresult(E_tar_badfield, header, "malformed size field");
+
+        unsigned char *content = curs + TAR_BLOCK_SIZE;
+        if (end - content < size) {
+            return tarresult(E_tar_truncated, header, "entry content extends beyond the archive");
+        }
+
+        unsigned char type = curs[OFS_TYPEFLAG];
+        switch (type) {
+        case 'x':
+            if (parsepax(string(content, size), &over) != 0) {
+                return tarresult(E_tar_badpax, header, "malformed pax extended header");
+            }
+            break;
+
+        case 'L':
+            over.path = string(content, fieldlen(content, size));
+            break;
+
+        case '0':
+        case '7':
+        case '\0': {
+            string name = over.path;
+            if (name.len == 0) {
+                long namelen   = fieldlen(curs + OFS_NAME, LEN_NAME);
+                long prefixlen = 0;
+                if (memcmp(curs + OFS_MAGIC, "ustar\0", 6) == 0) {
+                    prefixlen = fieldlen(curs + OFS_PREFIX, LEN_PREFIX);
+                }
+
+                name = string(namebuf, 0);
+                if (prefixlen > 0) {
+                    memcpy(namebuf, curs + OFS_PREFIX, prefixlen);
+                    namebuf[prefixlen] = '/';
+                    name.len           = prefixlen + 1;
+                }
+
+                memcpy(namebuf + name.len, curs + OFS_NAME, namelen);
+                name.len += namelen;
+            }
+
+            // Pre-POSIX archivers marked directories only by a trailing slash.
+            if (name.len > 0 && name.s[name.len - 1] != '/') {
+                tarentry entry = { .name = name, .offset = content - archive.s, .size = size };
+                if (handler) {
+                    tarresult res = handler(&entry, user, index);
+                    if (res.code != E_tar_none) return res;
+                }
+
+                index++;
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+
+        // Overrides only ever apply to the header which immediately follows them.
+        if (type != 'x' && type != 'L') over = (overrides){ .path = stringZ, .size = -1 };
+
+        if (end - content < roundblock(size)) {
+            if (end - content == size) break; // tolerate a missing final pad
+            return tarresult(E_tar_truncated, header, "entry padding extends beyond the archive");
+        }
+
+        curs = content + roundblock(size);
+    }
+
+    for (unsigned char *tail = curs; end - curs < TAR_BLOCK_SIZE && tail < end; tail++) {
+        if (*tail != 0) {
+            return tarresult(E_tar_truncated, string(curs, end - curs), "trailing partial header");
+        }
+    }
+
+    return tarresult(E_tar_none, stringZ, "");
+}
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/trace.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TRACE_PTHREAD 1
+#include <pthread.h>
+#endif
+
+#define MAX_THREADS 65 // the calling thread and every worker of libs/jobs
+#define MAX_NAMELEN 512
+
+struct tracer {
+    FILE  *out;
+    double epoch;
+    long   nevents;
+    int    nthreads;
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_t       threads[MAX_THREADS];
+#endif
+};
+
+// Timestamps are in microseconds since the trace was opened.
+static double now(void)
+{
+#ifdef TRACE_PTHREAD
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((double)ts.tv_sec * 1e6) + ((double)ts.tv_nsec / 1e3);
+#else
+    return (double)clock() * 1e6 / CLOCKS_PER_SEC;
+#endif
+}
+
+static void putevent(tracer *tracer, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(tracer->out, tracer->nevents++ > 0 ? ",\n" : "\n");
+    vfprintf(tracer->out, fmt, args);
+    va_end(args);
+}
+
+static void putstring(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04X", c);
+        else fputc(c, out);
+    }
+
+    fputc('"', out);
+}
+
+// Threads are numbered in the order that they first record an event. Must be called while holding
+// the tracer's lock.
+static int threadid(tracer *tracer)
+{
+#ifdef TRACE_PTHREAD
+    pthread_t self = pthread_self();
+    for (int i = 0; i < tracer->nthreads; i++) {
+        if (pthread_equal(tracer->threads[i], self)) return i;
+    }
+
+    if (tracer->nthreads == MAX_THREADS) return MAX_THREADS - 1;
+    tracer->threads[tracer->nthreads] = self;
+#endif
+
+    int tid = tracer->nthreads++;
+    putevent(tracer, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,", tid);
+    if (tid == 0) fprintf(tracer->out, "\"args\":{\"name\":\"main\"}}");
+    else fprintf(tracer->out, "\"args\":{\"name\":\"worker %d\"}}", tid);
+    return tid;
+}
+
+tracer *traceopen(const char *filename)
+{
+    tracer *tracer = calloc(1, sizeof(*tracer));
+    if (!tracer) return NULL;
+
+    tracer->out = fopen(filename, "w");
+    if (!tracer->out) {
+        free(tracer);
+        return NULL;
+    }
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_init(&tracer->lock, NULL);
+#endif
+
+    tracer->epoch = now();
+    fprintf(tracer->out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    return tracer;
+}
+
+int traceclose(tracer *tracer)
+{
+    fprintf(tracer->out, "\n]}\n");
+    int err = ferror(tracer->out) != 0;
+    err     = fclose(tracer->out) != 0 || err;
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_destroy(&tracer->lock);
+#endif
+
+    free(tracer);
+    return err ? -1 : 0;
+}
+
+void tracerbegin(tracer *tracer, const char *cat, const char *fmt, ...)
+{
+    char    name[MAX_NAMELEN];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(name, sizeof(name), fmt, args);
+    va_end(args);
+
+    double ts = now() - tracer->epoch;
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_lock(&tracer->lock);
+#endif
+
+    int tid = threadid(tracer);
+    putevent(tracer, "{\"ph\":\"B\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"cat\":", tid, ts);
+    putstring(tracer->out, cat);
+    fprintf(tracer->out, ",\"name\":");
+    putstring(tracer->out, name);
+    fputc('}', tracer->out);
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_unlock(&tracer->lock);
+#endif
+}
+
+void tracerend(tracer *tracer)
+{
+    double ts = now() - tracer->epoch;
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_lock(&tracer->lock);
+#endif
+
+    int tid = threadid(tracer);
+    putevent(tracer, "{\"ph\":\"E\",\"pid\":1,\"tid\":%d,\"ts\":%.3f}", tid, ts);
+
+#ifdef TRACE_PTHREAD
+    pthread_mutex_unlock(&tracer->lock);
+#endif
+}
@@ -0,0 +1,215 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "libs/watch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+#if defined(__linux__)
+#define WATCH_INOTIFY 1
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#endif
+
+typedef struct watchentry {
+    int    wd;   // watch of the directory which holds the path, or of the path itself
+    string name; // entry within the watched directory; empty if the path is the directory
+    string path; // owned, and NUL-terminated
+    int    pending;
+} watchentry;
+
+struct watcher {
+    int    fd;
+    vector entries; // T = watchentry; sorted by watch and then by name before waiting
+    int    sorted;
+};
+
+static int compareentries(const void *a, const void *b) // NOLINT
+{
+    const watchentry *ea = a;
+    const watchentry *eb = b;
+    if (ea->wd != eb->wd) return ea->wd < eb->wd ? -1 : 1;
+    if (ea->name.len != eb->name.len) return ea->name.len < eb->name.len ? -1 : 1;
+    return ea->name.len > 0 ? memcmp(ea->name.s, eb->name.s, ea->name.len) : 0;
+}
+
+watcher *watchnew(void)
+{
+#ifdef WATCH_INOTIFY
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    watcher *watcher = calloc(1, sizeof(*watcher));
+    watcher->fd      = fd;
+    watcher->entries = newvec(watchentry, 64);
+    return watcher;
+#else
+    return NULL;
+#endif
+}
+
+void watchdel(watcher *watcher)
+{
+    if (!watcher) return;
+
+#ifdef WATCH_INOTIFY
+    close(watcher->fd); // also removes every watch
+#endif
+
+    for (int i = 0; i < watcher->entries.len; i++) {
+        free(get(&watcher->entries, watchentry, i)->path.s);
+    }
+
+    free(watcher->entries.data);
+    free(watcher);
+}
+
+int watchadd(watcher *watcher, string path)
+{
+#ifdef WATCH_INOTIFY
+    char *cpath = malloc(path.len + 1);
+    memcpy(cpath, path.s, path.len);
+    cpath[path.len] = '\0';
+
+    struct stat st;
+    string      name = stringZ;
+    int         wd   = -1;
+    if (stat(cpath, &st) == 0 && S_ISDIR(st.st_mode)) {
+        wd = inotify_add_watch(watcher->fd, cpath, WATCH_EVENTS | IN_ONLYDIR);
+    } else {
+        char *slash = strrchr(cpath, '/');
+        if (!slash) {
+            name = string(cpath, path.len);
+            wd   = inotify_add_watch(watcher->fd, ".", WATCH_EVENTS | IN_ONLYDIR);
+        } else {
+            name   = string(slash + 1, path.len - (slash + 1 - cpath));
+            *slash = '\0';
+            wd     = inotify_add_watch(watcher->fd, slash == cpath ? "/" : cpath, WATCH_EVENTS);
+            *slash = '/';
+        }
+    }
+
+    if (wd < 0) {
+        free(cpath);
+        return -1;
+    }
+
+    watchentry *entry = push(&watcher->entries, watchentry);
+    *entry            = (watchentry){
+        .wd      = wd,
+        .name    = name,
+        .path    = string(cpath, path.len),
+        .pending = 0,
+    };
+
+    watcher->sorted = 0;
+    return 0;
+#else
+    (void)watcher;
+    (void)path;
+    return -1;
+#endif
+}
+
+#ifdef WATCH_INOTIFY
+// Marks every entry which matches an event's watch and name, and every directory entry which
+// matches its watch. Returns the number of entries which were newly marked.
+static int markentries(watcher *watcher, int wd, string name)
+{
+    watchentry *entries = watcher->entries.data;
+    int         marked  = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        watchentry key = { .wd = wd, .name = pass == 0 ? name : stringZ };
+
+        // Find the first of any run of equal entries.
+        int lo = 0, hi = watcher->entries.len;
+        while (lo < hi) {
+            int mid = lo + ((hi - lo) / 2);
+            if (compareentries(&entries[mid], &key) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+
+        for (; lo < watcher->entries.len && compareentries(&entries[lo], &key) == 0; lo++) {
+            marked              += !entries[lo].pending;
+            entries[lo].pending  = 1;
+        }
+    }
+
+    return marked;
+}
+
+static int markall(watcher *watcher)
+{
+    int marked = 0;
+    for (int i = 0; i < watcher->entries.len; i++) {
+        watchentry *entry  = get(&watcher->entries, watchentry, i);
+        marked            += !entry->pending;
+        entry->pending     = 1;
+    }
+
+    return marked;
+}
+#endif
+
+int watchwait(watcher *watcher, vector *changed, int settle)
+{
+#ifdef WATCH_INOTIFY
+    if (!watcher->sorted) {
+        qsort(watcher->entries.data, watcher->entries.len, sizeof(watchentry), compareentries);
+        watcher->sorted = 1;
+    }
+
+    union {
+        struct inotify_event event; // for alignment
+        char                 buf[4096];
+    } events;
+
+    // Events for unwatched entries of a watched directory do not start the settling period.
+    int npending = 0;
+    for (;;) {
+        struct pollfd pfd   = { .fd = watcher->fd, .events = POLLIN };
+        int           ready = poll(&pfd, 1, npending > 0 ? settle : -1);
+        if (ready < 0) return -1;
+        if (ready == 0) break;
+
+        ssize_t nread = read(watcher->fd, events.buf, sizeof(events.buf));
+        if (nread <= 0) return -1;
+
+        for (char *curs = events.buf; curs < events.buf + nread;) {
+            struct inotify_event *event  = (struct inotify_event *)curs;
+            curs                        += sizeof(*event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                npending += markall(watcher);
+            } else if (!(event->mask & IN_IGNORED)) {
+                string name  = string(event->name, event->len > 0 ? strlen(event->name) : 0);
+                npending    += markentries(watcher, event->wd, name);
+            }
+        }
+    }
+
+    for (int i = 0; i < watcher->entries.len; i++) {
+        watchentry *entry = get(&watcher->entries, watchentry, i);
+        if (!entry->pending) continue;
+
+        *push(changed, string) = entry->path;
+        entry->pending         = 0;
+    }
+
+    return npending;
+#else
+    (void)watcher;
+    (void)changed;
+    (void)settle;
+    return -1;
+#endif
+}
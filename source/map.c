@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * Layout maps list every member of a sealed packer in order of its offset within the ROM, in the
+ * manner of a linker's map file, so that tools which patch or inspect the ROM need not parse it.
+ *
+ * The text format begins with the ROM's size and its header and banner CRCs as “#”-comments,
+ * followed by one line per member:
+ *
+ *   offset     size       pad    class     fileid ovyid  target  source
+ *
+ * Offsets, sizes, and pads are hexadecimal, IDs are decimal, and fields which do not apply to a
+ * member (e.g., the target of an overlay) are written as “-”. The source is written last, so that
+ * it may contain spaces. The JSON format is one object:
+ *
+ *   { "romsize": N, "headercrc": N, "bannercrcs": [N, ...], "members": [member, ...] }
+ *
+ *   member := { "class": S, "source": S, "target": S, "fileid": N, "overlayid": N,
+ *               "offset": N, "size": N, "pad": N }
+ *
+ * where members which are computed in memory have a null source, and any other field which does
+ * not apply to a member is null. Banner CRCs are listed from version 1 upward.
+ */
+
+#include "packer.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "constants.h"
+
+#include "libs/litend.h"
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+typedef struct mapentry {
+    const char *class;
+    string      source; // NULL if the member is computed in memory
+    string      target; // NULL unless the member is part of the filesystem
+    int         fileid; // -1 unless the member has an entry in the FATB
+    int         ovyid;  // -1 unless the member is an overlay
+    uint32_t    offset;
+    uint32_t    size;
+    uint32_t    pad;
+    int         order; // position within the packer, so that empty members keep their place
+} mapentry;
+
+static int compareentries(const void *a, const void *b) // NOLINT
+{
+    const mapentry *ea = a;
+    const mapentry *eb = b;
+    if (ea->offset != eb->offset) return ea->offset < eb->offset ? -1 : 1;
+    return ea->order < eb->order ? -1 : ea->order > eb->order;
+}
+
+static void addmemb(vector *entries, const char *class, const rommember *memb, int fromdisk)
+{
+    mapentry *entry = push(entries, mapentry);
+    *entry          = (mapentry){
+        .class  = class,
+        .source = fromdisk && memb->source.filename.len > 0 ? memb->source.filename : stringZ,
+        .target = stringZ,
+        .fileid = -1,
+        .ovyid  = -1,
+        .offset = memb->offset,
+        .size   = memb->size,
+        .pad    = memb->pad,
+        .order  = entries->len - 1,
+    };
+}
+
+static void addovys(vector *entries, const char *class, const vector *ovys, int ovyofs)
+{
+    for (int i = 0; i < ovys->len; i++) {
+        addmemb(entries, class, get(ovys, rommember, i), 1);
+        mapentry *entry = get(entries, mapentry, entries->len - 1);
+        entry->fileid   = ovyofs + i;
+        entry->ovyid    = i;
+    }
+}
+
+static vector collect(rompacker *packer)
+{
+    int    nmembs  = packer->filesys.len + packer->ovy9.len + packer->ovy7.len + 12;
+    vector entries = newvec(mapentry, nmembs);
+
+    addmemb(&entries, "header", &packer->header, 0);
+    addmemb(&entries, "arm9", &packer->arm9, 1);
+    addmemb(&entries, "ovt9", &packer->ovt9, 1);
+    addovys(&entries, "ovy9", &packer->ovy9, 0);
+    addmemb(&entries, "arm7", &packer->arm7, 1);
+    addmemb(&entries, "ovt7", &packer->ovt7, 1);
+    addovys(&entries, "ovy7", &packer->ovy7, packer->ovy9.len);
+    addmemb(&entries, "fntb", &packer->fntb, 0);
+    addmemb(&entries, "fatb", &packer->fatb, 0);
+    addmemb(&entries, "banner", &packer->banner, 0);
+    if (packer->twl.key.len > 0) {
+        addmemb(&entries, "sectdigs", &packer->twl.sectors, 0);
+        addmemb(&entries, "blockdigs", &packer->twl.blocks, 0);
+    }
+
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile  *file  = get(&packer->filesys, romfile, i);
+        int       inmem = file->kind == K_romfile_buffer || file->kind == K_romfile_generator;
+        mapentry *entry = push(&entries, mapentry);
+        *entry          = (mapentry){
+            .class  = "file",
+            .source = inmem ? stringZ : file->source,
+            .target = file->target,
+            .fileid = file->filesysid,
+            .ovyid  = -1,
+            .offset = file->offset,
+            .size   = file->size,
+            .pad    = file->pad,
+            .order  = entries.len - 1,
+        };
+    }
+
+    qsort(entries.data, entries.len, sizeof(mapentry), compareentries);
+    return entries;
+}
+
+// Banners of later versions extend those of earlier ones, and each version adds its own CRC.
+static int bannercrcs(const rompacker *packer, uint16_t crcs[3])
+{
+    static const uint32_t sizes[]   = { BANNER_BSIZE_V1, BANNER_BSIZE_V2, BANNER_BSIZE_V3 };
+    static const uint32_t offsets[] = {
+        OFS_BANNER_CRC_V1OFFSET,
+        OFS_BANNER_CRC_V2OFFSET,
+        OFS_BANNER_CRC_V3OFFSET,
+    };
+
+    const unsigned char *banner = packer->banner.source.buf;
+    int                  n      = 0;
+    for (; n < 3 && packer->banner.size >= sizes[n]; n++) crcs[n] = lehalf(banner + offsets[n]);
+    return n;
+}
+
+static void putstring(FILE *out, string s)
+{
+    fputc('"', out);
+    for (long i = 0; i < s.len; i++) {
+        unsigned char c = s.s[i];
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04X", c);
+        else fputc(c, out);
+    }
+
+    fputc('"', out);
+}
+
+static void putoptstring(FILE *out, string s)
+{
+    if (s.s) putstring(out, s);
+    else fputs("null", out);
+}
+
+static void putoptid(FILE *out, int id)
+{
+    if (id >= 0) fprintf(out, "%d", id);
+    else fputs("null", out);
+}
+
+static void writetext(FILE *out, rompacker *packer, const vector *entries)
+{
+    const unsigned char *header = packer->header.source.buf;
+    uint16_t             crcs[3];
+    int                  ncrcs = bannercrcs(packer, crcs);
+
+    fprintf(out, "# ROM size:   0x%08" PRIX64 "\n", rompacker_romsize(packer));
+    fprintf(out, "# header CRC: 0x%04X\n", lehalf(header + OFS_HEADER_HEADERCRC));
+    for (int i = 0; i < ncrcs; i++) fprintf(out, "# banner CRC: 0x%04X (v%d)\n", crcs[i], i + 1);
+
+    fprintf(
+        out,
+        "%-10s %-10s %-6s %-9s %6s %5s  %s  %s\n",
+        "offset",
+        "size",
+        "pad",
+        "class",
+        "fileid",
+        "ovyid",
+        "target",
+        "source"
+    );
+
+    for (int i = 0; i < entries->len; i++) {
+        const mapentry *entry      = get(entries, mapentry, i);
+        char            fileid[12] = "-";
+        char            ovyid[12]  = "-";
+        if (entry->fileid >= 0) snprintf(fileid, sizeof(fileid), "%d", entry->fileid);
+        if (entry->ovyid >= 0) snprintf(ovyid, sizeof(ovyid), "%d", entry->ovyid);
+
+        fprintf(
+            out,
+            "0x%08X 0x%08X 0x%04X %-9s %6s %5s  %.*s  %.*s\n",
+            entry->offset,
+            entry->size,
+            entry->pad,
+            entry->class,
+            fileid,
+            ovyid,
+            entry->target.s ? (int)entry->target.len : 1,
+            entry->target.s ? (const char *)entry->target.s : "-",
+            entry->source.s ? (int)entry->source.len : 1,
+            entry->source.s ? (const char *)entry->source.s : "-"
+        );
+    }
+}
+
+static void writejson(FILE *out, rompacker *packer, const vector *entries)
+{
+    const unsigned char *header = packer->header.source.buf;
+    uint16_t             crcs[3];
+    int                  ncrcs = bannercrcs(packer, crcs);
+
+    fprintf(out, "{\"romsize\":%" PRIu64, rompacker_romsize(packer));
+    fprintf(out, ",\"headercrc\":%u", lehalf(header + OFS_HEADER_HEADERCRC));
+    fputs(",\"bannercrcs\":[", out);
+    for (int i = 0; i < ncrcs; i++) fprintf(out, i > 0 ? ",%u" : "%u", crcs[i]);
+
+    fputs("],\"members\":[", out);
+    for (int i = 0; i < entries->len; i++) {
+        const mapentry *entry = get(entries, mapentry, i);
+        fprintf(out, "%s\n{\"class\":\"%s\",\"source\":", i > 0 ? "," : "", entry->class);
+        putoptstring(out, entry->source);
+        fputs(",\"target\":", out);
+        putoptstring(out, entry->target);
+        fputs(",\"fileid\":", out);
+        putoptid(out, entry->fileid);
+        fputs(",\"overlayid\":", out);
+        putoptid(out, entry->ovyid);
+        fprintf(
+            out,
+            ",\"offset\":%u,\"size\":%u,\"pad\":%u}",
+            entry->offset,
+            entry->size,
+            entry->pad
+        );
+    }
+
+    fputs("\n]}\n", out);
+}
+
+enum dumperr rompacker_writemap(rompacker *packer, FILE *stream, enum mapformat format)
+{
+    if (packer->packing) return E_dump_packing;
+
+    vector entries = collect(packer);
+    if (format == K_map_json) writejson(stream, packer, &entries);
+    else writetext(stream, packer, &entries);
+
+    free(entries.data);
+    return fflush(stream) != 0 || ferror(stream) ? E_dump_write : E_dump_ok;
+}
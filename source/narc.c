@@ -0,0 +1,404 @@
+// SPDX-License-Identifier: MIT
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "narc.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define NARC_DIRENT 1
+#include <dirent.h>
+#endif
+
+#include "libs/fileio.h"
+#include "libs/litend.h"
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+#define BTAF_HEADER_BSIZE 0x0C
+#define BTNF_BSIZE        0x10
+#define GMIF_HEADER_BSIZE 0x08
+#define MAX_NAME_DEPTH    64
+
+#define narcerr(__narc, __msg, ...)                                                             \
+    {                                                                                           \
+        snprintf((__narc)->err, sizeof((__narc)->err), "rompacker:narc: " __msg, __VA_ARGS__); \
+        return -1;                                                                              \
+    }
+
+static char *cstring(string s)
+{
+    char *cstr = malloc(s.len + 1);
+    memcpy(cstr, s.s, s.len);
+    cstr[s.len] = '\0';
+    return cstr;
+}
+
+static string catpath(string dir, const char *name)
+{
+    long   namelen = (long)strlen(name);
+    string path    = string(malloc(dir.len + namelen + 1), dir.len + namelen + 1);
+    memcpy(path.s, dir.s, dir.len);
+    path.s[dir.len] = '/';
+    memcpy(path.s + dir.len + 1, name, namelen);
+    return path;
+}
+
+static int issuffix(string s, const char *suffix)
+{
+    long len = (long)strlen(suffix);
+    return s.len >= len && memcmp(s.s + s.len - len, suffix, len) == 0;
+}
+
+int narc_islist(string source)
+{
+    return issuffix(source, NARC_LIST_SUFFIX);
+}
+
+narc *narc_new(string source)
+{
+    narc *narc    = calloc(1, sizeof(*narc));
+    narc->source  = source;
+    narc->members = newvec(narcmember, 16);
+    narc->curr    = -1;
+    return narc;
+}
+
+void narc_free(narc *narc)
+{
+    if (!narc) return;
+    if (narc->hdl) fclose(narc->hdl);
+
+    for (int i = 0; i < narc->members.len; i++) free(get(&narc->members, narcmember, i)->source.s);
+    free(narc->members.data);
+    free(narc->prelude);
+    free(narc);
+}
+
+static int comparemembers(const void *a, const void *b) // NOLINT
+{
+    const narcmember *ma = a;
+    const narcmember *mb = b;
+
+    long minlen = ma->source.len < mb->source.len ? ma->source.len : mb->source.len;
+    int  cmp    = memcmp(ma->source.s, mb->source.s, minlen);
+    return cmp != 0 ? cmp : (ma->source.len > mb->source.len) - (ma->source.len < mb->source.len);
+}
+
+static int scandirectory(narc *narc)
+{
+#ifdef NARC_DIRENT
+    char *path = cstring(narc->source);
+    DIR  *dir  = opendir(path);
+    free(path);
+    if (!dir) narcerr(narc, "could not open directory “%.*s”", fmtstring(narc->source));
+
+    for (struct dirent *ent = readdir(dir); ent; ent = readdir(dir)) {
+        if (ent->d_name[0] == '.') continue;
+
+        string path = catpath(narc->source, ent->d_name);
+        stamp  st   = fstamps(path);
+        if (st.size < 0 || st.dir) {
+            free(path.s);
+            continue;
+        }
+
+        narcmember *memb = push(&narc->members, narcmember);
+        memb->source     = path;
+        memb->size       = st.size;
+    }
+
+    closedir(dir);
+    qsort(narc->members.data, narc->members.len, sizeof(narcmember), comparemembers);
+    return 0;
+#else
+    narcerr(narc, "directory sources are unsupported: “%.*s”", fmtstring(narc->source));
+#endif
+}
+
+static int scanlist(narc *narc)
+{
+    fview list = fmaps(narc->source);
+    if (list.data.len < 0) {
+        narcerr(narc, "could not open member list “%.*s”", fmtstring(narc->source));
+    }
+
+    strpair linecut = strcut(list.data, '\n');
+    while (linecut.head.len > 0 || linecut.tail.len > 0) {
+        string line = strltrim(strrtrim(linecut.head));
+        if (line.len > 0 && line.s[0] != '#') {
+            narcmember *memb = push(&narc->members, narcmember);
+            memb->source     = string(malloc(line.len), line.len);
+            memcpy(memb->source.s, line.s, line.len);
+
+            stamp st = fstamps(memb->source);
+            if (st.size < 0 || st.dir) {
+                funmap(list);
+                narcerr(narc, "could not open member “%.*s”", fmtstring(memb->source));
+            }
+
+            memb->size = st.size;
+        }
+
+        linecut = strcut(linecut.tail, '\n');
+    }
+
+    funmap(list);
+    return 0;
+}
+
+static void buildprelude(narc *narc, uint32_t imagesize)
+{
+    uint32_t nmembers = narc->members.len;
+    uint32_t btafsize = BTAF_HEADER_BSIZE + (8 * nmembers);
+    narc->prelen      = NARC_HEADER_BSIZE + btafsize + BTNF_BSIZE + GMIF_HEADER_BSIZE;
+    narc->prelude     = calloc(narc->prelen, 1);
+
+    unsigned char *p = narc->prelude;
+    memcpy(p, "NARC", 4);
+    putlehalf(p + 0x04, 0xFFFE);
+    putlehalf(p + 0x06, 0x0100);
+    putleword(p + 0x08, narc->size);
+    putlehalf(p + 0x0C, NARC_HEADER_BSIZE);
+    putlehalf(p + 0x0E, 3);
+    p += NARC_HEADER_BSIZE;
+
+    memcpy(p, "BTAF", 4);
+    putleword(p + 0x04, btafsize);
+    putlehalf(p + 0x08, nmembers);
+    for (uint32_t i = 0; i < nmembers; i++) {
+        narcmember *memb  = get(&narc->members, narcmember, i);
+        uint32_t    start = memb->offset - narc->prelen;
+        putleword(p + BTAF_HEADER_BSIZE + (8 * i), start);
+        putleword(p + BTAF_HEADER_BSIZE + (8 * i) + 4, start + memb->size);
+    }
+    p += btafsize;
+
+    // Unnamed archives carry only the root directory; its contents offset points at its own
+    // first-member field, which doubles as the end-of-directory marker.
+    memcpy(p, "BTNF", 4);
+    putleword(p + 0x04, BTNF_BSIZE);
+    putleword(p + 0x08, 4);
+    putlehalf(p + 0x0C, 0);
+    putlehalf(p + 0x0E, 1);
+    p += BTNF_BSIZE;
+
+    memcpy(p, "GMIF", 4);
+    putleword(p + 0x04, GMIF_HEADER_BSIZE + imagesize);
+}
+
+int narc_resolve(narc *narc)
+{
+    int err = issuffix(narc->source, NARC_LIST_SUFFIX) ? scanlist(narc) : scandirectory(narc);
+    if (err) return err;
+    if (narc->members.len > 0xFFFF) {
+        narcerr(narc, "archive “%.*s” has too many members", fmtstring(narc->source));
+    }
+
+    uint64_t prelen    = NARC_HEADER_BSIZE + BTAF_HEADER_BSIZE + (8 * (uint64_t)narc->members.len)
+                    + BTNF_BSIZE + GMIF_HEADER_BSIZE;
+    uint64_t imagesize = 0;
+    for (int i = 0; i < narc->members.len; i++) {
+        narcmember *memb  = get(&narc->members, narcmember, i);
+        memb->offset      = prelen + imagesize;
+        imagesize        += (memb->size + NARC_ALIGN - 1) & ~(uint64_t)(NARC_ALIGN - 1);
+        if (prelen + imagesize > UINT32_MAX) {
+            narcerr(narc, "archive “%.*s” is too large", fmtstring(narc->source));
+        }
+    }
+
+    narc->size = prelen + imagesize;
+    buildprelude(narc, imagesize);
+    return 0;
+}
+
+int narc_changed(const narc *narc)
+{
+    struct narc *fresh   = narc_new(narc->source);
+    int          changed = narc_resolve(fresh) != 0 || fresh->members.len != narc->members.len;
+    for (int i = 0; i < narc->members.len && !changed; i++) {
+        narcmember *was = get(&narc->members, narcmember, i);
+        narcmember *now = get(&fresh->members, narcmember, i);
+        changed         = was->size != now->size || !strequ(was->source, now->source);
+    }
+
+    narc_free(fresh);
+    return changed;
+}
+
+static int findmember(narc *narc, uint32_t offset)
+{
+    int lo = 0;
+    int hi = narc->members.len - 1;
+    while (lo < hi) {
+        int mid = lo + ((hi - lo + 1) / 2);
+        if (get(&narc->members, narcmember, mid)->offset <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+
+    return lo;
+}
+
+static inline int contains(narc *narc, int i, uint32_t offset)
+{
+    if (i < 0 || offset < get(&narc->members, narcmember, i)->offset) return 0;
+    return i + 1 >= narc->members.len || offset < get(&narc->members, narcmember, i + 1)->offset;
+}
+
+int narc_read(void *user, unsigned char *buf, uint32_t offset, uint32_t size)
+{
+    narc *narc = user;
+    if ((uint64_t)offset + size > narc->size) return -1;
+
+    if (offset < narc->prelen) {
+        uint32_t chunk = narc->prelen - offset < size ? narc->prelen - offset : size;
+        memcpy(buf, narc->prelude + offset, chunk);
+
+        buf    += chunk;
+        offset += chunk;
+        size   -= chunk;
+    }
+
+    while (size > 0) {
+        int i = contains(narc, narc->curr, offset) ? narc->curr : findmember(narc, offset);
+
+        narcmember *memb = get(&narc->members, narcmember, i);
+        uint32_t    rel  = offset - memb->offset;
+        uint32_t    chunk;
+        if (rel < memb->size) {
+            if (i != narc->curr || !narc->hdl) {
+                if (narc->hdl) fclose(narc->hdl);
+                narc->hdl  = fpreps(memb->source).hdl;
+                narc->curr = i;
+                if (!narc->hdl) return -1;
+            }
+
+            chunk = memb->size - rel < size ? memb->size - rel : size;
+            if (ftell(narc->hdl) != (long)rel && fseek(narc->hdl, rel, SEEK_SET) != 0) return -1;
+            if (fread(buf, 1, chunk, narc->hdl) != chunk) return -1;
+        } else {
+            uint32_t padded = (memb->size + NARC_ALIGN - 1) & ~(uint32_t)(NARC_ALIGN - 1);
+            chunk           = padded - rel < size ? padded - rel : size;
+            memset(buf, NARC_PADDING, chunk);
+        }
+
+        buf    += chunk;
+        offset += chunk;
+        size   -= chunk;
+    }
+
+    // Archives are read front-to-back; don't hold a member open once the last one is consumed.
+    if (offset == narc->size) narc_rewind(narc);
+
+    return 0;
+}
+
+void narc_rewind(narc *narc)
+{
+    if (narc->hdl) fclose(narc->hdl);
+    narc->hdl  = NULL;
+    narc->curr = -1;
+}
+
+int narc_parse(string data, narcview *view)
+{
+    if (data.len < NARC_HEADER_BSIZE || memcmp(data.s, "NARC", 4) != 0) return -1;
+
+    memset(view, 0, sizeof(*view));
+    uint32_t hdrsize   = lehalf(data.s + 0x0C);
+    uint32_t nsections = lehalf(data.s + 0x0E);
+    uint64_t ofs       = hdrsize;
+    int      found     = 0;
+
+    for (uint32_t i = 0; i < nsections; i++) {
+        if (ofs + 8 > (uint64_t)data.len) return -1;
+
+        unsigned char *sec     = data.s + ofs;
+        uint32_t       secsize = leword(sec + 4);
+        if (secsize < 8 || ofs + secsize > (uint64_t)data.len) return -1;
+
+        if (memcmp(sec, "BTAF", 4) == 0 && secsize >= BTAF_HEADER_BSIZE) {
+            view->nmembers = lehalf(sec + 8);
+            view->fatb     = sec + BTAF_HEADER_BSIZE;
+            if (BTAF_HEADER_BSIZE + (8 * (uint64_t)view->nmembers) > secsize) return -1;
+            found |= 1;
+        } else if (memcmp(sec, "BTNF", 4) == 0) {
+            view->fntb     = sec + 8;
+            view->fntbsize = secsize - 8;
+            found         |= 2;
+        } else if (memcmp(sec, "GMIF", 4) == 0) {
+            view->image     = sec + GMIF_HEADER_BSIZE;
+            view->imagesize = secsize - GMIF_HEADER_BSIZE;
+            found          |= 4;
+        }
+
+        ofs += secsize;
+    }
+
+    if (found != 7) return -1;
+    for (uint32_t i = 0; i < view->nmembers; i++) {
+        uint32_t start = leword(view->fatb + (8 * i));
+        uint32_t end   = leword(view->fatb + (8 * i) + 4);
+        if (start > end || end > view->imagesize) return -1;
+    }
+
+    return 0;
+}
+
+static long walkdir(
+    const narcview *view,
+    uint32_t        dirid,
+    char           *path,
+    long            pathlen,
+    int             depth,
+    narcnamefn      fn,
+    void           *user
+)
+{
+    if (depth > MAX_NAME_DEPTH || (dirid + 1) * 8 > view->fntbsize) return -1;
+
+    unsigned char *entry  = view->fntb + (8 * dirid);
+    uint32_t       curs   = leword(entry);
+    uint32_t       member = lehalf(entry + 4);
+    long           nnamed = 0;
+
+    while (curs < view->fntbsize && view->fntb[curs] != 0) {
+        unsigned char head    = view->fntb[curs++];
+        uint32_t      namelen = head & 0x7F;
+        if (curs + namelen > view->fntbsize || pathlen + namelen + 1 >= 512) return -1;
+
+        memcpy(path + pathlen, view->fntb + curs, namelen);
+        curs += namelen;
+
+        if (head & 0x80) {
+            if (curs + 2 > view->fntbsize) return -1;
+
+            uint32_t subdir = lehalf(view->fntb + curs) & 0x0FFF;
+            curs           += 2;
+
+            path[pathlen + namelen] = '/';
+
+            long nsub = walkdir(view, subdir, path, pathlen + namelen + 1, depth + 1, fn, user);
+            if (nsub < 0) return -1;
+            nnamed += nsub;
+        } else {
+            if (member >= view->nmembers) return -1;
+            if (fn) fn(user, member, string((unsigned char *)path, pathlen + namelen));
+            member++;
+            nnamed++;
+        }
+    }
+
+    return curs < view->fntbsize ? nnamed : -1;
+}
+
+long narc_names(const narcview *view, narcnamefn fn, void *user)
+{
+    char path[512];
+    if (view->fntbsize < 8) return -1;
+    return walkdir(view, 0, path, 0, 0, fn, user);
+}
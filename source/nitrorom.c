@@ -14,6 +14,7 @@
 static void showusage(FILE *stream);
 extern int  nitrorom_list(int argc, const char **argv);
 extern int  nitrorom_pack(int argc, const char **argv);
+extern int  nitrorom_serve(int argc, const char **argv);
 
 typedef int (*commandfunc)(int argc, const char **argv);
 
@@ -24,8 +25,9 @@ typedef struct command {
 
 // clang-format off
 static const command commands[] = {
-    { .name = "list", .func = nitrorom_list },
-    { .name = "pack", .func = nitrorom_pack },
+    { .name = "list",  .func = nitrorom_list  },
+    { .name = "pack",  .func = nitrorom_pack  },
+    { .name = "serve", .func = nitrorom_serve },
     { 0 },
 };
 // clang-format on
@@ -64,4 +66,5 @@ static void showusage(FILE *stream)
     fprintf(stream, "Commands:\n");
     fprintf(stream, "  list             List the components of a Nintendo DS ROM\n");
     fprintf(stream, "  pack             Produce a ROM image from source files\n");
+    fprintf(stream, "  serve            Produce ROM images on request, reusing earlier work\n");
 }
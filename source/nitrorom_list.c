@@ -12,13 +12,28 @@
 #include <string.h>
 
 #include "constants.h"
+#include "narc.h"
 
-#include "libs/fileio.h"
+#include "libs/clip.h"
 #include "libs/litend.h"
+#include "libs/romreader.h"
+#include "libs/strings.h"
+#include "libs/trace.h"
 
 #define PROGRAM_NAME "nitrorom-list"
 
+#define OFS_OVT_ID 0x00
+
+typedef struct args {
+    const char *infile;
+    const char *trace;
+
+    long narcs;
+} args;
+
 static void showusage(FILE *stream);
+static args parseargs(const char **argv);
+static void listnarc(tracer *trace, romreader *rom, uint32_t fileid);
 
 #define args(__comp)                                       \
     __comp##ofs, __comp##ofs + __comp##size, __comp##size, \
@@ -41,6 +56,23 @@ static int sortfiles(const void *a, const void *b) // NOLINT
     return ofsa == ofsb ? 0 : ofsa < ofsb ? -1 : 1;
 }
 
+// Emit one row for each overlay in an overlay table, in the order of the table.
+static void listoverlays(romreader *rom, enum romsection ovt, const char *ovyformat)
+{
+    const char *rowformat = "0x%08X,0x%08X,0x%08X,0x%04X,%s\n";
+    string      entries   = rombytes(rom, romsection(rom, ovt));
+    char        ovyname[32];
+    for (long i = 0; i < entries.len / OVT_ENTRY_BSIZE; i++) {
+        unsigned char *ovy     = entries.s + (i * OVT_ENTRY_BSIZE);
+        romrange       range   = romfatb(rom, leword(ovy + OFS_OVT_FILEID));
+        uint32_t       ovyofs  = range.start;
+        uint32_t       ovysize = range.end - range.start;
+
+        snprintf(ovyname, sizeof(ovyname), ovyformat, leword(ovy + OFS_OVT_ID));
+        printf(rowformat, args(ovy), ovyname);
+    }
+}
+
 int nitrorom_list(int argc, const char **argv)
 {
     if (argc <= 1 || strncmp(argv[1], "-h", 2) == 0 || strncmp(argv[1], "--help", 6) == 0) {
@@ -48,112 +80,63 @@ int nitrorom_list(int argc, const char **argv)
         exit(EXIT_SUCCESS);
     }
 
-    const char *infile = argv[1];
-    file        nds    = fprep(infile);
-    if (nds.size < 0) die("could not open input file “%s”!", infile);
-
-    unsigned char *header = malloc(HEADER_BSIZE);
-    fread(header, 1, HEADER_BSIZE, nds.hdl);
-
-    uint32_t arm9ofs  = leword(header + OFS_HEADER_ARM9_ROMOFFSET);
-    uint32_t arm9size = leword(header + OFS_HEADER_ARM9_LOADSIZE);
-    uint32_t arm7ofs  = leword(header + OFS_HEADER_ARM7_ROMOFFSET);
-    uint32_t arm7size = leword(header + OFS_HEADER_ARM7_LOADSIZE);
-    uint32_t fntbofs  = leword(header + OFS_HEADER_FNTB_ROMOFFSET);
-    uint32_t fntbsize = leword(header + OFS_HEADER_FNTB_BSIZE);
-    uint32_t fatbofs  = leword(header + OFS_HEADER_FATB_ROMOFFSET);
-    uint32_t fatbsize = leword(header + OFS_HEADER_FATB_BSIZE);
-    uint32_t ovt9ofs  = leword(header + OFS_HEADER_OVT9_ROMOFFSET);
-    uint32_t ovt9size = leword(header + OFS_HEADER_OVT9_BSIZE);
-    uint32_t ovt7ofs  = leword(header + OFS_HEADER_OVT7_ROMOFFSET);
-    uint32_t ovt7size = leword(header + OFS_HEADER_OVT7_BSIZE);
-    uint32_t bannofs  = leword(header + OFS_HEADER_BANNER_ROMOFFSET);
-
-    unsigned char buf[4];
-
-    fseek(nds.hdl, arm9ofs + arm9size, SEEK_SET);
-    fread(buf, 1, sizeof(uint32_t), nds.hdl);
-    uint32_t footer = leword(buf);
-    if (footer == 0xDEC00621) arm9size += (3 * sizeof(uint32_t));
-
-    fseek(nds.hdl, bannofs, SEEK_SET);
-    fread(buf, 1, sizeof(uint16_t), nds.hdl);
-
-    uint16_t bannvers = lehalf(buf);
-    uint32_t bannsize;
-    switch (bannvers) {
-    case 1:  bannsize = BANNER_BSIZE_V1; break;
-    case 2:  bannsize = BANNER_BSIZE_V2; break;
-    case 3:  bannsize = BANNER_BSIZE_V3; break;
-    default: die("unexpected banner size: %d", bannvers);
-    }
+    args    args  = parseargs(argv);
+    tracer *trace = args.trace ? traceopen(args.trace) : NULL;
+    if (args.trace && !trace) die("could not open trace file “%s”!", args.trace);
 
-    unsigned char *fatb = malloc(fatbsize);
-    fseek(nds.hdl, fatbofs, SEEK_SET);
-    fread(fatb, 1, fatbsize, nds.hdl);
+    tracebegin(trace, "list", "header");
+    romreaderr err = E_romreader_none;
+    romreader *rom = romopen(args.infile, &err);
+    if (err == E_romreader_missing) die("could not open input file “%s”!", args.infile);
+    if (!rom) die("input file “%s” is not a well-formed ROM!", args.infile);
 
+    romrange sections[NUM_ROMSECTIONS];
+    for (int i = 0; i < NUM_ROMSECTIONS; i++) sections[i] = romsection(rom, i);
+
+    romrange bann = sections[K_romsection_banner];
+    if (bann.start == bann.end) die("unexpected banner version at 0x%08X", bann.start);
+    traceend(trace);
+
+    tracebegin(trace, "list", "components");
     const char *rowformat = "0x%08X,0x%08X,0x%08X,0x%04X,%s\n";
     printf("ROM Start,ROM End,Size,Padding,Component\n");
     printf(rowformat, 0, HEADER_BSIZE, HEADER_BSIZE, 0, "% HEADER %");
 
-    printf(rowformat, args(arm9), "% ARM9 %");
-    if (ovt9size > 0) {
-        printf(rowformat, args(ovt9), "% OVT9 %");
-        unsigned char *ovt9 = malloc(ovt9size);
-        fseek(nds.hdl, ovt9ofs, SEEK_SET);
-        fread(ovt9, 1, ovt9size, nds.hdl);
-
-        const char *ovyformat   = "%% OVY9_0x%04X %%";
-        char        ovyname[32] = { 0 };
-        for (long i = 0; i < ovt9size / 0x20; i++) {
-            unsigned char *ovy     = &ovt9[i * 0x20];
-            long           fileid  = leword(ovy + 0x18);
-            uint32_t       ovyofs  = leword(fatb + (8 * fileid));
-            uint32_t       ovysize = leword(fatb + (8 * fileid) + 4) - ovyofs;
-
-            snprintf(ovyname, 32, ovyformat, leword(ovy));
-            printf(rowformat, args(ovy), ovyname);
-        }
-
-        free(ovt9);
-    }
-
-    printf(rowformat, args(arm7), "% ARM7 %");
-    if (ovt7size > 0) {
-        printf(rowformat, args(ovt7), "% OVT7 %");
-        unsigned char *ovt7 = malloc(ovt7size);
-        fseek(nds.hdl, ovt7ofs, SEEK_SET);
-        fread(ovt7, 1, ovt7size, nds.hdl);
-
-        const char *ovyformat   = "%% OVY7_0x%04X %%";
-        char        ovyname[32] = { 0 };
-        for (long i = 0; i < ovt7size / 0x20; i++) {
-            unsigned char *ovy     = &ovt7[i * 0x20];
-            long           fileid  = leword(ovy + 0x18);
-            uint32_t       ovyofs  = leword(fatb + (8 * fileid));
-            uint32_t       ovysize = leword(fatb + (8 * fileid) + 4) - ovyofs;
-
-            snprintf(ovyname, 32, ovyformat, leword(ovy));
-            printf(rowformat, args(ovy), ovyname);
-        }
-
-        free(ovt7);
+    const char *names[NUM_ROMSECTIONS] = {
+        [K_romsection_arm9]   = "% ARM9 %",
+        [K_romsection_ovt9]   = "% OVT9 %",
+        [K_romsection_arm7]   = "% ARM7 %",
+        [K_romsection_ovt7]   = "% OVT7 %",
+        [K_romsection_fntb]   = "% FNTB %",
+        [K_romsection_fatb]   = "% FATB %",
+        [K_romsection_banner] = "% BANNER %",
+    };
+
+    for (int i = K_romsection_arm9; i < NUM_ROMSECTIONS; i++) {
+        uint32_t sectofs  = sections[i].start;
+        uint32_t sectsize = sections[i].end - sections[i].start;
+        if ((i == K_romsection_ovt9 || i == K_romsection_ovt7) && sectsize == 0) continue;
+
+        printf(rowformat, args(sect), names[i]);
+        if (i == K_romsection_ovt9) listoverlays(rom, i, "%% OVY9_0x%04X %%");
+        if (i == K_romsection_ovt7) listoverlays(rom, i, "%% OVY7_0x%04X %%");
     }
+    traceend(trace);
 
-    printf(rowformat, args(fntb), "% FNTB %");
-    printf(rowformat, args(fatb), "% FATB %");
-    printf(rowformat, args(bann), "% BANNER %");
-
-    long noverlays = (ovt9size / 0x20) + (ovt7size / 0x20);
-    long nfiles    = (fatbsize / 8) - noverlays;
+    uint32_t ovt9size  = sections[K_romsection_ovt9].end - sections[K_romsection_ovt9].start;
+    uint32_t ovt7size  = sections[K_romsection_ovt7].end - sections[K_romsection_ovt7].start;
+    long     noverlays = (ovt9size / OVT_ENTRY_BSIZE) + (ovt7size / OVT_ENTRY_BSIZE);
+    long     nfiles    = (long)romnfiles(rom) - noverlays;
+    if (nfiles < 0) nfiles = 0;
 
-    unsigned char *fatbfiles = fatb + (8 * noverlays);
-    romfile       *files     = malloc(sizeof(romfile) * nfiles);
+    tracebegin(trace, "list", "files (%ld)", nfiles);
+    romfile *files = malloc(sizeof(romfile) * (nfiles + 1));
     for (long i = 0; i < nfiles; i++) {
-        romfile *file = &files[i];
-        file->fileid  = i + noverlays;
-        file->romofs  = leword(&fatbfiles[(i * 8)]);
-        file->size    = leword(&fatbfiles[(i * 8) + 4]) - file->romofs;
+        romrange range = romfatb(rom, i + noverlays);
+        romfile *file  = &files[i];
+        file->fileid   = i + noverlays;
+        file->romofs   = range.start;
+        file->size     = range.end - range.start;
     }
 
     qsort(files, nfiles, sizeof(romfile), sortfiles);
@@ -165,20 +148,133 @@ int nitrorom_list(int argc, const char **argv)
         char fileid[256];
         snprintf(fileid, 256, "%% FILE ID %d %%", file->fileid);
         printf(rowformat, args(file), fileid);
+        if (args.narcs) listnarc(trace, rom, file->fileid);
     }
+    traceend(trace);
 
     free(files);
-    free(fatb);
-    fclose(nds.hdl);
+    romclose(rom);
+    if (trace && traceclose(trace) != 0) die("could not write trace file “%s”!", args.trace);
     exit(EXIT_SUCCESS);
 }
 
+typedef struct narcname {
+    long ofs; // offset of the member's path within `narcnames.paths`
+    long len; // 0 for unnamed members
+} narcname;
+
+typedef struct narcnames {
+    narcname *names; // indexed by member ID
+    char     *paths;
+    long      pathslen;
+} narcnames;
+
+static void collectname(void *user, uint32_t member, string path)
+{
+    narcnames *names = user;
+    if (names->names[member].len > 0) return;
+
+    names->paths = realloc(names->paths, names->pathslen + path.len);
+    memcpy(names->paths + names->pathslen, path.s, path.len);
+
+    names->names[member].ofs  = names->pathslen;
+    names->names[member].len  = path.len;
+    names->pathslen          += path.len;
+}
+
+// Emit one row for each member of a filesystem member which is itself a NARC. Members are listed
+// at their absolute offsets within the ROM; padding is relative to the archive's alignment.
+static void listnarcmembers(romreader *rom, uint32_t fileid)
+{
+    romrange range = romfatb(rom, fileid);
+    string   data  = rombytes(rom, range);
+    if (data.len < NARC_HEADER_BSIZE || memcmp(data.s, "NARC", 4) != 0) return;
+
+    narcview view = { 0 };
+    if (narc_parse(data, &view) != 0) {
+        fprintf(stderr, PROGRAM_NAME ": FILE ID %u looks like a NARC but is malformed\n", fileid);
+        return;
+    }
+
+    narcnames names = { .names = calloc(view.nmembers + 1, sizeof(narcname)) };
+    narc_names(&view, collectname, &names);
+
+    const char *rowformat = "0x%08X,0x%08X,0x%08X,0x%04X,%s\n";
+    uint32_t    imageofs  = range.start + (uint32_t)(view.image - data.s);
+    for (uint32_t i = 0; i < view.nmembers; i++) {
+        uint32_t start = leword(view.fatb + (8 * i));
+        uint32_t end   = leword(view.fatb + (8 * i) + 4);
+        if (start > end || end > view.imagesize) continue;
+
+        char     component[512];
+        narcname name = names.names[i];
+        if (name.len > 0) {
+            snprintf(
+                component,
+                sizeof(component),
+                "%% FILE ID %u / %.*s %%",
+                fileid,
+                (int)name.len,
+                names.paths + name.ofs
+            );
+        } else {
+            snprintf(component, sizeof(component), "%% FILE ID %u / MEMBER %u %%", fileid, i);
+        }
+
+        printf(
+            rowformat,
+            imageofs + start,
+            imageofs + end,
+            end - start,
+            -end & (NARC_ALIGN - 1),
+            component
+        );
+    }
+
+    free(names.names);
+    free(names.paths);
+}
+
+static void listnarc(tracer *trace, romreader *rom, uint32_t fileid)
+{
+    tracebegin(trace, "narc", "FILE ID %u", fileid);
+    listnarcmembers(rom, fileid);
+    traceend(trace);
+}
+
+static args parseargs(const char **argv)
+{
+    args args = { 0 };
+
+    // clang-format off
+    const clipopt options[] = {
+        { .longopt = "narcs", .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.narcs },
+        { .longopt = "trace", .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.trace },
+        { 0 },
+    };
+
+    const clippos positionals[] = {
+        { .name = "input", .target = &args.infile },
+        { 0 },
+    };
+    // clang-format on
+
+    clip clip = clipinit(argv);
+    if (cliparse(&clip, options, positionals, NULL)) dieusage("%s", clip.err);
+
+    return args;
+}
+
 static void showusage(FILE *stream)
 {
     fprintf(stream, "nitrorom-list - List the components of a Nintendo DS ROM\n");
     fprintf(stream, "\n");
-    fprintf(stream, "Usage: nitrorom list <INPUT.NDS>\n");
+    fprintf(stream, "Usage: nitrorom list [OPTIONS] <INPUT.NDS>\n");
     fprintf(stream, "\n");
     fprintf(stream, "Options:\n");
+    fprintf(stream, "  --narcs                Also list the members of each filesystem member\n");
+    fprintf(stream, "                         which is a NARC, following the row of the NARC.\n");
+    fprintf(stream, "  --trace FILE           Record the spans of each section of the listing\n");
+    fprintf(stream, "                         to FILE as Chrome trace-event JSON.\n");
     fprintf(stream, "  -h / --help            Display this help-text and exit.\n");
 }
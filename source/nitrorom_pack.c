@@ -4,53 +4,145 @@
  * nitrorom-pack - Produce a Nintendo DS ROM from sources
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "nitrorom.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "config.h"
 #include "constants.h"
 #include "packer.h"
 
 #include "libs/clip.h"
 #include "libs/config.h"
 #include "libs/fileio.h"
+#include "libs/log.h"
+#include "libs/meter.h"
 #include "libs/sheets.h"
 #include "libs/strings.h"
 #include "libs/vector.h"
+#include "libs/watch.h"
 
-#define PROGRAM_NAME "nitrorom-pack"
+#define PROGRAM_NAME   "nitrorom-pack"
+#define TRACE_ROWBATCH 1024 // FILESYS records per span
+#define WATCH_SETTLE   100  // milliseconds without further changes before acting on a change
 
 typedef struct args {
     const char *config;
     const char *files;
     const char *workdir;
     const char *outfile;
+    const char *plan;
+    const char *cache;
+    const char *timings;
+    const char *trace;
+    const char *loglevel;
+    const char *server;
+    const char *layout;
+    const char *order;
+    const char *map;
 
     vector vardefs;
+    vector variants; // T = const char *; each as given to “--variant”
 
+    long compress;
     long dryrun;
     long verbose;
+    long logjson;
+    long mapjson;
+    long watch;
 } args;
 
-// clang-format off
-static const cfgsection cfgsections[] = {
-    { .section = string("header"),   .handler = cfg_header },
-    { .section = string("rom"),      .handler = cfg_rom    },
-    { .section = string("banner"),   .handler = cfg_banner },
-    { .section = string("arm9"),     .handler = cfg_arm9   },
-    { .section = string("arm7"),     .handler = cfg_arm7   },
-    { .section = stringZ,            .handler = NULL       },
+// Everything needed to build a packer after the working directory has changed, including each
+// rebuild while watching its inputs.
+typedef struct session {
+    args       *args;
+    char       *cfgpath;
+    char       *csvpath; // NULL if FILESYS is read from standard input
+    char       *cachedir;
+    char       *planfile;
+    char       *layoutpath; // NULL unless the layout of a previous ROM is kept
+    int         ownlayout;  // 1 if the previous ROM is the output itself
+    char       *orderpath;  // NULL unless members are placed in order of an access trace
+    char       *mappath;    // NULL unless a map of the ROM's layout is written
+    string      plankey;
+    logger     *log;
+    meter      *timings;
+    tracer     *trace;
+    fview       cfgfile; // backs configuration values held by the current packer
+    fview       csvfile; // backs filesystem members held by the current packer
+} session;
+
+// One ROM of a multi-variant pack. Definitions refer into the variant's specification.
+typedef struct variant {
+    char  *outfile;
+    char  *overlay; // NULL if the variant does not add to or replace members of FILESYS
+    vector vardefs; // T = strpair; those of the invocation, overridden by those of the variant
+} variant;
+
+typedef struct input {
+    string path; // owned by the resident packer, or by the resident itself
+    stamp  stamp;
+} input;
+
+// A sealed packer, together with everything which it refers to and the fingerprint of each file
+// which was read to build it.
+typedef struct resident {
+    string     key;
+    rompacker *packer;
+    char      *cfgpath;
+    char      *csvpath;
+    fview      cfgfile;
+    fview      csvfile;
+    vector     inputs; // T = input
+    long       lastuse;
+} resident;
+
+struct packcache {
+    resident *residents;
+    int       len;
+    int       capacity;
+    long      clock;
 };
-// clang-format on
 
-static void   showusage(FILE *stream);
-static args   parseargs(const char **argv);
-static string tryfload(const char *filename);
+typedef void (*inputfunc)(void *user, string path);
+
+static void         showusage(FILE *stream);
+static int          parseargs(args *args, const char **argv);
+static int          pack(args *args, packcache *cache, int *warm);
+static logger      *openlog(args *args);
+static char        *abspath(const char *cwd, const char *path);
+static int          samepath(const char *cwd, const char *a, const char *b);
+static string       makeplankey(session *sess);
+static string       residentkey(session *sess);
+static rompacker   *build(session *sess, string cfg, string csv);
+static rompacker   *newpacker(session *sess, vector *vardefs);
+static int          configure(session *sess, rompacker *packer, string cfg);
+static int          addfilesys(session *sess, rompacker *packer, string csv);
+static int          keeplayout(session *sess, rompacker *packer);
+static int          orderaccess(session *sess, rompacker *packer);
+static int          sealpacker(rompacker *packer);
+static int          packvariants(session *sess, const char *cwd);
+static int          dumpfailed(enum dumperr err, const char *outname);
+static void         saveplan(session *sess, rompacker *packer);
+static int          dumprom(rompacker *packer, FILE *outfile, const char *outname);
+static int          writemap(session *sess, rompacker *packer);
+static void         eachinput(rompacker *packer, string cfg, string csv, inputfunc fn, void *user);
+static rompacker   *recall(packcache *cache, session *sess, string key);
+static void         keep(packcache *cache, session *sess, string key, rompacker *packer);
+static void         forget(packcache *cache, rompacker *packer);
+static void         watchinputs(session *sess, rompacker **packer, FILE *outfile);
+static cfgresult    tracedconfig(rompacker *packer, string cfg);
+static sheetsresult tracedfilesys(rompacker *packer, string csv);
+static void         showtimings(FILE *stream, const meter *timings, meter total);
+static void         dumptimings(FILE *stream, const meter *timings, meter total);
 
 #define dumpargs(__memb) (__memb).source.buf, (__memb).size
 
@@ -61,56 +153,912 @@ int nitrorom_pack(int argc, const char **argv)
         exit(EXIT_SUCCESS);
     }
 
-    args   args    = parseargs(argv);
-    string cfgfile = tryfload(args.config);
-    string csvfile = tryfload(args.files);
-    FILE  *outfile = NULL;
-    if (!args.dryrun) {
-        outfile = fopen(args.outfile, "wb");
-        if (!outfile) die("could not open output file “%s”!", args.outfile);
+    args args = { 0 };
+    if (parseargs(&args, argv) != 0) exit(EXIT_FAILURE);
+    if (!args.server) return pack(&args, NULL, NULL);
+
+    logger *log = openlog(&args);
+    if (!log) die("could not open the log stream!");
+
+    double wall   = 0;
+    int    warm   = 0;
+    int    status = packremote(args.server, argc, argv, &wall, &warm);
+    if (status < 0) die("could not be served by “%s”: %s", args.server, strerror(errno));
+    loginfo(log, PROGRAM_NAME, "served in %.6f seconds (%s)", wall, warm ? "warm" : "cold");
+    if (logclose(log) != 0) die("could not write to the log stream!");
+
+    free(args.vardefs.data);
+    free(args.variants.data);
+    return status;
+}
+
+int packserved(int argc, const char **argv, packcache *cache, int *warm)
+{
+    *warm = 0;
+    if (argc <= 1 || strncmp(argv[1], "-h", 2) == 0 || strncmp(argv[1], "--help", 6) == 0) {
+        showusage(stderr);
+        return EXIT_SUCCESS;
+    }
+
+    args args = { 0 };
+    if (parseargs(&args, argv) != 0) {
+        free(args.vardefs.data);
+        free(args.variants.data);
+        return EXIT_FAILURE;
     }
 
-    chdir(args.workdir);
+    // A server has neither a standard-input of the client's nor a way to report later changes.
+    if (strcmp(args.files, "-") == 0 || args.watch) {
+        complainusage("%s", "a server cannot read FILESYS from standard input or watch its inputs");
+        free(args.vardefs.data);
+        free(args.variants.data);
+        return EXIT_FAILURE;
+    }
 
-    rompacker *packer = rompacker_new((unsigned int)args.verbose, &args.vardefs);
-    dieiferr(cfgparse(cfgfile, cfgsections, packer), cfgresult);
-    dieiferr(csvparse(csvfile, NULL, csv_addfile, packer), sheetsresult);
+    return pack(&args, cache, warm);
+}
 
-    if (rompacker_seal(packer) != 0) {
-        int maxshift = packer->prom ? MAX_CAPSHIFT_PROM : MAX_CAPSHIFT_MROM;
-        die("computed ROM size exceeds allowable maximum of 0x%08X!\n",
-            TRY_CAPSHIFT_BASE << maxshift);
+#define failwith(__msg, ...)            \
+    {                                   \
+        complain(__msg, ##__VA_ARGS__); \
+        goto fail;                      \
+    }
+
+// Packs the ROM described by `args`, releasing them. If `cache` is not NULL, then a resident packer
+// is reused if none of its inputs have changed, and any freshly-built packer is kept resident.
+static int pack(args *args, packcache *cache, int *warm)
+{
+    int        status  = EXIT_FAILURE;
+    int        stdinfs = strcmp(args->files, "-") == 0;
+    meter     *timings = args->timings ? calloc(NUM_ROMPHASES, sizeof(meter)) : NULL;
+    meter      begin   = timings ? meterread(M_full) : (meter){ 0 };
+    tracer    *trace   = args->trace ? traceopen(args->trace) : NULL;
+    logger    *log     = NULL;
+    FILE      *outfile = NULL;
+    char      *outpath = NULL;
+    char      *staged  = NULL; // NULL once the ROM is moved over `outpath`
+    rompacker *packer  = NULL;
+    string     key     = stringZ;
+    session    sess    = { .args = args };
+    if (args->trace && !trace) failwith("could not open trace file “%s”!", args->trace);
+
+    log = openlog(args);
+    if (!log) failwith("could not open the log stream!");
+
+    char cwd[4096] = { 0 };
+    getcwd(cwd, sizeof(cwd));
+    if (chdir(args->workdir) != 0) failwith("could not change to directory “%s”!", args->workdir);
+
+    sess.cfgpath    = abspath(cwd, args->config);
+    sess.csvpath    = stdinfs ? NULL : abspath(cwd, args->files);
+    sess.cachedir   = abspath(cwd, args->cache);
+    sess.planfile   = args->plan ? abspath(cwd, args->plan) : NULL;
+    sess.layoutpath = args->layout ? abspath(cwd, args->layout) : NULL;
+    sess.ownlayout  = args->layout && samepath(cwd, args->layout, args->outfile);
+    sess.orderpath  = args->order ? abspath(cwd, args->order) : NULL;
+    sess.mappath    = args->map ? abspath(cwd, args->map) : NULL;
+    sess.plankey    = args->plan ? makeplankey(&sess) : stringZ;
+    outpath         = args->dryrun ? NULL : abspath(cwd, args->outfile);
+    sess.log        = log;
+    sess.timings    = timings;
+    sess.trace      = trace;
+
+    if (cache) {
+        key    = residentkey(&sess);
+        packer = recall(cache, &sess, key);
+        *warm  = packer != NULL;
     }
 
-    if (args.dryrun) {
+    if (!packer) {
+        sess.cfgfile = fmap(sess.cfgpath);
+        sess.csvfile = stdinfs ? fmapstream(stdin) : fmap(sess.csvpath);
+        if (sess.cfgfile.data.len < 0) {
+            failwith("could not load input file “%s”: %s", args->config, strerror(errno));
+        } else if (sess.csvfile.data.len < 0 && stdinfs) {
+            failwith("could not read filesystem from standard input!");
+        } else if (sess.csvfile.data.len < 0) {
+            failwith("could not load input file “%s”: %s", args->files, strerror(errno));
+        }
+
+        if (args->variants.len == 0) {
+            packer = build(&sess, sess.cfgfile.data, sess.csvfile.data);
+            if (!packer) goto fail;
+            if (cache) keep(cache, &sess, key, packer);
+        }
+    }
+
+    if (args->variants.len > 0) {
+        if (packvariants(&sess, cwd) != 0) goto fail;
+    } else if (args->dryrun) {
         fdump("header.sbin", dumpargs(packer->header));
         fdump("banner.sbin", dumpargs(packer->banner));
         fdump("fntb.sbin", dumpargs(packer->fntb));
         fdump("fatb.sbin", dumpargs(packer->fatb));
     } else {
-        enum dumperr err = rompacker_dump(packer, outfile);
-        switch (err) {
-        case E_dump_packing: die("packer was not correctly sealed!");
-        case E_dump_ok:      break;
+        // The ROM is written beside the output and only moved over it once complete, so that a
+        // failed pack leaves any previous ROM (which may be the layout being kept) as it was.
+        outfile = fstage(outpath, &staged);
+        if (!outfile) failwith("could not open output file “%s”!", args->outfile);
+        if (dumprom(packer, outfile, args->outfile) != 0) goto fail;
+
+        int flushed = fflush(outfile) == 0;
+        int moved   = fcommit(staged, flushed ? outpath : NULL) == 0 && flushed;
+        staged      = NULL;
+        if (!moved) failwith("could not write output file “%s”!", args->outfile);
+    }
+
+    if (sess.mappath && packer && writemap(&sess, packer) != 0) goto fail;
+
+    if (timings) {
+        fflush(NULL); // so that buffered output is counted as written, and precedes the report
+
+        meter total = { 0 };
+        meteradd(&total, begin, meterread(M_full));
+        if (strcmp(args->timings, "json") == 0) dumptimings(stderr, timings, total);
+        else showtimings(stderr, timings, total);
+    }
+
+    int traced = trace ? traceclose(trace) : 0;
+    trace      = NULL;
+    if (traced != 0) failwith("could not write trace file “%s”!", args->trace);
+
+    if (args->watch) {
+        // Only the initial pack is metered and traced.
+        sess.timings    = NULL;
+        sess.trace      = NULL;
+        packer->timings = NULL;
+        packer->trace   = NULL;
+        watchinputs(&sess, &packer, outfile);
+    }
+
+    status = EXIT_SUCCESS;
+
+fail:
+    if (cache && packer) {
+        // A packer which failed to dump may have been left mid-way through reading a NARC.
+        if (status != EXIT_SUCCESS) {
+            forget(cache, packer);
+        } else {
+            packer->log     = NULL;
+            packer->timings = NULL;
+            packer->trace   = NULL;
         }
+    } else if (packer) {
+        rompacker_del(packer);
     }
 
-    rompacker_del(packer);
-    free(cfgfile.s);
-    free(csvfile.s);
-    free(args.vardefs.data);
+    if (log && logclose(log) != 0) {
+        status = EXIT_FAILURE;
+        complain("could not write to the log stream!");
+    }
+
+    if (trace) traceclose(trace);
+    free(timings);
+    free(key.s);
+    free(sess.cfgpath);
+    free(sess.csvpath);
+    free(sess.cachedir);
+    free(sess.planfile);
+    free(sess.layoutpath);
+    free(sess.orderpath);
+    free(sess.mappath);
+    free(sess.plankey.s);
+    free(outpath);
+    funmap(sess.cfgfile);
+    funmap(sess.csvfile);
+    free(args->vardefs.data);
+    free(args->variants.data);
     if (outfile) fclose(outfile);
-    exit(EXIT_SUCCESS);
+    if (staged) fcommit(staged, NULL);
+    return status;
+}
+
+static logger *openlog(args *args)
+{
+    enum loglevel  level  = args->loglevel ? (enum loglevel)loglevelof(args->loglevel) : L_warn;
+    enum logformat format = args->logjson ? L_json : L_text;
+    return logopen(stderr, args->verbose ? L_debug : level, format);
+}
+
+#define failiferr(__cond, __resT)               \
+    {                                           \
+        __resT __res = __cond;                  \
+        if (__res.code != 0) {                  \
+            fflush(NULL);                       \
+            fprintf(stderr, "%s\n", __res.msg); \
+            goto fail;                          \
+        }                                       \
+    }
+
+// Build a sealed packer, either from its plan or from the parsed configuration and filesystem. The
+// packer may refer into `cfg` and `csv`, which must outlive it. Failures are reported to
+// standard-error, and NULL is returned.
+static rompacker *build(session *sess, string cfg, string csv)
+{
+    args      *args    = sess->args;
+    logger    *log     = sess->log;
+    meter     *timings = sess->timings;
+    tracer    *trace   = sess->trace;
+    rompacker *packer  = NULL;
+    if (sess->planfile) {
+        static const char *planstatus[] = {
+            [E_plan_ok]      = "up-to-date",
+            [E_plan_missing] = "missing",
+            [E_plan_corrupt] = "corrupt",
+            [E_plan_version] = "from an incompatible version",
+            [E_plan_stale]   = "stale",
+            [E_plan_packing] = "unsealed",
+            [E_plan_memory]  = "not persistable",
+        };
+
+        enum planerr err = rompacker_loadplan(&packer, sess->planfile, sess->plankey);
+        loginfo(log, "rompacker:plan", "“%s” is %s", args->plan, planstatus[err]);
+    }
+
+    if (packer) {
+        packer->log     = log;
+        packer->timings = timings;
+        packer->trace   = trace;
+        return packer;
+    }
+
+    packer = newpacker(sess, &args->vardefs);
+    if (!packer) return NULL;
+    if (configure(sess, packer, cfg) != 0) goto fail;
+    if (addfilesys(sess, packer, csv) != 0) goto fail;
+    if (sess->layoutpath && keeplayout(sess, packer) != 0) goto fail;
+    if (sess->orderpath && orderaccess(sess, packer) != 0) goto fail;
+    if (sealpacker(packer) != 0) goto fail;
+
+    if (sess->planfile) {
+        rompacker_depend(packer, string(sess->cfgpath, strlen(sess->cfgpath)));
+        rompacker_depend(packer, string(sess->csvpath, strlen(sess->csvpath)));
+        saveplan(sess, packer);
+    }
+
+    return packer;
+
+fail:
+    rompacker_del(packer);
+    return NULL;
+}
+
+// Create an empty packer for the session, with the given definitions. Definitions and the cache
+// directory are copied, so that the packer may outlive its request.
+static rompacker *newpacker(session *sess, vector *vardefs)
+{
+    rompacker *packer = rompacker_new(0, NULL);
+    if (!packer) {
+        complain("could not open the working directory!");
+        return NULL;
+    }
+
+    rompacker_setlog(packer, sess->log);
+
+    for (int i = 0; i < vardefs->len; i++) {
+        strpair *pair = get(vardefs, strpair, i);
+        rompacker_define(packer, pair->head, pair->tail);
+    }
+
+    packer->compress = (unsigned int)sess->args->compress;
+    packer->cachedir = rompacker_own(packer, string(sess->cachedir, strlen(sess->cachedir)));
+    packer->timings  = sess->timings;
+    packer->trace    = sess->trace;
+    return packer;
+}
+
+// The following stages each report their failures to standard-error and return -1.
+static int configure(session *sess, rompacker *packer, string cfg)
+{
+    meter  *timings = sess->timings;
+    tracer *trace   = sess->trace;
+
+    meter phase = timings ? meterread(M_full) : (meter){ 0 };
+    tracebegin(trace, "phase", "%s", rompacker_phasenames[P_config]);
+    cfgresult parsed = trace ? tracedconfig(packer, cfg)
+                             : cfgparse(cfg, rompacker_cfgsections, packer);
+    traceend(trace);
+    failiferr(parsed, cfgresult);
+    if (timings) meteradd(&timings[P_config], phase, meterread(M_full));
+    return 0;
+
+fail:
+    return -1;
+}
+
+static int addfilesys(session *sess, rompacker *packer, string csv)
+{
+    meter  *timings = sess->timings;
+    tracer *trace   = sess->trace;
+
+    meter phase = timings ? meterread(M_full) : (meter){ 0 };
+    tracebegin(trace, "phase", "%s", rompacker_phasenames[P_filesys]);
+    if (tarprobe(csv)) {
+        // Members of an archive on disk are read back from it when dumping; members of an
+        // archive from standard input refer directly into the buffered stream.
+        string tarname = sess->csvpath ? string(sess->csvpath, strlen(sess->csvpath)) : stringZ;
+        failiferr(rompacker_addtar(packer, csv, tarname), tarresult);
+    } else if (trace) {
+        failiferr(tracedfilesys(packer, csv), sheetsresult);
+    } else {
+        failiferr(csvparse(csv, NULL, csv_addfile, packer), sheetsresult);
+    }
+    traceend(trace);
+    if (timings) meteradd(&timings[P_filesys], phase, meterread(M_full));
+    return 0;
+
+fail:
+    return -1;
+}
+
+// A previous ROM which does not yet exist (e.g., before the first build, when it is also the
+// output) leaves every member to be placed afresh.
+static int keeplayout(session *sess, rompacker *packer)
+{
+    fview prev = fmap(sess->layoutpath);
+    if ((prev.data.len < 0 && errno == ENOENT) || prev.data.len == 0) {
+        loginfo(sess->log, "rompacker:layout", "“%s” is empty or missing", sess->args->layout);
+        funmap(prev);
+        return 0;
+    } else if (prev.data.len < 0) {
+        complain("could not load previous ROM “%s”: %s", sess->args->layout, strerror(errno));
+        return -1;
+    }
+
+    enum layouterr err = rompacker_keeplayout(packer, prev.data);
+    funmap(prev);
+    if (err != E_layout_ok) {
+        complain("could not read the layout of previous ROM “%s”!", sess->args->layout);
+        return -1;
+    }
+
+    return 0;
+}
+
+// The trace is an input of the packer, so that a plan or a resident packer is not reused after it
+// changes, and so that changing it while watching repacks the ROM.
+static int orderaccess(session *sess, rompacker *packer)
+{
+    fview trace = fmap(sess->orderpath);
+    if (trace.data.len < 0) {
+        complain("could not load access trace “%s”: %s", sess->args->order, strerror(errno));
+        return -1;
+    }
+
+    enum accesserr err = rompacker_accessorder(packer, trace.data);
+    funmap(trace);
+    if (err != E_access_ok) {
+        complain("could not read access trace “%s”: %s", sess->args->order, packer->errmsg);
+        return -1;
+    }
+
+    rompacker_depend(packer, string(sess->orderpath, strlen(sess->orderpath)));
+    return 0;
+}
+
+static int sealpacker(rompacker *packer)
+{
+    enum sealerr err = rompacker_seal(packer);
+    if (err == E_seal_narc || err == E_seal_compress) {
+        fflush(NULL); // so that buffered logs precede the error
+        fprintf(stderr, "%s\n", packer->errmsg);
+        return -1;
+    } else if (err == E_seal_toolarge) {
+        int maxshift = packer->prom ? MAX_CAPSHIFT_PROM : MAX_CAPSHIFT_MROM;
+        fflush(NULL);
+        fprintf(
+            stderr,
+            PROGRAM_NAME ": computed ROM size exceeds allowable maximum of 0x%08X!\n\n",
+            TRY_CAPSHIFT_BASE << maxshift
+        );
+        return -1;
+    }
+
+    return 0;
+}
+
+static void saveplan(session *sess, rompacker *packer)
+{
+    if (rompacker_saveplan(packer, sess->planfile, sess->plankey) != E_plan_ok) {
+        logwarn(sess->log, PROGRAM_NAME, "could not write plan file “%s”", sess->args->plan);
+    }
+}
+
+static int dumprom(rompacker *packer, FILE *outfile, const char *outname)
+{
+    return dumpfailed(rompacker_dump(packer, outfile), outname);
+}
+
+static int writemap(session *sess, rompacker *packer)
+{
+    FILE *mapfile = fopen(sess->mappath, "w");
+    if (!mapfile) {
+        complain("could not open map file “%s”!", sess->args->map);
+        return -1;
+    }
+
+    enum mapformat format = sess->args->mapjson ? K_map_json : K_map_text;
+    enum dumperr   err    = rompacker_writemap(packer, mapfile, format);
+    if (fclose(mapfile) != 0 && err == E_dump_ok) err = E_dump_write;
+    return dumpfailed(err, sess->args->map);
+}
+
+static int dumpfailed(enum dumperr err, const char *outname)
+{
+    static const char *dumpfailures[] = {
+        [E_dump_packing] = "packer was not correctly sealed!",
+        [E_dump_nofile]  = "could not open a filesystem member while writing the ROM!",
+        [E_dump_read]    = "a source file was truncated while writing the ROM!",
+    };
+
+    if (err == E_dump_write) {
+        complain("could not write output file “%s”!", outname);
+    } else if (err != E_dump_ok) {
+        complain("%s", dumpfailures[err]);
+    }
+
+    return err == E_dump_ok ? 0 : -1;
+}
+
+// A variant's specification is its output path, followed by comma-separated definitions and at
+// most one “@”-prefixed overlay; `parseargs` has already checked its shape. Paths are resolved
+// against `cwd`.
+static variant parsevariant(const char *cwd, const char *spec, const vector *vardefs)
+{
+    variant v = { .vardefs = newvec(strpair, vardefs->len + 8) };
+    for (int i = 0; i < vardefs->len; i++) *push(&v.vardefs, strpair) = *get(vardefs, strpair, i);
+
+    strpair fields = strcut(string(spec, strlen(spec)), ',');
+    char   *path   = strndup((const char *)fields.head.s, fields.head.len);
+    v.outfile      = abspath(cwd, path);
+    free(path);
+
+    while (fields.tail.s) {
+        fields = strcut(fields.tail, ',');
+        if (fields.head.s[0] == '@') {
+            path      = strndup((const char *)fields.head.s + 1, fields.head.len - 1);
+            v.overlay = abspath(cwd, path);
+            free(path);
+            continue;
+        }
+
+        strpair def = strcut(fields.head, '=');
+        int     i   = 0;
+        for (; i < v.vardefs.len && !strequ(get(&v.vardefs, strpair, i)->head, def.head); i++);
+        if (i < v.vardefs.len) *get(&v.vardefs, strpair, i) = def;
+        else *push(&v.vardefs, strpair) = def;
+    }
+
+    return v;
+}
+
+// Pack each variant against one scan of FILESYS, which every variant inherits after its own overlay
+// is added. The first variant's ROM is written from sources; each later ROM copies the members
+// which it shares with the first out of that ROM.
+static int packvariants(session *sess, const char *cwd)
+{
+    args      *args     = sess->args;
+    int        status   = -1;
+    int        nvars    = args->variants.len;
+    variant   *variants = calloc(nvars, sizeof(variant));
+    fview     *overlays = calloc(nvars, sizeof(fview));
+    rompacker *base     = NULL;
+    rompacker *donor    = NULL;
+    rompacker *packer   = NULL;
+    int        donorfd  = -1;
+    int        fd       = -1;
+    for (int i = 0; i < nvars; i++) {
+        variants[i] = parsevariant(cwd, *get(&args->variants, const char *, i), &args->vardefs);
+    }
+
+    base = newpacker(sess, &args->vardefs);
+    if (!base || addfilesys(sess, base, sess->csvfile.data) != 0) goto fail;
+
+    for (int i = 0; i < nvars; i++) {
+        variant *v = &variants[i];
+        fd         = open(v->outfile, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            complain("could not open output file “%s”!", v->outfile);
+            goto fail;
+        }
+
+        packer = newpacker(sess, &v->vardefs);
+        if (!packer || configure(sess, packer, sess->cfgfile.data) != 0) goto fail;
+
+        if (v->overlay) {
+            overlays[i] = fmap(v->overlay);
+            if (overlays[i].data.len < 0) {
+                complain("could not load overlay “%s”: %s", v->overlay, strerror(errno));
+                goto fail;
+            }
+
+            failiferr(csvparse(overlays[i].data, NULL, csv_addfile, packer), sheetsresult);
+        }
+
+        failiferr(rompacker_inherit(packer, base), sheetsresult);
+        if (sess->orderpath && orderaccess(sess, packer) != 0) goto fail;
+        if (sealpacker(packer) != 0) goto fail;
+
+        enum dumperr err = donor ? rompacker_dumpshared(packer, fd, donor, donorfd)
+                                 : rompacker_dumpfd(packer, fd);
+        if (dumpfailed(err, v->outfile) != 0) goto fail;
+        loginfo(sess->log, PROGRAM_NAME, "wrote variant “%s”", v->outfile);
+
+        if (donor) {
+            rompacker_del(packer);
+            close(fd);
+        } else {
+            donor   = packer;
+            donorfd = fd;
+        }
+
+        packer = NULL;
+        fd     = -1;
+    }
+
+    status = 0;
+
+fail:
+    if (packer) rompacker_del(packer);
+    if (donor) rompacker_del(donor);
+    if (base) rompacker_del(base);
+    if (fd >= 0) close(fd);
+    if (donorfd >= 0) close(donorfd);
+    for (int i = 0; i < nvars; i++) {
+        free(variants[i].outfile);
+        free(variants[i].overlay);
+        free(variants[i].vardefs.data);
+        funmap(overlays[i]);
+    }
+
+    free(variants);
+    free(overlays);
+    return status;
+}
+
+// Every file which was read to build the packer is passed to `fn`, including entries of the cache.
+static void eachinput(rompacker *packer, string cfg, string csv, inputfunc fn, void *user)
+{
+    fn(user, cfg);
+    fn(user, csv);
+    fn(user, packer->arm9.source.filename);
+    fn(user, packer->ovt9.source.filename);
+    fn(user, packer->arm7.source.filename);
+    fn(user, packer->ovt7.source.filename);
+    for (int i = 0; i < packer->ovy9.len; i++) {
+        fn(user, get(&packer->ovy9, rommember, i)->source.filename);
+    }
+    for (int i = 0; i < packer->ovy7.len; i++) {
+        fn(user, get(&packer->ovy7, rommember, i)->source.filename);
+    }
+
+    // Members of NARCs are registered as dependencies while sealing.
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind != K_romfile_buffer && file->kind != K_romfile_generator) {
+            fn(user, file->source);
+        }
+    }
+    for (int i = 0; i < packer->deps.len; i++) {
+        fn(user, *get(&packer->deps, string, i));
+    }
+}
+
+packcache *packcachenew(int capacity)
+{
+    packcache *cache = calloc(1, sizeof(*cache));
+    cache->capacity  = capacity > 0 ? capacity : 1;
+    cache->residents = calloc(cache->capacity, sizeof(resident));
+    return cache;
+}
+
+static void evict(packcache *cache, int i)
+{
+    resident *res = &cache->residents[i];
+    rompacker_del(res->packer);
+    funmap(res->cfgfile);
+    funmap(res->csvfile);
+    free(res->key.s);
+    free(res->cfgpath);
+    free(res->csvpath);
+    free(res->inputs.data);
+
+    cache->residents[i] = cache->residents[--cache->len];
+}
+
+void packcachedel(packcache *cache)
+{
+    if (!cache) return;
+
+    while (cache->len > 0) evict(cache, cache->len - 1);
+    free(cache->residents);
+    free(cache);
+}
+
+static void stampinput(void *user, string path)
+{
+    if (path.len == 0) return;
+
+    input *in = push((vector *)user, input);
+    in->path  = path;
+    in->stamp = fstamps(path);
+}
+
+// Returns the resident packer for `key` if none of its inputs has changed since it was built.
+static rompacker *recall(packcache *cache, session *sess, string key)
+{
+    int i = 0;
+    for (; i < cache->len && !strequ(cache->residents[i].key, key); i++);
+    if (i == cache->len) return NULL;
+
+    resident *res = &cache->residents[i];
+    for (int j = 0; j < res->inputs.len; j++) {
+        input *in = get(&res->inputs, input, j);
+        stamp  st = fstamps(in->path);
+        if (st.size != in->stamp.size || st.mtime != in->stamp.mtime
+            || st.mtimens != in->stamp.mtimens) {
+            loginfo(sess->log, PROGRAM_NAME, "“%.*s” has changed", fmtstring(in->path));
+            evict(cache, i);
+            return NULL;
+        }
+    }
+
+    loginfo(sess->log, PROGRAM_NAME, "reusing the resident packer");
+    res->lastuse         = ++cache->clock;
+    res->packer->log     = sess->log;
+    res->packer->timings = sess->timings;
+    res->packer->trace   = sess->trace;
+    return res->packer;
+}
+
+// The packer, the views which back it, and the session's paths are taken by the cache, which evicts
+// its least-recently used resident if it is full.
+static void keep(packcache *cache, session *sess, string key, rompacker *packer)
+{
+    if (cache->len == cache->capacity) {
+        int lru = 0;
+        for (int i = 1; i < cache->len; i++) {
+            if (cache->residents[i].lastuse < cache->residents[lru].lastuse) lru = i;
+        }
+
+        evict(cache, lru);
+    }
+
+    resident *res = &cache->residents[cache->len++];
+    *res          = (resident){
+        .key     = string(malloc(key.len), key.len),
+        .packer  = packer,
+        .cfgpath = sess->cfgpath,
+        .csvpath = sess->csvpath,
+        .cfgfile = sess->cfgfile,
+        .csvfile = sess->csvfile,
+        .inputs  = newvec(input, 256),
+        .lastuse = ++cache->clock,
+    };
+
+    memcpy((char *)res->key.s, key.s, key.len);
+    sess->cfgpath = NULL;
+    sess->csvpath = NULL;
+    sess->cfgfile = (fview){ 0 };
+    sess->csvfile = (fview){ 0 };
+
+    string cfg = string(res->cfgpath, strlen(res->cfgpath));
+    string csv = string(res->csvpath, strlen(res->csvpath));
+    eachinput(packer, cfg, csv, stampinput, &res->inputs);
+}
+
+static void forget(packcache *cache, rompacker *packer)
+{
+    for (int i = 0; i < cache->len; i++) {
+        if (cache->residents[i].packer == packer) {
+            evict(cache, i);
+            return;
+        }
+    }
+}
+
+static int iscached(session *sess, string path)
+{
+    long len = (long)strlen(sess->cachedir);
+    return path.len > len && memcmp(path.s, sess->cachedir, len) == 0 && path.s[len] == '/';
+}
+
+typedef struct watching {
+    watcher *watcher;
+    session *sess;
+} watching;
+
+static void watchpath(void *user, string path)
+{
+    watching *w = user;
+    if (path.len == 0 || iscached(w->sess, path)) return;
+    if (watchadd(w->watcher, path) != 0) {
+        logwarn(w->sess->log, PROGRAM_NAME, "could not watch “%.*s” for changes", fmtstring(path));
+    }
+}
+
+// Every file which was read to build the packer is watched, except for entries of the cache, whose
+// inputs are themselves dependencies of the packer.
+static watcher *watchpacker(session *sess, rompacker *packer)
+{
+    watching w = { .watcher = watchnew(), .sess = sess };
+    if (!w.watcher) die("could not watch the inputs for changes!");
+
+    string cfg = string(sess->cfgpath, strlen(sess->cfgpath));
+    string csv = string(sess->csvpath, strlen(sess->csvpath));
+    eachinput(packer, cfg, csv, watchpath, &w);
+    return w.watcher;
+}
+
+// Returns 1 if the ROM must be repacked from its sources to reflect a change to `path`.
+static int refresh(session *sess, rompacker *packer, string path, int outfd)
+{
+    string cfgpath = string(sess->cfgpath, strlen(sess->cfgpath));
+    string csvpath = string(sess->csvpath, strlen(sess->csvpath));
+    if (strequ(path, cfgpath) || strequ(path, csvpath)) return 1;
+
+    enum refresherr err = rompacker_refresh(packer, path, outfd);
+    switch (err) {
+    case E_refresh_ok:
+    case E_refresh_unused:
+        return 0;
+
+    case E_refresh_layout:
+        loginfo(sess->log, PROGRAM_NAME, "“%.*s” no longer fits the ROM", fmtstring(path));
+        return 1;
+
+    case E_refresh_nofile:
+    case E_refresh_read:
+        logwarn(sess->log, PROGRAM_NAME, "could not read “%.*s”", fmtstring(path));
+        return 1;
+
+    case E_refresh_write:   die("could not write output file “%s”!", sess->args->outfile);
+    case E_refresh_packing: die("packer was not correctly sealed!");
+    }
+
+    return 1;
+}
+
+// The current packer and its ROM are kept if the inputs cannot be rebuilt, until the next change.
+static void repack(session *sess, rompacker **packer, FILE *outfile)
+{
+    loginfo(sess->log, PROGRAM_NAME, "repacking from sources...");
+
+    fview      cfgfile = fmap(sess->cfgpath);
+    fview      csvfile = fmap(sess->csvpath);
+    rompacker *fresh   = NULL;
+    if (cfgfile.data.len < 0 || csvfile.data.len < 0) {
+        logerror(sess->log, PROGRAM_NAME, "could not load CONFIG.INI or FILESYS");
+    } else {
+        fresh = build(sess, cfgfile.data, csvfile.data);
+    }
+
+    if (!fresh) {
+        logerror(sess->log, PROGRAM_NAME, "could not repack; waiting for further changes");
+        funmap(cfgfile);
+        funmap(csvfile);
+        return;
+    }
+
+    rompacker_del(*packer);
+    funmap(sess->cfgfile);
+    funmap(sess->csvfile);
+    *packer       = fresh;
+    sess->cfgfile = cfgfile;
+    sess->csvfile = csvfile;
+
+    rewind(outfile);
+    if (ftruncate(fileno(outfile), 0) != 0) die("could not truncate “%s”!", sess->args->outfile);
+
+    enum dumperr err = rompacker_dump(fresh, outfile);
+    if (err == E_dump_write) die("could not write output file “%s”!", sess->args->outfile);
+    if (err != E_dump_ok) logerror(sess->log, PROGRAM_NAME, "could not read every source file");
+    if (sess->mappath && writemap(sess, fresh) != 0) die("could not write the map of the ROM!");
+}
+
+// Changes to CONFIG.INI, to FILESYS, or to any file which no longer fits the ROM's layout repack
+// the ROM; any other changes are rewritten in place. Returns if the watch is interrupted.
+static void watchinputs(session *sess, rompacker **packer, FILE *outfile)
+{
+    vector changed = newvec(string, 16);
+    for (;;) {
+        watcher *watcher = watchpacker(sess, *packer);
+        int      stale   = 0;
+        while (!stale) {
+            loginfo(sess->log, PROGRAM_NAME, "watching for changes...");
+            fflush(NULL); // so that the ROM is complete on disk, and logs are not held back
+
+            changed.len = 0;
+            if (watchwait(watcher, &changed, WATCH_SETTLE) < 0) {
+                watchdel(watcher);
+                free(changed.data);
+                return;
+            }
+
+            int refreshed = 0;
+            for (int i = 0; i < changed.len && !stale; i++) {
+                string path  = *get(&changed, string, i);
+                stale        = refresh(sess, *packer, path, fileno(outfile));
+                refreshed   += !stale;
+            }
+
+            if (!stale && refreshed > 0 && sess->planfile) saveplan(sess, *packer);
+
+            // Refreshed filesystem members may have grown into their padding.
+            if (!stale && refreshed > 0 && sess->mappath && writemap(sess, *packer) != 0) {
+                die("could not write the map of the ROM!");
+            }
+        }
+
+        watchdel(watcher);
+        repack(sess, packer, outfile);
+    }
+}
+
+// Each key-value pair of the configuration is forwarded to its section's handler within a span.
+static cfgresult tracedsection(string sec, string key, string val, void *user, long line)
+{
+    rompacker        *packer = user;
+    const cfgsection *match  = &rompacker_cfgsections[0];
+    for (; match->handler != NULL && !strequ(sec, match->section); match++);
+
+    tracebegin(packer->trace, "config", "[%.*s] %.*s", fmtstring(sec), fmtstring(key));
+    cfgresult result = match->handler(sec, key, val, user, line);
+    traceend(packer->trace);
+    return result;
+}
+
+static cfgresult tracedconfig(rompacker *packer, string cfg)
+{
+    int nsections = 0;
+    while (rompacker_cfgsections[nsections].handler != NULL) nsections++;
+
+    cfgsection *sections = calloc(nsections + 1, sizeof(cfgsection));
+    for (int i = 0; i < nsections; i++) {
+        sections[i].section = rompacker_cfgsections[i].section;
+        sections[i].handler = tracedsection;
+    }
+
+    cfgresult result = cfgparse(cfg, sections, packer);
+    free(sections);
+    return result;
+}
+
+typedef struct tracedrows {
+    rompacker *packer;
+    long       nrows;
+} tracedrows;
+
+// FILESYS records are added in batches of TRACE_ROWBATCH, each within its own span.
+static sheetsresult tracedrecord(sheetsrecord *record, void *user, int line)
+{
+    tracedrows *rows = user;
+    if (rows->nrows % TRACE_ROWBATCH == 0) {
+        if (rows->nrows > 0) traceend(rows->packer->trace);
+        tracebegin(rows->packer->trace, "filesys", "records from line %d", line);
+    }
+
+    rows->nrows++;
+    return csv_addfile(record, rows->packer, line);
+}
+
+static sheetsresult tracedfilesys(rompacker *packer, string csv)
+{
+    tracedrows   rows   = { .packer = packer, .nrows = 0 };
+    sheetsresult result = csvparse(csv, NULL, tracedrecord, &rows);
+    if (rows.nrows > 0) traceend(packer->trace);
+    return result;
 }
 
 enum cliperr_user {
     E_clip_noequ = E_clip_user,
     E_clip_varset,
+    E_clip_noout,
+    E_clip_overlays,
 };
 
 static int adddefinition(clip *clip, const clipopt *opt, const char *option, void *user)
 {
-    (void)user;
     (void)opt;
 
     string  keyval = string(clip->arg, strlen(clip->arg));
@@ -125,7 +1073,7 @@ static int adddefinition(clip *clip, const clipopt *opt, const char *option, voi
         return E_clip_noequ;
     }
 
-    vector *vardefs = user;
+    vector *vardefs = &((args *)user)->vardefs;
     for (int i = 0; i < vardefs->len; i++) {
         strpair *pair = get(vardefs, strpair, i);
         if (strequ(pair->head, kvpair.head)) {
@@ -145,20 +1093,80 @@ static int adddefinition(clip *clip, const clipopt *opt, const char *option, voi
     return E_clip_none;
 }
 
-static args parseargs(const char **argv)
+static int addvariant(clip *clip, const clipopt *opt, const char *option, void *user)
+{
+    (void)opt;
+
+    // Definitions and overlays may follow the output path in any order, but only one overlay.
+    strpair fields   = strcut(string(clip->arg, strlen(clip->arg)), ',');
+    int     overlays = 0;
+    if (fields.head.len <= 0) {
+        snprintf(clip->err, sizeof(clip->err), "missing output path for option “%s”", option);
+        return E_clip_noout;
+    }
+
+    while (fields.tail.s) {
+        fields = strcut(fields.tail, ',');
+        if (fields.head.len > 1 && fields.head.s[0] == '@') {
+            overlays++;
+        } else if (fields.head.len <= 0 || strcut(fields.head, '=').head.len <= 0
+                   || strcut(fields.head, '=').tail.len <= 0) {
+            snprintf(
+                clip->err,
+                sizeof(clip->err),
+                "expected KEY=VAL or @OVERLAY, but found “%.*s” for option “%s”",
+                fmtstring(fields.head),
+                option
+            );
+            return E_clip_noequ;
+        }
+    }
+
+    if (overlays > 1) {
+        snprintf(clip->err, sizeof(clip->err), "more than one overlay for option “%s”", option);
+        return E_clip_overlays;
+    }
+
+    *push(&((args *)user)->variants, const char *) = clip->arg;
+    return E_clip_none;
+}
+
+#define failusage(__msg, ...)              \
+    {                                      \
+        complainusage(__msg, __VA_ARGS__); \
+        return -1;                         \
+    }
+
+// Usage errors are reported to standard-error, and -1 is returned.
+static int parseargs(args *out, const char **argv)
 {
     args args    = { 0 };
     args.workdir = ".";
-    args.outfile = "rom.nds";
-    args.vardefs = newvec(strpair, 32);
+    args.cache    = ".nitrorom-cache";
+    args.vardefs  = newvec(strpair, 32);
+    args.variants = newvec(const char *, 8);
 
     // clang-format off
     const clipopt options[] = {
-        { .longopt = "define",    .shortopt = 'D',  .hasarg = H_reqarg, .handler = adddefinition },
-        { .longopt = "directory", .shortopt = 'C',  .hasarg = H_reqarg, .starget = &args.workdir },
-        { .longopt = "output",    .shortopt = 'o',  .hasarg = H_reqarg, .starget = &args.outfile },
-        { .longopt = "dry-run",   .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.dryrun  },
-        { .longopt = "verbose",   .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.verbose },
+        { .longopt = "define",    .shortopt = 'D',  .hasarg = H_reqarg, .handler = adddefinition  },
+        { .longopt = "directory", .shortopt = 'C',  .hasarg = H_reqarg, .starget = &args.workdir  },
+        { .longopt = "output",    .shortopt = 'o',  .hasarg = H_reqarg, .starget = &args.outfile  },
+        { .longopt = "plan",      .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.plan     },
+        { .longopt = "cache",     .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.cache    },
+        { .longopt = "compress",  .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.compress },
+        { .longopt = "dry-run",   .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.dryrun   },
+        { .longopt = "verbose",   .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.verbose  },
+        { .longopt = "timings",   .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.timings  },
+        { .longopt = "trace",     .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.trace    },
+        { .longopt = "log-level", .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.loglevel },
+        { .longopt = "log-json",  .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.logjson  },
+        { .longopt = "watch",     .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.watch    },
+        { .longopt = "server",    .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.server   },
+        { .longopt = "variant",   .shortopt = '\0', .hasarg = H_reqarg, .handler = addvariant     },
+        { .longopt = "stable",    .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.layout   },
+        { .longopt = "order",     .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.order    },
+        { .longopt = "map",       .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.map      },
+        { .longopt = "map-json",  .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.mapjson  },
         { 0 },
     };
 
@@ -170,15 +1178,72 @@ static args parseargs(const char **argv)
     // clang-format on
 
     clip clip = clipinit(argv);
-    if (cliparse(&clip, options, positionals, &args.vardefs)) dieusage("%s", clip.err);
-    return args;
+    int  err  = cliparse(&clip, options, positionals, &args);
+    *out      = args;
+    if (err) failusage("%s", clip.err);
+    if (args.timings && strcmp(args.timings, "text") != 0 && strcmp(args.timings, "json") != 0) {
+        failusage("unknown timings format “%s”; expected “text” or “json”", args.timings);
+    }
+    if (args.loglevel && loglevelof(args.loglevel) < 0) {
+        failusage(
+            "unknown log level “%s”; expected “error”, “warn”, “info”, or “debug”",
+            args.loglevel
+        );
+    }
+    if (args.plan && args.files && strcmp(args.files, "-") == 0) {
+        failusage("%s", "option “--plan” cannot be used when reading FILESYS from standard input");
+    }
+    if (args.watch && args.files && strcmp(args.files, "-") == 0) {
+        failusage("%s", "option “--watch” cannot be used when reading FILESYS from standard input");
+    }
+    if (args.watch && args.dryrun) {
+        failusage("%s", "options “--watch” and “--dry-run” cannot be used together");
+    }
+    if (args.server && args.files && strcmp(args.files, "-") == 0) {
+        failusage(
+            "%s",
+            "option “--server” cannot be used when reading FILESYS from standard input"
+        );
+    }
+    if (args.server && args.watch) {
+        failusage("%s", "options “--server” and “--watch” cannot be used together");
+    }
+    if (args.variants.len > 0 && (args.outfile || args.plan || args.watch || args.server)) {
+        failusage(
+            "%s",
+            "option “--variant” cannot be used with “-o”, “--plan”, “--watch”, or “--server”"
+        );
+    }
+    if (args.variants.len > 0 && args.dryrun) {
+        failusage("%s", "options “--variant” and “--dry-run” cannot be used together");
+    }
+    if (args.variants.len > 0 && args.layout) {
+        failusage("%s", "options “--variant” and “--stable” cannot be used together");
+    }
+    if (args.variants.len > 0 && args.map) {
+        failusage("%s", "options “--variant” and “--map” cannot be used together");
+    }
+    if (args.mapjson && !args.map) {
+        failusage("%s", "option “--map-json” requires “--map”");
+    }
+
+    // Without variants, the ROM is written to the one output file.
+    out->outfile = args.outfile ? args.outfile : "rom.nds";
+    return 0;
 }
 
 static void showusage(FILE *stream)
 {
     fprintf(stream, "nitrorom-pack - Produce a Nintendo DS ROM from sources\n");
     fprintf(stream, "\n");
-    fprintf(stream, "Usage: nitrorom pack [OPTIONS] <CONFIG.INI> <FILESYS.CSV>\n");
+    fprintf(stream, "Usage: nitrorom pack [OPTIONS] <CONFIG.INI> <FILESYS>\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "FILESYS is either a CSV of source and target paths or a tar archive whose\n");
+    fprintf(stream, "entries are packed at “/” followed by their names. If FILESYS is “-”, then\n");
+    fprintf(stream, "it is read from standard input. A CSV source which names a directory or a\n");
+    fprintf(stream, "“.narclist” file of source paths is packed as a NARC of those files. An\n");
+    fprintf(stream, "optional third CSV column compresses a file as “lz10”, “lz11”, or “auto”,\n");
+    fprintf(stream, "and an optional fourth column sets its alignment, e.g. “0x4”.\n");
     fprintf(stream, "\n");
     fprintf(stream, "Options:\n");
     fprintf(stream, "  -D / --define KEY=VAL  Define a key-value pair to be used when parsing\n");
@@ -187,17 +1252,252 @@ static void showusage(FILE *stream)
     fprintf(stream, "                         wrapping, e.g. `${KEY}`.\n");
     fprintf(stream, "  -C / --directory DIR   Change to directory DIR before loading any files.\n");
     fprintf(stream, "  -o / --output FILE     Write the output ROM to FILE. Default: “rom.nds”.\n");
+    fprintf(stream, "  --plan FILE            Restore the packing plan in FILE if none of its\n");
+    fprintf(stream, "                         inputs have changed; otherwise, pack from sources\n");
+    fprintf(stream, "                         and store a fresh plan in FILE.\n");
+    fprintf(stream, "  --compress             Compress the ARM9 static binary and each of its\n");
+    fprintf(stream, "                         overlays which is not yet compressed, patching\n");
+    fprintf(stream, "                         the overlay table and the ARM9 module parameters.\n");
+    fprintf(stream, "  --cache DIR            Store compressed members in DIR, where they are\n");
+    fprintf(stream, "                         reused by later runs. Default: “.nitrorom-cache”.\n");
     fprintf(stream, "  --dry-run              Enable dry-run mode; do not create an output ROM\n");
     fprintf(stream, "                         and instead emit computed artifacts: the ROM's\n");
     fprintf(stream, "                         header, banner, and filesystem tables.\n");
     fprintf(stream, "  --verbose              Enable verbose mode; emit additional program logs\n");
-    fprintf(stream, "                         during execution to standard-error.\n");
+    fprintf(stream, "                         during execution to standard-error. Equivalent\n");
+    fprintf(stream, "                         to “--log-level debug”.\n");
+    fprintf(stream, "  --log-level LEVEL      Emit program logs at least as severe as LEVEL,\n");
+    fprintf(stream, "                         which must be one of “error”, “warn”, “info”,\n");
+    fprintf(stream, "                         or “debug”. Default: “warn”.\n");
+    fprintf(stream, "  --log-json             Emit program logs as JSON, one object per line.\n");
+    fprintf(stream, "  --timings FORMAT       Report the time, I/O, and memory spent by each\n");
+    fprintf(stream, "                         phase of packing to standard-error as FORMAT,\n");
+    fprintf(stream, "                         which must be one of “text” or “json”.\n");
+    fprintf(stream, "  --trace FILE           Record the spans of each phase, parallel job, and\n");
+    fprintf(stream, "                         ROM member to FILE as Chrome trace-event JSON.\n");
+    fprintf(stream, "  --watch                After packing, watch CONFIG.INI, FILESYS, and\n");
+    fprintf(stream, "                         each source file until interrupted. Members\n");
+    fprintf(stream, "                         whose new content still fits their place in\n");
+    fprintf(stream, "                         the ROM are rewritten in place; any other\n");
+    fprintf(stream, "                         change repacks the ROM from its sources.\n");
+    fprintf(stream, "  --server SOCKET        Send the request to the `nitrorom serve` process\n");
+    fprintf(stream, "                         listening on SOCKET, which reuses its packers\n");
+    fprintf(stream, "                         while none of their inputs have changed.\n");
+    fprintf(stream, "  --stable ROM           Keep each filesystem member at its offset within\n");
+    fprintf(stream, "                         ROM (e.g., the previous output) where it still\n");
+    fprintf(stream, "                         fits; place the others in free space or at the\n");
+    fprintf(stream, "                         end. The FNTB and file IDs are unaffected.\n");
+    fprintf(stream, "  --order TRACE          Place the filesystem members listed in TRACE, one\n");
+    fprintf(stream, "                         target path or file ID per line in the order that\n");
+    fprintf(stream, "                         they are read at run-time, ahead of all others so\n");
+    fprintf(stream, "                         that members read together are contiguous. The\n");
+    fprintf(stream, "                         FNTB and file IDs are unaffected.\n");
+    fprintf(stream, "  --map FILE             Write a map of the ROM's layout to FILE: its\n");
+    fprintf(stream, "                         size, header and banner CRCs, and the class,\n");
+    fprintf(stream, "                         source, target, file ID, overlay ID, offset,\n");
+    fprintf(stream, "                         size, and padding of each member by offset.\n");
+    fprintf(stream, "  --map-json             Write the map as one JSON object, not as text.\n");
+    fprintf(stream, "  --variant SPEC         Pack one variant of the ROM, where SPEC is its\n");
+    fprintf(stream, "                         output path, then comma-separated KEY=VAL\n");
+    fprintf(stream, "                         definitions, then an optional “@OVERLAY” CSV\n");
+    fprintf(stream, "                         whose members replace or extend FILESYS. May be\n");
+    fprintf(stream, "                         repeated; variants share one scan of FILESYS,\n");
+    fprintf(stream, "                         and members which match the first variant's are\n");
+    fprintf(stream, "                         copied out of its ROM.\n");
     fprintf(stream, "  -h / --help            Display this help-text and exit.\n");
 }
 
-static string tryfload(const char *filename)
+static char *abspath(const char *cwd, const char *path)
 {
-    string fcont = fload(filename);
-    if (fcont.len < 0) die("could not load input file “%s”: %s", filename, strerror(errno));
-    return fcont;
+    size_t cwdlen  = strlen(cwd);
+    size_t pathlen = strlen(path);
+    char  *result  = malloc(cwdlen + pathlen + 2);
+
+    if (path[0] == '/') {
+        memcpy(result, path, pathlen + 1);
+    } else {
+        memcpy(result, cwd, cwdlen);
+        result[cwdlen] = '/';
+        memcpy(result + cwdlen + 1, path, pathlen + 1);
+    }
+
+    return result;
+}
+
+static int samepath(const char *cwd, const char *a, const char *b)
+{
+    char *abspatha = abspath(cwd, a);
+    char *abspathb = abspath(cwd, b);
+    int   same     = strcmp(abspatha, abspathb) == 0;
+
+    free(abspatha);
+    free(abspathb);
+    return same;
+}
+
+// A plan is only valid for the same program version, working directory, compression mode, and
+// variable definitions which were used to build it, and for the same choice of a stable layout and
+// of an access trace. Any previous ROM whose layout is kept is fingerprinted, unless it is the
+// output itself, which changes with every pack.
+static string makeplankey(session *sess)
+{
+    args *args          = sess->args;
+    char  workdir[4096] = { 0 };
+    getcwd(workdir, sizeof(workdir));
+
+    stamp       layout    = { 0 };
+    const char *layoutfmt = "stable=%s\nsize=%lld\nmtime=%lld.%09ld\n";
+    if (sess->layoutpath && !sess->ownlayout) layout = fstamp(sess->layoutpath);
+
+    const char *keyfmt = "%s%s\n%s\ncompress=%ld\n";
+    long        len    = snprintf(NULL, 0, keyfmt, VERSION, REVISION, workdir, args->compress);
+    for (int i = 0; i < args->vardefs.len; i++) {
+        strpair *pair  = get(&args->vardefs, strpair, i);
+        len           += pair->head.len + pair->tail.len + 2;
+    }
+    if (sess->ownlayout) {
+        len += strlen("stable\n");
+    } else if (sess->layoutpath) {
+        len += snprintf(
+            NULL,
+            0,
+            layoutfmt,
+            sess->layoutpath,
+            layout.size,
+            layout.mtime,
+            layout.mtimens
+        );
+    }
+    if (args->order) len += strlen("order=\n") + strlen(args->order);
+
+    string key = string(malloc(len + 1), 0);
+    key.len    = snprintf(
+        (char *)key.s,
+        len + 1,
+        keyfmt,
+        VERSION,
+        REVISION,
+        workdir,
+        args->compress
+    );
+    for (int i = 0; i < args->vardefs.len; i++) {
+        strpair *pair  = get(&args->vardefs, strpair, i);
+        key.len       += snprintf(
+            (char *)key.s + key.len,
+            len + 1 - key.len,
+            "%.*s=%.*s\n",
+            fmtstring(pair->head),
+            fmtstring(pair->tail)
+        );
+    }
+    if (sess->ownlayout) {
+        key.len += snprintf((char *)key.s + key.len, len + 1 - key.len, "stable\n");
+    } else if (sess->layoutpath) {
+        key.len += snprintf(
+            (char *)key.s + key.len,
+            len + 1 - key.len,
+            layoutfmt,
+            sess->layoutpath,
+            layout.size,
+            layout.mtime,
+            layout.mtimens
+        );
+    }
+    if (args->order) {
+        key.len += snprintf((char *)key.s + key.len, len + 1 - key.len, "order=%s\n", args->order);
+    }
+
+    return key;
+}
+
+// A resident packer is only reused for the same inputs, and under the same conditions as its plan.
+static string residentkey(session *sess)
+{
+    string      base   = makeplankey(sess);
+    const char *keyfmt = "%.*sconfig=%s\nfilesys=%s\ncache=%s\n";
+    const char *cfg    = sess->cfgpath;
+    const char *csv    = sess->csvpath;
+    long        len    = snprintf(NULL, 0, keyfmt, fmtstring(base), cfg, csv, sess->cachedir);
+
+    string key = string(malloc(len + 1), len);
+    snprintf((char *)key.s, len + 1, keyfmt, fmtstring(base), cfg, csv, sess->cachedir);
+    free(base.s);
+    return key;
+}
+
+static void showcounter(FILE *stream, int width, long long counter)
+{
+    if (counter < 0) fprintf(stream, " %*s", width, "-");
+    else fprintf(stream, " %*lld", width, counter);
+}
+
+static void showphase(FILE *stream, const char *name, meter phase)
+{
+    const char *inner = strchr(name, '.');
+    if (inner) fprintf(stream, "  %-17s", inner + 1);
+    else fprintf(stream, "%-19s", name);
+
+    fprintf(stream, " %7ld %10.6f %10.6f", phase.count, phase.wall, phase.cpu);
+    showcounter(stream, 12, phase.nread);
+    showcounter(stream, 12, phase.nwritten);
+    showcounter(stream, 9, phase.nsyscalls);
+    showcounter(stream, 7, phase.nopened);
+    showcounter(stream, 9, phase.maxrss);
+    fprintf(stream, "\n");
+}
+
+// Phases which did not run (e.g., sealing a restored plan) are omitted.
+static void showtimings(FILE *stream, const meter *timings, meter total)
+{
+    fprintf(
+        stream,
+        "%-19s %7s %10s %10s %12s %12s %9s %7s %9s\n",
+        "phase",
+        "count",
+        "wall (s)",
+        "cpu (s)",
+        "read (B)",
+        "written (B)",
+        "syscalls",
+        "opened",
+        "RSS (KiB)"
+    );
+
+    for (int i = 0; i < NUM_ROMPHASES; i++) {
+        if (timings[i].count > 0) showphase(stream, rompacker_phasenames[i], timings[i]);
+    }
+
+    showphase(stream, "total", total);
+}
+
+static void dumpcounter(FILE *stream, const char *key, long long counter)
+{
+    if (counter < 0) fprintf(stream, ",\"%s\":null", key);
+    else fprintf(stream, ",\"%s\":%lld", key, counter);
+}
+
+static void dumpphase(FILE *stream, const char *name, meter phase)
+{
+    fprintf(stream, "\"%s\":{\"count\":%ld", name, phase.count);
+    fprintf(stream, ",\"wall\":%.9f,\"cpu\":%.9f", phase.wall, phase.cpu);
+    dumpcounter(stream, "read", phase.nread);
+    dumpcounter(stream, "written", phase.nwritten);
+    dumpcounter(stream, "syscalls", phase.nsyscalls);
+    dumpcounter(stream, "opened", phase.nopened);
+    dumpcounter(stream, "maxrss", phase.maxrss);
+    fprintf(stream, "}");
+}
+
+static void dumptimings(FILE *stream, const meter *timings, meter total)
+{
+    fprintf(stream, "{\"phases\":{");
+    for (int i = 0, n = 0; i < NUM_ROMPHASES; i++) {
+        if (timings[i].count == 0) continue;
+        if (n++ > 0) fprintf(stream, ",");
+        dumpphase(stream, rompacker_phasenames[i], timings[i]);
+    }
+
+    fprintf(stream, "},");
+    dumpphase(stream, "total", total);
+    fprintf(stream, "}\n");
 }
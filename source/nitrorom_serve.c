@@ -0,0 +1,391 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * nitrorom-serve - Pack Nintendo DS ROMs on request, keeping packers resident between requests
+ *
+ * A request is a sequence of NUL-terminated fields, ended by closing the client's side of the
+ * connection: the program's version, the client's working directory, and the arguments given to
+ * `nitrorom pack`. The server packs the ROM from the client's working directory and streams its
+ * diagnostics back over the connection, followed by a NUL and a trailer of the form
+ * "status=N wall=SECONDS warm|cold\n".
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "nitrorom.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "config.h"
+
+#include "libs/clip.h"
+#include "libs/log.h"
+#include "libs/meter.h"
+
+#define PROGRAM_NAME     "nitrorom-serve"
+#define SERVE_VERSION    VERSION REVISION
+#define SERVE_MAXREQUEST (1 << 20)
+#define SERVE_MAXARGS    1024
+#define SERVE_BACKLOG    16
+
+typedef struct args {
+    const char *socket;
+    const char *loglevel;
+
+    long keep;
+    long verbose;
+    long logjson;
+} args;
+
+static void showusage(FILE *stream);
+static args parseargs(const char **argv);
+static int  listenat(const char *path);
+static void serve(int conn, packcache *cache, logger *log);
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+int nitrorom_serve(int argc, const char **argv)
+{
+    if (argc <= 1 || strncmp(argv[1], "-h", 2) == 0 || strncmp(argv[1], "--help", 6) == 0) {
+        showusage(stdout);
+        exit(EXIT_SUCCESS);
+    }
+
+    args           args   = parseargs(argv);
+    enum loglevel  level  = args.loglevel ? (enum loglevel)loglevelof(args.loglevel) : L_info;
+    enum logformat format = args.logjson ? L_json : L_text;
+    logger        *log    = logopen(stderr, args.verbose ? L_debug : level, format);
+    if (!log) die("could not open the log stream!");
+
+    int home = open(".", O_RDONLY | O_DIRECTORY);
+    if (home < 0) die("could not open the working directory!");
+
+    int sock = listenat(args.socket);
+    if (sock < 0) die("could not listen on “%s”: %s", args.socket, strerror(errno));
+
+    // Interruptions are not restarted, so that a waiting `accept` returns to observe them.
+    struct sigaction sa = { .sa_handler = stop };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    packcache *cache = packcachenew((int)args.keep);
+    loginfo(log, PROGRAM_NAME, "listening on “%s”", args.socket);
+    fflush(NULL);
+
+    while (!stopping) {
+        int conn = accept(sock, NULL, NULL);
+        if (conn < 0 && errno == EINTR) continue;
+        if (conn < 0) {
+            logerror(log, PROGRAM_NAME, "could not accept a connection: %s", strerror(errno));
+            break;
+        }
+
+        serve(conn, cache, log);
+        close(conn);
+        if (fchdir(home) != 0) die("could not return to the working directory!");
+        fflush(NULL);
+    }
+
+    loginfo(log, PROGRAM_NAME, "shutting down");
+    packcachedel(cache);
+    close(sock);
+    unlink(args.socket);
+    close(home);
+    if (logclose(log) != 0) die("could not write to the log stream!");
+    return EXIT_SUCCESS;
+}
+
+static int sendall(int fd, const void *buf, size_t size)
+{
+    const char *curs = buf;
+    while (size > 0) {
+        ssize_t nwritten = write(fd, curs, size);
+        if (nwritten < 0 && errno == EINTR) continue;
+        if (nwritten <= 0) return -1;
+
+        curs += nwritten;
+        size -= nwritten;
+    }
+
+    return 0;
+}
+
+// Returns the number of bytes read before the peer closed its side of the connection, or -1 if the
+// request could not be read or is too large.
+static long recvall(int fd, char *buf, long size)
+{
+    long len = 0;
+    for (;;) {
+        ssize_t nread = read(fd, buf + len, size - len);
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread < 0) return -1;
+        if (nread == 0) return len;
+
+        len += nread;
+        if (len == size) return -1;
+    }
+}
+
+static void reply(int conn, int status, double wall, int warm)
+{
+    char trailer[64];
+    int  len = snprintf(
+        trailer + 1,
+        sizeof(trailer) - 1,
+        "status=%d wall=%.6f %s\n",
+        status,
+        wall,
+        warm ? "warm" : "cold"
+    );
+
+    trailer[0] = '\0';
+    sendall(conn, trailer, len + 1);
+}
+
+// Requests are packed one at a time, with standard-error redirected onto the connection.
+static void serve(int conn, packcache *cache, logger *log)
+{
+    char       *request = malloc(SERVE_MAXREQUEST);
+    const char *fields[SERVE_MAXARGS + 3]; // the version, the working directory, and NULL
+    int         nfields = 0;
+    long        len     = recvall(conn, request, SERVE_MAXREQUEST);
+    long        i       = 0;
+    for (; i < len && nfields < SERVE_MAXARGS + 2; nfields++) {
+        fields[nfields]  = request + i;
+        i               += (long)strnlen(request + i, len - i) + 1;
+    }
+
+    const char *error = NULL;
+    if (len <= 0 || i < len || request[len - 1] != '\0' || nfields < 3) {
+        error = "malformed request";
+    } else if (strcmp(fields[0], SERVE_VERSION) != 0) {
+        error = "the client's version does not match the server's";
+    } else if (chdir(fields[1]) != 0) {
+        error = "could not change to the client's working directory";
+    }
+
+    if (error) {
+        logwarn(log, PROGRAM_NAME, "%s", error);
+        dprintf(conn, PROGRAM_NAME ": %s\n", error);
+        reply(conn, EXIT_FAILURE, 0, 0);
+        free(request);
+        return;
+    }
+
+    fields[nfields] = NULL;
+    loginfo(log, PROGRAM_NAME, "packing from “%s”", fields[1]);
+    fflush(NULL);
+
+    int saved = dup(STDERR_FILENO);
+    dup2(conn, STDERR_FILENO);
+
+    int   warm   = 0;
+    meter spent  = { 0 };
+    meter begin  = meterread(M_clock);
+    int   status = packserved(nfields - 2, fields + 2, cache, &warm);
+    meteradd(&spent, begin, meterread(M_clock));
+    fflush(NULL);
+
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+
+    loginfo(
+        log,
+        PROGRAM_NAME,
+        "status %d after %.6f seconds (%s)",
+        status,
+        spent.wall,
+        warm ? "warm" : "cold"
+    );
+    reply(conn, status, spent.wall, warm);
+    free(request);
+}
+
+static int listenat(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+
+    int bound = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+    if (bound != 0 && errno == EADDRINUSE) {
+        // A socket left behind by a server which did not shut down cleanly refuses connections.
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) != 0
+            && errno == ECONNREFUSED) {
+            unlink(path);
+            bound = bind(sock, (struct sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+
+        if (probe >= 0) close(probe);
+    }
+
+    if (bound != 0 || listen(sock, SERVE_BACKLOG) != 0) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+
+    return sock;
+}
+
+static int connectto(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(addr.sun_path, path);
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(sock);
+        errno = err;
+        return -1;
+    }
+
+    return sock;
+}
+
+int packremote(const char *socket, int argc, const char **argv, double *wall, int *warm)
+{
+    char cwd[4096] = { 0 };
+    if (!getcwd(cwd, sizeof(cwd))) return -1;
+
+    int conn = connectto(socket);
+    if (conn < 0) return -1;
+
+    signal(SIGPIPE, SIG_IGN);
+    int sent = sendall(conn, SERVE_VERSION, sizeof(SERVE_VERSION)) == 0
+            && sendall(conn, cwd, strlen(cwd) + 1) == 0;
+    for (int i = 0; i < argc && sent; i++) sent = sendall(conn, argv[i], strlen(argv[i]) + 1) == 0;
+    if (!sent || shutdown(conn, SHUT_WR) != 0) {
+        int err = errno;
+        close(conn);
+        errno = err;
+        return -1;
+    }
+
+    // Diagnostics are replayed as they arrive, up to the NUL which begins the trailer.
+    char buf[4096];
+    char trailer[64] = { 0 };
+    long ntrailer    = -1;
+    for (;;) {
+        ssize_t nread = read(conn, buf, sizeof(buf));
+        if (nread < 0 && errno == EINTR) continue;
+        if (nread <= 0) break;
+
+        char *curs = buf;
+        if (ntrailer < 0) {
+            char *nul = memchr(buf, '\0', nread);
+            fwrite(buf, 1, nul ? nul - buf : nread, stderr);
+            if (!nul) continue;
+
+            curs     = nul + 1;
+            ntrailer = 0;
+        }
+
+        long room = (long)sizeof(trailer) - 1 - ntrailer;
+        long rest = (long)(buf + nread - curs);
+        if (rest > room) rest = room;
+        memcpy(trailer + ntrailer, curs, rest);
+        ntrailer += rest;
+    }
+
+    close(conn);
+
+    int  status  = EXIT_FAILURE;
+    char mode[8] = { 0 };
+    if (sscanf(trailer, "status=%d wall=%lf %7s", &status, wall, mode) != 3) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    *warm = strcmp(mode, "warm") == 0;
+    return status;
+}
+
+static args parseargs(const char **argv)
+{
+    args args = { 0 };
+    args.keep = 8;
+
+    // clang-format off
+    const clipopt options[] = {
+        { .longopt = "keep",      .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.keep     },
+        { .longopt = "verbose",   .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.verbose  },
+        { .longopt = "log-level", .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.loglevel },
+        { .longopt = "log-json",  .shortopt = '\0', .hasarg = H_noarg,  .ntarget = &args.logjson  },
+        { 0 },
+    };
+
+    const clippos positionals[] = {
+        { .name = "socket", .target = &args.socket },
+        { 0 },
+    };
+    // clang-format on
+
+    clip clip = clipinit(argv);
+    if (cliparse(&clip, options, positionals, NULL)) dieusage("%s", clip.err);
+    if (args.keep < 1) dieusage("%s", "option “--keep” must be at least 1");
+    if (args.loglevel && loglevelof(args.loglevel) < 0) {
+        dieusage(
+            "unknown log level “%s”; expected “error”, “warn”, “info”, or “debug”",
+            args.loglevel
+        );
+    }
+
+    return args;
+}
+
+static void showusage(FILE *stream)
+{
+    fprintf(stream, "nitrorom-serve - Pack Nintendo DS ROMs on request\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Usage: nitrorom serve [OPTIONS] <SOCKET>\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Listen on the Unix socket SOCKET for requests from `nitrorom pack` with\n");
+    fprintf(stream, "“--server” until interrupted. Each request is packed exactly as it would\n");
+    fprintf(stream, "be by `nitrorom pack`, but a packer is kept resident between requests\n");
+    fprintf(stream, "and reused by later ones for which none of its inputs have changed.\n");
+    fprintf(stream, "\n");
+    fprintf(stream, "Options:\n");
+    fprintf(stream, "  --keep N               Keep at most N packers resident, evicting the one\n");
+    fprintf(stream, "                         least-recently used. Default: 8.\n");
+    fprintf(stream, "  --verbose              Enable verbose mode; emit additional program logs\n");
+    fprintf(stream, "                         during execution to standard-error. Equivalent\n");
+    fprintf(stream, "                         to “--log-level debug”.\n");
+    fprintf(stream, "  --log-level LEVEL      Emit program logs at least as severe as LEVEL,\n");
+    fprintf(stream, "                         which must be one of “error”, “warn”, “info”,\n");
+    fprintf(stream, "                         or “debug”. Default: “info”.\n");
+    fprintf(stream, "  --log-json             Emit program logs as JSON, one object per line.\n");
+    fprintf(stream, "  -h / --help            Display this help-text and exit.\n");
+}
@@ -1,17 +1,31 @@
 // SPDX-License-Identifier: MIT
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "packer.h"
 
+#include <errno.h>
 #include <inttypes.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "compress.h"
 #include "constants.h"
+#include "digest.h"
+#include "narc.h"
 
+#include "libs/crc16.h"
+#include "libs/fdpool.h"
+#include "libs/fileio.h"
+#include "libs/jobs.h"
 #include "libs/litend.h"
+#include "libs/log.h"
+#include "libs/meter.h"
+#include "libs/sha1.h"
 #include "libs/strings.h"
 #include "libs/vector.h"
 
@@ -20,77 +34,124 @@ rompacker *rompacker_new(unsigned int verbose, vector *vardefs)
     rompacker *packer = calloc(1, sizeof(*packer));
     if (!packer) return 0;
 
+    for (int i = 0; i < NUM_ROMCLASSES; i++) packer->align[i] = ROM_ALIGN;
+
     packer->packing = 1;
-    packer->verbose = verbose;
+    packer->ownlog  = verbose ? logopen(stderr, L_debug, L_text) : NULL;
+    packer->log     = packer->ownlog;
+    packer->fds     = fdpoolnew(0);
+    if (!packer->fds) {
+        if (packer->ownlog) logclose(packer->ownlog);
+        free(packer);
+        return NULL;
+    }
 
     // The header is the only constant-size element in the entire ROM, so we can pre-allocate it.
     packer->banner.source.filename = string("%HEADER%");
     packer->header.source.buf      = calloc(HEADER_BSIZE, 1);
     packer->header.size            = HEADER_BSIZE;
+    packer->twl.sectorsize         = DIGEST_SECTORSIZE;
+    packer->twl.blocksectors       = DIGEST_BLOCKSECTORS;
 
     packer->ovy9    = newvec(rommember, 128);
     packer->ovy7    = newvec(rommember, 128);
     packer->filesys = newvec(romfile, 512);
-    packer->vardefs = vardefs;
+    packer->deps    = newvec(string, 16);
+    packer->owned   = newvec(void *, 16);
+    packer->ownvars = newvec(strpair, vardefs ? 1 : 32);
+    packer->vardefs = vardefs ? vardefs : &packer->ownvars;
 
     return packer;
 }
 
-static inline void safeclose(FILE *f)
+void rompacker_setlog(rompacker *packer, logger *log)
 {
-    if (f) fclose(f);
+    if (packer->ownlog) logclose(packer->ownlog);
+
+    packer->ownlog = NULL;
+    packer->log    = log;
 }
 
 void rompacker_del(rompacker *packer)
 {
-    // These are allocated by `cfg_overlays` in `cfg_arm.c`.
-    if (packer->ovy9.len > 0) free(get(&packer->ovy9, rommember, 0)->source.filename.s);
-    if (packer->ovy7.len > 0) free(get(&packer->ovy7, rommember, 0)->source.filename.s);
+    if (packer->plan.data.s) funmap(packer->plan);
+
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind == K_romfile_narc) narc_free(file->gen.user);
+    }
+
+    for (int i = 0; i < packer->deps.len; i++) free(get(&packer->deps, string, i)->s);
+    for (int i = 0; i < packer->owned.len; i++) free(*get(&packer->owned, void *, i));
+    free(packer->deps.data);
+    free(packer->owned.data);
+    free(packer->ownvars.data);
 
     free(packer->header.source.buf);
     free(packer->banner.source.buf);
     free(packer->fntb.source.buf);
     free(packer->fatb.source.buf);
+    free(packer->twl.sectors.source.buf);
+    free(packer->twl.blocks.source.buf);
+
+    fdpooldel(packer->fds);
+    if (packer->ownlog) logclose(packer->ownlog);
     free(packer->ovy9.data);
     free(packer->ovy7.data);
     free(packer->filesys.data);
-
-    safeclose(packer->arm9.source.hdl);
-    safeclose(packer->ovt9.source.hdl);
-    safeclose(packer->arm7.source.hdl);
-    safeclose(packer->ovt7.source.hdl);
+    free(packer->layout.data);
+    free(packer->access.data);
 
     free(packer);
 }
 
-static uint16_t crctable[16] = {
-    0x0000, 0xCC01, 0xD801, 0x1400, 0xF001, 0x3C00, 0x2800, 0xE401,
-    0xA001, 0x6C00, 0x7800, 0xB401, 0x5000, 0x9C01, 0x8801, 0x4400,
-};
-
-static uint16_t crc16(string data, uint16_t crc)
+void rompacker_depend(rompacker *packer, string filename)
 {
-    const unsigned char *end = data.s + data.len;
+    string *dep = push(&packer->deps, string);
+    dep->s      = malloc(filename.len);
+    dep->len    = filename.len;
+    memcpy(dep->s, filename.s, filename.len);
+}
 
-    uint16_t x = 0;
-    uint16_t y;
-    uint16_t bit = 0;
-    while (data.s < end) {
-        if (bit == 0) x = lehalf(data.s);
+string rompacker_own(rompacker *packer, string s)
+{
+    void **copy = push(&packer->owned, void *);
+    *copy       = malloc(s.len > 0 ? s.len : 1);
+    if (s.s && s.len > 0) memcpy(*copy, s.s, s.len);
+    return string(*copy, s.len);
+}
 
-        y     = crctable[crc & 15];
-        crc >>= 4;
-        crc  ^= y;
-        crc  ^= crctable[(x >> bit) & 15];
-        bit  += 4;
+// clang-format off
+const char *rompacker_phasenames[NUM_ROMPHASES] = {
+    [P_config]       = "config",
+    [P_filesys]      = "filesys",
+    [P_statscan]     = "filesys.stat-scan",
+    [P_seal]         = "seal",
+    [P_narcs]        = "seal.narcs",
+    [P_compress]     = "seal.compress",
+    [P_fntb]         = "seal.fntb",
+    [P_dump]         = "dump",
+    [P_dump_header]  = "dump.header",
+    [P_dump_arm9]    = "dump.arm9",
+    [P_dump_arm7]    = "dump.arm7",
+    [P_dump_tables]  = "dump.tables",
+    [P_dump_banner]  = "dump.banner",
+    [P_dump_filesys] = "dump.filesys",
+    [P_dump_digests] = "dump.digests",
+    [P_dump_tail]    = "dump.tail",
+};
+// clang-format on
 
-        if (bit == 16) {
-            data.s += 2;
-            bit     = 0;
-        }
-    }
+static inline meter phasebegin(rompacker *packer, enum romphase phase)
+{
+    tracebegin(packer->trace, "phase", "%s", rompacker_phasenames[phase]);
+    return packer->timings ? meterread(M_full) : (meter){ 0 };
+}
 
-    return crc;
+static inline void phaseend(rompacker *packer, enum romphase phase, meter start)
+{
+    if (packer->timings) meteradd(&packer->timings[phase], start, meterread(M_full));
+    traceend(packer->trace);
 }
 
 static int comparefnames(const void *a, const void *b) // NOLINT
@@ -124,68 +185,78 @@ static int comparefnames(const void *a, const void *b) // NOLINT
 
 #define membsize(__memb) ((__memb)->size + (__memb)->pad)
 
-#define printmemb(__curs, __memb)                                     \
-    {                                                                 \
-        fprintf(                                                      \
-            stderr,                                                   \
-            "rompacker:member: 0x%08" PRIX64 ",0x%08X,0x%08X,%.*s\n", \
-            __curs,                                                   \
-            (__memb)->size,                                           \
-            membsize(__memb),                                         \
-            fmtstring((__memb)->source.filename)                      \
-        );                                                            \
-    }
-
-#define printfile(__curs, __file)                                     \
-    {                                                                 \
-        fprintf(                                                      \
-            stderr,                                                   \
-            "rompacker:member: 0x%08" PRIX64 ",0x%08X,0x%08X,%.*s\n", \
-            __curs,                                                   \
-            (__file)->size,                                           \
-            membsize(__file),                                         \
-            fmtstring((__file)->target)                               \
-        );                                                            \
-    }
+#define logmemb(__log, __curs, __memb, __name)  \
+    logdebug(                                   \
+        (__log),                                \
+        "rompacker:member",                     \
+        "0x%08" PRIX64 ",0x%08X,0x%08X,%.*s",   \
+        (__curs),                               \
+        (__memb)->size,                         \
+        membsize(__memb),                       \
+        fmtstring(__name)                       \
+    )
+
+#define padto(__size, __align)  (-(__size) & ((__align) - 1))
+#define alignup(__ofs, __align) (((__ofs) + (__align) - 1) & ~(uint64_t)((__align) - 1))
+
+#define filealign(__packer, __file) \
+    ((__file)->align ? (__file)->align : (__packer)->align[K_romclass_file])
 
 #define sealarmparams(__packer, __n)                                         \
     &(__packer)->arm##__n, &(__packer)->ovt##__n, &(__packer)->ovy##__n, __n
 
-#define sealmemb(__memb, __cursor, __verbose)             \
-    {                                                     \
-        if (__verbose) printmemb(__cursor, __memb);       \
-        (__memb)->offset = (__cursor);                    \
-        (__cursor)       = (__cursor) + membsize(__memb); \
+// Members start at a multiple of `align`; the space skipped to reach it is added to the padding of
+// `*last`, the non-empty member before it, so that the dump stays contiguous.
+static void sealmemb(
+    rommember  *memb,
+    uint32_t    align,
+    uint64_t   *cursor,
+    rommember **last,
+    logger     *log
+)
+{
+    if (memb->size > 0) {
+        uint64_t start  = alignup(*cursor, align);
+        (*last)->pad   += start - *cursor;
+        *cursor         = start;
+        *last           = memb;
     }
 
+    logmemb(log, *cursor, memb, memb->source.filename);
+    memb->offset  = *cursor;
+    *cursor      += membsize(memb);
+}
+
 static void sealarm(
-    rommember     *arm,
-    rommember     *ovt,
-    vector        *ovyvec,
-    int            which,
-    unsigned char *header, // NOLINT
-    unsigned char *fatb,   // NOLINT
-    uint64_t      *romcursor,
-    int            ovyofs, // NOLINT
-    int            verbose // NOLINT
+    rommember      *arm,
+    rommember      *ovt,
+    vector         *ovyvec,
+    int             which,
+    const uint32_t *align,
+    unsigned char  *header, // NOLINT
+    unsigned char  *fatb,   // NOLINT
+    uint64_t       *romcursor,
+    rommember     **last,
+    int             ovyofs, // NOLINT
+    logger         *log
 )
 {
     uint32_t ofsarmrom  = which == 9 ? OFS_HEADER_ARM9_ROMOFFSET : OFS_HEADER_ARM7_ROMOFFSET;
     uint32_t ofsovtrom  = which == 9 ? OFS_HEADER_OVT9_ROMOFFSET : OFS_HEADER_OVT7_ROMOFFSET;
     uint32_t ofsovtsize = which == 9 ? OFS_HEADER_OVT9_BSIZE : OFS_HEADER_OVT7_BSIZE;
 
-    putleword(header + ofsarmrom, *romcursor);
-    sealmemb(arm, *romcursor, verbose);
+    sealmemb(arm, align[K_romclass_arm], romcursor, last, log);
+    putleword(header + ofsarmrom, arm->offset);
 
-    putleword(header + ofsovtrom, ovt->size > 0 ? *romcursor : 0);
+    sealmemb(ovt, align[K_romclass_table], romcursor, last, log);
+    putleword(header + ofsovtrom, ovt->size > 0 ? ovt->offset : 0);
     putleword(header + ofsovtsize, ovt->size);
-    sealmemb(ovt, *romcursor, verbose);
 
     for (int i = 0, j = ovyofs; i < ovyvec->len; i++, j++) {
         rommember *ovy = get(ovyvec, rommember, i);
-        putleword(fatb_begin(fatb, j), *romcursor);
-        putleword(fatb_end(fatb, j), *romcursor + ovy->size);
-        sealmemb(ovy, *romcursor, verbose);
+        sealmemb(ovy, align[K_romclass_overlay], romcursor, last, log);
+        putleword(fatb_begin(fatb, j), ovy->offset);
+        putleword(fatb_end(fatb, j), ovy->offset + ovy->size);
     }
 }
 
@@ -284,7 +355,7 @@ static void sealfntb(rompacker *packer, romfile *sorted, int fileid)
     root->id         = 0xF000;
 
     packer->fntb.size            = buildfntb(packer, sorted, dirtree, fileid);
-    packer->fntb.pad             = -packer->fntb.size & (ROM_ALIGN - 1);
+    packer->fntb.pad             = padto(packer->fntb.size, packer->align[K_romclass_table]);
     packer->fntb.source.filename = string("%FILENAMES%");
     packer->fntb.source.buf      = calloc(packer->fntb.size, 1);
 
@@ -317,7 +388,9 @@ static void sealfntb(rompacker *packer, romfile *sorted, int fileid)
     free(dirtree->data);
 }
 
-static int sealheader(rompacker *packer, uint64_t romsize)
+// The capacity of the storage must hold every byte used, which includes any digest tables beyond
+// the end of the ROM's NTR content.
+static int sealheader(rompacker *packer, uint64_t romsize, uint64_t used)
 {
     unsigned char *header = packer->header.source.buf;
 
@@ -325,7 +398,7 @@ static int sealheader(rompacker *packer, uint64_t romsize)
     int      maxshift = packer->prom ? MAX_CAPSHIFT_PROM : MAX_CAPSHIFT_MROM;
     int      shift    = 0;
     for (; shift < maxshift; shift++) {
-        if (romsize < (trycap << shift)) {
+        if (used < (trycap << shift)) {
             header[OFS_HEADER_CHIPCAPACITY] = shift;
             break;
         }
@@ -340,18 +413,17 @@ static int sealheader(rompacker *packer, uint64_t romsize)
     putleword(header + OFS_HEADER_STATICFOOTER, 0x00004BA0); // static NitroSDK footer
 
     uint16_t crc = crc16(string(header, OFS_HEADER_HEADERCRC), 0xFFFF);
-    if (packer->verbose) fprintf(stderr, "rompacker: header CRC: 0x%04X\n", crc);
+    loginfo(packer->log, "rompacker", "header CRC: 0x%04X", crc);
     putlehalf(header + OFS_HEADER_HEADERCRC, crc);
 
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker: storage: 0x%08" PRIX64 " used / 0x%08X avail (%f%%)\n",
-            romsize,
-            (trycap << shift),
-            (double)romsize / (trycap << shift)
-        );
-    }
+    loginfo(
+        packer->log,
+        "rompacker",
+        "storage: 0x%08" PRIX64 " used / 0x%08X avail (%f%%)",
+        used,
+        (trycap << shift),
+        (double)used / (trycap << shift)
+    );
 
     return 0;
 }
@@ -363,24 +435,498 @@ static void sealbanner(rompacker *packer)
 
     uint16_t crc = crc16(string(crcregion, BANNER_BSIZE_V1 - OFS_BANNER_ICON_BITMAP), 0xFFFF);
     putleword(banner + OFS_BANNER_CRC_V1OFFSET, crc);
-    if (packer->verbose) fprintf(stderr, "rompacker: banner v1 CRC: 0x%04X\n", crc);
+    loginfo(packer->log, "rompacker", "banner v1 CRC: 0x%04X", crc);
 
     if (packer->bannerver > 1) {
         crc = crc16(string(crcregion, BANNER_BSIZE_V2 - OFS_BANNER_ICON_BITMAP), 0xFFFF);
         putleword(banner + OFS_BANNER_CRC_V2OFFSET, crc);
-        if (packer->verbose) fprintf(stderr, "rompacker: banner v2 CRC: 0x%04X\n", crc);
+        loginfo(packer->log, "rompacker", "banner v2 CRC: 0x%04X", crc);
     }
 
     if (packer->bannerver > 2) {
         crc = crc16(string(crcregion, BANNER_BSIZE_V3 - OFS_BANNER_ICON_BITMAP), 0xFFFF);
         putleword(banner + OFS_BANNER_CRC_V3OFFSET, crc);
-        if (packer->verbose) fprintf(stderr, "rompacker: banner v3 CRC: 0x%04X\n", crc);
+        loginfo(packer->log, "rompacker", "banner v3 CRC: 0x%04X", crc);
+    }
+}
+
+typedef struct narcjobs {
+    romfile **files;
+    tracer   *trace;
+} narcjobs;
+
+static void resolvenarc(void *user, long job)
+{
+    narcjobs *jobs = user;
+    romfile  *file = jobs->files[job];
+    tracebegin(jobs->trace, "narc", "%.*s", fmtstring(file->source));
+    narc_resolve(file->gen.user);
+    traceend(jobs->trace);
+}
+
+// NARCs are independent of each other, so their members are scanned in parallel. Member paths are
+// registered as dependencies afterward, so that a packing plan notices edits to any of them.
+static int resolvenarcs(rompacker *packer)
+{
+    romfile **files = malloc(sizeof(romfile *) * (packer->filesys.len + 1));
+    long      njobs = 0;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind == K_romfile_narc) files[njobs++] = file;
+    }
+
+    narcjobs jobs = { .files = files, .trace = packer->trace };
+    jobsrun(0, njobs, resolvenarc, &jobs);
+
+    int failed = 0;
+    for (long i = 0; i < njobs && !failed; i++) {
+        romfile *file = files[i];
+        narc    *narc = file->gen.user;
+        if (narc->err[0] != '\0') {
+            snprintf(packer->errmsg, sizeof(packer->errmsg), "%s", narc->err);
+            failed = 1;
+            break;
+        }
+
+        file->size = narc->size;
+        for (int j = 0; j < narc->members.len; j++) {
+            rompacker_depend(packer, get(&narc->members, narcmember, j)->source);
+        }
+
+        logdebug(
+            packer->log,
+            "rompacker:filesystem",
+            "0x%08X,0x%08X,%.*s,%.*s (NARC of %d members)",
+            file->size,
+            file->pad,
+            fmtstring(file->source),
+            fmtstring(file->target),
+            narc->members.len
+        );
+    }
+
+    free(files);
+    return failed ? -1 : 0;
+}
+
+static void placefile(rompacker *packer, romfile *file, uint64_t offset)
+{
+    unsigned char *fatb = packer->fatb.source.buf;
+    putleword(fatb_begin(fatb, file->filesysid), offset);
+    putleword(fatb_end(fatb, file->filesysid), offset + file->size);
+
+    logmemb(packer->log, offset, file, file->target);
+    file->offset = offset;
+}
+
+static int comparetargets(const void *a, const void *b) // NOLINT
+{
+    const romfile *fa = *(const romfile *const *)a;
+    const romfile *fb = *(const romfile *const *)b;
+    if (fa->target.len != fb->target.len) return fa->target.len < fb->target.len ? -1 : 1;
+    return memcmp(fa->target.s, fb->target.s, fa->target.len);
+}
+
+// Members named by the access trace come first, in order of their first access; all others follow
+// in packing order. File IDs must already be assigned.
+static romfile **placementorder(rompacker *packer, int numovys)
+{
+    int       nfiles = packer->filesys.len;
+    romfile  *files  = packer->filesys.data;
+    romfile **order  = malloc(sizeof(romfile *) * (nfiles + 1));
+    if (packer->access.len == 0) {
+        for (int i = 0; i < nfiles; i++) order[i] = &files[i];
+        return order;
     }
+
+    romfile **byid     = malloc(sizeof(romfile *) * (nfiles + 1));
+    romfile **bytarget = malloc(sizeof(romfile *) * (nfiles + 1));
+    char     *ordered  = calloc(nfiles + 1, 1);
+    for (int i = 0; i < nfiles; i++) {
+        byid[files[i].filesysid - numovys] = &files[i];
+        bytarget[i]                        = &files[i];
+    }
+
+    qsort(bytarget, nfiles, sizeof(romfile *), comparetargets);
+    int norder   = 0;
+    int nunknown = 0;
+    for (int i = 0; i < packer->access.len; i++) {
+        romaccess *entry = get(&packer->access, romaccess, i);
+        romfile   *file  = NULL;
+        if (entry->fileid >= 0) {
+            int index = entry->fileid - numovys;
+            if (index >= 0 && index < nfiles) file = byid[index];
+        } else {
+            romfile   key   = { .target = entry->target };
+            romfile  *pkey  = &key;
+            romfile **found = bsearch(&pkey, bytarget, nfiles, sizeof(romfile *), comparetargets);
+            if (found) file = *found;
+        }
+
+        if (!file) {
+            nunknown++;
+        } else if (!ordered[file->packingid]) {
+            ordered[file->packingid] = 1;
+            order[norder++]          = file;
+        }
+    }
+
+    int ntraced = norder;
+    for (int i = 0; i < nfiles; i++) {
+        if (!ordered[i]) order[norder++] = &files[i];
+    }
+
+    loginfo(
+        packer->log,
+        "rompacker:access",
+        "placing %d members in order of access; %d entries of the trace name no member",
+        ntraced,
+        nunknown
+    );
+
+    free(byid);
+    free(bytarget);
+    free(ordered);
+    return order;
 }
 
-int rompacker_seal(rompacker *packer)
+// Members are placed in the given order, each followed by any headroom.
+static void placeinorder(rompacker *packer, romfile **order, uint64_t cursor)
 {
-    if (packer->verbose) fprintf(stderr, "rompacker: sealing the packer...\n");
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file  = order[i];
+        cursor         = alignup(cursor, filealign(packer, file));
+        placefile(packer, file, cursor);
+        cursor        += membsize(file) + packer->headroom;
+    }
+}
+
+static int compareslots(const void *a, const void *b) // NOLINT
+{
+    const romslot *sa = a;
+    const romslot *sb = b;
+    if (sa->target.len != sb->target.len) return sa->target.len < sb->target.len ? -1 : 1;
+    return memcmp(sa->target.s, sb->target.s, sa->target.len);
+}
+
+// Members which share an offset (i.e., those which are empty) keep their packing order.
+static int compareoffsets(const void *a, const void *b) // NOLINT
+{
+    const romfile *fa = *(const romfile *const *)a;
+    const romfile *fb = *(const romfile *const *)b;
+    if (fa->offset != fb->offset) return fa->offset < fb->offset ? -1 : 1;
+    return fa < fb ? -1 : fa > fb;
+}
+
+typedef struct romgap {
+    uint64_t start;
+    uint64_t end;
+} romgap;
+
+// Members which fit their previous slot are placed there first; the space between them is then
+// offered to every other member, in the given order, before the end of the ROM.
+static void placestable(rompacker *packer, romfile **order, uint64_t cursor)
+{
+    int       nfiles = packer->filesys.len;
+    romfile **kept   = malloc(sizeof(romfile *) * (nfiles + 1));
+    char     *placed = calloc(nfiles + 1, 1);
+    int       nkept  = 0;
+    for (int i = 0; i < nfiles; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        romslot  key  = { .target = file->target };
+        romslot *slot = bsearch(
+            &key,
+            packer->layout.data,
+            packer->layout.len,
+            sizeof(romslot),
+            compareslots
+        );
+        if (slot && slot->offset >= cursor && slot->offset % filealign(packer, file) == 0
+            && (uint64_t)slot->offset + membsize(file) <= slot->end) {
+            file->offset  = slot->offset;
+            kept[nkept++] = file;
+        }
+    }
+
+    // A previous ROM which shared data between members may offer overlapping slots.
+    qsort(kept, nkept, sizeof(romfile *), compareoffsets);
+    vector   gaps  = newvec(romgap, 64);
+    uint64_t end   = cursor;
+    int      nheld = 0;
+    for (int i = 0; i < nkept; i++) {
+        romfile *file = kept[i];
+        if (file->offset < end) continue;
+        if (file->offset > end) {
+            *push(&gaps, romgap) = (romgap){ .start = end, .end = file->offset };
+        }
+
+        placefile(packer, file, file->offset);
+        end = file->offset + membsize(file);
+        nheld++;
+
+        placed[file->packingid] = 1; // packing IDs are positions until the packer is sealed
+    }
+
+    int ngapped = 0;
+    for (int i = 0; i < nfiles; i++) {
+        romfile *file = order[i];
+        if (placed[file->packingid]) continue;
+
+        // The gap which fits the member most tightly is chosen, so that larger gaps remain for
+        // larger members.
+        uint32_t align = filealign(packer, file);
+        romgap  *gap   = NULL;
+        uint64_t slack = UINT64_MAX;
+        for (int j = 0; j < gaps.len && slack > 0; j++) {
+            romgap  *curr  = get(&gaps, romgap, j);
+            uint64_t start = alignup(curr->start, align);
+            if (start + membsize(file) <= curr->end && curr->end - start - membsize(file) < slack) {
+                gap   = curr;
+                slack = curr->end - start - membsize(file);
+            }
+        }
+
+        uint64_t want = membsize(file) + packer->headroom;
+        if (gap) {
+            uint64_t start = alignup(gap->start, align);
+            placefile(packer, file, start);
+            gap->start = gap->end - start < want ? gap->end : start + want;
+            ngapped++;
+        } else {
+            end = alignup(end, align);
+            placefile(packer, file, end);
+            end += want;
+        }
+    }
+
+    loginfo(
+        packer->log,
+        "rompacker:layout",
+        "kept %d members in place; moved %d into free space and %d to the end",
+        nheld,
+        ngapped,
+        nfiles - nheld - ngapped
+    );
+
+    free(gaps.data);
+    free(placed);
+    free(kept);
+}
+
+// Gaps are binned by their size, and each bin is a stack of gaps linked by `next`. Only the slack
+// which precedes or pads a member is offered, so every gap is smaller than ROM_MAXALIGN.
+typedef struct gapbins {
+    vector   gaps; // T = romgap
+    int     *next;
+    int      heads[ROM_MAXALIGN];
+    uint64_t occupied[ROM_MAXALIGN / 64];
+} gapbins;
+
+static void putgap(gapbins *bins, uint64_t start, uint64_t end)
+{
+    start = alignup(start, ROM_MINALIGN);
+    if (end <= start) return;
+
+    int size = end - start < ROM_MAXALIGN ? (int)(end - start) : ROM_MAXALIGN - 1;
+    int slot = bins->gaps.len;
+    if ((slot & (slot - 1)) == 0) bins->next = realloc(bins->next, sizeof(int) * (slot * 2 + 1));
+
+    *push(&bins->gaps, romgap) = (romgap){ .start = start, .end = start + size };
+    bins->next[slot]           = bins->heads[size];
+    bins->heads[size]          = slot;
+    bins->occupied[size / 64] |= 1ull << (size % 64);
+}
+
+// Returns the smallest gap which holds at least `size` bytes after removing it from its bin, or
+// NULL if there is none.
+static romgap *takegap(gapbins *bins, uint32_t size)
+{
+    int bin = -1;
+    for (int word = (int)(size / 64); word < ROM_MAXALIGN / 64 && bin < 0; word++) {
+        uint64_t bits = bins->occupied[word];
+        if (word == (int)(size / 64)) bits &= ~0ull << (size % 64);
+        if (bits) bin = (word * 64) + __builtin_ctzll(bits);
+    }
+
+    if (bin < 0) return NULL;
+
+    int slot         = bins->heads[bin];
+    bins->heads[bin] = bins->next[slot];
+    if (bins->heads[bin] < 0) bins->occupied[bin / 64] &= ~(1ull << (bin % 64));
+    return get(&bins->gaps, romgap, slot);
+}
+
+// Larger members are fitted first, so that the smallest are left for the tightest gaps.
+static int comparesizes(const void *a, const void *b) // NOLINT
+{
+    const romfile *fa = *(const romfile *const *)a;
+    const romfile *fb = *(const romfile *const *)b;
+    if (fa->size != fb->size) return fa->size > fb->size ? -1 : 1;
+    return fa->packingid < fb->packingid ? -1 : fa->packingid > fb->packingid;
+}
+
+// Members which are smaller than the alignment of filesystem members, and whose own alignment is
+// not set, are fitted into the slack which precedes or pads the others (or the banner), where they
+// need only start at a multiple of ROM_MINALIGN. Every other member is placed in the given order,
+// as by `placeinorder`; small members which fit no gap follow them. Padding which would overlap a
+// member placed behind it is then trimmed.
+static void placebestfit(rompacker *packer, romfile **order, uint64_t cursor)
+{
+    int       nfiles = packer->filesys.len;
+    romfile **small  = malloc(sizeof(romfile *) * (nfiles + 1));
+    int       nsmall = 0;
+    gapbins  *bins   = malloc(sizeof(gapbins));
+    bins->gaps       = newvec(romgap, 256);
+    bins->next       = NULL;
+    memset(bins->heads, 0xFF, sizeof(bins->heads));
+    memset(bins->occupied, 0, sizeof(bins->occupied));
+
+    putgap(bins, packer->banner.offset + packer->banner.size, cursor);
+    for (int i = 0; i < nfiles; i++) {
+        romfile *file  = order[i];
+        uint32_t align = filealign(packer, file);
+        if (file->align == 0 && file->size > 0 && file->size < align) {
+            small[nsmall++] = file;
+            continue;
+        }
+
+        uint64_t start = alignup(cursor, align);
+        putgap(bins, cursor, start);
+        placefile(packer, file, start);
+        putgap(bins, start + file->size, start + membsize(file));
+        cursor = start + membsize(file) + packer->headroom;
+    }
+
+    qsort(small, nsmall, sizeof(romfile *), comparesizes);
+    int      nfitted = 0;
+    uint64_t fitted  = 0;
+    for (int i = 0; i < nsmall; i++) {
+        romfile *file = small[i];
+        romgap  *gap  = takegap(bins, file->size);
+        if (gap) {
+            uint64_t start = gap->start;
+            uint64_t end   = gap->end;
+            placefile(packer, file, start);
+            putgap(bins, start + file->size, end); // may move the gaps
+            nfitted++;
+            fitted += file->size;
+            continue;
+        }
+
+        uint64_t start = alignup(cursor, filealign(packer, file));
+        putgap(bins, cursor, start);
+        placefile(packer, file, start);
+        putgap(bins, start + file->size, start + membsize(file));
+        cursor = start + membsize(file) + packer->headroom;
+    }
+
+    // The dump fills any space before a member, but never writes padding over one.
+    romfile **placed = small;
+    for (int i = 0; i < nfiles; i++) placed[i] = get(&packer->filesys, romfile, i);
+    qsort(placed, nfiles, sizeof(romfile *), compareoffsets);
+    if (nfiles > 0 && packer->banner.offset + membsize(&packer->banner) > placed[0]->offset) {
+        packer->banner.pad = placed[0]->offset - packer->banner.offset - packer->banner.size;
+    }
+    for (int i = 0; i + 1 < nfiles; i++) {
+        romfile *file = placed[i];
+        uint64_t next = placed[i + 1]->offset;
+        if (file->offset + membsize(file) > next && next >= file->offset + file->size) {
+            file->pad = next - file->offset - file->size;
+        }
+    }
+
+    loginfo(
+        packer->log,
+        "rompacker:layout",
+        "fitted %d small members (0x%08" PRIX64 " bytes) into padding; %d followed the others",
+        nfitted,
+        fitted,
+        nsmall - nfitted
+    );
+
+    free(small);
+    free(bins->gaps.data);
+    free(bins->next);
+    free(bins);
+}
+
+// Pads each member to the alignment of its class. Returns 1 if any alignment differs from the
+// default, else 0.
+static int alignmembers(rompacker *packer)
+{
+    uint32_t *align     = packer->align;
+    int       realigned = 0;
+    for (int i = 0; i < NUM_ROMCLASSES; i++) realigned |= align[i] != ROM_ALIGN;
+
+    packer->arm9.pad = padto(packer->arm9.size, align[K_romclass_arm]);
+    packer->arm7.pad = padto(packer->arm7.size, align[K_romclass_arm]);
+    packer->ovt9.pad = padto(packer->ovt9.size, align[K_romclass_table]);
+    packer->ovt7.pad = padto(packer->ovt7.size, align[K_romclass_table]);
+    for (int i = 0; i < packer->ovy9.len; i++) {
+        rommember *ovy = get(&packer->ovy9, rommember, i);
+        ovy->pad       = padto(ovy->size, align[K_romclass_overlay]);
+    }
+    for (int i = 0; i < packer->ovy7.len; i++) {
+        rommember *ovy = get(&packer->ovy7, rommember, i);
+        ovy->pad       = padto(ovy->size, align[K_romclass_overlay]);
+    }
+
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file  = get(&packer->filesys, romfile, i);
+        file->pad      = padto(file->size, filealign(packer, file));
+        realigned     |= file->align != 0 && file->align != ROM_ALIGN;
+    }
+
+    return realigned;
+}
+
+#define paddedsize(__memb) ((uint64_t)(__memb)->size + padto((__memb)->size, ROM_ALIGN))
+
+// Reports the difference between the ROM's extent and what it would be if every member were
+// aligned to ROM_ALIGN.
+static void logsaved(rompacker *packer)
+{
+    uint64_t extent = packer->banner.offset + membsize(&packer->banner);
+    uint64_t deflt  = paddedsize(&packer->header) + paddedsize(&packer->arm9)
+                   + paddedsize(&packer->ovt9) + paddedsize(&packer->arm7)
+                   + paddedsize(&packer->ovt7) + paddedsize(&packer->fntb)
+                   + paddedsize(&packer->fatb) + paddedsize(&packer->banner);
+    for (int i = 0; i < packer->ovy9.len; i++) {
+        deflt += paddedsize(get(&packer->ovy9, rommember, i));
+    }
+    for (int i = 0; i < packer->ovy7.len; i++) {
+        deflt += paddedsize(get(&packer->ovy7, rommember, i));
+    }
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file  = get(&packer->filesys, romfile, i);
+        deflt         += paddedsize(file);
+        if (file->offset + membsize(file) > extent) extent = file->offset + membsize(file);
+    }
+
+    loginfo(
+        packer->log,
+        "rompacker:align",
+        "members span 0x%08" PRIX64 " bytes, which %s %" PRIu64 " bytes against 0x%X alignment",
+        extent,
+        deflt >= extent ? "saves" : "costs",
+        deflt >= extent ? deflt - extent : extent - deflt,
+        ROM_ALIGN
+    );
+}
+
+static enum sealerr seal(rompacker *packer)
+{
+    loginfo(packer->log, "rompacker", "sealing the packer...");
+
+    meter phase = phasebegin(packer, P_narcs);
+    int   err   = resolvenarcs(packer);
+    phaseend(packer, P_narcs, phase);
+    if (err != 0) return E_seal_narc;
+
+    phase = phasebegin(packer, P_compress);
+    err   = compressfiles(packer) != 0 || compressarm9(packer) != 0;
+    phaseend(packer, P_compress, phase);
+    if (err != 0) return E_seal_compress;
 
     packer->packing = 0;
 
@@ -390,15 +936,21 @@ int rompacker_seal(rompacker *packer)
         packer->fatb.source.filename = string("%FILEALLOCS%");
         packer->fatb.size            = numfiles * 8;
         packer->fatb.source.buf      = calloc(packer->fatb.size, 1);
-        packer->fatb.pad             = -(packer->fatb.size) & (ROM_ALIGN - 1);
+        packer->fatb.pad             = padto(packer->fatb.size, packer->align[K_romclass_table]);
     }
 
+    int realigned = alignmembers(packer);
+
     uint64_t       romcursor = HEADER_BSIZE;
+    rommember     *last      = &packer->header;
     unsigned char *fatb      = packer->fatb.source.buf;
     unsigned char *header    = packer->header.source.buf;
-    sealarm(sealarmparams(packer, 9), header, fatb, &romcursor, 0, packer->verbose);
-    sealarm(sealarmparams(packer, 7), header, fatb, &romcursor, packer->ovy9.len, packer->verbose);
+    uint32_t      *align     = packer->align;
+    int            ovyofs    = packer->ovy9.len;
+    sealarm(sealarmparams(packer, 9), align, header, fatb, &romcursor, &last, 0, packer->log);
+    sealarm(sealarmparams(packer, 7), align, header, fatb, &romcursor, &last, ovyofs, packer->log);
 
+    phase = phasebegin(packer, P_fntb);
     if (packer->filesys.len > 0) {
         romfile *sorted = malloc(sizeof(romfile) * packer->filesys.len);
         memcpy(sorted, packer->filesys.data, sizeof(romfile) * packer->filesys.len);
@@ -406,141 +958,941 @@ int rompacker_seal(rompacker *packer)
         sealfntb(packer, sorted, numovys);
         free(sorted);
     }
+    phaseend(packer, P_fntb, phase);
 
-    putleword(header + OFS_HEADER_FNTB_ROMOFFSET, romcursor);
+    sealmemb(&packer->fntb, align[K_romclass_table], &romcursor, &last, packer->log);
+    putleword(header + OFS_HEADER_FNTB_ROMOFFSET, packer->fntb.offset);
     putleword(header + OFS_HEADER_FNTB_BSIZE, packer->fntb.size);
-    sealmemb(&packer->fntb, romcursor, packer->verbose);
 
-    putleword(header + OFS_HEADER_FATB_ROMOFFSET, romcursor);
+    sealmemb(&packer->fatb, align[K_romclass_table], &romcursor, &last, packer->log);
+    putleword(header + OFS_HEADER_FATB_ROMOFFSET, packer->fatb.offset);
     putleword(header + OFS_HEADER_FATB_BSIZE, packer->fatb.size);
-    sealmemb(&packer->fatb, romcursor, packer->verbose);
 
-    putleword(header + OFS_HEADER_BANNER_ROMOFFSET, romcursor);
-    sealmemb(&packer->banner, romcursor, packer->verbose);
+    sealmemb(&packer->banner, ROM_ALIGN, &romcursor, &last, packer->log);
+    putleword(header + OFS_HEADER_BANNER_ROMOFFSET, packer->banner.offset);
 
+    romfile **order = placementorder(packer, numovys);
+    if (packer->layout.len > 0) placestable(packer, order, romcursor);
+    else if (packer->bestfit) placebestfit(packer, order, romcursor);
+    else placeinorder(packer, order, romcursor);
+    free(order);
+
+    // Final ROM size must ignore the padding of the last member (either the banner or the member
+    // which is placed last).
+    uint64_t romsize = packer->banner.offset + packer->banner.size;
+    uint64_t extent  = packer->banner.offset + membsize(&packer->banner);
     for (int i = 0; i < packer->filesys.len; i++) {
-        romfile *topack = get(&packer->filesys, romfile, i);
-        putleword(fatb_begin(fatb, topack->filesysid), romcursor);
-        putleword(fatb_end(fatb, topack->filesysid), romcursor + topack->size);
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->offset + file->size > romsize) romsize = file->offset + file->size;
+        if (file->offset + membsize(file) > extent) extent = file->offset + membsize(file);
+    }
+
+    if (realigned) logsaved(packer);
+
+    uint64_t used = romsize;
+    sealdigests(packer, extent);
+    if (packer->twl.key.len > 0) used = packer->twl.blocks.offset + packer->twl.blocks.size;
+
+    sealbanner(packer);
+    int result = sealheader(packer, romsize, used);
+    loginfo(packer->log, "rompacker", "packer is sealed, okay to dump!");
+    return result ? E_seal_toolarge : E_seal_ok;
+}
+
+enum sealerr rompacker_seal(rompacker *packer)
+{
+    if (!packer->packing) return E_seal_sealed;
+
+    meter        phase = phasebegin(packer, P_seal);
+    enum sealerr err   = seal(packer);
+    phaseend(packer, P_seal, phase);
+    return err;
+}
+
+typedef struct slotnames {
+    romslot       *slots; // indexed by file ID
+    unsigned char *names; // NULL while measuring
+    long           len;
+} slotnames;
 
-        if (packer->verbose) printfile(romcursor, topack);
-        topack->offset  = romcursor;
-        romcursor      += membsize(topack);
+// Targets are rooted, unlike the paths which are walked from the FNTB.
+static void nameslot(void *user, uint32_t fileid, string path)
+{
+    slotnames *names = user;
+    if (names->names) {
+        unsigned char *target = names->names + names->len;
+        target[0]             = '/';
+        memcpy(target + 1, path.s, path.len);
+        names->slots[fileid].target = string(target, path.len + 1);
     }
 
-    // Final ROM size must ignore the padding of the last-added member (either the banner or the
-    // last filesystem entry).
-    uint64_t romsize = romcursor;
-    if (packer->filesys.len > 0) {
-        romsize -= get(&packer->filesys, romfile, packer->filesys.len - 1)->pad;
-    } else {
-        romsize -= packer->banner.pad;
+    names->len += path.len + 1;
+}
+
+// Returns the first start which lies beyond `offset`, or UINT32_MAX if there is none.
+static uint32_t nextstart(const uint32_t *starts, int nstarts, uint32_t offset)
+{
+    int lo = 0, hi = nstarts;
+    while (lo < hi) {
+        int mid = lo + ((hi - lo) / 2);
+        if (starts[mid] <= offset) lo = mid + 1;
+        else hi = mid;
     }
 
-    sealbanner(packer);
-    int result = sealheader(packer, romsize);
-    if (packer->verbose) fprintf(stderr, "rompacker: packer is sealed, okay to dump!\n");
-    return result;
+    return lo < nstarts ? starts[lo] : UINT32_MAX;
+}
+
+static int comparestarts(const void *a, const void *b) // NOLINT
+{
+    uint32_t sa = *(const uint32_t *)a;
+    uint32_t sb = *(const uint32_t *)b;
+    return sa < sb ? -1 : sa > sb;
+}
+
+enum layouterr rompacker_keeplayout(rompacker *packer, string rom)
+{
+    if (!packer->packing) return E_layout_sealed;
+    if (rom.len < HEADER_BSIZE) return E_layout_corrupt;
+
+    unsigned char *header   = rom.s;
+    uint32_t       fntbofs  = leword(header + OFS_HEADER_FNTB_ROMOFFSET);
+    uint32_t       fntbsize = leword(header + OFS_HEADER_FNTB_BSIZE);
+    uint32_t       fatbofs  = leword(header + OFS_HEADER_FATB_ROMOFFSET);
+    uint32_t       fatbsize = leword(header + OFS_HEADER_FATB_BSIZE);
+    uint32_t       ovtsize  = leword(header + OFS_HEADER_OVT9_BSIZE)
+                     + leword(header + OFS_HEADER_OVT7_BSIZE);
+    uint32_t       novys    = ovtsize / OVT_ENTRY_BSIZE;
+    uint32_t       nfiles   = fatbsize / 8;
+    if ((uint64_t)fntbofs + fntbsize > (uint64_t)rom.len
+        || (uint64_t)fatbofs + fatbsize > (uint64_t)rom.len || nfiles < novys) {
+        return E_layout_corrupt;
+    }
+
+    // Every allocation of the previous ROM bounds the slot of the member before it.
+    static const int sysofs[] = {
+        OFS_HEADER_ARM9_ROMOFFSET,
+        OFS_HEADER_ARM7_ROMOFFSET,
+        OFS_HEADER_FNTB_ROMOFFSET,
+        OFS_HEADER_FATB_ROMOFFSET,
+        OFS_HEADER_OVT9_ROMOFFSET,
+        OFS_HEADER_OVT7_ROMOFFSET,
+        OFS_HEADER_BANNER_ROMOFFSET,
+    };
+
+    int            nsys   = sizeof(sysofs) / sizeof(sysofs[0]);
+    romslot       *slots  = calloc(nfiles + 1, sizeof(romslot));
+    uint32_t      *starts = malloc(sizeof(uint32_t) * (nfiles + nsys));
+    int            nstart = 0;
+    unsigned char *fatb   = rom.s + fatbofs;
+    for (int i = 0; i < nsys; i++) {
+        uint32_t start = leword(header + sysofs[i]);
+        if (start > 0) starts[nstart++] = start;
+    }
+
+    for (uint32_t i = 0; i < nfiles; i++) {
+        uint32_t start = leword(fatb_begin(fatb, i));
+        uint32_t end   = leword(fatb_end(fatb, i));
+        if (end < start) {
+            free(slots);
+            free(starts);
+            return E_layout_corrupt;
+        }
+
+        slots[i].offset = start;
+        if (end > start) starts[nstart++] = start;
+    }
+
+    qsort(starts, nstart, sizeof(uint32_t), comparestarts);
+    for (uint32_t i = novys; i < nfiles; i++) {
+        slots[i].end = nextstart(starts, nstart, slots[i].offset);
+    }
+
+    // Names are measured first, so that they can share one block of storage.
+    narcview  view  = { .fntb = rom.s + fntbofs, .fntbsize = fntbsize, .nmembers = nfiles };
+    slotnames names = { .slots = slots };
+    long      named = narc_names(&view, nameslot, &names);
+    if (named >= 0) {
+        names.names = rompacker_own(packer, string(NULL, names.len > 0 ? names.len : 1)).s;
+        names.len   = 0;
+        narc_names(&view, nameslot, &names);
+    }
+
+    free(packer->layout.data);
+    packer->layout = newvec(romslot, nfiles - novys + 1);
+    for (uint32_t i = novys; i < nfiles && named >= 0; i++) {
+        if (slots[i].target.len > 0) *push(&packer->layout, romslot) = slots[i];
+    }
+
+    qsort(packer->layout.data, packer->layout.len, sizeof(romslot), compareslots);
+    loginfo(
+        packer->log,
+        "rompacker:layout",
+        "keeping the layout of %d members from the previous ROM",
+        packer->layout.len
+    );
+
+    free(slots);
+    free(starts);
+    return named >= 0 ? E_layout_ok : E_layout_corrupt;
+}
+
+// File IDs are given in decimal, or in hexadecimal with a “0x” prefix. Returns -1 if `s` is not a
+// file ID.
+static int parsefileid(string s)
+{
+    int base = 10;
+    if (s.len > 2 && s.s[0] == '0' && (s.s[1] == 'x' || s.s[1] == 'X')) {
+        base   = 16;
+        s.s   += 2;
+        s.len -= 2;
+    }
+
+    long id = 0;
+    for (long i = 0; i < s.len; i++) {
+        unsigned char c     = s.s[i];
+        int           digit = c >= '0' && c <= '9'               ? c - '0'
+                            : base == 16 && c >= 'a' && c <= 'f' ? c - 'a' + 10
+                            : base == 16 && c >= 'A' && c <= 'F' ? c - 'A' + 10
+                                                                 : -1;
+        if (digit < 0) return -1;
+
+        id = (id * base) + digit;
+        if (id > UINT16_MAX) return -1;
+    }
+
+    return s.len > 0 ? (int)id : -1;
+}
+
+enum accesserr rompacker_accessorder(rompacker *packer, string trace)
+{
+    if (!packer->packing) return E_access_sealed;
+
+    vector  access = newvec(romaccess, 256);
+    strpair lines  = { .tail = trace };
+    for (int lineno = 1; lines.tail.s; lineno++) {
+        lines       = strcut(lines.tail, '\n');
+        string line = strrtrim(strltrim(lines.head));
+        if (line.len == 0 || line.s[0] == '#') continue;
+
+        romaccess *entry = push(&access, romaccess);
+        entry->fileid    = line.s[0] == '/' ? -1 : parsefileid(line);
+        if (entry->fileid < 0 && line.s[0] != '/') {
+            snprintf(
+                packer->errmsg,
+                sizeof(packer->errmsg),
+                "line %d: expected a file ID or a rooted target path, but found “%.*s”",
+                lineno,
+                fmtstring(line)
+            );
+            free(access.data);
+            return E_access_corrupt;
+        }
+
+        entry->target = entry->fileid < 0 ? rompacker_own(packer, line) : stringZ;
+    }
+
+    free(packer->access.data);
+    packer->access = access;
+    return E_access_ok;
+}
+
+uint32_t rompacker_minalign(enum romclass class)
+{
+    return class == K_romclass_arm ? ROM_ALIGN : ROM_MINALIGN;
+}
+
+int rompacker_alignok(enum romclass class, uint32_t align)
+{
+    return (align & (align - 1)) == 0 && align >= rompacker_minalign(class)
+        && align <= ROM_MAXALIGN;
+}
+
+uint64_t rompacker_romsize(rompacker *packer)
+{
+    if (packer->packing) return 0;
+
+    // The dump includes the padding of the final member, which the header's ROM size does not.
+    uint64_t end = packer->banner.offset + membsize(&packer->banner);
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->offset + membsize(file) > end) end = file->offset + membsize(file);
+    }
+
+    if (packer->twl.key.len > 0) end = packer->twl.blocks.offset + membsize(&packer->twl.blocks);
+    return packer->filltail && packer->tailsize > end ? packer->tailsize : end;
 }
 
 #define READSIZE 4096
+#define FILLSIZE ROM_ALIGN
 
-#define writememb_buf(__memb, __fill, __stream)                         \
-    {                                                                   \
-        fwrite((__memb).source.buf, 1, (__memb).size, __stream);        \
-        for (int i = 0; i < (__memb).pad; i++) fputc(__fill, __stream); \
+// Dumps write through a sink so that the same routine can target a stdio stream, a raw file
+// descriptor, or a caller-provided buffer. Refreshes write through a sink positioned at a member's
+// offset within a file which was already dumped.
+typedef struct romsink romsink;
+
+typedef int (*sinkwriter)(romsink *sink, const void *buf, size_t size);
+
+struct romsink {
+    sinkwriter write;
+    uint64_t   written;
+    romhasher *hasher; // if non-NULL, digests each byte as it is written
+
+    union {
+        FILE *stream;
+        int   fd;
+
+        struct {
+            unsigned char *buf;
+            uint64_t       cap;
+        } mem;
+
+        struct {
+            int      fd;
+            uint64_t base;
+        } at;
     };
+};
 
-#define writememb_hdl(__memb, __fill, __stream)                         \
-    {                                                                   \
-        while ((__memb).size > 0) {                                     \
-            size_t __nread = fread(                                     \
-                readbuf,                                                \
-                1,                                                      \
-                (__memb).size > READSIZE ? READSIZE : (__memb).size,    \
-                (__memb).source.hdl                                     \
-            );                                                          \
-            fwrite(readbuf, 1, __nread, __stream);                      \
-            (__memb).size -= __nread;                                   \
-        }                                                               \
-        for (int i = 0; i < (__memb).pad; i++) fputc(__fill, __stream); \
+static int writestream(romsink *sink, const void *buf, size_t size)
+{
+    return fwrite(buf, 1, size, sink->stream) == size ? 0 : -1;
+}
+
+static int writefd(romsink *sink, const void *buf, size_t size)
+{
+    const unsigned char *curs = buf;
+    while (size > 0) {
+        ssize_t nwrite = write(sink->fd, curs, size);
+        if (nwrite < 0 && errno == EINTR) continue;
+        if (nwrite <= 0) return -1;
+
+        curs += nwrite;
+        size -= nwrite;
     }
 
-enum dumperr rompacker_dump(rompacker *packer, FILE *stream)
+    return 0;
+}
+
+static int writeat(romsink *sink, const void *buf, size_t size)
+{
+    const unsigned char *curs = buf;
+    uint64_t             ofs  = sink->at.base + sink->written;
+    while (size > 0) {
+        ssize_t nwrite = pwrite(sink->at.fd, curs, size, (off_t)ofs);
+        if (nwrite < 0 && errno == EINTR) continue;
+        if (nwrite <= 0) return -1;
+
+        curs += nwrite;
+        ofs  += nwrite;
+        size -= nwrite;
+    }
+
+    return 0;
+}
+
+static int writemem(romsink *sink, const void *buf, size_t size)
+{
+    if (sink->written + size > sink->mem.cap) return -1;
+
+    memcpy(sink->mem.buf + sink->written, buf, size);
+    return 0;
+}
+
+static int sinkwrite(romsink *sink, const void *buf, size_t size)
+{
+    if (size == 0) return 0;
+    if (sink->write(sink, buf, size) != 0) return -1;
+    if (sink->hasher) hasherfeed(sink->hasher, sink->written, buf, size);
+
+    sink->written += size;
+    return 0;
+}
+
+static int sinkfill(romsink *sink, const unsigned char *fill, uint64_t size)
+{
+    while (size > 0) {
+        size_t chunk = size > FILLSIZE ? FILLSIZE : size;
+        if (sinkwrite(sink, fill, chunk) != 0) return -1;
+        size -= chunk;
+    }
+
+    return 0;
+}
+
+// Rewrites `size` bytes at `offset` within what the sink has already written, once their content is
+// known. Streams and descriptors must be seekable; sinks for a refresh never patch.
+static int sinkpatch(romsink *sink, uint64_t offset, const void *buf, size_t size)
+{
+    if (sink->write == writemem) {
+        memcpy(sink->mem.buf + offset, buf, size);
+        return 0;
+    }
+
+    if (sink->write == writestream) {
+        off_t end = ftello(sink->stream);
+        if (end < 0 || fseeko(sink->stream, end - sink->written + offset, SEEK_SET) != 0) return -1;
+
+        int failed = fwrite(buf, 1, size, sink->stream) != size;
+        return fseeko(sink->stream, end, SEEK_SET) != 0 || failed ? -1 : 0;
+    }
+
+    off_t end = lseek(sink->fd, 0, SEEK_CUR);
+    if (end < 0) return -1;
+
+    romsink at = { .write = writeat, .written = 0, .at = { .fd = sink->fd } };
+    at.at.base = end - sink->written + offset;
+    return writeat(&at, buf, size);
+}
+
+static enum dumperr sinkcopy(
+    romsink       *sink,
+    fdpool        *fds,
+    string         source,
+    uint64_t       offset,
+    uint32_t       size,
+    unsigned char *readbuf
+)
+{
+    fdlease lease = fdacquire(fds, source);
+    if (lease.fd < 0) return E_dump_nofile;
+
+    enum dumperr err = E_dump_ok;
+    while (size > 0 && err == E_dump_ok) {
+        uint32_t chunk = size > READSIZE ? READSIZE : size;
+        if (fdread(lease.fd, readbuf, chunk, offset) != 0) err = E_dump_read;
+        else if (sinkwrite(sink, readbuf, chunk) != 0) err = E_dump_write;
+
+        offset += chunk;
+        size   -= chunk;
+    }
+
+    fdrelease(fds, lease);
+    return err;
+}
+
+// A donor is a sealed packer which already dumped its ROM to `fd`. Members with the same content as
+// one of the donor's (i.e., the same range of the same source file, or a NARC of the same size from
+// the same source) are cloned from the donor's ROM instead of being read from their sources.
+typedef struct donated {
+    string   source;
+    uint64_t rangeofs;
+    uint32_t size;
+    uint32_t narc;
+    uint32_t offset; // within the donor's ROM
+} donated;
+
+typedef struct romdonor {
+    int      fd;
+    donated *membs; // sorted by content
+    int      nmembs;
+} romdonor;
+
+static int comparedonated(const void *a, const void *b) // NOLINT
+{
+    const donated *da = a;
+    const donated *db = b;
+    if (da->narc != db->narc) return da->narc < db->narc ? -1 : 1;
+    if (da->size != db->size) return da->size < db->size ? -1 : 1;
+    if (da->rangeofs != db->rangeofs) return da->rangeofs < db->rangeofs ? -1 : 1;
+    if (da->source.len != db->source.len) return da->source.len < db->source.len ? -1 : 1;
+    return memcmp(da->source.s, db->source.s, da->source.len);
+}
+
+static donated donatedmemb(const rommember *memb)
+{
+    return (donated){ .source = memb->source.filename, .size = memb->size, .offset = memb->offset };
+}
+
+static donated donatedfile(const romfile *file)
+{
+    return (donated){
+        .source   = file->source,
+        .rangeofs = file->kind == K_romfile_range ? file->rangeofs : 0,
+        .size     = file->size,
+        .narc     = file->kind == K_romfile_narc,
+        .offset   = file->offset,
+    };
+}
+
+static void donateovys(romdonor *donor, const vector *ovys)
+{
+    for (int i = 0; i < ovys->len; i++) {
+        donor->membs[donor->nmembs++] = donatedmemb(get(ovys, rommember, i));
+    }
+}
+
+static romdonor *newdonor(const rompacker *packer, int fd)
+{
+    romdonor *donor = malloc(sizeof(*donor));
+    donor->fd       = fd;
+    donor->nmembs   = 0;
+    donor->membs    = malloc(sizeof(donated) * (4 + packer->ovy9.len + packer->ovy7.len
+                                                 + packer->filesys.len));
+
+    donor->membs[donor->nmembs++] = donatedmemb(&packer->arm9);
+    donor->membs[donor->nmembs++] = donatedmemb(&packer->ovt9);
+    donor->membs[donor->nmembs++] = donatedmemb(&packer->arm7);
+    donor->membs[donor->nmembs++] = donatedmemb(&packer->ovt7);
+    donateovys(donor, &packer->ovy9);
+    donateovys(donor, &packer->ovy7);
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind == K_romfile_path || file->kind == K_romfile_range
+            || file->kind == K_romfile_narc) {
+            donor->membs[donor->nmembs++] = donatedfile(file);
+        }
+    }
+
+    qsort(donor->membs, donor->nmembs, sizeof(donated), comparedonated);
+    return donor;
+}
+
+// Returns 1 if the member was cloned from the donor's ROM, 0 if the donor holds no member with the
+// same content, or -1 if the clone could not be written.
+static int sinkclone(romsink *sink, romdonor *donor, donated key)
+{
+    if (!donor || key.size == 0) return 0;
+
+    donated *match = bsearch(&key, donor->membs, donor->nmembs, sizeof(donated), comparedonated);
+    if (!match) return 0;
+    if (fclone(donor->fd, match->offset, sink->fd, key.size) != 0) return -1;
+
+    sink->written += key.size;
+    return 1;
+}
+
+static enum dumperr writememb_buf(romsink *sink, rommember *memb, const unsigned char *fill)
+{
+    if (sinkwrite(sink, memb->source.buf, memb->size) != 0) return E_dump_write;
+    return sinkfill(sink, fill, memb->pad) == 0 ? E_dump_ok : E_dump_write;
+}
+
+static enum dumperr writememb_file(
+    romsink             *sink,
+    fdpool              *fds,
+    rommember           *memb,
+    const unsigned char *fill,
+    unsigned char       *readbuf,
+    romdonor            *donor
+)
 {
-    if (packer->verbose) fprintf(stderr, "rompacker: dumping contents to disk... ");
+    int cloned = sinkclone(sink, donor, donatedmemb(memb));
+    if (cloned < 0) return E_dump_write;
+
+    if (!cloned && memb->size > 0) {
+        enum dumperr err = sinkcopy(sink, fds, memb->source.filename, 0, memb->size, readbuf);
+        if (err != E_dump_ok) return err;
+    }
+
+    return sinkfill(sink, fill, memb->pad) == 0 ? E_dump_ok : E_dump_write;
+}
+
+static enum dumperr sinkgenerate(
+    romsink       *sink,
+    romfile       *file,
+    uint32_t       offset,
+    uint32_t       end,
+    unsigned char *readbuf
+)
+{
+    while (offset < end) {
+        uint32_t chunk = end - offset > READSIZE ? READSIZE : end - offset;
+        if (file->gen.func(file->gen.user, readbuf, offset, chunk) != 0) return E_dump_read;
+        if (sinkwrite(sink, readbuf, chunk) != 0) return E_dump_write;
+        offset += chunk;
+    }
+
+    return E_dump_ok;
+}
+
+static enum dumperr writefile(
+    romsink             *sink,
+    romfile             *file,
+    const unsigned char *fill,
+    unsigned char       *readbuf,
+    fdpool              *fds,
+    romdonor            *donor
+)
+{
+    int cloned = file->kind == K_romfile_buffer || file->kind == K_romfile_generator
+                   ? 0
+                   : sinkclone(sink, donor, donatedfile(file));
+    if (cloned < 0) return E_dump_write;
+    if (cloned) return sinkfill(sink, fill, file->pad) == 0 ? E_dump_ok : E_dump_write;
+
+    enum dumperr err = E_dump_ok;
+    switch (file->kind) {
+    case K_romfile_buffer:
+        if (sinkwrite(sink, file->buf, file->size) != 0) err = E_dump_write;
+        break;
+
+    case K_romfile_generator:
+    case K_romfile_narc:
+        err = sinkgenerate(sink, file, 0, file->size, readbuf);
+        break;
+
+    default: {
+        // Members which share a source file (e.g., ranges of one archive) share one descriptor.
+        uint64_t offset = file->kind == K_romfile_range ? file->rangeofs : 0;
+        err             = sinkcopy(sink, fds, file->source, offset, file->size, readbuf);
+        break;
+    }
+    }
+
+    if (err != E_dump_ok) return err;
+    return sinkfill(sink, fill, file->pad) == 0 ? E_dump_ok : E_dump_write;
+}
+
+#define tryput(__expr, ...)                               \
+    {                                                     \
+        tracebegin(packer->trace, "member", __VA_ARGS__); \
+        err = (__expr);                                   \
+        traceend(packer->trace);                          \
+        if (err != E_dump_ok) goto cleanup;               \
+    }
+
+// Each class of member is metered as its own phase, which ends where the next one begins.
+#define nextphase()                            \
+    {                                          \
+        phaseend(packer, current, phase);      \
+        phase = phasebegin(packer, ++current); \
+    }
+
+static enum dumperr dumpto(rompacker *packer, romsink *sink, romdonor *donor)
+{
+    loginfo(packer->log, "rompacker", "dumping contents to disk...");
     if (packer->packing) return E_dump_packing;
 
+    meter          total   = phasebegin(packer, P_dump);
+    enum romphase  current = P_dump_header;
+    meter          phase   = phasebegin(packer, current);
+    fdpool        *fds     = packer->fds;
+    long long      opened  = fdpoolopens(fds); // the pool outlives each dump of a resident packer
+    long long      reused  = fdpoolhits(fds);
     unsigned char *readbuf = malloc(READSIZE);
+    romfile      **placed  = malloc(sizeof(romfile *) * (packer->filesys.len + 1));
+    romhasher     *hasher  = hashernew(packer);
+    unsigned char  fill[FILLSIZE];
+    memset(fill, packer->fillwith, sizeof(fill));
+
+    // Cloned members never pass through the sink, so they could not be digested.
+    sink->hasher = hasher;
+    if (hasher) donor = NULL;
+
+    for (int i = 0; i < packer->filesys.len; i++) placed[i] = get(&packer->filesys, romfile, i);
+    qsort(placed, packer->filesys.len, sizeof(romfile *), compareoffsets);
 
-    if (packer->verbose) fprintf(stderr, "header... ");
-    writememb_buf(packer->header, packer->fillwith, stream);
+    enum dumperr err = E_dump_ok;
+    logdebug(packer->log, "rompacker:dump", "header...");
+    tryput(writememb_buf(sink, &packer->header, fill), "%s", "header");
+    nextphase();
 
-    if (packer->verbose) fprintf(stderr, "arm9... ");
-    writememb_hdl(packer->arm9, packer->fillwith, stream);
+    logdebug(packer->log, "rompacker:dump", "arm9...");
+    tryput(writememb_file(sink, fds, &packer->arm9, fill, readbuf, donor), "%s", "arm9");
 
-    if (packer->verbose && packer->ovt9.size) fprintf(stderr, "ovt9... ");
-    writememb_hdl(packer->ovt9, packer->fillwith, stream);
+    if (packer->ovt9.size) logdebug(packer->log, "rompacker:dump", "ovt9...");
+    tryput(writememb_file(sink, fds, &packer->ovt9, fill, readbuf, donor), "%s", "ovt9");
 
-    if (packer->verbose && packer->ovy9.len) fprintf(stderr, "ovy9... ");
+    if (packer->ovy9.len) logdebug(packer->log, "rompacker:dump", "ovy9...");
     for (int i = 0; i < packer->ovy9.len; i++) {
         rommember *ovy = get(&packer->ovy9, rommember, i);
-        writememb_hdl(*ovy, packer->fillwith, stream);
+        tryput(writememb_file(sink, fds, ovy, fill, readbuf, donor), "ovy9 %d", i);
     }
+    nextphase();
 
-    if (packer->verbose) fprintf(stderr, "arm7... ");
-    writememb_hdl(packer->arm7, packer->fillwith, stream);
+    logdebug(packer->log, "rompacker:dump", "arm7...");
+    tryput(writememb_file(sink, fds, &packer->arm7, fill, readbuf, donor), "%s", "arm7");
 
-    if (packer->verbose && packer->ovt7.size) fprintf(stderr, "ovt7... ");
-    writememb_hdl(packer->ovt7, packer->fillwith, stream);
+    if (packer->ovt7.size) logdebug(packer->log, "rompacker:dump", "ovt7...");
+    tryput(writememb_file(sink, fds, &packer->ovt7, fill, readbuf, donor), "%s", "ovt7");
 
-    if (packer->verbose && packer->ovy7.len) fprintf(stderr, "ovy7... ");
+    if (packer->ovy7.len) logdebug(packer->log, "rompacker:dump", "ovy7...");
     for (int i = 0; i < packer->ovy7.len; i++) {
         rommember *ovy = get(&packer->ovy7, rommember, i);
-        writememb_hdl(*ovy, packer->fillwith, stream);
+        tryput(writememb_file(sink, fds, ovy, fill, readbuf, donor), "ovy7 %d", i);
     }
+    nextphase();
 
-    if (packer->verbose && packer->fntb.size) fprintf(stderr, "fntb... ");
-    writememb_buf(packer->fntb, packer->fillwith, stream);
+    if (packer->fntb.size) logdebug(packer->log, "rompacker:dump", "fntb...");
+    tryput(writememb_buf(sink, &packer->fntb, fill), "%s", "fntb");
 
-    if (packer->verbose && packer->fatb.size) fprintf(stderr, "fatb... ");
-    writememb_buf(packer->fatb, packer->fillwith, stream);
+    if (packer->fatb.size) logdebug(packer->log, "rompacker:dump", "fatb...");
+    tryput(writememb_buf(sink, &packer->fatb, fill), "%s", "fatb");
+    nextphase();
 
-    if (packer->verbose && packer->banner.size) fprintf(stderr, "banner... ");
-    writememb_buf(packer->banner, packer->fillwith, stream);
+    if (packer->banner.size) logdebug(packer->log, "rompacker:dump", "banner...");
+    tryput(writememb_buf(sink, &packer->banner, fill), "%s", "banner");
+    nextphase();
 
-    char sourcefn[256] = { 0 };
-    if (packer->verbose && packer->banner.size) fprintf(stderr, "filesys... ");
+    // Members are written in the order of their offsets; any space between them is filled.
+    if (packer->filesys.len) logdebug(packer->log, "rompacker:dump", "filesys...");
     for (int i = 0; i < packer->filesys.len; i++) {
-        romfile *file = get(&packer->filesys, romfile, i);
+        romfile *file = placed[i];
+        if (file->offset > sink->written && sinkfill(sink, fill, file->offset - sink->written)) {
+            err = E_dump_write;
+            goto cleanup;
+        }
 
-        int sourcefnlen = file->source.len <= 255 ? (int)file->source.len : 255;
-        memcpy(sourcefn, file->source.s, sourcefnlen);
-        sourcefn[sourcefnlen] = '\0';
-
-        FILE *source = fopen(sourcefn, "rb"); // NOLINT; this file is known to exist
-        while (file->size > 0) {
-            size_t nread = fread( // NOLINT: clang-tidy claims that this can invoke fread on EOF, which is impossible
-                readbuf,
-                1,
-                file->size > READSIZE ? READSIZE : file->size,
-                source
-            );
+        tryput(writefile(sink, file, fill, readbuf, fds, donor), "%.*s", fmtstring(file->target));
+    }
+    nextphase();
+
+    if (hasher) {
+        romdigests *twl = &packer->twl;
+        logdebug(packer->log, "rompacker:dump", "digests...");
+        if (sinkfill(sink, fill, twl->sectors.offset - sink->written) != 0) {
+            err = E_dump_write;
+            goto cleanup;
+        }
+
+        hasherfinish(hasher);
+        tryput(writememb_buf(sink, &twl->sectors, fill), "%s", "sector digests");
+        tryput(writememb_buf(sink, &twl->blocks, fill), "%s", "block digests");
 
-            fwrite(readbuf, 1, nread, stream);
-            file->size -= nread;
+        unsigned char *hmacs = packer->header.source.buf + OFS_HEADER_HMAC_ARM9;
+        uint32_t       size  = OFS_HEADER_HMAC_BANNER + SHA1_DIGEST_BSIZE - OFS_HEADER_HMAC_ARM9;
+        if (sinkpatch(sink, OFS_HEADER_HMAC_ARM9, hmacs, size) != 0) {
+            err = E_dump_write;
+            goto cleanup;
         }
-        for (int i = 0; i < file->pad; i++) fputc(packer->fillwith, stream);
-        fclose(source); // NOLINT; filesystem entries must exist to get this far
     }
+    nextphase();
 
-    if (packer->filltail) {
-        for (size_t curr = ftell(stream); curr < packer->tailsize; curr++) {
-            fputc(packer->fillwith, stream);
-        }
+    if (packer->filltail && sink->written < packer->tailsize) {
+        if (sinkfill(sink, fill, packer->tailsize - sink->written) != 0) err = E_dump_write;
     }
 
-    if (packer->verbose) fprintf(stderr, "done!\n");
+cleanup:
+    phaseend(packer, current, phase);
+    loginfo(packer->log, "rompacker", "dumping %s", err == E_dump_ok ? "done!" : "failed!");
+    loginfo(
+        packer->log,
+        "rompacker",
+        "source files opened: %lld; descriptors reused: %lld",
+        fdpoolopens(fds) - opened,
+        fdpoolhits(fds) - reused
+    );
+    free(placed);
     free(readbuf);
-    return E_dump_ok;
+    hasherdel(hasher);
+    sink->hasher = NULL;
+    phaseend(packer, P_dump, total);
+    return err;
+}
+
+enum dumperr rompacker_dump(rompacker *packer, FILE *stream)
+{
+    romsink sink = { .write = writestream, .written = 0, .stream = stream };
+    return dumpto(packer, &sink, NULL);
+}
+
+enum dumperr rompacker_dumpfd(rompacker *packer, int fd)
+{
+    romsink sink = { .write = writefd, .written = 0, .fd = fd };
+    return dumpto(packer, &sink, NULL);
+}
+
+enum dumperr rompacker_dumpshared(rompacker *packer, int fd, const rompacker *donor, int donorfd)
+{
+    if (donor->packing) return E_dump_packing;
+
+    romsink       sink  = { .write = writefd, .written = 0, .fd = fd };
+    romdonor     *given = newdonor(donor, donorfd);
+    enum dumperr  err   = dumpto(packer, &sink, given);
+    free(given->membs);
+    free(given);
+    return err;
+}
+
+enum dumperr rompacker_dumpbuf(rompacker *packer, unsigned char *buf, uint64_t bufsize)
+{
+    romsink sink = { .write = writemem, .written = 0, .mem = { .buf = buf, .cap = bufsize } };
+    return dumpto(packer, &sink, NULL);
+}
+
+// Sinks for a refresh begin at the offset of each rewritten member.
+static void sinkseek(romsink *sink, uint64_t offset)
+{
+    sink->at.base = offset;
+    sink->written = 0;
+}
+
+typedef struct refresh {
+    rompacker           *packer;
+    string               filename;
+    long                 size; // of the file as it is now; -1 if it no longer exists
+    romsink             *sink; // if NULL, only check that every member still fits
+    const unsigned char *fill;
+    unsigned char       *readbuf;
+    int                  nmembs;
+    int                  fatbdirty;
+} refresh;
+
+static enum refresherr refreshmemb(refresh *r, rommember *memb)
+{
+    if (!strequ(memb->source.filename, r->filename)) return E_refresh_ok;
+    if (r->size != (long)memb->size) return E_refresh_layout;
+
+    r->nmembs++;
+    if (!r->sink) return E_refresh_ok;
+
+    sinkseek(r->sink, memb->offset);
+    enum dumperr err = writememb_file(r->sink, r->packer->fds, memb, r->fill, r->readbuf, NULL);
+    return (enum refresherr)err;
+}
+
+static enum refresherr refreshovys(refresh *r, vector *ovys)
+{
+    enum refresherr err = E_refresh_ok;
+    for (int i = 0; i < ovys->len && err == E_refresh_ok; i++) {
+        err = refreshmemb(r, get(ovys, rommember, i));
+    }
+
+    return err;
+}
+
+// Each member of a NARC is rewritten alone, at its offset within the archive.
+static enum refresherr refreshnarc(refresh *r, romfile *file)
+{
+    narc *narc = file->gen.user;
+    if (strequ(narc->source, r->filename) && narc_changed(narc)) return E_refresh_layout;
+
+    for (int i = 0; i < narc->members.len; i++) {
+        narcmember *memb = get(&narc->members, narcmember, i);
+        if (!strequ(memb->source, r->filename)) continue;
+        if (r->size != (long)memb->size) return E_refresh_layout;
+
+        r->nmembs++;
+        if (!r->sink) continue;
+
+        narc_rewind(narc);
+        sinkseek(r->sink, file->offset + memb->offset);
+
+        uint32_t     end = memb->offset + memb->size;
+        enum dumperr err = sinkgenerate(r->sink, file, memb->offset, end, r->readbuf);
+        if (err != E_dump_ok) return (enum refresherr)err;
+    }
+
+    return E_refresh_ok;
+}
+
+// Filesystem members may grow or shrink within their padding, which moves the end of their FATB
+// entry. The member placed last has no padding of its own within the ROM's size, so it may not
+// change.
+static enum refresherr refreshfile(refresh *r, romfile *file, int last)
+{
+    if (file->kind == K_romfile_narc) return refreshnarc(r, file);
+    if (!strequ(file->source, r->filename)) return E_refresh_ok;
+    if (file->kind != K_romfile_path || file->transform != K_transform_none) {
+        return E_refresh_layout;
+    }
+
+    uint32_t slot = membsize(file);
+    if (r->size < 0 || r->size > slot || (last && r->size != (long)file->size)) {
+        return E_refresh_layout;
+    }
+
+    r->nmembs++;
+    if (!r->sink) return E_refresh_ok;
+
+    if (r->size != (long)file->size) {
+        file->size = (uint32_t)r->size;
+        file->pad  = (uint16_t)(slot - file->size);
+        unsigned char *fatb = r->packer->fatb.source.buf;
+        putleword(fatb_end(fatb, file->filesysid), file->offset + file->size);
+        r->fatbdirty = 1;
+    }
+
+    sinkseek(r->sink, file->offset);
+    return (enum refresherr)writefile(r->sink, file, r->fill, r->readbuf, r->packer->fds, NULL);
+}
+
+static enum refresherr refreshall(refresh *r)
+{
+    rompacker      *packer = r->packer;
+    enum refresherr err    = refreshmemb(r, &packer->arm9);
+    if (err == E_refresh_ok) err = refreshmemb(r, &packer->ovt9);
+    if (err == E_refresh_ok) err = refreshovys(r, &packer->ovy9);
+    if (err == E_refresh_ok) err = refreshmemb(r, &packer->arm7);
+    if (err == E_refresh_ok) err = refreshmemb(r, &packer->ovt7);
+    if (err == E_refresh_ok) err = refreshovys(r, &packer->ovy7);
+    romfile *last = NULL;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (!last || file->offset >= last->offset) last = file;
+    }
+
+    for (int i = 0; i < packer->filesys.len && err == E_refresh_ok; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        err           = refreshfile(r, file, file == last);
+    }
+
+    if (err == E_refresh_ok && r->fatbdirty) {
+        sinkseek(r->sink, packer->fatb.offset);
+        err = (enum refresherr)writememb_buf(r->sink, &packer->fatb, r->fill);
+    }
+
+    return err;
+}
+
+// Inputs to computed members (e.g., the source of a compressed member) are only known as
+// dependencies. Members of NARCs are also registered as dependencies, once for each archive, but
+// are refreshed directly.
+static int feedscomputed(rompacker *packer, string filename)
+{
+    int ndeps = 0;
+    for (int i = 0; i < packer->deps.len; i++) {
+        ndeps += strequ(*get(&packer->deps, string, i), filename);
+    }
+
+    for (int i = 0; i < packer->filesys.len && ndeps > 0; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind != K_romfile_narc) continue;
+
+        narc *narc = file->gen.user;
+        for (int j = 0; j < narc->members.len; j++) {
+            ndeps -= strequ(get(&narc->members, narcmember, j)->source, filename);
+        }
+    }
+
+    return ndeps > 0;
+}
+
+enum refresherr rompacker_refresh(rompacker *packer, string filename, int fd)
+{
+    if (packer->packing) return E_refresh_packing;
+    if (feedscomputed(packer, filename)) return E_refresh_layout;
+
+    // A pooled descriptor may still refer to the file's previous content.
+    fdevict(packer->fds, filename);
+
+    refresh r = { .packer = packer, .filename = filename, .size = fsizes(filename) };
+    enum refresherr err = refreshall(&r);
+    if (err != E_refresh_ok) return err;
+    if (r.nmembs == 0) return E_refresh_unused;
+
+    // Any change to the ROM changes its digests, which cover every member.
+    if (packer->twl.key.len > 0) return E_refresh_layout;
+
+    unsigned char fill[FILLSIZE];
+    memset(fill, packer->fillwith, sizeof(fill));
+
+    romsink sink = { .write = writeat, .written = 0, .at = { .fd = fd, .base = 0 } };
+    r.sink       = &sink;
+    r.fill       = fill;
+    r.readbuf    = malloc(READSIZE);
+    r.nmembs     = 0;
+    err          = refreshall(&r);
+    free(r.readbuf);
+
+    loginfo(
+        packer->log,
+        "rompacker:refresh",
+        "%s %d member%s from “%.*s”",
+        err == E_refresh_ok ? "rewrote" : "failed to rewrite",
+        r.nmembs,
+        r.nmembs == 1 ? "" : "s",
+        fmtstring(filename)
+    );
+    return err;
 }
@@ -12,19 +12,26 @@
 #include "constants.h"
 
 #include "libs/config.h"
+#include "libs/fdpool.h"
 #include "libs/fileio.h"
+#include "libs/log.h"
 #include "libs/strings.h"
 #include "libs/vector.h"
 
 #define NEF_EXT_LEN lengthof(".nef")
 
-// NOTE: This performs an allocation that may *appear* to be left dangling, but we employ a trick:
-// The first element of the vector points to the beginning of the allocated region, so freeing the
-// first element's filename string will free the entire region.
+// Logs are scoped by the section which is being configured.
+static const char *armscope(const char *sec)
+{
+    return strcmp(sec, "arm9") == 0 ? "rompacker:configuration:arm9"
+                                    : "rompacker:configuration:arm7";
+}
+
+// Overlay filenames point into a single allocation, which is owned by the packer.
 static cfgresult cfg_overlays(rompacker *packer, file *f, vector *ovyvec, long line, char *sec)
 {
     long           lennames = f->size - 0x10;
-    unsigned char *ovynames = malloc(lennames);
+    unsigned char *ovynames = rompacker_own(packer, string(NULL, lennames)).s;
     fread(ovynames, 1, lennames, f->hdl);
     fclose(f->hdl);
 
@@ -37,8 +44,10 @@ static cfgresult cfg_overlays(rompacker *packer, file *f, vector *ovyvec, long l
         for (long j = i; j < lennames && ovynames[j]; j++, ovy->source.filename.len++);
         i += ovy->source.filename.len;
 
-        file fovy = fprep((const char *)ovy->source.filename.s);
-        if (fovy.size < 0) {
+        // The descriptor stays pooled, so that the dump need not reopen the file.
+        fdlease fovy = fdacquire(packer->fds, ovy->source.filename);
+        fdrelease(packer->fds, fovy);
+        if (fovy.fd < 0) {
             configerr(
                 "could not open %s overlay file “%.*s”",
                 sec,
@@ -46,18 +55,15 @@ static cfgresult cfg_overlays(rompacker *packer, file *f, vector *ovyvec, long l
             );
         }
 
-        ovy->source.hdl = fovy.hdl;
-        ovy->size       = fovy.size;
-        ovy->pad        = -(fovy.size) & (ROM_ALIGN - 1);
+        ovy->size = fovy.size;
+        ovy->pad  = -(fovy.size) & (ROM_ALIGN - 1);
 
-        if (packer->verbose) {
-            fprintf(
-                stderr,
-                "rompacker:configuration:%s: loaded “%.*s” as an overlay\n",
-                sec,
-                fmtstring(ovy->source.filename)
-            );
-        }
+        loginfo(
+            packer->log,
+            armscope(sec),
+            "loaded “%.*s” as an overlay",
+            fmtstring(ovy->source.filename)
+        );
     }
 
     return configok;
@@ -73,22 +79,15 @@ static inline cfgresult cfg_arm_prepfile(
 )
 {
     varsub(val, packer);
-    file fhandle = fpreps(val);
-    if (fhandle.size < 0) configerr("could not open %s file “%.*s”", key, fmtstring(val));
+    fdlease fhandle = fdacquire(packer->fds, val);
+    fdrelease(packer->fds, fhandle);
+    if (fhandle.fd < 0) configerr("could not open %s file “%.*s”", key, fmtstring(val));
 
     target->source.filename = val;
-    target->source.hdl      = fhandle.hdl;
     target->size            = fhandle.size;
     target->pad             = -(fhandle.size) & (ROM_ALIGN - 1);
 
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:%s: loaded “%.*s” as the static binary\n",
-            sec,
-            fmtstring(val)
-        );
-    }
+    loginfo(packer->log, armscope(sec), "loaded “%.*s” as the static binary", fmtstring(val));
 
     return configok;
 }
@@ -114,6 +113,7 @@ static cfgresult cfg_arm9_definitions(rompacker *packer, string val, long line)
     fread(header + OFS_HEADER_ARM9_ENTRYPOINT, 1, 4, fdefinitions.hdl);
     fread(header + OFS_HEADER_ARM9_LOADSIZE, 1, 4, fdefinitions.hdl);
     fread(header + OFS_HEADER_ARM9_AUTOLOADCB, 1, 4, fdefinitions.hdl);
+    rompacker_depend(packer, val);
 
     return fdefinitions.size > 0x10
              ? cfg_overlays(packer, &fdefinitions, &packer->ovy9, line, "arm9")
@@ -184,6 +184,7 @@ static cfgresult cfg_arm7_definitions(rompacker *packer, string val, long line)
     fread(header + OFS_HEADER_ARM7_ENTRYPOINT, 1, 4, fdefinitions.hdl);
     fread(header + OFS_HEADER_ARM7_LOADSIZE, 1, 4, fdefinitions.hdl);
     fread(header + OFS_HEADER_ARM7_AUTOLOADCB, 1, 4, fdefinitions.hdl);
+    rompacker_depend(packer, val);
 
     return fdefinitions.size > 0x10
              ? cfg_overlays(packer, &fdefinitions, &packer->ovy7, line, "arm7")
@@ -17,6 +17,7 @@
 #include "libs/config.h"
 #include "libs/fileio.h"
 #include "libs/litend.h"
+#include "libs/log.h"
 #include "libs/strings.h"
 
 static cfgresult cfg_banner_version(rompacker *packer, string val, long line)
@@ -52,9 +53,7 @@ static cfgresult cfg_banner_version(rompacker *packer, string val, long line)
 
     unsigned char *banner = packer->banner.source.buf;
     banner[0]             = result;
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:banner: set version to %d\n", result);
-    }
+    loginfo(packer->log, "rompacker:configuration:banner", "set version to %d", result);
 
     return configok;
 }
@@ -62,28 +61,29 @@ static cfgresult cfg_banner_version(rompacker *packer, string val, long line)
 static cfgresult cfg_banner_icon4bpp(rompacker *packer, string val, long line)
 {
     varsub(val, packer);
-    string ficon4bpp = floads(val);
-    if (ficon4bpp.len < 0) configerr("could not open icon bitmap file “%.*s”", fmtstring(val));
-    if (ficon4bpp.len > (long)ICON_BITMAP_BSIZE) {
+    fview ficon4bpp = fmaps(val);
+    if (ficon4bpp.data.len < 0) configerr("could not open icon bitmap file “%.*s”", fmtstring(val));
+    if (ficon4bpp.data.len > (long)ICON_BITMAP_BSIZE) {
+        funmap(ficon4bpp);
         configerr(
             "icon bitmap file “%.*s” size 0x%08lX exceeds maximum size 0x%04X",
             fmtstring(val),
-            ficon4bpp.len,
+            ficon4bpp.data.len,
             ICON_BITMAP_BSIZE
         );
     }
 
     unsigned char *banner = packer->banner.source.buf;
-    memcpy(banner + OFS_BANNER_ICON_BITMAP, ficon4bpp.s, ficon4bpp.len);
-    free(ficon4bpp.s);
-
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:banner: loaded “%.*s” as the icon bitmap\n",
-            fmtstring(val)
-        );
-    }
+    memcpy(banner + OFS_BANNER_ICON_BITMAP, ficon4bpp.data.s, ficon4bpp.data.len);
+    funmap(ficon4bpp);
+    rompacker_depend(packer, val);
+
+    loginfo(
+        packer->log,
+        "rompacker:configuration:banner",
+        "loaded “%.*s” as the icon bitmap",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -91,28 +91,29 @@ static cfgresult cfg_banner_icon4bpp(rompacker *packer, string val, long line)
 static cfgresult cfg_banner_iconpal(rompacker *packer, string val, long line)
 {
     varsub(val, packer);
-    string ficonpal = floads(val);
-    if (ficonpal.len < 0) configerr("could not open icon palette file “%.*s”", fmtstring(val));
-    if (ficonpal.len > (long)ICON_PALETTE_BSIZE) {
+    fview ficonpal = fmaps(val);
+    if (ficonpal.data.len < 0) configerr("could not open icon palette file “%.*s”", fmtstring(val));
+    if (ficonpal.data.len > (long)ICON_PALETTE_BSIZE) {
+        funmap(ficonpal);
         configerr(
             "icon palette file “%.*s” size 0x%08lX exceeds maximum size 0x%04X",
             fmtstring(val),
-            ficonpal.len,
+            ficonpal.data.len,
             ICON_PALETTE_BSIZE
         );
     }
 
     unsigned char *banner = packer->banner.source.buf;
-    memcpy(banner + OFS_BANNER_ICON_PALETTE, ficonpal.s, ficonpal.len);
-    free(ficonpal.s);
-
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:banner: loaded “%.*s” as the icon palette\n",
-            fmtstring(val)
-        );
-    }
+    memcpy(banner + OFS_BANNER_ICON_PALETTE, ficonpal.data.s, ficonpal.data.len);
+    funmap(ficonpal);
+    rompacker_depend(packer, val);
+
+    loginfo(
+        packer->log,
+        "rompacker:configuration:banner",
+        "loaded “%.*s” as the icon palette",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -163,6 +164,13 @@ static cfgresult cfg_banner_iconpng(rompacker *packer, string val, long line)
         configerr("error setting up PNG info struct for icon file “%.*s”", fmtstring(val));
     }
 
+    // libpng reports malformed input by jumping back here; without a handler, it aborts.
+    if (setjmp(png_jmpbuf(ppng))) {
+        png_destroy_read_struct(&ppng, &pinfo, NULL);
+        fclose(ficonpng.hdl);
+        configerr("icon file “%.*s” is malformed", fmtstring(val));
+    }
+
     png_init_io(ppng, ficonpng.hdl);
     png_set_sig_bytes(ppng, PNGSIGSIZE);
     png_read_info(ppng, pinfo);
@@ -185,7 +193,6 @@ static cfgresult cfg_banner_iconpng(rompacker *packer, string val, long line)
     // clang-format on
 
     unsigned char *banner  = packer->banner.source.buf;
-    unsigned char *tiles   = banner + OFS_BANNER_ICON_BITMAP;
     unsigned char *palette = banner + OFS_BANNER_ICON_PALETTE;
 
     for (int i = 0; i < ICON_COLOR_DEPTH; i++) {
@@ -202,22 +209,31 @@ static cfgresult cfg_banner_iconpng(rompacker *packer, string val, long line)
     png_bytepp prows   = (png_bytepp)malloc(height * sizeof(png_bytep));
     for (uint32_t i = 0; i < height; i++) prows[i] = (png_bytep)(pixels + (i * rowsize));
 
+    if (setjmp(png_jmpbuf(ppng))) {
+        png_destroy_read_struct(&ppng, &pinfo, NULL);
+        fclose(ficonpng.hdl);
+        free(prows);
+        free(pixels);
+        configerr("icon file “%.*s” is malformed", fmtstring(val));
+    }
+
     png_read_image(ppng, prows);
     png_destroy_read_struct(&ppng, &pinfo, NULL);
     free((png_bytep)prows);
     fclose(ficonpng.hdl);
+    rompacker_depend(packer, val);
 
+    unsigned char *tiles = banner + OFS_BANNER_ICON_BITMAP;
     for (int y = 0; y < 4; y++) {
         for (int x = 0; x < 4; x++) copytile(x, y, pixels, tiles);
     }
 
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:banner: loaded “%.*s” as the icon\n",
-            fmtstring(val)
-        );
-    }
+    loginfo(
+        packer->log,
+        "rompacker:configuration:banner",
+        "loaded “%.*s” as the icon",
+        fmtstring(val)
+    );
 
     free(pixels);
     return configok;
@@ -322,9 +338,7 @@ static cfgresult cfg_banner_title(rompacker *packer, string val, long line)
     cfgresult result = cfg_banner_titlepart(packer, val, line);
     if (result.code != E_config_none) return result;
 
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:banner: set title to “%.*s”\n", fmtstring(val));
-    }
+    loginfo(packer->log, "rompacker:configuration:banner", "set title to “%.*s”", fmtstring(val));
 
     return configok;
 }
@@ -345,9 +359,12 @@ static cfgresult cfg_banner_subtitle(rompacker *packer, string val, long line)
     cfgresult result = cfg_banner_titlepart(packer, val, line);
     if (result.code != E_config_none) return result;
 
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:banner: set subtitle to “%.*s”\n", fmtstring(val));
-    }
+    loginfo(
+        packer->log,
+        "rompacker:configuration:banner",
+        "set subtitle to “%.*s”",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -366,13 +383,12 @@ static cfgresult cfg_banner_developer(rompacker *packer, string val, long line)
     cfgresult result = cfg_banner_titlepart(packer, val, line);
     if (result.code != E_config_none) return result;
 
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:banner: set developer to “%.*s”\n",
-            fmtstring(val)
-        );
-    }
+    loginfo(
+        packer->log,
+        "rompacker:configuration:banner",
+        "set developer to “%.*s”",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -13,31 +13,33 @@
 #include "libs/config.h"
 #include "libs/fileio.h"
 #include "libs/litend.h"
+#include "libs/log.h"
 #include "libs/strings.h"
 
 static cfgresult cfg_header_template(rompacker *packer, string val, long line)
 {
     varsub(val, packer);
-    string ftemplate = floads(val);
-    if (ftemplate.len < 0) configerr("could not open template file “%.*s”", fmtstring(val));
-    if (ftemplate.len > HEADER_BSIZE) {
+    fview ftemplate = fmaps(val);
+    if (ftemplate.data.len < 0) configerr("could not open template file “%.*s”", fmtstring(val));
+    if (ftemplate.data.len > HEADER_BSIZE) {
+        funmap(ftemplate);
         configerr(
             "template file “%.*s” size 0x%08lX exceeds maximum size 0x%04X",
             fmtstring(val),
-            ftemplate.len,
+            ftemplate.data.len,
             HEADER_BSIZE
         );
     }
-    memcpy(packer->header.source.buf, ftemplate.s, ftemplate.len);
-    free(ftemplate.s);
-
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:header: loaded “%.*s” as a template\n",
-            fmtstring(val)
-        );
-    }
+    memcpy(packer->header.source.buf, ftemplate.data.s, ftemplate.data.len);
+    funmap(ftemplate);
+    rompacker_depend(packer, val);
+
+    loginfo(
+        packer->log,
+        "rompacker:configuration:header",
+        "loaded “%.*s” as a template",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -57,9 +59,7 @@ static inline cfgresult cfg_header_nchars(
     }
 
     memcpy(((unsigned char *)packer->header.source.buf) + ofs, val.s, val.len);
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:header: set %s to “%.*s”\n", key, fmtstring(val));
-    }
+    loginfo(packer->log, "rompacker:configuration:header", "set %s to “%.*s”", key, fmtstring(val));
 
     return configok;
 }
@@ -99,9 +99,7 @@ static cfgresult cfg_header_revision(rompacker *packer, string val, long line)
     if (result > 255) configerr("revision value %d exceeds maximum of 255", result);
 
     ((unsigned char *)packer->header.source.buf)[OFS_HEADER_REVISION] = result;
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:header: set revision to %d\n", result);
-    }
+    loginfo(packer->log, "rompacker:configuration:header", "set revision to %d", result);
 
     return configok;
 }
@@ -137,9 +135,7 @@ static cfgresult cfg_header_securecrc(rompacker *packer, string val, long line)
 
     unsigned char *header = packer->header.source.buf;
     putlehalf(header + OFS_HEADER_SECURECRC, result);
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:header: set secure CRC to 0x%04X\n", result);
-    }
+    loginfo(packer->log, "rompacker:configuration:header", "set secure CRC to 0x%04X", result);
 
     return configok;
 }
@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: MIT
+
+#include "packer.h"
+
+#include <stdio.h>
+#include <stdlib.h> // NOLINT: misc-include-cleaner
+
+#include "cfgparse.h"
+
+#include "libs/config.h"
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+// clang-format off
+const cfgsection rompacker_cfgsections[] = {
+    { .section = string("header"),   .handler = cfg_header },
+    { .section = string("rom"),      .handler = cfg_rom    },
+    { .section = string("banner"),   .handler = cfg_banner },
+    { .section = string("arm9"),     .handler = cfg_arm9   },
+    { .section = string("arm7"),     .handler = cfg_arm7   },
+    { .section = string("twl"),      .handler = cfg_twl    },
+    { .section = stringZ,            .handler = NULL       },
+};
+// clang-format on
+
+// Programmatic input has no source lines; errors are reported against line 0.
+cfgresult rompacker_define(rompacker *packer, string key, string val)
+{
+    long line = 0;
+    if (!packer->packing) configerr("packer is already sealed");
+
+    for (int i = 0; i < packer->vardefs->len; i++) {
+        strpair *pair = get(packer->vardefs, strpair, i);
+        if (strequ(pair->head, key)) configerr("variable “%.*s” is already set", fmtstring(key));
+    }
+
+    strpair *pair = push(packer->vardefs, strpair);
+    pair->head    = rompacker_own(packer, key);
+    pair->tail    = rompacker_own(packer, val);
+    return configok;
+}
+
+cfgresult rompacker_configure(rompacker *packer, string sec, string key, string val)
+{
+    long line = 0;
+    if (!packer->packing) configerr("packer is already sealed");
+
+    const cfgsection *match = &rompacker_cfgsections[0];
+    for (; match->handler != NULL && !strequ(sec, match->section); match++);
+    if (match->handler == NULL) configerr("unrecognized section “%.*s”", fmtstring(sec));
+
+    // Handlers may retain their values (e.g., as filenames) until the packer is deleted.
+    return match->handler(sec, key, rompacker_own(packer, val), packer, line);
+}
@@ -12,6 +12,7 @@
 
 #include "libs/config.h"
 #include "libs/litend.h"
+#include "libs/log.h"
 #include "libs/strings.h"
 
 // clang-format off
@@ -21,6 +22,12 @@ static const strkeyval storagetypes[] = {
     { .smatch = stringZ,         .val = 0       },
 };
 
+static const strkeyval placements[] = {
+    { .smatch = string("sequential"), .val = 0 },
+    { .smatch = string("best-fit"),   .val = 1 },
+    { .smatch = stringZ,              .val = 0 },
+};
+
 static const strkeyval booleans[] = {
     { .smatch = string("true"),  .val = 1 },
     { .smatch = string("false"), .val = 0 },
@@ -49,13 +56,12 @@ static cfgresult cfg_rom_storagetype(rompacker *packer, string val, long line)
     putlehalf(header + OFS_HEADER_SECURE_DELAY, match->val);
 
     packer->prom = match->val == ST_PROM;
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:rom: setting storage type to %.*s\n",
-            fmtstring(val)
-        );
-    }
+    loginfo(
+        packer->log,
+        "rompacker:configuration:rom",
+        "setting storage type to %.*s",
+        fmtstring(val)
+    );
 
     return configok;
 }
@@ -70,60 +76,177 @@ static cfgresult cfg_rom_filltail(rompacker *packer, string val, long line)
     }
 
     packer->filltail = match->val;
-    if (packer->verbose) {
-        fprintf(stderr, "rompacker:configuration:rom: will fill final ROM to capacity\n");
-    }
+    loginfo(packer->log, "rompacker:configuration:rom", "will fill final ROM to capacity");
 
     return configok;
 }
 
-static cfgresult cfg_rom_fillwith(rompacker *packer, string val, long line)
+int parsebase16(string val, uint32_t *result)
 {
-    varsub(val, packer);
     string par = val;
     if (par.len > 2 && par.s[0] == '0' && (par.s[1] == 'x' || par.s[1] == 'X')) {
         par.s   += 2;
         par.len -= 2;
     }
 
-    unsigned int result = 0;
+    if (par.len > 8) return -1;
+
+    *result = 0;
     for (long i = 0; i < par.len; i++) {
         int digit = -1;
         if (par.s[i] >= '0' && par.s[i] <= '9') digit = par.s[i] - '0';
         else if (par.s[i] >= 'A' && par.s[i] <= 'F') digit = par.s[i] - 'A' + 10;
         else if (par.s[i] >= 'a' && par.s[i] <= 'f') digit = par.s[i] - 'a' + 10;
 
-        if (digit < 0 || digit > 15) {
-            configerr(
-                "expected unsigned base-16 numeric-literal, but found “%.*s”",
-                fmtstring(val)
-            );
-        }
+        if (digit < 0 || digit > 15) return -1;
 
-        result *= 16;
-        result += digit;
+        *result *= 16;
+        *result += digit;
+    }
+
+    return 0;
+}
+
+static cfgresult cfg_rom_fillwith(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    uint32_t result = 0;
+    if (parsebase16(val, &result) != 0) {
+        configerr("expected unsigned base-16 numeric-literal, but found “%.*s”", fmtstring(val));
     }
 
     if (result > 0xFF) configerr("fill-with value 0x%08X exceeds maximum of 0xFF", result);
 
     packer->fillwith = result;
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:configuration:rom: will fill padding-values with 0x%02X\n",
+    loginfo(
+        packer->log,
+        "rompacker:configuration:rom",
+        "will fill padding-values with 0x%02X",
+        result
+    );
+
+    return configok;
+}
+
+// Headroom is rounded up to the ROM's alignment, so that it never misaligns the member after it.
+static cfgresult cfg_rom_headroom(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    uint32_t result = 0;
+    if (parsebase16(val, &result) != 0) {
+        configerr("expected unsigned base-16 numeric-literal, but found “%.*s”", fmtstring(val));
+    }
+
+    uint32_t maximum = UINT32_MAX - ROM_ALIGN + 1;
+    if (result > maximum) {
+        configerr("headroom value 0x%08X exceeds maximum of 0x%08X", result, maximum);
+    }
+
+    packer->headroom = (result + ROM_ALIGN - 1) & ~(uint32_t)(ROM_ALIGN - 1);
+    loginfo(
+        packer->log,
+        "rompacker:configuration:rom",
+        "will reserve 0x%08X bytes after each newly-placed member",
+        packer->headroom
+    );
+
+    return configok;
+}
+
+static cfgresult cfg_rom_placement(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    const strkeyval *match = &placements[0];
+    for (; match->smatch.len > 0 && !strequ(val, match->smatch); match++);
+    if (match->smatch.len <= 0) {
+        configerr("expected either “sequential” or “best-fit”, but found “%.*s”", fmtstring(val));
+    }
+
+    packer->bestfit = match->val;
+    loginfo(
+        packer->log,
+        "rompacker:configuration:rom",
+        "will place filesystem members %s",
+        match->val ? "best-fit" : "sequentially"
+    );
+
+    return configok;
+}
+
+static const char *classnames[] = {
+    [K_romclass_arm]     = "ARM binaries",
+    [K_romclass_overlay] = "overlays",
+    [K_romclass_table]   = "tables",
+    [K_romclass_file]    = "filesystem members",
+};
+
+static inline cfgresult cfg_rom_align(
+    rompacker    *packer,
+    string        val,
+    long          line,
+    enum romclass class
+)
+{
+    varsub(val, packer);
+    uint32_t result = 0;
+    if (parsebase16(val, &result) != 0) {
+        configerr("expected unsigned base-16 numeric-literal, but found “%.*s”", fmtstring(val));
+    }
+
+    if (!rompacker_alignok(class, result)) {
+        configerr(
+            "alignment of %s must be a power of two from 0x%X to 0x%X, but found 0x%X",
+            classnames[class],
+            rompacker_minalign(class),
+            ROM_MAXALIGN,
             result
         );
     }
 
+    packer->align[class] = result;
+    loginfo(
+        packer->log,
+        "rompacker:configuration:rom",
+        "will align %s to 0x%X bytes",
+        classnames[class],
+        result
+    );
+
     return configok;
 }
 
+static cfgresult cfg_rom_alignarm(rompacker *packer, string val, long line)
+{
+    return cfg_rom_align(packer, val, line, K_romclass_arm);
+}
+
+static cfgresult cfg_rom_alignoverlays(rompacker *packer, string val, long line)
+{
+    return cfg_rom_align(packer, val, line, K_romclass_overlay);
+}
+
+static cfgresult cfg_rom_aligntables(rompacker *packer, string val, long line)
+{
+    return cfg_rom_align(packer, val, line, K_romclass_table);
+}
+
+static cfgresult cfg_rom_alignfiles(rompacker *packer, string val, long line)
+{
+    return cfg_rom_align(packer, val, line, K_romclass_file);
+}
+
 // clang-format off
 static const keyvalueparser kvparsers[] = {
-    { .key = string("storage-type"), .parser = cfg_rom_storagetype  },
-    { .key = string("fill-tail"),    .parser = cfg_rom_filltail     },
-    { .key = string("fill-with"),    .parser = cfg_rom_fillwith     },
-    { .key = stringZ,                .parser = NULL                 },
+    { .key = string("storage-type"),   .parser = cfg_rom_storagetype   },
+    { .key = string("fill-tail"),      .parser = cfg_rom_filltail      },
+    { .key = string("fill-with"),      .parser = cfg_rom_fillwith      },
+    { .key = string("headroom"),       .parser = cfg_rom_headroom      },
+    { .key = string("align-arm"),      .parser = cfg_rom_alignarm      },
+    { .key = string("align-overlays"), .parser = cfg_rom_alignoverlays },
+    { .key = string("align-tables"),   .parser = cfg_rom_aligntables   },
+    { .key = string("align-files"),    .parser = cfg_rom_alignfiles    },
+    { .key = string("placement"),      .parser = cfg_rom_placement     },
+    { .key = stringZ,                  .parser = NULL                  },
 };
 // clang-format on
 
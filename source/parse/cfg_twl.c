@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+
+#include "packer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cfgparse.h"
+#include "constants.h"
+
+#include "libs/config.h"
+#include "libs/fileio.h"
+#include "libs/log.h"
+#include "libs/strings.h"
+
+// The key is copied, so that a plan or a resident packer does not depend on the file staying open.
+static cfgresult cfg_twl_digestkey(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    fview fkey = fmaps(val);
+    if (fkey.data.len < 0) configerr("could not open digest key file “%.*s”", fmtstring(val));
+    if (fkey.data.len == 0) {
+        funmap(fkey);
+        configerr("digest key file “%.*s” is empty", fmtstring(val));
+    }
+
+    packer->twl.key = rompacker_own(packer, fkey.data);
+    funmap(fkey);
+    rompacker_depend(packer, val);
+
+    loginfo(
+        packer->log,
+        "rompacker:configuration:twl",
+        "loaded “%.*s” as the digest key (%ld bytes)",
+        fmtstring(val),
+        packer->twl.key.len
+    );
+
+    return configok;
+}
+
+// Sectors start on the ROM's alignment, so that the digest tables which follow them do too.
+static cfgresult cfg_twl_sectorsize(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    uint32_t result = 0;
+    if (parsebase16(val, &result) != 0) {
+        configerr("expected unsigned base-16 numeric-literal, but found “%.*s”", fmtstring(val));
+    }
+
+    if ((result & (result - 1)) != 0 || result < ROM_ALIGN || result > ROM_MAXALIGN) {
+        configerr(
+            "digest sector size must be a power of two from 0x%X to 0x%X, but found 0x%X",
+            ROM_ALIGN,
+            ROM_MAXALIGN,
+            result
+        );
+    }
+
+    packer->twl.sectorsize = result;
+    loginfo(
+        packer->log,
+        "rompacker:configuration:twl",
+        "will digest sectors of 0x%X bytes",
+        result
+    );
+
+    return configok;
+}
+
+static cfgresult cfg_twl_blocksectors(rompacker *packer, string val, long line)
+{
+    varsub(val, packer);
+    uint32_t result = 0;
+    if (parsebase16(val, &result) != 0) {
+        configerr("expected unsigned base-16 numeric-literal, but found “%.*s”", fmtstring(val));
+    }
+
+    if (result == 0 || result > 0x10000) {
+        configerr("digest block sector-count must be from 0x1 to 0x10000, but found 0x%X", result);
+    }
+
+    packer->twl.blocksectors = result;
+    loginfo(
+        packer->log,
+        "rompacker:configuration:twl",
+        "will digest blocks of 0x%X sectors",
+        result
+    );
+
+    return configok;
+}
+
+// clang-format off
+static const keyvalueparser kvparsers[] = {
+    { .key = string("digest-key"),           .parser = cfg_twl_digestkey    },
+    { .key = string("digest-sector-size"),   .parser = cfg_twl_sectorsize   },
+    { .key = string("digest-block-sectors"), .parser = cfg_twl_blocksectors },
+    { .key = stringZ,                        .parser = NULL                 },
+};
+// clang-format on
+
+cfgresult cfg_twl(string sec, string key, string val, void *user, long line) // NOLINT
+{
+    (void)sec;
+    rompacker *packer = user;
+
+    const keyvalueparser *match = &kvparsers[0];
+    for (; match->parser != NULL && !strequ(key, match->key); match++);
+
+    if (match->parser) return match->parser(packer, val, line);
+
+    configerr("unrecognized twl-section key “%.*s”", fmtstring(key));
+}
@@ -3,6 +3,7 @@
 #ifndef CFGPARSE_H
 #define CFGPARSE_H
 
+#include <stdint.h>
 #include <stdio.h> // NOLINT
 
 #include "packer.h"
@@ -29,6 +30,9 @@
         .code = E_config_none \
     }
 
+// Returns -1 if `val` is not a base-16 literal, with or without a “0x” prefix, of at most 8 digits.
+int parsebase16(string val, uint32_t *result);
+
 typedef cfgresult (*valueparser)(rompacker *packer, string val, long line);
 
 typedef struct keyvalueparser {
@@ -2,12 +2,20 @@
 
 #include "packer.h"
 
+#include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h> // NOLINT: misc-include-cleaner
+#include <string.h>
 
+#include "cfgparse.h"
 #include "constants.h"
+#include "fsparse.h"
+#include "narc.h"
 
 #include "libs/fileio.h"
+#include "libs/log.h"
+#include "libs/meter.h"
 #include "libs/sheets.h"
 #include "libs/strings.h"
 #include "libs/vector.h"
@@ -25,37 +33,277 @@
         return __res;                                                   \
     }
 
-#define SOURCE 0
-#define TARGET 1
+#define SOURCE    0
+#define TARGET    1
+#define TRANSFORM 2
+#define ALIGN     3
 
+// clang-format off
+static const string transforms[] = {
+    [K_transform_none] = string(""),
+    [K_transform_lz10] = string("lz10"),
+    [K_transform_lz11] = string("lz11"),
+    [K_transform_auto] = string("auto"),
+};
+// clang-format on
+
+romfile *fspush(
+    rompacker       *packer,
+    enum romfilekind kind,
+    string           source,
+    string           target,
+    uint32_t         size
+)
+{
+    romfile *file = push(&packer->filesys, romfile);
+    *file         = (romfile){
+        .source    = source,
+        .target    = target,
+        .size      = size,
+        .pad       = -size & (ROM_ALIGN - 1),
+        .packingid = packer->filesys.len - 1,
+        .kind      = kind,
+    };
+
+    // The size of a NARC is unknown until it is resolved by rompacker_seal, which logs it then.
+    if (kind != K_romfile_narc) {
+        logdebug(
+            packer->log,
+            "rompacker:filesystem",
+            "0x%08X,0x%08X,%.*s,%.*s",
+            file->size,
+            file->pad,
+            fmtstring(file->source),
+            fmtstring(file->target)
+        );
+    }
+
+    return file;
+}
+
+static sheetsresult addfile(
+    rompacker *packer,
+    string     source,
+    string     target,
+    string     transform,
+    uint16_t   align,
+    int        line
+)
+{
+    if (!packer->packing) sheetserr("%s", "packer is already sealed");
+
+    uint16_t mode = K_transform_none;
+    for (; mode <= K_transform_auto && !strequ(transform, transforms[mode]); mode++);
+    if (mode > K_transform_auto) {
+        sheetserr("unrecognized transform “%.*s”", fmtstring(transform));
+    }
+
+    // Directories and member lists are packed as NARCs.
+    meter start = packer->timings ? meterread(M_clock) : (meter){ 0 };
+    stamp st    = narc_islist(source) ? (stamp){ .size = 0, .dir = 1 } : fstamps(source);
+    if (packer->timings) meteradd(&packer->timings[P_statscan], start, meterread(M_clock));
+    if (st.size < 0) sheetserr("could not open source file “%.*s”", fmtstring(source));
+    if (st.size > UINT32_MAX) sheetserr("source file “%.*s” is too large", fmtstring(source));
+
+    if (st.dir && mode != K_transform_none) {
+        sheetserr("cannot transform NARC source “%.*s”", fmtstring(source));
+    }
+
+    romfile *file = NULL;
+    if (st.dir) {
+        file           = fspush(packer, K_romfile_narc, source, target, 0);
+        file->gen.func = narc_read;
+        file->gen.user = narc_new(source);
+    } else {
+        file            = fspush(packer, K_romfile_path, source, target, st.size);
+        file->transform = mode;
+    }
+
+    file->align = align;
+
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+// An optional fourth field overrides the alignment of filesystem members for this one.
 sheetsresult csv_addfile(sheetsrecord *record, void *user, int line)
 {
-    if (record->nfields != 2) {
-        sheetserr("expected 2 fields for record, but found %lu", record->nfields);
+    if (record->nfields < 2 || record->nfields > 4) {
+        sheetserr("expected 2 to 4 fields for record, but found %lu", record->nfields);
     }
 
-    rompacker *packer = user;
-    romfile   *file   = push(&packer->filesys, romfile);
-    file->source      = record->fields[SOURCE];
-    file->target      = record->fields[TARGET];
+    uint32_t align     = 0;
+    string   alignment = record->nfields == 4 ? record->fields[ALIGN] : stringZ;
+    if (alignment.len > 0
+        && (parsebase16(alignment, &align) != 0 || !rompacker_alignok(K_romclass_file, align))) {
+        sheetserr(
+            "expected a power of two from 0x%X to 0x%X for alignment, but found “%.*s”",
+            ROM_MINALIGN,
+            ROM_MAXALIGN,
+            fmtstring(alignment)
+        );
+    }
 
-    long fsize      = fsizes(file->source);
-    file->size      = fsize;
-    file->pad       = -file->size & (ROM_ALIGN - 1);
-    file->packingid = packer->filesys.len - 1;
+    string transform = record->nfields >= 3 ? record->fields[TRANSFORM] : stringZ;
+    string source    = record->fields[SOURCE];
+    return addfile(user, source, record->fields[TARGET], transform, (uint16_t)align, line);
+}
 
-    if (fsize < 0) sheetserr("could not open source file “%.*s”", fmtstring(file->source));
+// Programmatic records are numbered in the order that they are added to the packer.
+sheetsresult rompacker_addfile(rompacker *packer, string source, string target)
+{
+    return rompacker_addtransformed(packer, source, target, stringZ);
+}
 
-    if (packer->verbose) {
-        fprintf(
-            stderr,
-            "rompacker:filesystem: 0x%08X,0x%08X,%.*s,%.*s\n",
-            file->size,
-            file->pad,
-            fmtstring(file->source),
-            fmtstring(file->target)
+sheetsresult rompacker_addtransformed(
+    rompacker *packer,
+    string     source,
+    string     target,
+    string     transform
+)
+{
+    int    line  = packer->filesys.len + 1;
+    string owned = rompacker_own(packer, source);
+    return addfile(packer, owned, rompacker_own(packer, target), transform, 0, line);
+}
+
+sheetsresult rompacker_addrange(
+    rompacker *packer,
+    string     source,
+    uint64_t   offset,
+    uint32_t   size,
+    string     target
+)
+{
+    int line = packer->filesys.len + 1;
+    if (!packer->packing) sheetserr("%s", "packer is already sealed");
+
+    long fsize = fsizes(source);
+    if (fsize < 0) sheetserr("could not open source file “%.*s”", fmtstring(source));
+    if (offset + size > (uint64_t)fsize) {
+        sheetserr(
+            "range 0x%08" PRIX64 "+0x%08" PRIX32 " exceeds size of source file “%.*s”",
+            offset,
+            size,
+            fmtstring(source)
         );
     }
 
+    string   owned = rompacker_own(packer, source);
+    string   dest  = rompacker_own(packer, target);
+    romfile *file  = fspush(packer, K_romfile_range, owned, dest, size);
+    file->rangeofs = offset;
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+sheetsresult rompacker_addbuffer(rompacker *packer, const void *buf, uint32_t size, string target)
+{
+    int line = packer->filesys.len + 1;
+    if (!packer->packing) sheetserr("%s", "packer is already sealed");
+
+    string   copy = rompacker_own(packer, string((unsigned char *)buf, size));
+    string   name = string("%MEMORY%");
+    romfile *file = fspush(packer, K_romfile_buffer, name, rompacker_own(packer, target), size);
+    file->buf     = copy.s;
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+sheetsresult rompacker_addgenerator(
+    rompacker   *packer,
+    romgenerator func,
+    void        *user,
+    uint32_t     size,
+    string       target
+)
+{
+    int line = packer->filesys.len + 1;
+    if (!packer->packing) sheetserr("%s", "packer is already sealed");
+    if (!func) sheetserr("%s", "expected a generator function, but found NULL");
+
+    string   name  = string("%GENERATOR%");
+    romfile *file  = fspush(packer, K_romfile_generator, name, rompacker_own(packer, target), size);
+    file->gen.func = func;
+    file->gen.user = user;
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+static int comparetargets(const void *a, const void *b) // NOLINT
+{
+    const romfile *fa = a;
+    const romfile *fb = b;
+    if (fa->target.len != fb->target.len) return fa->target.len < fb->target.len ? -1 : 1;
+    return memcmp(fa->target.s, fb->target.s, fa->target.len);
+}
+
+static romfile inheritfile(rompacker *packer, const romfile *file)
+{
+    romfile copy = *file;
+    copy.target  = rompacker_own(packer, file->target);
+    switch (file->kind) {
+    case K_romfile_buffer:
+        copy.buf = rompacker_own(packer, string((unsigned char *)file->buf, file->size)).s;
+        break;
+
+    case K_romfile_generator:
+        break; // shared with the donor, as is its placeholder name
+
+    case K_romfile_narc:
+        copy.source   = rompacker_own(packer, file->source);
+        copy.gen.user = narc_new(copy.source);
+        break;
+
+    default:
+        copy.source = rompacker_own(packer, file->source);
+        break;
+    }
+
+    return copy;
+}
+
+sheetsresult rompacker_inherit(rompacker *packer, const rompacker *donor)
+{
+    int line = 0;
+    if (!packer->packing || !donor->packing) sheetserr("%s", "packer is already sealed");
+
+    // Look up the packer's own members by target; their packing IDs are still their positions.
+    int      nown  = packer->filesys.len;
+    romfile *own   = packer->filesys.data;
+    romfile *index = malloc(sizeof(romfile) * (nown > 0 ? nown : 1));
+    char    *taken = calloc(nown > 0 ? nown : 1, 1);
+    memcpy(index, own, sizeof(romfile) * nown);
+    qsort(index, nown, sizeof(romfile), comparetargets);
+
+    vector merged   = newvec(romfile, donor->filesys.len + nown);
+    int    replaced = 0;
+    for (int i = 0; i < donor->filesys.len; i++) {
+        const romfile *file  = get(&donor->filesys, romfile, i);
+        romfile       *match = bsearch(file, index, nown, sizeof(romfile), comparetargets);
+        if (match && !taken[match->packingid]) {
+            *push(&merged, romfile) = *match;
+            taken[match->packingid] = 1;
+            replaced++;
+        } else {
+            *push(&merged, romfile) = inheritfile(packer, file);
+        }
+    }
+
+    for (int i = 0; i < nown; i++) {
+        if (!taken[i]) *push(&merged, romfile) = own[i];
+    }
+
+    for (int i = 0; i < merged.len; i++) get(&merged, romfile, i)->packingid = i;
+
+    loginfo(
+        packer->log,
+        "rompacker:filesystem",
+        "inherited %d members, of which %d were replaced and %d added",
+        donor->filesys.len,
+        replaced,
+        nown - replaced
+    );
+
+    free(index);
+    free(taken);
+    free(packer->filesys.data);
+    packer->filesys = merged;
     return (sheetsresult){ .code = E_sheets_none };
 }
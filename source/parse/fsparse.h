@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MIT
+
+#ifndef FSPARSE_H
+#define FSPARSE_H
+
+#include <stdint.h>
+
+#include "packer.h"
+
+#include "libs/strings.h"
+
+// Append a filesystem member to the packer; callers then fill in the fields specific to its kind.
+// `source` and `target` must remain valid until the packer is deleted.
+romfile *fspush(
+    rompacker       *packer,
+    enum romfilekind kind,
+    string           source,
+    string           target,
+    uint32_t         size
+);
+
+#endif // FSPARSE_H
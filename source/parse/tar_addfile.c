@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: MIT
+
+#include "packer.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h> // NOLINT: misc-include-cleaner
+#include <string.h>
+
+#include "fsparse.h"
+
+#include "libs/strings.h"
+#include "libs/tar.h"
+
+#define tarerr(__msg, ...)                                        \
+    {                                                             \
+        tarresult __res = { .code = E_tar_user, .pos = stringZ }; \
+        snprintf(                                                 \
+            (__res).msg,                                          \
+            sizeof(__res).msg,                                    \
+            "rompacker:filesystem:%d: " __msg,                    \
+            index + 1,                                            \
+            __VA_ARGS__                                           \
+        );                                                        \
+        return __res;                                             \
+    }
+
+typedef struct tarcontext {
+    rompacker *packer;
+    string     archive;
+    string     filename; // owned by the packer; empty if members refer directly into `archive`
+} tarcontext;
+
+// Entry names are relative to the archive's root, but may carry a leading "./" or "/".
+static string trimname(string name)
+{
+    while (name.len > 0) {
+        if (name.s[0] == '/') {
+            name = string(name.s + 1, name.len - 1);
+        } else if (name.len > 1 && name.s[0] == '.' && name.s[1] == '/') {
+            name = string(name.s + 2, name.len - 2);
+        } else {
+            break;
+        }
+    }
+
+    return name;
+}
+
+static tarresult addentry(tarentry *entry, void *user, int index)
+{
+    tarcontext *ctx  = user;
+    string      name = trimname(entry->name);
+    if (name.len == 0) tarerr("archive entry “%.*s” has no filename", fmtstring(entry->name));
+    if (entry->size > UINT32_MAX) {
+        tarerr("archive entry “%.*s” is too large", fmtstring(entry->name));
+    }
+
+    string target = rompacker_own(ctx->packer, string(NULL, name.len + 1));
+    target.s[0]   = '/';
+    memcpy(target.s + 1, name.s, name.len);
+
+    if (ctx->filename.len > 0) {
+        string   source = ctx->filename;
+        romfile *file   = fspush(ctx->packer, K_romfile_range, source, target, entry->size);
+        file->rangeofs  = entry->offset;
+    } else {
+        string   source = string("%ARCHIVE%");
+        romfile *file   = fspush(ctx->packer, K_romfile_buffer, source, target, entry->size);
+        file->buf       = ctx->archive.s + entry->offset;
+    }
+
+    return (tarresult){ .code = E_tar_none };
+}
+
+tarresult rompacker_addtar(rompacker *packer, string archive, string filename)
+{
+    if (!packer->packing) {
+        return (tarresult){ .code = E_tar_user, .msg = "rompacker:filesystem: packer is sealed" };
+    }
+
+    tarcontext ctx = {
+        .packer   = packer,
+        .archive  = archive,
+        .filename = filename.len > 0 ? rompacker_own(packer, filename) : stringZ,
+    };
+
+    return tarparse(archive, addentry, &ctx);
+}
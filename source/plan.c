@@ -0,0 +1,437 @@
+// SPDX-License-Identifier: MIT
+
+/*
+ * Packing plans are a compact binary snapshot of a sealed packer: the computed header, banner,
+ * FNTB, and FATB; the source path, size, offset, and padding of every other member; and a
+ * fingerprint (size and mtime) of every file which contributed to the packer. Restoring a plan
+ * lets a caller skip straight to `rompacker_dump` without re-parsing or re-sealing anything.
+ *
+ * All integers are stored little-endian. Strings are stored as a 32-bit length followed by their
+ * bytes, without a null-terminator.
+ *
+ *   magic      "NRPLAN\0\0"
+ *   version    u32
+ *   key        string
+ *   fillwith   u32 (bits 0-7: fill-value; bit 8: fill-tail)
+ *   tailsize   u32
+ *   header     bufmemb
+ *   arm9       pathmemb
+ *   ovt9       pathmemb
+ *   ovy9       u32 count, pathmemb[count]
+ *   arm7       pathmemb
+ *   ovt7       pathmemb
+ *   ovy7       u32 count, pathmemb[count]
+ *   fntb       bufmemb
+ *   fatb       bufmemb
+ *   banner     bufmemb
+ *   twl        string key, u32 sectorsize, u32 blocksectors, tablememb sectors, tablememb blocks
+ *   deps       u32 count, { string path, stamp }[count]
+ *   filesys    u32 count, filememb[count]
+ *   digest     u8[20], the SHA-1 of everything before it
+ *
+ *   bufmemb   := u32 size, u32 offset, u32 pad, u8[size]
+ *   tablememb := u32 size, u32 offset, u32 pad
+ *   pathmemb  := string path, u32 size, u32 offset, u32 pad, stamp
+ *   filememb  := string source, string target, u32 size, u32 offset, u32 pad,
+ *                u32 (bits 0-15: filesysid; bits 16-31: packingid), u32 kind,
+ *                u32 rangeofs-lo, u32 rangeofs-hi, stamp
+ *
+ * Buffer and generator members have no backing file, so a packer which contains any cannot be
+ * persisted. NARC members are rebuilt from their directory or member list when a plan is restored;
+ * their own members are recorded among the plan's dependencies. Digest tables are refilled by every
+ * dump, so only their layout is recorded.
+ *   stamp     := u32 size-lo, u32 size-hi, u32 mtime-lo, u32 mtime-hi, u32 mtime-ns
+ */
+
+#include "packer.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "constants.h"
+#include "narc.h"
+
+#include "libs/fileio.h"
+#include "libs/jobs.h"
+#include "libs/litend.h"
+#include "libs/sha1.h"
+#include "libs/strings.h"
+#include "libs/vector.h"
+
+#define PLAN_MAGIC   "NRPLAN\0\0"
+#define PLAN_VERSION 5
+
+typedef struct planreader {
+    unsigned char *start;
+    unsigned char *curs;
+    unsigned char *end;
+    int            err;
+} planreader;
+
+// Plans are built in memory, so that they can be digested and then stored in one piece.
+typedef struct planwriter {
+    unsigned char *buf;
+    long           len;
+    long           cap;
+} planwriter;
+
+static void putbytes(planwriter *w, const void *bytes, long n)
+{
+    if (w->len + n > w->cap) {
+        while (w->len + n > w->cap) w->cap *= 2;
+        w->buf = realloc(w->buf, w->cap);
+    }
+
+    if (n > 0) memcpy(w->buf + w->len, bytes, n);
+    w->len += n;
+}
+
+static void putword(planwriter *w, uint32_t word)
+{
+    unsigned char buf[4];
+    putleword(buf, word);
+    putbytes(w, buf, sizeof(buf));
+}
+
+static void putstring(planwriter *w, string s)
+{
+    putword(w, s.len);
+    putbytes(w, s.s, s.len);
+}
+
+static void putstamp(planwriter *w, stamp st)
+{
+    putword(w, (uint64_t)st.size & 0xFFFFFFFF);
+    putword(w, (uint64_t)st.size >> 32);
+    putword(w, (uint64_t)st.mtime & 0xFFFFFFFF);
+    putword(w, (uint64_t)st.mtime >> 32);
+    putword(w, st.mtimens);
+}
+
+static void putbufmemb(planwriter *w, rommember *memb)
+{
+    putword(w, memb->size);
+    putword(w, memb->offset);
+    putword(w, memb->pad);
+    putbytes(w, memb->source.buf, memb->size);
+}
+
+static void puttablememb(planwriter *w, rommember *memb)
+{
+    putword(w, memb->size);
+    putword(w, memb->offset);
+    putword(w, memb->pad);
+}
+
+static void putpathmemb(planwriter *w, rommember *memb)
+{
+    putstring(w, memb->source.filename);
+    putword(w, memb->size);
+    putword(w, memb->offset);
+    putword(w, memb->pad);
+    putstamp(w, memb->source.filename.len > 0 ? fstamps(memb->source.filename) : (stamp){ 0 });
+}
+
+enum planerr rompacker_saveplan(rompacker *packer, const char *filename, string key)
+{
+    if (packer->packing) return E_plan_packing;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        uint16_t kind = get(&packer->filesys, romfile, i)->kind;
+        if (kind == K_romfile_buffer || kind == K_romfile_generator) return E_plan_memory;
+    }
+
+    planwriter  writer = { .buf = malloc(0x10000), .len = 0, .cap = 0x10000 };
+    planwriter *w      = &writer;
+    putbytes(w, PLAN_MAGIC, lengthof(PLAN_MAGIC));
+    putword(w, PLAN_VERSION);
+    putstring(w, key);
+    putword(w, packer->fillwith | (packer->filltail << 8));
+    putword(w, packer->tailsize);
+
+    putbufmemb(w, &packer->header);
+    putpathmemb(w, &packer->arm9);
+    putpathmemb(w, &packer->ovt9);
+    putword(w, packer->ovy9.len);
+    for (int i = 0; i < packer->ovy9.len; i++) putpathmemb(w, get(&packer->ovy9, rommember, i));
+    putpathmemb(w, &packer->arm7);
+    putpathmemb(w, &packer->ovt7);
+    putword(w, packer->ovy7.len);
+    for (int i = 0; i < packer->ovy7.len; i++) putpathmemb(w, get(&packer->ovy7, rommember, i));
+    putbufmemb(w, &packer->fntb);
+    putbufmemb(w, &packer->fatb);
+    putbufmemb(w, &packer->banner);
+    putstring(w, packer->twl.key);
+    putword(w, packer->twl.sectorsize);
+    putword(w, packer->twl.blocksectors);
+    puttablememb(w, &packer->twl.sectors);
+    puttablememb(w, &packer->twl.blocks);
+
+    putword(w, packer->deps.len);
+    for (int i = 0; i < packer->deps.len; i++) {
+        string *dep = get(&packer->deps, string, i);
+        putstring(w, *dep);
+        putstamp(w, fstamps(*dep));
+    }
+
+    putword(w, packer->filesys.len);
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        putstring(w, file->source);
+        putstring(w, file->target);
+        putword(w, file->size);
+        putword(w, file->offset);
+        putword(w, file->pad);
+        putword(w, file->filesysid | ((uint32_t)file->packingid << 16));
+        putword(w, file->kind);
+        putword(w, file->kind == K_romfile_range ? file->rangeofs & 0xFFFFFFFF : 0);
+        putword(w, file->kind == K_romfile_range ? file->rangeofs >> 32 : 0);
+        putstamp(w, fstamps(file->source));
+    }
+
+    // The digest catches a plan which was damaged on disk, and so no longer describes its ROM. It
+    // is stored via a uniquely-named sibling file, so that an interrupted or concurrent save never
+    // leaves a partial or interleaved plan behind.
+    unsigned char digest[SHA1_DIGEST_BSIZE];
+    sha1digest(w->buf, w->len, digest);
+    putbytes(w, digest, sizeof(digest));
+
+    int failed = fstore(filename, w->buf, w->len);
+    free(w->buf);
+    return failed ? E_plan_missing : E_plan_ok;
+}
+
+static unsigned char *takebytes(planreader *r, long n)
+{
+    if (r->err || n < 0 || r->end - r->curs < n) {
+        r->err = 1;
+        return NULL;
+    }
+
+    unsigned char *bytes  = r->curs;
+    r->curs              += n;
+    return bytes;
+}
+
+static uint32_t takeword(planreader *r)
+{
+    unsigned char *bytes = takebytes(r, 4);
+    return bytes ? leword(bytes) : 0;
+}
+
+static string takestring(planreader *r)
+{
+    long           len = takeword(r);
+    unsigned char *s   = takebytes(r, len);
+    return s ? string(s, len) : stringZ;
+}
+
+static stamp takestamp(planreader *r)
+{
+    stamp st    = { 0 };
+    uint64_t lo = takeword(r);
+    uint64_t hi = takeword(r);
+    st.size     = (long long)(lo | (hi << 32));
+
+    lo         = takeword(r);
+    hi         = takeword(r);
+    st.mtime   = (long long)(lo | (hi << 32));
+    st.mtimens = takeword(r);
+    return st;
+}
+
+static int stampmatches(string filename, stamp expect)
+{
+    stamp actual = fstamps(filename);
+    return actual.size == expect.size && actual.mtime == expect.mtime
+        && actual.mtimens == expect.mtimens;
+}
+
+static void takebufmemb(planreader *r, rommember *memb)
+{
+    memb->size             = takeword(r);
+    memb->offset           = takeword(r);
+    memb->pad              = takeword(r);
+    unsigned char *content = takebytes(r, memb->size);
+
+    free(memb->source.buf);
+    memb->source.buf = NULL;
+    if (content && memb->size > 0) {
+        memb->source.buf = malloc(memb->size);
+        memcpy(memb->source.buf, content, memb->size);
+    }
+}
+
+static void taketablememb(planreader *r, rommember *memb, string name)
+{
+    memb->source.filename = name;
+    memb->size            = takeword(r);
+    memb->offset          = takeword(r);
+    memb->pad             = takeword(r);
+    memb->source.buf      = r->err ? NULL : calloc(memb->size, 1);
+}
+
+static int takepathmemb(planreader *r, rommember *memb)
+{
+    memb->source.filename = takestring(r);
+    memb->size            = takeword(r);
+    memb->offset          = takeword(r);
+    memb->pad             = takeword(r);
+    stamp expect          = takestamp(r);
+
+    if (r->err || memb->source.filename.len == 0) return r->err;
+    if (!stampmatches(memb->source.filename, expect)) return -1;
+
+    return fsizes(memb->source.filename) == (long)memb->size ? 0 : -1;
+}
+
+static int takeovys(planreader *r, vector *ovyvec)
+{
+    uint32_t count = takeword(r);
+    for (uint32_t i = 0; i < count && !r->err; i++) {
+        rommember *ovy = push(ovyvec, rommember);
+        *ovy           = (rommember){ 0 };
+        if (takepathmemb(r, ovy) != 0) return -1;
+    }
+
+    return r->err;
+}
+
+static void resolvenarc(void *user, long job)
+{
+    romfile **files = user;
+    narc_resolve(files[job]->gen.user);
+}
+
+static enum planerr restorenarcs(rompacker *packer)
+{
+    romfile **files = malloc(sizeof(romfile *) * (packer->filesys.len + 1));
+    long      njobs = 0;
+    for (int i = 0; i < packer->filesys.len; i++) {
+        romfile *file = get(&packer->filesys, romfile, i);
+        if (file->kind == K_romfile_narc) files[njobs++] = file;
+    }
+
+    jobsrun(0, njobs, resolvenarc, files);
+
+    enum planerr err = E_plan_ok;
+    for (long i = 0; i < njobs && err == E_plan_ok; i++) {
+        narc *narc = files[i]->gen.user;
+        if (narc->err[0] != '\0' || narc->size != files[i]->size) err = E_plan_stale;
+    }
+
+    free(files);
+    return err;
+}
+
+// A plan whose contents no longer match its digest is treated as stale, so that it is rebuilt.
+static int digestmatches(planreader *r)
+{
+    if (r->end - r->curs < SHA1_DIGEST_BSIZE) return 0;
+
+    unsigned char digest[SHA1_DIGEST_BSIZE];
+    r->end -= SHA1_DIGEST_BSIZE;
+    sha1digest(r->start, r->end - r->start, digest);
+    return memcmp(digest, r->end, SHA1_DIGEST_BSIZE) == 0;
+}
+
+static enum planerr takeplan(planreader *r, rompacker *packer, string key)
+{
+    unsigned char *magic = takebytes(r, lengthof(PLAN_MAGIC));
+    if (!magic || memcmp(magic, PLAN_MAGIC, lengthof(PLAN_MAGIC)) != 0) return E_plan_corrupt;
+    if (takeword(r) != PLAN_VERSION) return E_plan_version;
+    if (!digestmatches(r)) return E_plan_stale;
+    if (!strequ(takestring(r), key)) return r->err ? E_plan_corrupt : E_plan_stale;
+
+    uint32_t fill    = takeword(r);
+    packer->fillwith = fill & 0xFF;
+    packer->filltail = (fill >> 8) & 1;
+    packer->tailsize = takeword(r);
+
+    takebufmemb(r, &packer->header);
+    if (takepathmemb(r, &packer->arm9) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    if (takepathmemb(r, &packer->ovt9) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    if (takeovys(r, &packer->ovy9) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    if (takepathmemb(r, &packer->arm7) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    if (takepathmemb(r, &packer->ovt7) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    if (takeovys(r, &packer->ovy7) != 0) return r->err ? E_plan_corrupt : E_plan_stale;
+    takebufmemb(r, &packer->fntb);
+    takebufmemb(r, &packer->fatb);
+    takebufmemb(r, &packer->banner);
+    packer->twl.key          = takestring(r);
+    packer->twl.sectorsize   = takeword(r);
+    packer->twl.blocksectors = takeword(r);
+    taketablememb(r, &packer->twl.sectors, string("%SECTORDIGESTS%"));
+    taketablememb(r, &packer->twl.blocks, string("%BLOCKDIGESTS%"));
+    if (r->err) return E_plan_corrupt;
+
+    packer->fntb.source.filename   = string("%FILENAMES%");
+    packer->fatb.source.filename   = string("%FILEALLOCS%");
+    packer->banner.source.filename = string("%BANNER%");
+
+    uint32_t ndeps = takeword(r);
+    for (uint32_t i = 0; i < ndeps && !r->err; i++) {
+        string path   = takestring(r);
+        stamp  expect = takestamp(r);
+        if (!r->err && !stampmatches(path, expect)) return E_plan_stale;
+    }
+
+    uint32_t nfiles = takeword(r);
+    for (uint32_t i = 0; i < nfiles && !r->err; i++) {
+        romfile *file   = push(&packer->filesys, romfile);
+        file->source    = takestring(r);
+        file->target    = takestring(r);
+        file->size      = takeword(r);
+        file->offset    = takeword(r);
+        file->pad       = takeword(r);
+        uint32_t ids    = takeword(r);
+        file->filesysid = ids & 0xFFFF;
+        file->packingid = ids >> 16;
+        file->kind      = takeword(r);
+        file->transform = K_transform_none; // transformed members were redirected to the cache
+
+        uint64_t lo    = takeword(r);
+        uint64_t hi    = takeword(r);
+        file->rangeofs = lo | (hi << 32);
+        if (file->kind == K_romfile_narc) {
+            file->gen.func = narc_read;
+            file->gen.user = narc_new(file->source);
+        } else if (file->kind != K_romfile_path && file->kind != K_romfile_range) {
+            return E_plan_corrupt;
+        }
+
+        stamp expect = takestamp(r);
+        if (!r->err && !stampmatches(file->source, expect)) return E_plan_stale;
+    }
+
+    if (r->err) return E_plan_corrupt;
+    return restorenarcs(packer);
+}
+
+enum planerr rompacker_loadplan(rompacker **packer, const char *filename, string key)
+{
+    fview view = fmap(filename);
+    if (view.data.len < 0) return E_plan_missing;
+
+    // Member paths point directly into the plan's contents, so the view must outlive the packer.
+    rompacker *loaded = rompacker_new(0, NULL);
+    loaded->plan      = view;
+    loaded->packing   = 0;
+
+    planreader reader = {
+        .start = view.data.s,
+        .curs  = view.data.s,
+        .end   = view.data.s + view.data.len,
+        .err   = 0,
+    };
+    enum planerr err = takeplan(&reader, loaded, key);
+    if (err != E_plan_ok) {
+        rompacker_del(loaded);
+        return err;
+    }
+
+    *packer = loaded;
+    return E_plan_ok;
+}
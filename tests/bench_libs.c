@@ -0,0 +1,392 @@
+/*
+ * bench-libs - Measure the throughput of the hot loops in libs/ and in sealing.
+ *
+ * Each benchmark runs over inputs generated up front, doubling its iteration count until a run
+ * takes at least the minimum time, and then keeps the fastest of a few runs at that count. Results
+ * are written to standard output as CSV, and may be saved as a baseline for later runs; a later run
+ * which is slower than its baseline by more than the threshold is reported as a regression, and the
+ * program then exits with a failure.
+ *
+ * Usage: bench_libs [--min-ms N] [--filter NAME] [--baseline FILE] [--threshold PERCENT]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packer.h"
+
+#include "libs/clip.h"
+#include "libs/config.h"
+#include "libs/crc16.h"
+#include "libs/fileio.h"
+#include "libs/sheets.h"
+#include "libs/strings.h"
+
+#define PROGRAM_NAME "bench-libs"
+#define NUM_PATHS    61440
+#define NUM_KEYS     16384
+#define CRC_BSIZE    0x100000
+#define REPEATS      3
+
+#define die(__msg, ...)                                             \
+    {                                                               \
+        fprintf(stderr, PROGRAM_NAME ": " __msg "\n", __VA_ARGS__); \
+        exit(EXIT_FAILURE);                                         \
+    }
+
+typedef struct inputs {
+    string  csv;      // NUM_PATHS records of source and target paths
+    string  enclosed; // as `csv`, but with every field enclosed
+    string  ini;      // NUM_KEYS key-value pairs within a single section
+    string *paths;    // NUM_PATHS target paths, in generation order
+    string  crcdata;  // CRC_BSIZE bytes of pseudo-random data
+} inputs;
+
+typedef struct bench {
+    const char *name;
+    double (*run)(const inputs *in, long iters); // returns the elapsed seconds
+    long bytes;                                  // bytes processed per iteration, or 0
+    long rows;                                   // rows processed per iteration, or 0
+} bench;
+
+typedef struct result {
+    char   name[32];
+    long   iters;
+    double secs; // per iteration
+} result;
+
+static volatile long sink; // keeps the optimizer from discarding benchmarked work
+
+static uint32_t rngstate = 0x2545F491;
+
+static uint32_t rng(void)
+{
+    rngstate ^= rngstate << 13;
+    rngstate ^= rngstate >> 17;
+    rngstate ^= rngstate << 5;
+    return rngstate;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec / 1e9);
+}
+
+// Paths resemble those of a real filesystem: up to 6 levels of directories, each one of a handful
+// of names per level, with mixed-case names so that case-insensitive comparisons do some work.
+static void genpaths(inputs *in)
+{
+    static const char *dirs[] = { "data", "Graphics", "sound", "battle", "field", "msg", "Poke" };
+
+    in->paths = malloc(sizeof(string) * NUM_PATHS);
+    char path[256];
+    for (long i = 0; i < NUM_PATHS; i++) {
+        long levels = rng() % 7;
+        long len    = 0;
+        for (long j = 0; j < levels; j++) {
+            len += snprintf(path + len, sizeof(path) - len, "/%s%u", dirs[rng() % 7], rng() % 4);
+        }
+        len += snprintf(path + len, sizeof(path) - len, "/File_%05ld.bin", i);
+
+        in->paths[i] = string(malloc(len), len);
+        memcpy(in->paths[i].s, path, len);
+    }
+}
+
+static string gencsv(const inputs *in, int enclose)
+{
+    const char *fmt = enclose ? "\"fs%.*s\",\"%.*s\"\n" : "fs%.*s,%.*s\n";
+    long        cap = 64;
+    for (long i = 0; i < NUM_PATHS; i++) cap += (2 * in->paths[i].len) + 8;
+
+    char *csv = malloc(cap);
+    long  len = snprintf(csv, cap, "Source File,Target File\n");
+    for (long i = 0; i < NUM_PATHS; i++) {
+        string p  = in->paths[i];
+        len      += snprintf(csv + len, cap - len, fmt, fmtstring(p), fmtstring(p));
+    }
+
+    return string(csv, len);
+}
+
+static string genini(void)
+{
+    long  cap = 16 + (NUM_KEYS * 48);
+    char *ini = malloc(cap);
+    long  len = snprintf(ini, cap, "[bench]\n");
+    for (long i = 0; i < NUM_KEYS; i++) {
+        len += snprintf(ini + len, cap - len, "key%05ld = value-%08X\n", i, rng());
+    }
+
+    return string(ini, len);
+}
+
+static sheetsresult countrow(sheetsrecord *record, void *user, int line)
+{
+    (void)line;
+    *(long *)user += (long)record->nfields;
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+static cfgresult countkey(string sec, string key, string val, void *user, long line)
+{
+    (void)sec;
+    (void)line;
+    *(long *)user += key.len + val.len;
+    return (cfgresult){ .code = E_config_none };
+}
+
+static double bench_csvparse(const inputs *in, long iters)
+{
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) csvparse(in->csv, NULL, countrow, &count);
+    sink = count;
+    return now() - start;
+}
+
+static double bench_dsvparse(const inputs *in, long iters)
+{
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) dsvparse(in->enclosed, NULL, countrow, '\n', ',', '"', &count);
+    sink = count;
+    return now() - start;
+}
+
+static double bench_cfgparse(const inputs *in, long iters)
+{
+    static const cfgsection sections[] = {
+        { .section = string("bench"), .handler = countkey },
+        { .section = stringZ,         .handler = NULL     },
+    };
+
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) cfgparse(in->ini, sections, &count);
+    sink = count;
+    return now() - start;
+}
+
+static double bench_strcut(const inputs *in, long iters)
+{
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) {
+        for (long j = 0; j < NUM_PATHS; j++) {
+            strpair cut = { .tail = in->paths[j] };
+            do {
+                cut    = strcut(cut.tail, '/');
+                count += cut.head.len;
+            } while (cut.tail.len > 0);
+        }
+    }
+
+    sink = count;
+    return now() - start;
+}
+
+static double bench_stricmp(const inputs *in, long iters)
+{
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) {
+        for (long j = 1; j < NUM_PATHS; j++) count += stricmp(in->paths[j - 1], in->paths[j]) < 0;
+    }
+
+    sink = count;
+    return now() - start;
+}
+
+static double bench_strequ(const inputs *in, long iters)
+{
+    long   count = 0;
+    double start = now();
+    for (long i = 0; i < iters; i++) {
+        for (long j = 0; j < NUM_PATHS; j++) count += strequ(in->paths[j], in->paths[j]);
+    }
+
+    sink = count;
+    return now() - start;
+}
+
+static double bench_crc16(const inputs *in, long iters)
+{
+    uint16_t crc   = 0xFFFF;
+    double   start = now();
+    for (long i = 0; i < iters; i++) crc = crc16(in->crcdata, crc);
+    sink = crc;
+    return now() - start;
+}
+
+static int emptygen(void *user, unsigned char *buf, uint32_t offset, uint32_t size)
+{
+    (void)user;
+    (void)offset;
+    memset(buf, 0, size);
+    return 0;
+}
+
+// Sealing a packer of empty members is dominated by sorting their names and building the FNTB; only
+// the seal itself is timed. Sealing requires a banner, but nothing else from the configuration.
+static double bench_sealfntb(const inputs *in, long iters)
+{
+    double elapsed = 0;
+    for (long i = 0; i < iters; i++) {
+        rompacker *packer = rompacker_new(0, NULL);
+        cfg_banner(string("banner"), string("version"), string("1"), packer, 1);
+        for (long j = 0; j < NUM_PATHS; j++) {
+            rompacker_addgenerator(packer, emptygen, NULL, 0, in->paths[j]);
+        }
+
+        double start  = now();
+        int    err    = rompacker_seal(packer);
+        elapsed      += now() - start;
+        sink          = packer->fntb.size;
+        rompacker_del(packer);
+        if (err != E_seal_ok) die("could not seal packer: error %d", err);
+    }
+
+    return elapsed;
+}
+
+static sheetsresult loadresult(sheetsrecord *record, void *user, int line)
+{
+    vector *results = user;
+    if (record->nfields < 3) {
+        sheetsresult err = { .code = E_sheets_user, .pos = stringZ };
+        snprintf(err.msg, sizeof(err.msg), "baseline:%d: expected at least 3 fields", line);
+        return err;
+    }
+
+    result *res = push(results, result);
+    string  nm  = record->fields[0];
+    long    len = nm.len < (long)sizeof(res->name) - 1 ? nm.len : (long)sizeof(res->name) - 1;
+    memcpy(res->name, nm.s, len);
+    res->name[len] = '\0';
+    res->iters     = strtol((const char *)record->fields[1].s, NULL, 10);
+    res->secs      = strtod((const char *)record->fields[2].s, NULL);
+    return (sheetsresult){ .code = E_sheets_none };
+}
+
+int main(int argc, const char **argv)
+{
+    (void)argc;
+
+    const char *filter    = NULL;
+    const char *baseline  = NULL;
+    long        minms     = 200;
+    long        threshold = 10;
+
+    // clang-format off
+    const clipopt options[] = {
+        { .longopt = "min-ms",    .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &minms     },
+        { .longopt = "filter",    .shortopt = '\0', .hasarg = H_reqarg, .starget = &filter    },
+        { .longopt = "baseline",  .shortopt = '\0', .hasarg = H_reqarg, .starget = &baseline  },
+        { .longopt = "threshold", .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &threshold },
+        { 0 },
+    };
+
+    const clippos positionals[] = { { 0 } };
+    // clang-format on
+
+    clip clip = clipinit(argv);
+    if (cliparse(&clip, options, positionals, NULL)) die("%s", clip.err);
+
+    vector base = newvec(result, 16);
+    fview  bfile = { .data = { .len = -1 } };
+    if (baseline) {
+        bfile = fmap(baseline);
+        if (bfile.data.len < 0) die("could not read baseline file “%s”", baseline);
+
+        sheetsresult res = csvparse(bfile.data, NULL, loadresult, &base);
+        if (res.code != E_sheets_none) die("%s", res.msg);
+    }
+
+    inputs in = { 0 };
+    genpaths(&in);
+    in.csv      = gencsv(&in, 0);
+    in.enclosed = gencsv(&in, 1);
+    in.ini      = genini();
+    in.crcdata  = string(malloc(CRC_BSIZE), CRC_BSIZE);
+    for (long i = 0; i < CRC_BSIZE; i++) in.crcdata.s[i] = rng() & 0xFF;
+
+    long pathbytes = 0;
+    for (long i = 0; i < NUM_PATHS; i++) pathbytes += in.paths[i].len;
+
+    // clang-format off
+    const bench benches[] = {
+        { .name = "csvparse",  .run = bench_csvparse, .bytes = in.csv.len,      .rows = NUM_PATHS },
+        { .name = "dsvparse",  .run = bench_dsvparse, .bytes = in.enclosed.len, .rows = NUM_PATHS },
+        { .name = "cfgparse",  .run = bench_cfgparse, .bytes = in.ini.len,      .rows = NUM_KEYS  },
+        { .name = "strcut",    .run = bench_strcut,   .bytes = pathbytes,       .rows = NUM_PATHS },
+        { .name = "stricmp",   .run = bench_stricmp,  .bytes = 2 * pathbytes,   .rows = NUM_PATHS },
+        { .name = "strequ",    .run = bench_strequ,   .bytes = 2 * pathbytes,   .rows = NUM_PATHS },
+        { .name = "crc16",     .run = bench_crc16,    .bytes = CRC_BSIZE,       .rows = 0         },
+        { .name = "seal-fntb", .run = bench_sealfntb, .bytes = pathbytes,       .rows = NUM_PATHS },
+        { 0 },
+    };
+    // clang-format on
+
+    int regressions = 0;
+    printf("Benchmark,Iterations,Seconds,MB/s,Rows/s\n");
+    for (const bench *b = benches; b->name; b++) {
+        if (filter && !strstr(b->name, filter)) continue;
+
+        long   iters = 1;
+        double secs  = b->run(&in, iters);
+        while (secs * 1000 < (double)minms) {
+            iters *= 2;
+            secs   = b->run(&in, iters);
+        }
+
+        // The fastest of a few runs is the least disturbed by the rest of the system.
+        for (int i = 1; i < REPEATS; i++) {
+            double again = b->run(&in, iters);
+            if (again < secs) secs = again;
+        }
+
+        double per = secs / (double)iters;
+        printf(
+            "%s,%ld,%.9f,%.2f,%.0f\n",
+            b->name,
+            iters,
+            per,
+            (double)b->bytes / per / 1e6,
+            (double)b->rows / per
+        );
+
+        for (int i = 0; i < base.len; i++) {
+            result *prev = get(&base, result, i);
+            if (strcmp(prev->name, b->name) != 0 || prev->secs <= 0) continue;
+
+            double change = ((per / prev->secs) - 1) * 100;
+            if (change > (double)threshold) {
+                fprintf(
+                    stderr,
+                    PROGRAM_NAME ": regression in “%s”: %.1f%% slower than baseline\n",
+                    b->name,
+                    change
+                );
+                regressions++;
+            }
+        }
+    }
+
+    for (long i = 0; i < NUM_PATHS; i++) free(in.paths[i].s);
+    free(in.paths);
+    free(in.csv.s);
+    free(in.enclosed.s);
+    free(in.ini.s);
+    free(in.crcdata.s);
+    free(base.data);
+    if (baseline) funmap(bfile);
+    return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+/*
+ * genproject - Generate a synthetic project for benchmarking `nitrorom pack` and `nitrorom list`.
+ *
+ * The project consists of the same inputs as a real one: CONFIG.INI (as "rom.ini"), a header
+ * template, icon data, ARM9 and ARM7 static binaries with their definitions, an ARM9 overlay table
+ * with one overlay per entry, and FILESYS.CSV (as "files.csv") with its filesystem members. Member
+ * contents are pseudo-random, and every output is a pure function of the given options.
+ *
+ * Usage: genproject [--files N] [--overlays N] [--depth N] [--fanout N] [--min-size N]
+ *                   [--max-size N] [--sizes log|uniform] [--seed N] [--stamp FILE] <OUTDIR>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libs/clip.h"
+#include "libs/fileio.h"
+
+#define PROGRAM_NAME "genproject"
+#define MAX_MEMBERS  61440 // overlays and filesystem members share the file-ID space
+#define MAX_DEPTH    16
+
+#define die(__msg, ...)                                             \
+    {                                                               \
+        fprintf(stderr, PROGRAM_NAME ": " __msg "\n", __VA_ARGS__); \
+        exit(EXIT_FAILURE);                                         \
+    }
+
+typedef struct args {
+    const char *outdir;
+    const char *stamp;
+    const char *sizes;
+
+    long files;
+    long overlays;
+    long depth;
+    long fanout;
+    long minsize;
+    long maxsize;
+    long seed;
+} args;
+
+static uint32_t rngstate;
+
+static uint32_t rng(void)
+{
+    rngstate ^= rngstate << 13;
+    rngstate ^= rngstate >> 17;
+    rngstate ^= rngstate << 5;
+    return rngstate;
+}
+
+static void fillrandom(unsigned char *buf, long size)
+{
+    for (long i = 0; i < size; i += 4) {
+        uint32_t word = rng();
+        for (long j = 0; j < 4 && i + j < size; j++) buf[i + j] = (word >> (8 * j)) & 0xFF;
+    }
+}
+
+static void putword(unsigned char *buf, uint32_t word)
+{
+    for (int i = 0; i < 4; i++) buf[i] = (word >> (8 * i)) & 0xFF;
+}
+
+static void writefile(const char *path, const void *buf, long size)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) die("could not open “%s” for writing", path);
+    if ((long)fwrite(buf, 1, size, f) != size || fclose(f) != 0) die("could not write “%s”", path);
+}
+
+// Sizes are either uniform over [min, max], or log-uniform: a power of two is chosen uniformly and
+// then a size within it, which favors small files as game assets do.
+static long pickfilesize(const args *args)
+{
+    long span = args->maxsize - args->minsize + 1;
+    if (strcmp(args->sizes, "uniform") == 0) return args->minsize + (long)(rng() % span);
+
+    int lo = 0;
+    int hi = 0;
+    for (; (2L << lo) <= args->minsize; lo++);
+    for (; (2L << hi) <= args->maxsize; hi++);
+
+    long base = 1L << (lo + (int)(rng() % (hi - lo + 1)));
+    long size = base + (long)(rng() % base);
+    return size < args->minsize ? args->minsize : size > args->maxsize ? args->maxsize : size;
+}
+
+static void genbinaries(const args *args, unsigned char *buf)
+{
+    char path[64];
+
+    fillrandom(buf, 0x200);
+    writefile("template.sbin", buf, 0x200);
+    fillrandom(buf, 0x200);
+    writefile("icon.4bpp", buf, 0x200);
+    fillrandom(buf, 0x20);
+    writefile("icon.pal", buf, 0x20);
+
+    long arm9size = 0x80000;
+    fillrandom(buf, arm9size);
+    writefile("main.sbin", buf, arm9size);
+
+    long arm7size = 0x20000;
+    fillrandom(buf, arm7size);
+    writefile("sub.sbin", buf, arm7size);
+
+    putword(buf + 0x0, 0x02380000);
+    putword(buf + 0x4, 0x02380000);
+    putword(buf + 0x8, arm7size);
+    putword(buf + 0xC, 0x02380100);
+    writefile("sub_defs.sbin", buf, 0x10);
+
+    // The overlay table and the overlay names of the definitions are built side-by-side.
+    unsigned char *ovt  = calloc(args->overlays + 1, 0x20);
+    char          *defs = malloc(0x10 + (args->overlays * sizeof(path)));
+    long           len  = 0x10;
+    putword((unsigned char *)defs + 0x0, 0x02000000);
+    putword((unsigned char *)defs + 0x4, 0x02000800);
+    putword((unsigned char *)defs + 0x8, arm9size);
+    putword((unsigned char *)defs + 0xC, 0x02000900);
+
+    if (args->overlays > 0 && fmkdir("ovy") != 0) die("%s", "could not create directory “ovy”");
+    for (long i = 0; i < args->overlays; i++) {
+        long ovysize = 0x1000 + (long)(rng() % 0xF000);
+        snprintf(path, sizeof(path), "ovy/main_%04ld.sbin", i);
+        fillrandom(buf, ovysize);
+        writefile(path, buf, ovysize);
+
+        unsigned char *entry = ovt + (i * 0x20);
+        putword(entry + 0x00, i);
+        putword(entry + 0x04, 0x02100000);
+        putword(entry + 0x08, ovysize);
+        putword(entry + 0x18, i);
+
+        len += snprintf(defs + len, sizeof(path), "%s", path) + 1;
+    }
+
+    writefile("main_defs.sbin", defs, len);
+    writefile("main_table.sbin", ovt, args->overlays * 0x20);
+    free(ovt);
+    free(defs);
+}
+
+static void genconfig(void)
+{
+    static const char config[] = "[header]\n"
+                                 "template   = template.sbin\n"
+                                 "title      = BENCHMARK\n"
+                                 "serial     = BNCE\n"
+                                 "maker      = 01\n"
+                                 "revision   = 0\n"
+                                 "secure-crc = 0x0000\n"
+                                 "\n"
+                                 "[rom]\n"
+                                 "storage-type = PROM\n"
+                                 "fill-tail    = true\n"
+                                 "fill-with    = 0xFF\n"
+                                 "\n"
+                                 "[banner]\n"
+                                 "version   = 1\n"
+                                 "icon4bpp  = icon.4bpp\n"
+                                 "iconpal   = icon.pal\n"
+                                 "title     = Benchmark\n"
+                                 "subtitle  = Synthetic Project\n"
+                                 "developer = nitrorom\n"
+                                 "\n"
+                                 "[arm9]\n"
+                                 "static-binary = main.sbin\n"
+                                 "definitions   = main_defs.sbin\n"
+                                 "overlay-table = main_table.sbin\n"
+                                 "\n"
+                                 "[arm7]\n"
+                                 "static-binary = sub.sbin\n"
+                                 "definitions   = sub_defs.sbin\n";
+
+    writefile("rom.ini", config, sizeof(config) - 1);
+}
+
+// Each member is placed in a random directory of a tree which is `fanout` directories wide at each
+// of its `depth` levels. Source directories mirror the target directories.
+static void genfiles(const args *args, unsigned char *buf)
+{
+    FILE *csv = fopen("files.csv", "wb");
+    if (!csv) die("%s", "could not open “files.csv” for writing");
+    fprintf(csv, "Source File,Target File\n");
+    if (fmkdir("fs") != 0) die("%s", "could not create directory “fs”");
+
+    char dir[MAX_DEPTH * 8 + 8];
+    char path[sizeof(dir) + 32];
+    for (long i = 0; i < args->files; i++) {
+        long levels = args->depth > 0 ? (long)(rng() % (args->depth + 1)) : 0;
+        long len    = snprintf(dir, sizeof(dir), "fs");
+        for (long j = 0; j < levels; j++) {
+            len += snprintf(dir + len, sizeof(dir) - len, "/d%ld", (long)(rng() % args->fanout));
+            if (fmkdir(dir) != 0) die("could not create directory “%s”", dir);
+        }
+
+        long size = pickfilesize(args);
+        snprintf(path, sizeof(path), "%s/%05ld.bin", dir, i);
+        fillrandom(buf, size);
+        writefile(path, buf, size);
+        fprintf(csv, "%s,%s\n", path, path + lengthof("fs"));
+    }
+
+    if (fclose(csv) != 0) die("%s", "could not write “files.csv”");
+}
+
+int main(int argc, const char **argv)
+{
+    (void)argc;
+
+    args args     = { 0 };
+    args.sizes    = "log";
+    args.files    = 1000;
+    args.overlays = 8;
+    args.depth    = 3;
+    args.fanout   = 4;
+    args.minsize  = 16;
+    args.maxsize  = 0x10000;
+    args.seed     = 1;
+
+    // clang-format off
+    const clipopt options[] = {
+        { .longopt = "files",    .shortopt = 'n',  .hasarg = H_reqarg, .ntarget = &args.files    },
+        { .longopt = "overlays", .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.overlays },
+        { .longopt = "depth",    .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.depth    },
+        { .longopt = "fanout",   .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.fanout   },
+        { .longopt = "min-size", .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.minsize  },
+        { .longopt = "max-size", .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.maxsize  },
+        { .longopt = "sizes",    .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.sizes    },
+        { .longopt = "seed",     .shortopt = '\0', .hasarg = H_reqarg, .ntarget = &args.seed     },
+        { .longopt = "stamp",    .shortopt = '\0', .hasarg = H_reqarg, .starget = &args.stamp    },
+        { 0 },
+    };
+
+    const clippos positionals[] = {
+        { .name = "outdir", .target = &args.outdir },
+        { 0 },
+    };
+    // clang-format on
+
+    clip clip = clipinit(argv);
+    if (cliparse(&clip, options, positionals, NULL)) die("%s", clip.err);
+    if (!args.outdir) die("%s", "missing positional argument: <OUTDIR>");
+    if (args.files < 0 || args.overlays < 0 || args.files + args.overlays > MAX_MEMBERS) {
+        die("files and overlays must number at most %d in total", MAX_MEMBERS);
+    }
+    if (args.depth < 0 || args.depth > MAX_DEPTH) die("depth must be within 0 and %d", MAX_DEPTH);
+    if (args.fanout < 1) die("%s", "fanout must be at least 1");
+    if (args.minsize < 0 || args.maxsize < args.minsize || args.maxsize > 0x1000000) {
+        die("%s", "sizes must satisfy 0 <= min-size <= max-size <= 0x1000000");
+    }
+    if (strcmp(args.sizes, "log") != 0 && strcmp(args.sizes, "uniform") != 0) {
+        die("unknown size distribution “%s”; expected “log” or “uniform”", args.sizes);
+    }
+
+    // The stamp is relative to the invoking directory, like the output directory.
+    FILE *stamp = args.stamp ? fopen(args.stamp, "wb") : NULL;
+    if (args.stamp && !stamp) die("could not open “%s” for writing", args.stamp);
+
+    rngstate = (uint32_t)args.seed * 2654435761u + 0x2545F491;
+    if (fmkdir(args.outdir) != 0) die("could not create directory “%s”", args.outdir);
+    if (chdir(args.outdir) != 0) die("could not change to directory “%s”", args.outdir);
+
+    long           bufsize = args.maxsize > 0x80000 ? args.maxsize : 0x80000;
+    unsigned char *buf     = malloc(bufsize + 4);
+    genconfig();
+    genbinaries(&args, buf);
+    genfiles(&args, buf);
+    free(buf);
+
+    if (stamp) {
+        fprintf(stamp, "%ld files, %ld overlays\n", args.files, args.overlays);
+        fclose(stamp);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+#include "libs/blz.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define die(__msg, ...)                      \
+    {                                        \
+        fprintf(stderr, __msg, __VA_ARGS__); \
+        exit(EXIT_FAILURE);                  \
+    }
+
+typedef struct expect {
+    const char *testkey;
+    long        size;
+    long        rawprefix;
+    void (*fill)(unsigned char *buf, long size);
+    int compresses; // if 1, the input must shrink
+} expect;
+
+static const expect expectations[];
+
+static uint32_t rngstate = 0x2545F491;
+
+static uint32_t rng(void)
+{
+    rngstate ^= rngstate << 13;
+    rngstate ^= rngstate >> 17;
+    rngstate ^= rngstate << 5;
+    return rngstate;
+}
+
+static void fillzeros(unsigned char *buf, long size)
+{
+    memset(buf, 0, size);
+}
+
+static void fillrandom(unsigned char *buf, long size)
+{
+    for (long i = 0; i < size; i++) buf[i] = rng() & 0xFF;
+}
+
+static void filltext(unsigned char *buf, long size)
+{
+    static const char *words[] = { "nitro ", "rom ", "overlay ", "static ", "binary ", "pack " };
+    for (long i = 0; i < size;) {
+        const char *word = words[rng() % 6];
+        for (; *word && i < size; word++, i++) buf[i] = *word;
+    }
+}
+
+// Code-like content: runs of instructions which are repeated with small variations.
+static void fillcode(unsigned char *buf, long size)
+{
+    for (long i = 0; i < size; i += 4) {
+        uint32_t insn = (rng() % 8 == 0) ? rng() : 0xE1A00000 | (rng() & 0x1F);
+        for (long j = 0; j < 4 && i + j < size; j++) buf[i + j] = (insn >> (8 * j)) & 0xFF;
+    }
+}
+
+// Decompress in-place, as the ARM9 does, and verify that no compressed byte is overwritten before
+// it has been read.
+static void inplace(const unsigned char *comp, long complen, const unsigned char *expect, long len)
+{
+    unsigned char *buf = calloc(len, 1);
+    memcpy(buf, comp, complen);
+
+    uint32_t enclen = (comp[complen - 8] | (comp[complen - 7] << 8) | (comp[complen - 6] << 16));
+    long     prefix = complen - enclen;
+    long     curs   = complen - comp[complen - 5];
+    long     out    = len;
+    unsigned flags  = 0;
+    unsigned mask   = 0;
+    while (out > prefix) {
+        if ((mask >>= 1) == 0) {
+            flags = buf[--curs];
+            mask  = 0x80;
+        }
+
+        if (flags & mask) {
+            unsigned hi   = buf[--curs];
+            unsigned lo   = buf[--curs];
+            long     n    = (hi >> 4) + 3;
+            long     dist = (((hi & 0x0F) << 8) | lo) + 3;
+            if (n > out - prefix) n = out - prefix;
+            if (out - n < curs) die("in-place decompression overtook its input at 0x%lX\n", out);
+            for (; n > 0; n--, out--) buf[out - 1] = buf[out - 1 + dist];
+        } else {
+            if (out - 1 < curs) die("in-place decompression overtook its input at 0x%lX\n", out);
+            buf[out - 1] = buf[--curs];
+            out--;
+        }
+    }
+
+    if (memcmp(buf, expect, len) != 0) die("%s", "in-place decompression does not match input\n");
+    free(buf);
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2) die("%s", "missing arguments: <testkey>\n");
+
+    const char *testkey = argv[1];
+    expect     *expects = (expect *)&expectations[0];
+    for (; expects->testkey != NULL && strcmp(expects->testkey, testkey) != 0; expects++);
+    if (expects->testkey == NULL) die("unknown test key: %s\n", testkey);
+
+    long           size = expects->size;
+    unsigned char *raw  = malloc(size + 1);
+    unsigned char *comp = malloc(blzbound(size) + 1);
+    expects->fill(raw, size);
+
+    long complen = blzencode(raw, size, expects->rawprefix, comp);
+    if (complen == 0) {
+        if (expects->compresses) die("expected input of size 0x%lX to compress\n", size);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (complen >= size) die("compressed size 0x%lX is not below 0x%lX\n", complen, size);
+    if (complen % 4 != 0) die("compressed size 0x%lX is not 4-byte aligned\n", complen);
+    if (memcmp(comp, raw, expects->rawprefix) != 0) die("%s", "uncompressed prefix was altered\n");
+    if (blzdecsize(comp, complen) != size) {
+        die("expected decompressed size 0x%lX, but got 0x%lX\n", size, blzdecsize(comp, complen));
+    }
+
+    unsigned char *dec = malloc(size + 1);
+    if (blzdecode(comp, complen, dec) != size) die("%s", "could not decompress output\n");
+    if (memcmp(dec, raw, size) != 0) die("%s", "decompressed output does not match input\n");
+    inplace(comp, complen, raw, size);
+
+    free(raw);
+    free(comp);
+    free(dec);
+    exit(EXIT_SUCCESS);
+}
+
+// clang-format off
+static const expect expectations[] = {
+    { .testkey = "zeros",  .size = 0x10000, .rawprefix = 0,      .fill = fillzeros,  .compresses = 1 },
+    { .testkey = "text",   .size = 0x8123,  .rawprefix = 0,      .fill = filltext,   .compresses = 1 },
+    { .testkey = "code",   .size = 0x40000, .rawprefix = 0,      .fill = fillcode,   .compresses = 1 },
+    { .testkey = "prefix", .size = 0x40000, .rawprefix = 0x4000, .fill = fillcode,   .compresses = 1 },
+    { .testkey = "random", .size = 0x1000,  .rawprefix = 0,      .fill = fillrandom, .compresses = 0 },
+    { .testkey = "tiny",   .size = 3,       .rawprefix = 0,      .fill = fillzeros,  .compresses = 0 },
+    { 0 },
+};
+// clang-format on
@@ -0,0 +1,118 @@
+#include "libs/lz.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define die(__msg, ...)                      \
+    {                                        \
+        fprintf(stderr, __msg, __VA_ARGS__); \
+        exit(EXIT_FAILURE);                  \
+    }
+
+typedef struct expect {
+    const char *testkey;
+    long        size;
+    void (*fill)(unsigned char *buf, long size);
+    int compresses; // if 1, the input must shrink
+} expect;
+
+static const expect expectations[];
+
+static uint32_t rngstate = 0x2545F491;
+
+static uint32_t rng(void)
+{
+    rngstate ^= rngstate << 13;
+    rngstate ^= rngstate >> 17;
+    rngstate ^= rngstate << 5;
+    return rngstate;
+}
+
+static void fillzeros(unsigned char *buf, long size)
+{
+    memset(buf, 0, size);
+}
+
+static void fillrandom(unsigned char *buf, long size)
+{
+    for (long i = 0; i < size; i++) buf[i] = rng() & 0xFF;
+}
+
+static void filltext(unsigned char *buf, long size)
+{
+    static const char *words[] = { "nitro ", "rom ", "overlay ", "static ", "binary ", "pack " };
+    for (long i = 0; i < size;) {
+        const char *word = words[rng() % 6];
+        for (; *word && i < size; word++, i++) buf[i] = *word;
+    }
+}
+
+// Tile-like content: runs of a single byte with lengths that span every LZ11 token size.
+static void fillruns(unsigned char *buf, long size)
+{
+    for (long i = 0; i < size;) {
+        long          run = (rng() % 3 == 0) ? rng() % 0x400 : rng() % 0x20;
+        unsigned char val = rng() & 0xFF;
+        for (; run >= 0 && i < size; run--, i++) buf[i] = val;
+    }
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 3) die("%s", "missing arguments: <testkey> <lz10|lz11>\n");
+
+    const char *testkey = argv[1];
+    expect     *expects = (expect *)&expectations[0];
+    for (; expects->testkey != NULL && strcmp(expects->testkey, testkey) != 0; expects++);
+    if (expects->testkey == NULL) die("unknown test key: %s\n", testkey);
+
+    enum lzformat format;
+    if (strcmp(argv[2], "lz10") == 0) format = LZ_FORMAT_LZ10;
+    else if (strcmp(argv[2], "lz11") == 0) format = LZ_FORMAT_LZ11;
+    else die("unknown format: %s\n", argv[2]);
+
+    long           size = expects->size;
+    unsigned char *raw  = malloc(size + 1);
+    unsigned char *comp = malloc(lzbound(size));
+    expects->fill(raw, size);
+
+    long complen = lzencode(raw, size, format, comp);
+    if (complen < 0) die("could not compress input of size 0x%lX\n", size);
+    if (complen > lzbound(size)) die("compressed size 0x%lX exceeds its bound\n", complen);
+    if (complen % 4 != 0) die("compressed size 0x%lX is not 4-byte aligned\n", complen);
+    if (comp[0] != format) die("expected type 0x%02X, but got 0x%02X\n", format, comp[0]);
+    if (expects->compresses && complen >= size) {
+        die("compressed size 0x%lX is not below 0x%lX\n", complen, size);
+    }
+    if (lzdecsize(comp, complen) != size) {
+        die("expected decompressed size 0x%lX, but got 0x%lX\n", size, lzdecsize(comp, complen));
+    }
+
+    unsigned char *dec = malloc(size + 1);
+    if (lzdecode(comp, complen, dec) != size) die("%s", "could not decompress output\n");
+    if (memcmp(dec, raw, size) != 0) die("%s", "decompressed output does not match input\n");
+
+    // A stream which ends early must be rejected rather than read past its end.
+    if (size > 0x100 && lzdecode(comp, 8, dec) >= 0) {
+        die("%s", "truncated input was not rejected\n");
+    }
+
+    free(raw);
+    free(comp);
+    free(dec);
+    exit(EXIT_SUCCESS);
+}
+
+// clang-format off
+static const expect expectations[] = {
+    { .testkey = "zeros",  .size = 0x20000, .fill = fillzeros,  .compresses = 1 },
+    { .testkey = "text",   .size = 0x8123,  .fill = filltext,   .compresses = 1 },
+    { .testkey = "runs",   .size = 0x40000, .fill = fillruns,   .compresses = 1 },
+    { .testkey = "random", .size = 0x1000,  .fill = fillrandom, .compresses = 0 },
+    { .testkey = "tiny",   .size = 3,       .fill = fillzeros,  .compresses = 0 },
+    { .testkey = "empty",  .size = 0,       .fill = fillzeros,  .compresses = 0 },
+    { 0 },
+};
+// clang-format on
@@ -0,0 +1,246 @@
+#include "libs/romreader.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/litend.h"
+#include "libs/strings.h"
+
+#define die(__msg, ...)                      \
+    {                                        \
+        fprintf(stderr, __msg, __VA_ARGS__); \
+        exit(EXIT_FAILURE);                  \
+    }
+
+#define ROM_BSIZE    0x800
+#define ARM9_OFS     0x200
+#define ARM9_BSIZE   0xF0
+#define OVT9_OFS     0x300
+#define ARM7_OFS     0x340
+#define FNTB_OFS     0x380
+#define FATB_OFS     0x500
+#define FILES_OFS    0x600
+#define NFILES       5
+#define FILE_BSIZE   0x10
+#define ROOT_FIRSTID 2
+
+typedef struct expect {
+    const char *testkey;
+    void (*edit)(unsigned char *rom); // applied to the ROM before it is opened
+    romreaderr err;                   // when the ROM is opened
+    void (*check)(romreader *rom);
+} expect;
+
+static const expect expectations[];
+
+// Two overlays for the ARM9 (IDs 0 and 5, as files 0 and 1), none for the ARM7, and a filesystem of
+// `a.bin`, `b.bin`, and `data/text.bin` as files 2 to 4.
+static void buildrom(unsigned char *rom)
+{
+    memset(rom, 0, ROM_BSIZE);
+    putleword(rom + 0x020, ARM9_OFS);
+    putleword(rom + 0x02C, ARM9_BSIZE);
+    putleword(rom + 0x030, ARM7_OFS);
+    putleword(rom + 0x03C, 0x40);
+    putleword(rom + 0x048, FATB_OFS);
+    putleword(rom + 0x04C, NFILES * 8);
+    putleword(rom + 0x050, OVT9_OFS);
+    putleword(rom + 0x054, 0x40);
+    putleword(rom + 0x084, 0x200);
+    putleword(rom + ARM9_OFS + ARM9_BSIZE, 0xDEC00621);
+
+    putleword(rom + OVT9_OFS + 0x00, 0);
+    putleword(rom + OVT9_OFS + 0x18, 0);
+    putleword(rom + OVT9_OFS + 0x20, 5);
+    putleword(rom + OVT9_OFS + 0x38, 1);
+
+    // clang-format off
+    static const unsigned char fntb[] = {
+        0x10, 0x00, 0x00, 0x00, ROOT_FIRSTID, 0x00, 0x02, 0x00, // root: 2 directories
+        0x24, 0x00, 0x00, 0x00, 0x04,         0x00, 0x00, 0xF0, // data/: parent is the root
+        0x05, 'a', '.', 'b', 'i', 'n',
+        0x05, 'b', '.', 'b', 'i', 'n',
+        0x84, 'd', 'a', 't', 'a', 0x01, 0xF0,
+        0x00,
+        0x08, 't', 'e', 'x', 't', '.', 'b', 'i', 'n',
+        0x00,
+    };
+    // clang-format on
+    memcpy(rom + FNTB_OFS, fntb, sizeof(fntb));
+    putleword(rom + 0x040, FNTB_OFS);
+    putleword(rom + 0x044, sizeof(fntb));
+
+    for (uint32_t i = 0; i < NFILES; i++) {
+        uint32_t start = FILES_OFS + (i * FILE_BSIZE);
+        putleword(rom + FATB_OFS + (8 * i), start);
+        putleword(rom + FATB_OFS + (8 * i) + 4, start + FILE_BSIZE);
+        memset(rom + start, 'A' + i, FILE_BSIZE);
+    }
+}
+
+static void checksects(romreader *rom)
+{
+    romrange arm9 = romsection(rom, K_romsection_arm9);
+    if (arm9.start != ARM9_OFS || arm9.end != ARM9_OFS + ARM9_BSIZE + 12) {
+        die(
+            "expected the ARM9 and its footer to end at 0x%X, but found 0x%X-0x%X\n",
+            ARM9_OFS + ARM9_BSIZE + 12,
+            arm9.start,
+            arm9.end
+        );
+    }
+
+    romrange ovt7 = romsection(rom, K_romsection_ovt7);
+    if (ovt7.start != ovt7.end) die("%s", "expected an empty ARM7 overlay table\n");
+
+    romrange banner = romsection(rom, K_romsection_banner);
+    if (banner.start != banner.end) die("%s", "expected an empty banner\n");
+}
+
+static void checkfiles(romreader *rom)
+{
+    if (romnfiles(rom) != NFILES) die("expected %d files, but found %u\n", NFILES, romnfiles(rom));
+
+    for (uint32_t i = 0; i < NFILES; i++) {
+        string bytes = rombytes(rom, romfatb(rom, i));
+        if (bytes.len != FILE_BSIZE || bytes.s[0] != 'A' + i || bytes.s[bytes.len - 1] != 'A' + i) {
+            die("unexpected contents of file %u\n", i);
+        }
+    }
+
+    romrange none = romfatb(rom, NFILES);
+    if (none.start != 0 || none.end != 0) die("%s", "expected an empty range beyond the FATB\n");
+}
+
+static void expectfind(romreader *rom, string path, romreaderr experr, uint32_t expid)
+{
+    uint32_t   fileid = UINT32_MAX;
+    romreaderr err    = romfind(rom, path, &fileid);
+    if (err != experr) {
+        die("expected error %d for “%.*s”, but got %d\n", experr, fmtstring(path), err);
+    }
+    if (err == E_romreader_none && fileid != expid) {
+        die("expected file %u for “%.*s”, but got %u\n", expid, fmtstring(path), fileid);
+    }
+}
+
+static void checkpaths(romreader *rom)
+{
+    expectfind(rom, string("a.bin"), E_romreader_none, 2);
+    expectfind(rom, string("b.bin"), E_romreader_none, 3);
+    expectfind(rom, string("data/text.bin"), E_romreader_none, 4);
+    expectfind(rom, string("/data/text.bin"), E_romreader_none, 4);
+    expectfind(rom, string("data"), E_romreader_notfound, 0);
+    expectfind(rom, string("text.bin"), E_romreader_notfound, 0);
+
+    string path = stringZ;
+    if (rompath(rom, 4, &path) != E_romreader_none || !strequ(path, string("data/text.bin"))) {
+        die("%s", "expected file 4 to be named “data/text.bin”\n");
+    }
+    if (rompath(rom, 0, &path) != E_romreader_notfound) {
+        die("%s", "expected overlays to be unnamed\n");
+    }
+}
+
+static void checkovys(romreader *rom)
+{
+    uint32_t fileid = UINT32_MAX;
+    if (romoverlay(rom, K_romsection_ovt9, 5, &fileid) != E_romreader_none || fileid != 1) {
+        die("expected overlay 5 to be file 1, but got %u\n", fileid);
+    }
+    if (romoverlay(rom, K_romsection_ovt9, 0, &fileid) != E_romreader_none || fileid != 0) {
+        die("expected overlay 0 to be file 0, but got %u\n", fileid);
+    }
+    if (romoverlay(rom, K_romsection_ovt9, 1, &fileid) != E_romreader_notfound) {
+        die("%s", "expected no overlay 1\n");
+    }
+    if (romoverlay(rom, K_romsection_ovt7, 0, &fileid) != E_romreader_notfound) {
+        die("%s", "expected no ARM7 overlays\n");
+    }
+}
+
+static void rejectfntb(romreader *rom)
+{
+    uint32_t fileid;
+    if (romfind(rom, string("a.bin"), &fileid) != E_romreader_badfntb) {
+        die("%s", "expected a malformed FNTB to be rejected\n");
+    }
+}
+
+static void rejectovt(romreader *rom)
+{
+    uint32_t fileid;
+    if (romoverlay(rom, K_romsection_ovt9, 0, &fileid) != E_romreader_badovt) {
+        die("%s", "expected a malformed overlay table to be rejected\n");
+    }
+}
+
+static void growfatb(unsigned char *rom)
+{
+    putleword(rom + 0x04C, ROM_BSIZE);
+}
+
+static void swapfatb(unsigned char *rom)
+{
+    putleword(rom + FATB_OFS + 4, FILES_OFS - 1);
+}
+
+static void movefntb(unsigned char *rom)
+{
+    rom[FNTB_OFS + 4] = NFILES; // the root's first file is beyond the FATB
+}
+
+static void moveovt(unsigned char *rom)
+{
+    putleword(rom + OVT9_OFS + 0x38, NFILES);
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2) die("%s", "missing arguments: <testkey>\n");
+
+    const char *testkey = argv[1];
+    expect     *expects = (expect *)&expectations[0];
+    for (; expects->testkey != NULL && strcmp(expects->testkey, testkey) != 0; expects++);
+    if (expects->testkey == NULL) die("unknown test key: %s\n", testkey);
+
+    romreaderr err = E_romreader_none;
+    if (expects->err == E_romreader_missing) {
+        if (romopen("nonexistent.nds", &err) != NULL || err != expects->err) {
+            die("expected error %d when opening a missing ROM, but got %d\n", expects->err, err);
+        }
+
+        exit(EXIT_SUCCESS);
+    }
+
+    unsigned char *buf = malloc(ROM_BSIZE);
+    buildrom(buf);
+    if (expects->edit) expects->edit(buf);
+
+    romreader *rom = romopenbuf(string(buf, ROM_BSIZE), &err);
+    if (err != expects->err) die("expected error %d when opening, but got %d\n", expects->err, err);
+    if ((rom == NULL) != (err != E_romreader_none)) die("%s", "reader disagrees with its error\n");
+
+    if (rom && expects->check) expects->check(rom);
+
+    romclose(rom);
+    free(buf);
+    exit(EXIT_SUCCESS);
+}
+
+// clang-format off
+static const expect expectations[] = {
+    { .testkey = "sections",  .edit = NULL,     .err = E_romreader_none,      .check = checksects },
+    { .testkey = "files",     .edit = NULL,     .err = E_romreader_none,      .check = checkfiles },
+    { .testkey = "paths",     .edit = NULL,     .err = E_romreader_none,      .check = checkpaths },
+    { .testkey = "overlays",  .edit = NULL,     .err = E_romreader_none,      .check = checkovys  },
+    { .testkey = "missing",   .edit = NULL,     .err = E_romreader_missing,   .check = NULL       },
+    { .testkey = "truncated", .edit = growfatb, .err = E_romreader_truncated, .check = NULL       },
+    { .testkey = "badfatb",   .edit = swapfatb, .err = E_romreader_badfatb,   .check = NULL       },
+    { .testkey = "badfntb",   .edit = movefntb, .err = E_romreader_none,      .check = rejectfntb },
+    { .testkey = "badovt",    .edit = moveovt,  .err = E_romreader_none,      .check = rejectovt  },
+    { 0 },
+};
+// clang-format on
@@ -0,0 +1,144 @@
+#include "libs/sha1.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define die(__msg, ...)                      \
+    {                                        \
+        fprintf(stderr, __msg, __VA_ARGS__); \
+        exit(EXIT_FAILURE);                  \
+    }
+
+// Keys and messages are either literal strings or `len` copies of `fill`. A test without a key is
+// of the plain digest.
+typedef struct expect {
+    const char   *testkey;
+    const char   *key;
+    unsigned char keyfill;
+    long          keylen;
+    const char   *msg;
+    unsigned char msgfill;
+    long          msglen;
+    const char   *digest;
+} expect;
+
+static const expect expectations[];
+
+static unsigned char *materialize(const char *s, unsigned char fill, long len)
+{
+    unsigned char *buf = malloc(len + 1);
+    if (s) memcpy(buf, s, len);
+    else memset(buf, fill, len);
+    return buf;
+}
+
+static void check(const char *what, const unsigned char digest[SHA1_DIGEST_BSIZE], const char *hex)
+{
+    char actual[2 * SHA1_DIGEST_BSIZE + 1];
+    sha1hex(digest, actual);
+    if (strcmp(actual, hex) != 0) die("%s: expected %s, but got %s\n", what, hex, actual);
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 2) die("%s", "missing arguments: <testkey>\n");
+
+    const char *testkey = argv[1];
+    expect     *expects = (expect *)&expectations[0];
+    for (; expects->testkey != NULL && strcmp(expects->testkey, testkey) != 0; expects++);
+    if (expects->testkey == NULL) die("unknown test key: %s\n", testkey);
+
+    long           msglen = expects->msg ? (long)strlen(expects->msg) : expects->msglen;
+    unsigned char *msg    = materialize(expects->msg, expects->msgfill, msglen);
+    unsigned char  digest[SHA1_DIGEST_BSIZE];
+
+    if (expects->keylen == 0 && !expects->key) {
+        sha1digest(msg, msglen, digest);
+        check("whole", digest, expects->digest);
+
+        sha1 ctx;
+        sha1init(&ctx);
+        for (long i = 0; i < msglen; i++) sha1update(&ctx, msg + i, 1);
+        sha1final(&ctx, digest);
+        check("bytewise", digest, expects->digest);
+    } else {
+        long           keylen = expects->key ? (long)strlen(expects->key) : expects->keylen;
+        unsigned char *key    = materialize(expects->key, expects->keyfill, keylen);
+
+        sha1hmac keyed;
+        sha1hmacinit(&keyed, key, keylen);
+        sha1hmacdigest(&keyed, msg, msglen, digest);
+        check("whole", digest, expects->digest);
+
+        // The keyed context must be reusable once it has authenticated a message.
+        sha1hmac ctx = keyed;
+        for (long i = 0; i < msglen; i++) sha1hmacupdate(&ctx, msg + i, 1);
+        sha1hmacfinal(&ctx, digest);
+        check("bytewise", digest, expects->digest);
+
+        sha1hmacdigest(&keyed, msg, msglen, digest);
+        check("reused", digest, expects->digest);
+        free(key);
+    }
+
+    free(msg);
+    exit(EXIT_SUCCESS);
+}
+
+// Digests are from FIPS 180-1 and RFC 2202.
+// clang-format off
+static const expect expectations[] = {
+    {
+        .testkey = "empty",
+        .msg     = "",
+        .digest  = "da39a3ee5e6b4b0d3255bfef95601890afd80709",
+    },
+    {
+        .testkey = "abc",
+        .msg     = "abc",
+        .digest  = "a9993e364706816aba3e25717850c26c9cd0d89d",
+    },
+    {
+        .testkey = "two-blocks",
+        .msg     = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+        .digest  = "84983e441c3bd26ebaae4aa1f95129e5e54670f1",
+    },
+    {
+        .testkey = "million",
+        .msgfill = 'a', .msglen = 1000000,
+        .digest  = "34aa973cd4c4daa4f61eeb2bdbad27316534016f",
+    },
+    {
+        .testkey = "hmac-short-key",
+        .keyfill = 0x0B, .keylen = 20,
+        .msg     = "Hi There",
+        .digest  = "b617318655057264e28bc0b6fb378c8ef146be00",
+    },
+    {
+        .testkey = "hmac-text-key",
+        .key     = "Jefe",
+        .msg     = "what do ya want for nothing?",
+        .digest  = "effcdf6ae5eb2fa2d27416d5f184df9c259a7c79",
+    },
+    {
+        .testkey = "hmac-filled",
+        .keyfill = 0xAA, .keylen = 20,
+        .msgfill = 0xDD, .msglen = 50,
+        .digest  = "125d7342b9ac11cd91a39af48aa17b4f63f175d3",
+    },
+    {
+        .testkey = "hmac-long-key",
+        .keyfill = 0xAA, .keylen = 80,
+        .msg     = "Test Using Larger Than Block-Size Key - Hash Key First",
+        .digest  = "aa4ae5e15272d00e95705637ce8a3b55ed402112",
+    },
+    {
+        .testkey = "hmac-long-both",
+        .keyfill = 0xAA, .keylen = 80,
+        .msg     = "Test Using Larger Than Block-Size Key and Larger Than One Block-Size Data",
+        .digest  = "e8e99d0f45237d786d6bbaa7965c7808bbff1a91",
+    },
+    { 0 },
+};
+// clang-format on
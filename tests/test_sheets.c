@@ -154,11 +154,25 @@ static const sheetsrecord enclosed[] = {
         .enclosed = (1 << 0) | (1 << 2) | (1 << 3),
     },
 };
+
+static const sheetsrecord longfields[] = {
+    {
+        .fields   = { string("res/prebuilt/data/a_very_long_source_path_that_spans_chunks.narc"), string("/data/a_very_long_target_path_that_spans_chunks.narc") },
+        .nfields  = 2,
+        .enclosed = 0,
+    },
+    {
+        .fields   = { string("res/prebuilt/data/an_enclosed_source_path_with_\"\"escaped\"\" enclosers_past_32_bytes.bin"), string("/data/short.bin") },
+        .nfields  = 2,
+        .enclosed = (1 << 0),
+    },
+};
 // clang-format on
 
 static const expect expectations[] = {
     { .testkey = "onerow", .nrecords = 1, .records = onerow },
     { .testkey = "tworows", .nrecords = 2, .records = tworows },
     { .testkey = "enclosed", .nrecords = 2, .records = enclosed },
+    { .testkey = "longfields", .nrecords = 2, .records = longfields },
     { 0 },
 };
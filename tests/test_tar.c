@@ -0,0 +1,174 @@
+#include "libs/tar.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libs/strings.h"
+
+#define die0(__msg)             \
+    {                           \
+        fprintf(stderr, __msg); \
+        return E_tar_user;      \
+    }
+#define die(__msg, ...)                      \
+    {                                        \
+        fprintf(stderr, __msg, __VA_ARGS__); \
+        return E_tar_user;                   \
+    }
+
+#define tarresult(__code, __msg)                         \
+    (tarresult)                                          \
+    {                                                    \
+        .code = (__code), .msg = (__msg), .pos = stringZ \
+    }
+
+#define P10  "pppppppppp"
+#define P100 P10 P10 P10 P10 P10 P10 P10 P10 P10 P10
+#define L10  "llllllllll"
+#define L100 L10 L10 L10 L10 L10 L10 L10 L10 L10 L10
+
+typedef struct entry {
+    string      name;
+    long        size;
+    const char *head; // expected leading content of the entry
+} entry;
+
+typedef struct expect {
+    const char  *testkey;
+    const int    code;
+    const int    nentries;
+    const entry *entries;
+} expect;
+
+typedef struct harness {
+    const expect *expects;
+    string        archive;
+} harness;
+
+static const expect expectations[];
+
+static tarresult verify(tarentry *tarentry, void *user, int index)
+{
+    harness *harness = user;
+    if (index >= harness->expects->nentries) {
+        tarresult res = tarresult(E_tar_user, "");
+        snprintf(
+            res.msg,
+            sizeof(res.msg),
+            "expected at most %d entries, but got %d",
+            harness->expects->nentries,
+            index + 1
+        );
+        return res;
+    }
+
+    const entry *expect = &harness->expects->entries[index];
+    if (!strequ(tarentry->name, expect->name)) {
+        tarresult res = tarresult(E_tar_user, "");
+        snprintf(
+            res.msg,
+            sizeof(res.msg),
+            "expected entry %d to be %.*s, but found %.*s",
+            index,
+            fmtstring(expect->name),
+            fmtstring(tarentry->name)
+        );
+        return res;
+    }
+
+    if (tarentry->size != expect->size) {
+        tarresult res = tarresult(E_tar_user, "");
+        snprintf(
+            res.msg,
+            sizeof(res.msg),
+            "expected entry %d to have size %ld, but found %ld",
+            index,
+            expect->size,
+            tarentry->size
+        );
+        return res;
+    }
+
+    long headlen = (long)strlen(expect->head);
+    if (tarentry->offset + tarentry->size > harness->archive.len
+        || memcmp(harness->archive.s + tarentry->offset, expect->head, headlen) != 0) {
+        tarresult res = tarresult(E_tar_user, "");
+        snprintf(res.msg, sizeof(res.msg), "entry %d has unexpected content", index);
+        return res;
+    }
+
+    return tarresult(E_tar_none, "");
+}
+
+int main(int argc, const char **argv)
+{
+    if (argc < 3) die0("missing arguments: <testkey> <testfile>\n");
+
+    const char *testkey = argv[1];
+    expect     *expects = (expect *)&expectations[0];
+    for (; expects->testkey != NULL && strcmp(expects->testkey, testkey) != 0; expects++);
+    if (expects->testkey == NULL) die("unknown test key: %s\n", testkey);
+
+    FILE *testf = fopen(argv[2], "rb");
+    if (!testf) die("test content file “%s” does not exist\n", argv[2]);
+
+    fseek(testf, 0, SEEK_END);
+    long fsize = ftell(testf);
+    fseek(testf, 0, SEEK_SET);
+    if (fsize < 0) {
+        fclose(testf);
+        die("could not determine size of test file “%s”\n", argv[2]);
+    }
+
+    string content = string(malloc(fsize + 1), fsize);
+    fread(content.s, 1, content.len, testf);
+    fclose(testf);
+
+    harness   harness = { .expects = expects, .archive = content };
+    tarresult result  = tarparse(content, verify, &harness);
+    free(content.s);
+
+    if (result.code != expects->code) {
+        fprintf(
+            stderr,
+            "expected code %d, but got %d: %s\n",
+            expects->code,
+            result.code,
+            result.msg
+        );
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+// clang-format off
+static const entry ustar[] = {
+    { .name = string("data/a.bin"),                   .size = 5,   .head = "hello" },
+    { .name = string("data/" P100 "/file.bin"),       .size = 600, .head = "xxxx"  },
+};
+
+static const entry pax[] = {
+    { .name = string("data/" L100 L100 L100 ".bin"),  .size = 4,   .head = "pax!"  },
+    { .name = string("b.bin"),                        .size = 0,   .head = ""      },
+};
+
+static const entry gnu[] = {
+    { .name = string("data/" L100 L100 L100 ".bin"),  .size = 4,   .head = "gnu!"  },
+};
+
+static const entry checksum[] = {
+    { .name = string("a.bin"),                        .size = 5,   .head = "hello" },
+};
+// clang-format on
+
+static const expect expectations[] = {
+    { .testkey = "ustar",     .code = E_tar_none,      .nentries = 2, .entries = ustar    },
+    { .testkey = "pax",       .code = E_tar_none,      .nentries = 2, .entries = pax      },
+    { .testkey = "gnu",       .code = E_tar_none,      .nentries = 1, .entries = gnu      },
+    { .testkey = "checksum",  .code = E_tar_checksum,  .nentries = 1, .entries = checksum },
+    { .testkey = "truncated", .code = E_tar_truncated, .nentries = 0, .entries = NULL     },
+    { 0 },
+};